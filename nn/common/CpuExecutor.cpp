@@ -18,6 +18,7 @@
 
 #include "CpuExecutor.h"
 
+#include "CpuFusion.h"
 #include "NeuralNetworks.h"
 #include "OperationResolver.h"
 #include "Operations.h"
@@ -25,6 +26,7 @@
 #include "Tracing.h"
 
 #include "Eigen/Core"
+#include "public/gemmlowp.h"
 // b/109953668, disable OpenMP
 #ifdef NNAPI_OPENMP
 #include <omp.h>
@@ -32,6 +34,12 @@
 #include <android/hardware_buffer.h>
 #include <sys/mman.h>
 
+#include <atomic>
+#include <functional>
+#include <new>
+#include <numeric>
+#include <utility>
+
 namespace android {
 namespace nn {
 
@@ -41,8 +49,9 @@ class OperationExecutionContext : public IOperationExecutionContext {
     DISALLOW_IMPLICIT_CONSTRUCTORS(OperationExecutionContext);
 
    public:
-    OperationExecutionContext(const Operation* operation, RunTimeOperandInfo* operands)
-        : operation(operation), operands(operands) {}
+    OperationExecutionContext(const Operation* operation, RunTimeOperandInfo* operands,
+                              ThreadPool* threadPool)
+        : operation(operation), operands(operands), threadPool(threadPool) {}
 
     uint32_t getNumInputs() const override;
     OperandType getInputType(uint32_t index) const override;
@@ -63,6 +72,8 @@ class OperationExecutionContext : public IOperationExecutionContext {
     bool isOmittedInput(uint32_t index) const override;
     bool isOmittedOutput(uint32_t index) const override;
 
+    ThreadPool* getThreadPool() const override { return threadPool; }
+
     // Return false if any of inputs or outputs is omitted, i.e. has lifetime of NO_VALUE.
     bool checkNoOmittedOperand() const;
     // Return false if any of inputs has dimension 0.
@@ -75,6 +86,7 @@ class OperationExecutionContext : public IOperationExecutionContext {
 
     const Operation* operation;
     RunTimeOperandInfo* operands;
+    ThreadPool* threadPool;
 
     int result = ANEURALNETWORKS_NO_ERROR;
 };
@@ -419,6 +431,273 @@ bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos
     return true;
 }
 
+CpuOperationGraph CpuOperationGraph::create(const Model& model) {
+    NNTRACE_CPU(NNTRACE_PHASE_UNSPECIFIED, "CpuOperationGraph::create");
+    const uint32_t operationCount = model.operations.size();
+    CpuOperationGraph graph;
+    graph.mNumPredecessors.assign(operationCount, 0);
+    graph.mSuccessors.resize(operationCount);
+    graph.mWordsPerOperation = (operationCount + 63) / 64;
+    graph.mAncestors.assign(size_t(operationCount) * graph.mWordsPerOperation, 0);
+
+    // The operation writing each operand, among the operations seen so far.
+    constexpr uint32_t kNoProducer = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> producers(model.operands.size(), kNoProducer);
+    std::vector<uint32_t> predecessors;
+    for (uint32_t i = 0; i < operationCount; i++) {
+        const Operation& operation = model.operations[i];
+        predecessors.clear();
+        for (uint32_t operandIndex : operation.inputs) {
+            if (producers[operandIndex] != kNoProducer) {
+                predecessors.push_back(producers[operandIndex]);
+            }
+        }
+        std::sort(predecessors.begin(), predecessors.end());
+        predecessors.erase(std::unique(predecessors.begin(), predecessors.end()),
+                           predecessors.end());
+
+        uint64_t* ancestors = &graph.mAncestors[size_t(i) * graph.mWordsPerOperation];
+        for (uint32_t predecessor : predecessors) {
+            graph.mSuccessors[predecessor].push_back(i);
+            const uint64_t* predecessorAncestors =
+                    &graph.mAncestors[size_t(predecessor) * graph.mWordsPerOperation];
+            for (uint32_t word = 0; word < graph.mWordsPerOperation; word++) {
+                ancestors[word] |= predecessorAncestors[word];
+            }
+            ancestors[predecessor / 64] |= uint64_t(1) << (predecessor % 64);
+        }
+        graph.mNumPredecessors[i] = predecessors.size();
+
+        for (uint32_t operandIndex : operation.outputs) {
+            producers[operandIndex] = i;
+        }
+    }
+    return graph;
+}
+
+// Whether a TRANSPOSE leaves its data in place, as it only moves dimensions of
+// size 1.  The permutation must be constant.
+static bool isTransposeInPlace(const Model& model, const Operation& operation) {
+    if (operation.inputs.size() != 2) {
+        return false;
+    }
+    const Operand& input = model.operands[operation.inputs[0]];
+    const Operand& perm = model.operands[operation.inputs[1]];
+    const uint32_t rank = input.dimensions.size();
+    std::vector<int32_t> permData;
+    if (perm.lifetime == OperandLifeTime::NO_VALUE && rank == 2) {
+        permData = {1, 0};
+    } else if (perm.lifetime == OperandLifeTime::CONSTANT_COPY &&
+               perm.location.length == rank * sizeof(int32_t)) {
+        permData.resize(rank);
+        memcpy(permData.data(), &model.operandValues[perm.location.offset], perm.location.length);
+    } else {
+        return false;
+    }
+    int32_t previousAxis = -1;
+    for (int32_t axis : permData) {
+        if (axis < 0 || axis >= static_cast<int32_t>(rank)) {
+            return false;
+        }
+        if (input.dimensions[axis] != 1) {
+            if (axis < previousAxis) {
+                return false;
+            }
+            previousAxis = axis;
+        }
+    }
+    return true;
+}
+
+// Whether the output of the operation can be a view of its input: the
+// operation copies its input unchanged, and the input is a temporary of known
+// size read by no other operation.
+static bool isViewOperation(const Model& model, const Operation& operation) {
+    switch (operation.type) {
+        case OperationType::RESHAPE:
+        case OperationType::SQUEEZE:
+        case OperationType::EXPAND_DIMS:
+            break;
+        case OperationType::TRANSPOSE:
+            if (!isTransposeInPlace(model, operation)) {
+                return false;
+            }
+            break;
+        case OperationType::CONCATENATION:
+            // A single tensor and the axis.
+            if (operation.inputs.size() != 2) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    if (operation.inputs.empty() || operation.outputs.size() != 1) {
+        return false;
+    }
+    const Operand& input = model.operands[operation.inputs[0]];
+    const Operand& output = model.operands[operation.outputs[0]];
+    if (input.lifetime != OperandLifeTime::TEMPORARY_VARIABLE || input.numberOfConsumers != 1 ||
+        output.lifetime != OperandLifeTime::TEMPORARY_VARIABLE) {
+        return false;
+    }
+    // CONCATENATION requantizes its input if the parameters differ.
+    if (input.type != output.type || isExtensionOperandType(input.type) ||
+        input.scale != output.scale || input.zeroPoint != output.zeroPoint) {
+        return false;
+    }
+    const uint32_t size = nonExtensionOperandSizeOfData(input);
+    return size > 0 && size == nonExtensionOperandSizeOfData(output);
+}
+
+CpuMemoryPlan CpuMemoryPlan::create(const Model& model, const CpuOperationGraph* graph) {
+    NNTRACE_CPU(NNTRACE_PHASE_UNSPECIFIED, "CpuMemoryPlan::create");
+    const uint32_t operandCount = model.operands.size();
+    const uint32_t operationCount = model.operations.size();
+
+    // The operand whose bytes each operand uses: itself, or for the output of
+    // a view, the first operand of the chain of views leading to it.
+    std::vector<uint32_t> storageOf(operandCount);
+    std::iota(storageOf.begin(), storageOf.end(), 0);
+    for (const Operation& operation : model.operations) {
+        if (isViewOperation(model, operation)) {
+            storageOf[operation.outputs[0]] = storageOf[operation.inputs[0]];
+        }
+    }
+
+    // Find the first and the last operation that refers to each operand, and
+    // if the operations may run in parallel, all of them.  The uses of a view
+    // count as uses of the operand it shares the bytes of.
+    std::vector<uint32_t> firstUse(operandCount, kNotPlanned);
+    std::vector<uint32_t> lastUse(operandCount, 0);
+    std::vector<std::vector<uint32_t>> uses(graph != nullptr ? operandCount : 0);
+    for (uint32_t i = 0; i < operationCount; i++) {
+        const Operation& operation = model.operations[i];
+        auto use = [&storageOf, &firstUse, &lastUse, &uses, graph,
+                    i](const hidl_vec<uint32_t>& indexes) {
+            for (uint32_t index : indexes) {
+                const uint32_t operandIndex = storageOf[index];
+                firstUse[operandIndex] = std::min(firstUse[operandIndex], i);
+                lastUse[operandIndex] = i;
+                if (graph != nullptr) {
+                    uses[operandIndex].push_back(i);
+                }
+            }
+        };
+        use(operation.inputs);
+        use(operation.outputs);
+    }
+
+    struct Temporary {
+        uint32_t operandIndex;
+        uint32_t size;
+        uint32_t firstUse;
+        uint32_t lastUse;
+    };
+    std::vector<Temporary> temporaries;
+    for (uint32_t i = 0; i < operandCount; i++) {
+        const Operand& operand = model.operands[i];
+        if (operand.lifetime != OperandLifeTime::TEMPORARY_VARIABLE || storageOf[i] != i ||
+            firstUse[i] == kNotPlanned || isExtensionOperandType(operand.type)) {
+            continue;
+        }
+        // The size is 0 if the operand has unspecified dimensions.
+        const uint32_t size = nonExtensionOperandSizeOfData(operand);
+        if (size == 0) {
+            continue;
+        }
+        temporaries.push_back({i, size, firstUse[i], lastUse[i]});
+    }
+
+    CpuMemoryPlan plan;
+    plan.mOffsets.assign(operandCount, kNotPlanned);
+
+    // Peak of the total size of the live temporaries.
+    std::vector<int64_t> liveSizeDelta(operationCount + 1, 0);
+    for (const Temporary& temporary : temporaries) {
+        liveSizeDelta[temporary.firstUse] += temporary.size;
+        liveSizeDelta[temporary.lastUse + 1] -= temporary.size;
+    }
+    int64_t liveSize = 0;
+    for (int64_t delta : liveSizeDelta) {
+        liveSize += delta;
+        plan.mPeakLiveSize = std::max(plan.mPeakLiveSize, static_cast<size_t>(liveSize));
+    }
+
+    // Greedy by size: place the largest temporaries first, each one in the
+    // smallest gap left between the temporaries already placed whose lifetimes
+    // overlap with its own, or after all of them if no gap is large enough.
+    std::sort(temporaries.begin(), temporaries.end(), [](const Temporary& a, const Temporary& b) {
+        return a.size != b.size ? a.size > b.size : a.operandIndex < b.operandIndex;
+    });
+    auto alignUp = [](size_t offset) {
+        return (offset + kAlignment - 1) & ~size_t(kAlignment - 1);
+    };
+    // Whether all the operations using temporary a complete before the
+    // operation writing temporary b starts.
+    auto allUsesHappenBefore = [&uses, graph](const Temporary& a, const Temporary& b) {
+        const std::vector<uint32_t>& usesOfA = uses[a.operandIndex];
+        return std::all_of(usesOfA.begin(), usesOfA.end(), [graph, &b](uint32_t operation) {
+            return graph->happensBefore(operation, b.firstUse);
+        });
+    };
+    auto lifetimesOverlap = [&allUsesHappenBefore, graph](const Temporary& a, const Temporary& b) {
+        if (graph == nullptr) {
+            return a.firstUse <= b.lastUse && b.firstUse <= a.lastUse;
+        }
+        return !allUsesHappenBefore(a, b) && !allUsesHappenBefore(b, a);
+    };
+    std::vector<const Temporary*> placed;
+    std::vector<std::pair<size_t, size_t>> conflicts;  // [begin, end) of overlapping temporaries
+    for (const Temporary& temporary : temporaries) {
+        conflicts.clear();
+        for (const Temporary* other : placed) {
+            if (lifetimesOverlap(*other, temporary)) {
+                const size_t begin = plan.mOffsets[other->operandIndex];
+                conflicts.emplace_back(begin, begin + other->size);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end());
+        size_t bestOffset = 0;
+        size_t bestGap = std::numeric_limits<size_t>::max();
+        size_t candidate = 0;
+        for (const auto& [begin, end] : conflicts) {
+            if (begin >= candidate) {
+                const size_t gap = begin - candidate;
+                if (gap >= temporary.size && gap < bestGap) {
+                    bestOffset = candidate;
+                    bestGap = gap;
+                }
+            }
+            candidate = std::max(candidate, alignUp(end));
+        }
+        if (bestGap == std::numeric_limits<size_t>::max()) {
+            bestOffset = candidate;
+        }
+        if (bestOffset + temporary.size > kNotPlanned) {
+            // Too large to address with 32-bit offsets; allocate it on demand.
+            continue;
+        }
+        plan.mOffsets[temporary.operandIndex] = bestOffset;
+        plan.mArenaSize = std::max(plan.mArenaSize, bestOffset + temporary.size);
+        placed.push_back(&temporary);
+    }
+    // Views of planned temporaries.  Views of temporaries allocated on demand
+    // are allocated on demand too, and copied into.
+    for (uint32_t i = 0; i < operandCount; i++) {
+        if (storageOf[i] != i && plan.isPlanned(storageOf[i])) {
+            plan.mOffsets[i] = plan.mOffsets[storageOf[i]];
+            plan.mNumViews++;
+        }
+    }
+
+    VLOG(CPUEXE) << "CpuMemoryPlan::create: " << placed.size() << " of " << temporaries.size()
+                 << " temporaries planned, " << plan.mNumViews
+                 << " views, arena size = " << plan.mArenaSize
+                 << ", peak live size = " << plan.mPeakLiveSize;
+    return plan;
+}
+
 template <typename T>
 inline bool convertToNhwcImpl(T* to, const T* from, const std::vector<uint32_t>& fromDim) {
     uint32_t spatialSize = fromDim[2] * fromDim[3];
@@ -530,50 +809,115 @@ static bool convertFromNhwc(RunTimeOperandInfo& to, const RunTimeOperandInfo& fr
     return true;
 }
 
-// Ignore the .pools entry in model and request.  This will have been taken care of
-// by the caller.
-int CpuExecutor::run(const Model& model, const Request& request,
-                     const std::vector<RunTimePoolInfo>& modelPoolInfos,
-                     const std::vector<RunTimePoolInfo>& requestPoolInfos) {
-    NNTRACE_CPU(NNTRACE_PHASE_EXECUTION, "run");
-    VLOG(CPUEXE) << "CpuExecutor::run() with request(" << SHOW_IF_DEBUG(toString(request)) << ")";
+// Whether an operand may be omitted by the request or is always omitted.
+static bool mayBeOmitted(const Operand& operand) {
+    return operand.lifetime == OperandLifeTime::NO_VALUE ||
+           operand.lifetime == OperandLifeTime::MODEL_INPUT ||
+           operand.lifetime == OperandLifeTime::MODEL_OUTPUT;
+}
 
-    // b/109953668, disable OpenMP
-#ifdef NNAPI_OPENMP
-    ScopedOpenmpSettings openMpSettings;
-#endif  // NNAPI_OPENMP
+// Whether the dimensions of an operand are known before execution and none of
+// them is zero.  They cannot change during execution: shapes computed at
+// execution time must agree with the fully specified ones of the model.
+static bool hasStaticNonZeroDimensions(const Operand& operand) {
+    if (operand.lifetime == OperandLifeTime::NO_VALUE) {
+        return true;
+    }
+    // The size is 0 for tensors with unspecified or zero dimensions.
+    return !isExtensionOperandType(operand.type) && nonExtensionOperandSizeOfData(operand) > 0;
+}
 
-    mModel = &model;
-    mRequest = &request;  // TODO check if mRequest is needed
-    initializeRunTimeInfo(modelPoolInfos, requestPoolInfos);
-    // The model has serialized the operation in execution order.
-    for (const auto& operation : model.operations) {
-        int n = executeOperation(operation);
-        if (n != ANEURALNETWORKS_NO_ERROR) {
-            finish(n);
-            return n;
-        }
+CpuPreparedModel::OperationStep CpuPreparedModel::createOperationStep(
+        const Model& model, const CpuMemoryPlan& memoryPlan, const IOperationResolver& resolver,
+        const Operation& operation) {
+    OperationStep step;
+    // The operations with a case in CpuExecutor::executeOperation() cannot be
+    // replaced through the resolver (b/124041202).  All the others are either
+    // builtin operations implemented through the resolver or extensions.
+    if (BuiltinOperationResolver::get()->findOperation(operation.type) != nullptr ||
+        isExtensionOperationType(operation.type)) {
+        step.registration = resolver.findOperation(operation.type);
     }
-    for (auto& runtimeInfo : modelPoolInfos) {
-        runtimeInfo.update();
+    auto isOmittable = [&model](uint32_t index) { return mayBeOmitted(model.operands[index]); };
+    auto isNotStatic = [&model](uint32_t index) {
+        return !hasStaticNonZeroDimensions(model.operands[index]);
+    };
+    if (step.registration != nullptr) {
+        const OperationRegistration::Flag& flags = step.registration->flags;
+        step.checkOmittedOperands =
+                !flags.allowOmittedOperand &&
+                (std::any_of(operation.inputs.begin(), operation.inputs.end(), isOmittable) ||
+                 std::any_of(operation.outputs.begin(), operation.outputs.end(), isOmittable));
+        step.checkZeroSizedInputs =
+                !flags.allowZeroSizedInput &&
+                std::any_of(operation.inputs.begin(), operation.inputs.end(), isNotStatic);
     }
-    for (auto& runtimeInfo : requestPoolInfos) {
-        runtimeInfo.update();
+    auto isUnplannedTemporary = [&model, &memoryPlan](uint32_t index) {
+        return model.operands[index].lifetime == OperandLifeTime::TEMPORARY_VARIABLE &&
+               !memoryPlan.isPlanned(index);
+    };
+    step.freesInputs =
+            std::any_of(operation.inputs.begin(), operation.inputs.end(), isUnplannedTemporary);
+    return step;
+}
+
+CpuPreparedModel CpuPreparedModel::create(const Model& originalModel,
+                                          const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                                          const IOperationResolver* operationResolver,
+                                          ThreadPool* threadPool, bool allowFusion,
+                                          bool parallelOperations) {
+    NNTRACE_CPU(NNTRACE_PHASE_UNSPECIFIED, "CpuPreparedModel::create");
+    CpuPreparedModel preparedModel;
+    preparedModel.mId = getNextId();
+    if (allowFusion) {
+        std::optional<Model> fusedModel = fuseOperations(originalModel, operationResolver);
+        if (fusedModel) {
+            VLOG(CPUEXE) << "Fused " << originalModel.operations.size() << " operations into "
+                         << fusedModel->operations.size();
+            preparedModel.mFusedModel = std::make_shared<const Model>(std::move(*fusedModel));
+        }
     }
-    finish(ANEURALNETWORKS_NO_ERROR);
-    VLOG(CPUEXE) << "Completed run normally";
-    return ANEURALNETWORKS_NO_ERROR;
+    const Model& model = preparedModel.mFusedModel ? *preparedModel.mFusedModel : originalModel;
+    preparedModel.mModel = &model;
+    preparedModel.mModelPoolInfos = &modelPoolInfos;
+    preparedModel.mThreadPool = threadPool;
+    if (threadPool != nullptr && parallelOperations) {
+        preparedModel.mOperationGraph = CpuOperationGraph::create(model);
+    }
+    preparedModel.mMemoryPlan =
+            CpuMemoryPlan::create(model, preparedModel.getOperationGraph());
+    preparedModel.initializeOperationsAndOperands(operationResolver);
+    return preparedModel;
 }
 
-bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPoolInfos,
-                                        const std::vector<RunTimePoolInfo>& requestPoolInfos) {
-    VLOG(CPUEXE) << "CpuExecutor::initializeRunTimeInfo";
-    const size_t count = mModel->operands.size();
-    mOperands.resize(count);
+CpuPreparedModel CpuPreparedModel::createForSingleRun(
+        const Model& model, const std::vector<RunTimePoolInfo>& modelPoolInfos,
+        const IOperationResolver* operationResolver) {
+    NNTRACE_CPU(NNTRACE_PHASE_UNSPECIFIED, "CpuPreparedModel::createForSingleRun");
+    CpuPreparedModel preparedModel;
+    preparedModel.mId = getNextId();
+    preparedModel.mModel = &model;
+    preparedModel.mModelPoolInfos = &modelPoolInfos;
+    // Nothing is planned, so the temporaries are allocated as the operations
+    // produce them and freed after their last use.
+    preparedModel.initializeOperationsAndOperands(operationResolver);
+    return preparedModel;
+}
+
+uint64_t CpuPreparedModel::getNextId() {
+    static std::atomic<uint64_t> nextId(1);
+    return nextId.fetch_add(1);
+}
 
-    // Start by setting the runtime info to what's in the model.
+void CpuPreparedModel::initializeOperationsAndOperands(
+        const IOperationResolver* operationResolver) {
+    const Model& model = *mModel;
+    const std::vector<RunTimePoolInfo>& modelPoolInfos = *mModelPoolInfos;
+    const CpuMemoryPlan& memoryPlan = mMemoryPlan;
+    const size_t count = model.operands.size();
+    mOperands.resize(count);
     for (size_t i = 0; i < count; i++) {
-        const Operand& from = mModel->operands[i];
+        const Operand& from = model.operands[i];
         RunTimeOperandInfo& to = mOperands[i];
         to.type = from.type;
         to.dimensions = from.dimensions;
@@ -584,11 +928,18 @@ bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& mode
         to.extraParams = from.extraParams;
         switch (from.lifetime) {
             case OperandLifeTime::TEMPORARY_VARIABLE:
+                mVaryingOperands.push_back(i);
                 to.buffer = nullptr;
-                to.numberOfUsesLeft = from.numberOfConsumers;
+                if (memoryPlan.isPlanned(i)) {
+                    // Planned temporaries stay in the arena for the whole run.
+                    to.length = nonExtensionOperandSizeOfData(from);
+                    to.numberOfUsesLeft = 0;
+                } else {
+                    to.numberOfUsesLeft = from.numberOfConsumers;
+                }
                 break;
             case OperandLifeTime::CONSTANT_COPY:
-                to.buffer = const_cast<uint8_t*>(&mModel->operandValues[from.location.offset]);
+                to.buffer = const_cast<uint8_t*>(&model.operandValues[from.location.offset]);
                 to.numberOfUsesLeft = 0;
                 break;
             case OperandLifeTime::CONSTANT_REFERENCE: {
@@ -601,6 +952,10 @@ bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& mode
             }
             case OperandLifeTime::MODEL_INPUT:
             case OperandLifeTime::MODEL_OUTPUT:
+                mVaryingOperands.push_back(i);
+                to.buffer = nullptr;
+                to.numberOfUsesLeft = 0;
+                break;
             case OperandLifeTime::NO_VALUE:
                 to.buffer = nullptr;
                 to.numberOfUsesLeft = 0;
@@ -611,6 +966,195 @@ bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& mode
         }
     }
 
+    const FusedOperationResolver resolver(operationResolver);
+    mOperationSteps.reserve(model.operations.size());
+    for (const Operation& operation : model.operations) {
+        mOperationSteps.push_back(createOperationStep(model, memoryPlan, resolver, operation));
+    }
+}
+
+CpuExecutor::~CpuExecutor() = default;
+
+// Ignore the .pools entry in model and request.  This will have been taken care of
+// by the caller.
+int CpuExecutor::run(const Model& model, const Request& request,
+                     const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                     const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    const CpuPreparedModel preparedModel =
+            CpuPreparedModel::createForSingleRun(model, modelPoolInfos, mOperationResolver);
+    return run(preparedModel, request, requestPoolInfos);
+}
+
+int CpuExecutor::run(const CpuPreparedModel& preparedModel, const Request& request,
+                     const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    NNTRACE_CPU(NNTRACE_PHASE_EXECUTION, "run");
+    VLOG(CPUEXE) << "CpuExecutor::run() with request(" << SHOW_IF_DEBUG(toString(request)) << ")";
+
+    // b/109953668, disable OpenMP
+#ifdef NNAPI_OPENMP
+    ScopedOpenmpSettings openMpSettings;
+#endif  // NNAPI_OPENMP
+
+    mPreparedModel = &preparedModel;
+    mModel = &preparedModel.getModel();
+    mRequest = &request;  // TODO check if mRequest is needed
+    mFinished = false;
+    if (mScratchBuffer == nullptr) {
+        mScratchBuffer.reset(new (std::nothrow) uint8_t[kThreadScratchBufferSize]);
+    }
+    const ScopedThreadScratchBuffer scratchBuffer(mScratchBuffer.get());
+    if (mGemmContext == nullptr) {
+        mGemmContext.reset(new gemmlowp::GemmContext);
+    }
+    // With a thread pool, the operations and the pool already use the cores,
+    // so the GEMMs stay on the calling thread.
+    mGemmContext->set_max_num_threads(
+            preparedModel.getThreadPool() != nullptr ? 1 : ThreadPool::getDefaultNumThreads());
+    const ScopedThreadGemmContext gemmContext(mGemmContext.get());
+    if (!initializeRunTimeInfo(requestPoolInfos)) {
+        finish(ANEURALNETWORKS_OUT_OF_MEMORY);
+        return ANEURALNETWORKS_OUT_OF_MEMORY;
+    }
+    if (preparedModel.getOperationGraph() != nullptr) {
+        int n = runOperationsInParallel();
+        if (n != ANEURALNETWORKS_NO_ERROR) {
+            finish(n);
+            return n;
+        }
+    } else {
+        // The model has serialized the operation in execution order.
+        const hidl_vec<Operation>& operations = mModel->operations;
+        for (uint32_t i = 0; i < operations.size(); i++) {
+            int n = executeOperation(operations[i], preparedModel.getOperationStep(i));
+            if (n != ANEURALNETWORKS_NO_ERROR) {
+                finish(n);
+                return n;
+            }
+        }
+    }
+    for (auto& runtimeInfo : preparedModel.getModelPoolInfos()) {
+        runtimeInfo.update();
+    }
+    for (auto& runtimeInfo : requestPoolInfos) {
+        runtimeInfo.update();
+    }
+    finish(ANEURALNETWORKS_NO_ERROR);
+    VLOG(CPUEXE) << "Completed run normally";
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int CpuExecutor::runOperationsInParallel() {
+    NNTRACE_CPU(NNTRACE_PHASE_EXECUTION, "runOperationsInParallel");
+    const CpuOperationGraph& graph = *mPreparedModel->getOperationGraph();
+    const hidl_vec<Operation>& operations = mModel->operations;
+    const uint32_t operationCount = operations.size();
+
+    std::unique_ptr<std::atomic<uint32_t>[]> predecessorsLeft(
+            new std::atomic<uint32_t>[operationCount]);
+    for (uint32_t i = 0; i < operationCount; i++) {
+        predecessorsLeft[i].store(graph.getNumPredecessors(i), std::memory_order_relaxed);
+    }
+
+    std::mutex usesLeftMutex;
+    mUsesLeftMutex = &usesLeftMutex;
+
+    // The lowest index of the operations that failed so far.  Operations with
+    // a higher index are skipped, but the ones with a lower index still run,
+    // as they may fail too: this reports the failure that the sequential run
+    // would, regardless of timing.  Operations come in execution order, so
+    // the ones before a failure never depend on it.
+    std::atomic<uint32_t> failedOperation(operationCount);
+    std::mutex resultMutex;
+    int result = ANEURALNETWORKS_NO_ERROR;
+
+    TaskGroup taskGroup(mPreparedModel->getThreadPool());
+    // Runs an operation, then goes on with one of the operations that it makes
+    // ready on the same thread, and schedules the others on the pool.
+    std::function<void(uint32_t)> runFrom = [&](uint32_t operationIndex) {
+        while (operationIndex < failedOperation.load()) {
+            int n = executeOperation(operations[operationIndex],
+                                     mPreparedModel->getOperationStep(operationIndex));
+            if (n != ANEURALNETWORKS_NO_ERROR) {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                if (operationIndex < failedOperation.load()) {
+                    failedOperation = operationIndex;
+                    result = n;
+                }
+                return;
+            }
+            std::optional<uint32_t> next;
+            for (uint32_t successor : graph.getSuccessors(operationIndex)) {
+                if (predecessorsLeft[successor].fetch_sub(1) != 1) {
+                    continue;
+                }
+                if (!next) {
+                    next = successor;
+                } else {
+                    taskGroup.schedule([&runFrom, successor] { runFrom(successor); });
+                }
+            }
+            if (!next) {
+                return;
+            }
+            operationIndex = *next;
+        }
+    };
+    for (uint32_t i = 0; i < operationCount; i++) {
+        if (graph.getNumPredecessors(i) == 0) {
+            taskGroup.schedule([&runFrom, i] { runFrom(i); });
+        }
+    }
+    taskGroup.wait();
+
+    mUsesLeftMutex = nullptr;
+    return result;
+}
+
+bool CpuExecutor::allocateArena() {
+    const size_t arenaSize = mPreparedModel->getMemoryPlan().getArenaSize();
+    if (arenaSize <= mArenaSize) {
+        return true;
+    }
+    constexpr size_t kAlignment = CpuMemoryPlan::kAlignment;
+    mArena.reset(new (std::nothrow) uint8_t[arenaSize + kAlignment - 1]);
+    if (mArena == nullptr) {
+        LOG(ERROR) << "Unable to allocate " << arenaSize << " bytes for temporaries";
+        mArenaBase = nullptr;
+        mArenaSize = 0;
+        return false;
+    }
+    const uintptr_t address = reinterpret_cast<uintptr_t>(mArena.get());
+    mArenaBase = reinterpret_cast<uint8_t*>((address + kAlignment - 1) & ~(kAlignment - 1));
+    mArenaSize = arenaSize;
+    return true;
+}
+
+bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& requestPoolInfos) {
+    VLOG(CPUEXE) << "CpuExecutor::initializeRunTimeInfo";
+    if (!allocateArena()) {
+        return false;
+    }
+
+    // Start by setting the runtime info to what's in the model.  After a run
+    // of the same prepared model, only the operands that the run changed need
+    // resetting, and assigning them reuses the storage of their dimensions.
+    const std::vector<RunTimeOperandInfo>& operands = mPreparedModel->getOperands();
+    const std::vector<uint32_t>& varyingOperands = mPreparedModel->getVaryingOperands();
+    if (mOperandsPreparedModelId != mPreparedModel->getId()) {
+        mOperands = operands;
+        mOperandsPreparedModelId = mPreparedModel->getId();
+    } else {
+        for (uint32_t i : varyingOperands) {
+            mOperands[i] = operands[i];
+        }
+    }
+    const CpuMemoryPlan& memoryPlan = mPreparedModel->getMemoryPlan();
+    for (uint32_t i : varyingOperands) {
+        if (memoryPlan.isPlanned(i)) {
+            mOperands[i].buffer = mArenaBase + memoryPlan.getOffset(i);
+        }
+    }
+
     // Adjust the runtime info for the arguments passed to the model,
     // modifying the buffer location, and possibly the dimensions.
     auto updateForArguments = [this, &requestPoolInfos](
@@ -648,7 +1192,11 @@ bool CpuExecutor::initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& mode
     return true;
 }
 
-void CpuExecutor::freeNoLongerUsedOperands(const std::vector<uint32_t>& inputs) {
+void CpuExecutor::freeNoLongerUsedOperands(const hidl_vec<uint32_t>& inputs) {
+    std::unique_lock<std::mutex> lock;
+    if (mUsesLeftMutex != nullptr) {
+        lock = std::unique_lock<std::mutex>(*mUsesLeftMutex);
+    }
     for (uint32_t i : inputs) {
         auto& info = mOperands[i];
         // Check if it's a static or model input/output.
@@ -663,8 +1211,38 @@ void CpuExecutor::freeNoLongerUsedOperands(const std::vector<uint32_t>& inputs)
     }
 }
 
-int CpuExecutor::executeOperation(const Operation& operation) {
+int CpuExecutor::executeRegisteredOperation(const Operation& operation,
+                                            const CpuPreparedModel::OperationStep& step) {
+    const OperationRegistration* registration = step.registration;
+    if (registration->prepare == nullptr || registration->execute == nullptr) {
+        LOG(ERROR) << "Incomplete operation registration: " << getOperationName(operation.type);
+        return ANEURALNETWORKS_OP_FAILED;
+    }
+    OperationExecutionContext context(&operation, mOperands.data(),
+                                      mPreparedModel->getThreadPool());
+    const bool success = (!step.checkOmittedOperands || context.checkNoOmittedOperand()) &&
+                         (!step.checkZeroSizedInputs || context.checkNoZeroSizedInput()) &&
+                         registration->prepare(&context) && registration->execute(&context);
+    int result = context.getResultCode();
+    if (!success && result == ANEURALNETWORKS_NO_ERROR) {
+        result = ANEURALNETWORKS_OP_FAILED;
+    }
+    if (result != ANEURALNETWORKS_NO_ERROR) {
+        LOG(ERROR) << getOperationName(operation.type) << " failed.";
+        return result;
+    }
+    if (step.freesInputs) {
+        freeNoLongerUsedOperands(operation.inputs);
+    }
+    return ANEURALNETWORKS_NO_ERROR;
+}
+
+int CpuExecutor::executeOperation(const Operation& operation,
+                                  const CpuPreparedModel::OperationStep& step) {
     // VLOG(CPUEXE) << "CpuExecutor::executeOperation(" << toString(operation) << ")";
+    if (step.registration != nullptr) {
+        return executeRegisteredOperation(operation, step);
+    }
     const hidl_vec<uint32_t>& ins = operation.inputs;
     const hidl_vec<uint32_t>& outs = operation.outputs;
     bool success = false;
@@ -795,21 +1373,23 @@ int CpuExecutor::executeOperation(const Operation& operation) {
             RunTimeOperandInfo& output = mOperands[outs[0]];
             Shape outShape = output.shape();
 
-            RunTimeOperandInfo input_tmp, output_tmp;
-            std::unique_ptr<uint8_t[]> input_tmp_guard, output_tmp_guard;
-            if (!convertToNhwc(input_tmp, input, input_tmp_guard, data_layout)) {
+            // NCHW tensors are computed in place by the Nchw kernels; the
+            // shape computations below work on the NHWC view of the input.
+            if (input.dimensions.size() != 4) {
+                LOG(ERROR) << "DEPTHWISE_CONV_2D only supports 4-D input";
                 success = false;
                 break;
             }
-            output_tmp.lifetime = OperandLifeTime::TEMPORARY_VARIABLE;
-            output_tmp.buffer = data_layout ? nullptr : output.buffer;
-            output_tmp.length = data_layout ? 0 : output.length;
+            Shape inputShapeNhwc = input.shape();
+            if (data_layout) {
+                const auto& dim = input.dimensions;
+                inputShapeNhwc.dimensions = {dim[0], dim[2], dim[3], dim[1]};
+            }
 
             if (useImplicitPadding) {
-                Shape inputShape = input_tmp.shape();
                 Shape filterShape = filter.shape();
-                int32_t input_width = getSizeOfDimension(inputShape, 2);
-                int32_t input_height = getSizeOfDimension(inputShape, 1);
+                int32_t input_width = getSizeOfDimension(inputShapeNhwc, 2);
+                int32_t input_height = getSizeOfDimension(inputShapeNhwc, 1);
                 int32_t filter_width = getSizeOfDimension(filterShape, 2);
                 int32_t filter_height = getSizeOfDimension(filterShape, 1);
                 calculateExplicitPadding(input_width, stride_width, dilation_width_factor,
@@ -820,59 +1400,106 @@ int CpuExecutor::executeOperation(const Operation& operation) {
                                          &padding_bottom);
             }
 
-            if (!depthwiseConvPrepare(input_tmp.shape(), filter.shape(), bias.shape(), padding_left,
+            if (!depthwiseConvPrepare(inputShapeNhwc, filter.shape(), bias.shape(), padding_left,
                                       padding_right, padding_top, padding_bottom, stride_width,
                                       stride_height, depth_multiplier, dilation_width_factor,
-                                      dilation_height_factor, &outShape) ||
-                !setInfoAndAllocateIfNeeded(&output_tmp, outShape, &result)) {
-                if (!data_layout) output.dimensions = output_tmp.dimensions;
+                                      dilation_height_factor, &outShape)) {
                 success = false;
                 break;
             }
-            if (input_tmp.type == OperandType::TENSOR_FLOAT32) {
-                success = depthwiseConvFloat32(
-                        reinterpret_cast<const float*>(input_tmp.buffer), input_tmp.shape(),
-                        reinterpret_cast<const float*>(filter.buffer), filter.shape(),
-                        reinterpret_cast<const float*>(bias.buffer), bias.shape(), padding_left,
-                        padding_right, padding_top, padding_bottom, stride_width, stride_height,
-                        dilation_width_factor, dilation_height_factor, depth_multiplier, activation,
-                        reinterpret_cast<float*>(output_tmp.buffer), outShape);
-            } else if (input_tmp.type == OperandType::TENSOR_FLOAT16) {
-                success = depthwiseConvFloat16(
-                        reinterpret_cast<const _Float16*>(input_tmp.buffer), input_tmp.shape(),
-                        reinterpret_cast<const _Float16*>(filter.buffer), filter.shape(),
-                        reinterpret_cast<const _Float16*>(bias.buffer), bias.shape(), padding_left,
-                        padding_right, padding_top, padding_bottom, stride_width, stride_height,
-                        dilation_width_factor, dilation_height_factor, depth_multiplier, activation,
-                        reinterpret_cast<_Float16*>(output_tmp.buffer), outShape);
-            } else if (input_tmp.type == OperandType::TENSOR_QUANT8_ASYMM) {
-                if (filter.type == OperandType::TENSOR_QUANT8_SYMM_PER_CHANNEL) {
-                    success = depthwiseConvQuant8PerChannel(
-                            reinterpret_cast<const uint8_t*>(input_tmp.buffer), input_tmp.shape(),
-                            reinterpret_cast<const int8_t*>(filter.buffer), filter.shape(),
-                            filter.extraParams.channelQuant().scales.data(),
-                            reinterpret_cast<const int32_t*>(bias.buffer), bias.shape(),
+            if (data_layout) {
+                const auto dim = outShape.dimensions;
+                outShape.dimensions = {dim[0], dim[3], dim[1], dim[2]};
+            }
+            if (!setInfoAndAllocateIfNeeded(&output, outShape, &result)) {
+                success = false;
+                break;
+            }
+            ThreadPool* threadPool = mPreparedModel->getThreadPool();
+            if (input.type == OperandType::TENSOR_FLOAT32) {
+                if (data_layout) {
+                    success = depthwiseConvFloat32Nchw(
+                            reinterpret_cast<const float*>(input.buffer), input.shape(),
+                            reinterpret_cast<const float*>(filter.buffer), filter.shape(),
+                            reinterpret_cast<const float*>(bias.buffer), bias.shape(),
+                            padding_left, padding_right, padding_top, padding_bottom, stride_width,
+                            stride_height, dilation_width_factor, dilation_height_factor,
+                            depth_multiplier, activation, reinterpret_cast<float*>(output.buffer),
+                            outShape, threadPool);
+                } else {
+                    success = depthwiseConvFloat32(
+                            reinterpret_cast<const float*>(input.buffer), input.shape(),
+                            reinterpret_cast<const float*>(filter.buffer), filter.shape(),
+                            reinterpret_cast<const float*>(bias.buffer), bias.shape(),
+                            padding_left, padding_right, padding_top, padding_bottom, stride_width,
+                            stride_height, dilation_width_factor, dilation_height_factor,
+                            depth_multiplier, activation, reinterpret_cast<float*>(output.buffer),
+                            outShape);
+                }
+            } else if (input.type == OperandType::TENSOR_FLOAT16) {
+                if (data_layout) {
+                    success = depthwiseConvFloat16Nchw(
+                            reinterpret_cast<const _Float16*>(input.buffer), input.shape(),
+                            reinterpret_cast<const _Float16*>(filter.buffer), filter.shape(),
+                            reinterpret_cast<const _Float16*>(bias.buffer), bias.shape(),
                             padding_left, padding_right, padding_top, padding_bottom, stride_width,
                             stride_height, dilation_width_factor, dilation_height_factor,
                             depth_multiplier, activation,
-                            reinterpret_cast<uint8_t*>(output_tmp.buffer), outShape);
-                } else if (filter.type == OperandType::TENSOR_QUANT8_ASYMM) {
-                    success = depthwiseConvQuant8(
-                            reinterpret_cast<const uint8_t*>(input_tmp.buffer), input_tmp.shape(),
-                            reinterpret_cast<const uint8_t*>(filter.buffer), filter.shape(),
-                            reinterpret_cast<const int32_t*>(bias.buffer), bias.shape(),
+                            reinterpret_cast<_Float16*>(output.buffer), outShape, threadPool);
+                } else {
+                    success = depthwiseConvFloat16(
+                            reinterpret_cast<const _Float16*>(input.buffer), input.shape(),
+                            reinterpret_cast<const _Float16*>(filter.buffer), filter.shape(),
+                            reinterpret_cast<const _Float16*>(bias.buffer), bias.shape(),
                             padding_left, padding_right, padding_top, padding_bottom, stride_width,
                             stride_height, dilation_width_factor, dilation_height_factor,
                             depth_multiplier, activation,
-                            reinterpret_cast<uint8_t*>(output_tmp.buffer), outShape);
+                            reinterpret_cast<_Float16*>(output.buffer), outShape);
+                }
+            } else if (input.type == OperandType::TENSOR_QUANT8_ASYMM) {
+                if (filter.type == OperandType::TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+                    if (data_layout) {
+                        success = depthwiseConvQuant8PerChannelNchw(
+                                reinterpret_cast<const uint8_t*>(input.buffer), input.shape(),
+                                reinterpret_cast<const int8_t*>(filter.buffer), filter.shape(),
+                                filter.extraParams.channelQuant().scales.data(),
+                                reinterpret_cast<const int32_t*>(bias.buffer), bias.shape(),
+                                padding_left, padding_right, padding_top, padding_bottom,
+                                stride_width, stride_height, dilation_width_factor,
+                                dilation_height_factor, depth_multiplier, activation,
+                                reinterpret_cast<uint8_t*>(output.buffer), outShape, threadPool);
+                    } else {
+                        success = depthwiseConvQuant8PerChannel(
+                                reinterpret_cast<const uint8_t*>(input.buffer), input.shape(),
+                                reinterpret_cast<const int8_t*>(filter.buffer), filter.shape(),
+                                filter.extraParams.channelQuant().scales.data(),
+                                reinterpret_cast<const int32_t*>(bias.buffer), bias.shape(),
+                                padding_left, padding_right, padding_top, padding_bottom,
+                                stride_width, stride_height, dilation_width_factor,
+                                dilation_height_factor, depth_multiplier, activation,
+                                reinterpret_cast<uint8_t*>(output.buffer), outShape);
+                    }
+                } else if (filter.type == OperandType::TENSOR_QUANT8_ASYMM) {
+                    if (data_layout) {
+                        success = depthwiseConvQuant8Nchw(
+                                reinterpret_cast<const uint8_t*>(input.buffer), input.shape(),
+                                reinterpret_cast<const uint8_t*>(filter.buffer), filter.shape(),
+                                reinterpret_cast<const int32_t*>(bias.buffer), bias.shape(),
+                                padding_left, padding_right, padding_top, padding_bottom,
+                                stride_width, stride_height, dilation_width_factor,
+                                dilation_height_factor, depth_multiplier, activation,
+                                reinterpret_cast<uint8_t*>(output.buffer), outShape, threadPool);
+                    } else {
+                        success = depthwiseConvQuant8(
+                                reinterpret_cast<const uint8_t*>(input.buffer), input.shape(),
+                                reinterpret_cast<const uint8_t*>(filter.buffer), filter.shape(),
+                                reinterpret_cast<const int32_t*>(bias.buffer), bias.shape(),
+                                padding_left, padding_right, padding_top, padding_bottom,
+                                stride_width, stride_height, dilation_width_factor,
+                                dilation_height_factor, depth_multiplier, activation,
+                                reinterpret_cast<uint8_t*>(output.buffer), outShape);
+                    }
                 }
-            }
-            if (data_layout) {
-                output_tmp_guard.reset(output_tmp.buffer);
-            }
-            if (!success || !convertFromNhwc(output, output_tmp, data_layout, &result)) {
-                success = false;
-                break;
             }
         } break;
         case OperationType::LOCAL_RESPONSE_NORMALIZATION: {
@@ -1345,7 +1972,8 @@ int CpuExecutor::executeOperation(const Operation& operation) {
 
             success = cast::prepare(input.shape(), &outShape) &&
                       setInfoAndAllocateIfNeeded(&output, outShape, &result) &&
-                      cast::eval(input.buffer, input.shape(), output.buffer, outShape);
+                      cast::eval(input.buffer, input.shape(), output.buffer, outShape,
+                                 mPreparedModel->getThreadPool());
         } break;
         case OperationType::SQUEEZE: {
             if (ins.size() != 2 || outs.size() != 1 ||
@@ -1411,20 +2039,21 @@ int CpuExecutor::executeOperation(const Operation& operation) {
                 break;
             }
             if (input.type == OperandType::TENSOR_FLOAT16) {
-                success = meanFloat16(reinterpret_cast<_Float16*>(input.buffer), input.shape(),
-                                      reinterpret_cast<const int32_t*>(axis.buffer), axis.shape(),
-                                      keepDims > 0, reinterpret_cast<_Float16*>(output.buffer),
-                                      outShape);
+                success = meanGeneric<_Float16>(
+                        reinterpret_cast<_Float16*>(input.buffer), input.shape(),
+                        reinterpret_cast<const int32_t*>(axis.buffer), axis.shape(),
+                        reinterpret_cast<_Float16*>(output.buffer),
+                        mPreparedModel->getThreadPool());
             } else if (input.type == OperandType::TENSOR_FLOAT32) {
-                success = meanGeneric<float, float>(
+                success = meanGeneric<float>(
                         reinterpret_cast<float*>(input.buffer), input.shape(),
-                        reinterpret_cast<const int32_t*>(axis.buffer), axis.shape(), keepDims > 0,
-                        reinterpret_cast<float*>(output.buffer), outShape);
+                        reinterpret_cast<const int32_t*>(axis.buffer), axis.shape(),
+                        reinterpret_cast<float*>(output.buffer), mPreparedModel->getThreadPool());
             } else if (input.type == OperandType::TENSOR_QUANT8_ASYMM) {
-                success = meanGeneric<uint8_t, int32_t>(
+                success = meanGeneric<uint8_t>(
                         reinterpret_cast<uint8_t*>(input.buffer), input.shape(),
-                        reinterpret_cast<const int32_t*>(axis.buffer), axis.shape(), keepDims > 0,
-                        reinterpret_cast<uint8_t*>(output.buffer), outShape);
+                        reinterpret_cast<const int32_t*>(axis.buffer), axis.shape(),
+                        reinterpret_cast<uint8_t*>(output.buffer), mPreparedModel->getThreadPool());
             }
         } break;
         case OperationType::ARGMAX:
@@ -1442,7 +2071,7 @@ int CpuExecutor::executeOperation(const Operation& operation) {
             success = argMinMaxPrepare(input.shape(), axis, &outShape) &&
                       setInfoAndAllocateIfNeeded(&output, outShape, &result) &&
                       argMinMaxGeneric(input.buffer, input.shape(), axis, isArgMin, output.buffer,
-                                       outShape);
+                                       outShape, mPreparedModel->getThreadPool());
         } break;
         case OperationType::EXPAND_DIMS: {
             if (!allParametersPresent(2, 1)) {
@@ -1539,7 +2168,8 @@ int CpuExecutor::executeOperation(const Operation& operation) {
             success = maximum_minimum::prepare(in1.shape(), in2.shape(), &outputShape) &&
                       setInfoAndAllocateIfNeeded(&output, outputShape, &result) &&
                       maximum_minimum::eval(in1.buffer, in1.shape(), in2.buffer, in2.shape(),
-                                            isMinimum, output.buffer, outputShape);
+                                            isMinimum, output.buffer, outputShape,
+                                            mPreparedModel->getThreadPool());
         } break;
         case OperationType::GROUPED_CONV_2D: {
             const size_t inCount = ins.size();
@@ -1706,7 +2336,7 @@ int CpuExecutor::executeOperation(const Operation& operation) {
             success = pow::prepare(base.shape(), exponent.shape(), &outShape) &&
                       setInfoAndAllocateIfNeeded(&output, outShape, &result) &&
                       pow::eval(base.buffer, base.shape(), exponent.buffer, exponent.shape(),
-                                output.buffer, outShape);
+                                output.buffer, outShape, mPreparedModel->getThreadPool());
         } break;
         case OperationType::TOPK_V2: {
             if (!allParametersPresent(2, 2)) {
@@ -1724,27 +2354,10 @@ int CpuExecutor::executeOperation(const Operation& operation) {
                       setInfoAndAllocateIfNeeded(&values, valuesShape, &result) &&
                       setInfoAndAllocateIfNeeded(&indices, indicesShape, &result) &&
                       topk_v2::eval(input.buffer, input.shape(), k, values.buffer, valuesShape,
-                                    indices.buffer, indicesShape);
+                                    indices.buffer, indicesShape, mPreparedModel->getThreadPool());
         } break;
         default: {
-            const OperationRegistration* operationRegistration =
-                    mOperationResolver->findOperation(operation.type);
-            if (operationRegistration == nullptr) {
-                LOG(ERROR) << getOperationName(operation.type) << " not registered";
-            } else if (operationRegistration->prepare == nullptr ||
-                       operationRegistration->execute == nullptr) {
-                LOG(ERROR) << "Incomplete operation registration: "
-                           << getOperationName(operation.type);
-            } else {
-                OperationExecutionContext context(&operation, mOperands.data());
-                success = operationRegistration->flags.allowOmittedOperand ||
-                          context.checkNoOmittedOperand();
-                success = success && (operationRegistration->flags.allowZeroSizedInput ||
-                                      context.checkNoZeroSizedInput());
-                success = success && operationRegistration->prepare(&context) &&
-                          operationRegistration->execute(&context);
-                result = context.getResultCode();
-            }
+            LOG(ERROR) << getOperationName(operation.type) << " not registered";
         }
     }
     if (!success && result == ANEURALNETWORKS_NO_ERROR) {
@@ -1755,15 +2368,21 @@ int CpuExecutor::executeOperation(const Operation& operation) {
         return result;
     }
 
-    freeNoLongerUsedOperands(ins);
+    if (step.freesInputs) {
+        freeNoLongerUsedOperands(ins);
+    }
     return ANEURALNETWORKS_NO_ERROR;
 }
 
 void CpuExecutor::finish(int result) {
-    // Free allocated temporary operands.
-    for (auto& info : mOperands) {
+    // Free allocated temporary operands.  Planned ones belong to the arena.
+    const CpuMemoryPlan& memoryPlan = mPreparedModel->getMemoryPlan();
+    for (uint32_t i = 0; i < mOperands.size(); i++) {
+        RunTimeOperandInfo& info = mOperands[i];
         if (info.lifetime == OperandLifeTime::TEMPORARY_VARIABLE && info.buffer != nullptr) {
-            delete[] info.buffer;
+            if (!memoryPlan.isPlanned(i)) {
+                delete[] info.buffer;
+            }
             info.buffer = nullptr;
         }
     }
@@ -1783,6 +2402,7 @@ void CpuExecutor::finish(int result) {
         mOutputShapes.clear();
     }
 
+    mPreparedModel = nullptr;
     mModel = nullptr;
     mRequest = nullptr;
     mFinished = true;
@@ -1795,17 +2415,9 @@ ScopedOpenmpSettings::ScopedOpenmpSettings() {
     kmp_set_blocktime(20);  // ms, see b/109645291
 
 #if NNAPI_LIMIT_CPU_THREADS
-    // Code not yet enabled. Choosing the number of threads to be based on
-    // benchmarking. See longer comment by the class declaration.
+    // Code not yet enabled. See longer comment by the class declaration.
     mMaxThreadsInitial = Eigen::nbThreads();
-    const int nProcs = omp_get_num_procs();
-    int threads = nProcs;
-    if (nProcs >= 8) {
-        threads = nProcs - 4;
-    } else if (nProcs >= 4) {
-        threads = nProcs - 2;
-    }
-    Eigen::setNbThreads(threads);
+    Eigen::setNbThreads(ThreadPool::getDefaultNumThreads());
 #endif
 }
 
@@ -0,0 +1,816 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CpuFusion"
+
+#include "CpuFusion.h"
+
+#include "ActivationFunctor.h"
+#include "OperationsUtils.h"
+#include "ThreadPool.h"
+#include "Tracing.h"
+#include "Utils.h"
+#include "VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace android {
+namespace nn {
+
+namespace {
+
+// The fused operations use operation types from the extension range, under
+// the last prefix, which TypeManager would only assign to the 32767th
+// extension.  They only exist in models returned by fuseOperations() and are
+// never validated.
+constexpr uint32_t kFusedOperationPrefix = 0x7FFF;
+constexpr uint8_t kLowBitsType = static_cast<uint8_t>(Model::ExtensionTypeEncoding::LOW_BITS_TYPE);
+
+constexpr OperationType makeFusedOperationType(uint32_t code) {
+    return static_cast<OperationType>((kFusedOperationPrefix << kLowBitsType) | code);
+}
+
+// A CONV_2D or FULLY_CONNECTED followed by an ADD of its output.
+//
+// Inputs:
+// * 0 to n - 1: The inputs of the CONV_2D or FULLY_CONNECTED.
+// * n: The other input of the ADD.
+// * n + 1: The fused activation of the ADD.
+// * n + 2: A TENSOR_INT32 holding the type of the first operation, n, the
+//   index of the output of the first operation among the inputs of the ADD,
+//   and the zero point of that output.
+// * n + 3: A FLOAT32 holding the scale of the output of the first operation.
+//
+// Outputs:
+// * 0: The output of the ADD.
+constexpr OperationType kFusedResidualAdd = makeFusedOperationType(1);
+
+// A chain of unary elementwise operations on TENSOR_FLOAT32 or TENSOR_FLOAT16.
+//
+// Inputs:
+// * 0: The input of the first operation.
+// * 1: A TENSOR_INT32 holding the types of the operations, in order.
+//
+// Outputs:
+// * 0: The output of the last operation.
+constexpr OperationType kFusedUnaryChain = makeFusedOperationType(2);
+
+// Returns whether the resolver implements the operation type with the builtin
+// implementation, or like the builtin resolver leaves it to CpuExecutor.
+bool isBuiltin(const IOperationResolver* resolver, OperationType type) {
+    return resolver->findOperation(type) == BuiltinOperationResolver::get()->findOperation(type);
+}
+
+bool isFusableTensorType(OperandType type) {
+    return type == OperandType::TENSOR_FLOAT32 || type == OperandType::TENSOR_FLOAT16 ||
+           type == OperandType::TENSOR_QUANT8_ASYMM;
+}
+
+bool isFloatTensorType(OperandType type) {
+    return type == OperandType::TENSOR_FLOAT32 || type == OperandType::TENSOR_FLOAT16;
+}
+
+bool hasSameTypeAndQuantization(const Operand& a, const Operand& b) {
+    return a.type == b.type && a.scale == b.scale && a.zeroPoint == b.zeroPoint;
+}
+
+// Returns the index of the fused activation among the inputs of the
+// operation, or -1 if the operation has no fused activation that fusion
+// supports.
+int getActivationInputIndex(const std::vector<Operand>& operands, const Operation& operation) {
+    const uint32_t inCount = operation.inputs.size();
+    switch (operation.type) {
+        case OperationType::ADD:
+        case OperationType::MUL:
+        case OperationType::SUB:
+        case OperationType::DIV:
+            return inCount == 3 ? 2 : -1;
+        case OperationType::FULLY_CONNECTED:
+            return inCount == 4 ? 3 : -1;
+        case OperationType::CONV_2D: {
+            // The optional layout follows the activation in the implicit
+            // padding signature, a stride in the explicit one.
+            const bool implicitPadding =
+                    inCount == 7 ||
+                    (inCount >= 8 && operands[operation.inputs[7]].type == OperandType::BOOL);
+            const uint32_t index = implicitPadding ? 6 : 9;
+            return index < inCount ? index : -1;
+        }
+        case OperationType::DEPTHWISE_CONV_2D: {
+            const bool implicitPadding =
+                    inCount == 8 ||
+                    (inCount >= 9 && operands[operation.inputs[8]].type == OperandType::BOOL);
+            const uint32_t index = implicitPadding ? 7 : 10;
+            return index < inCount ? index : -1;
+        }
+        default:
+            return -1;
+    }
+}
+
+int32_t getFusedActivation(OperationType type) {
+    switch (type) {
+        case OperationType::RELU:
+            return kActivationRelu;
+        case OperationType::RELU1:
+            return kActivationRelu1;
+        case OperationType::RELU6:
+            return kActivationRelu6;
+        default:
+            return -1;
+    }
+}
+
+// The functions below compute exactly what the builtin implementations of the
+// operations compute for each element.
+
+float applyAbs(float x) {
+    return std::abs(x);
+}
+
+float applyExp(float x) {
+    return vector_math::exp(x);
+}
+
+float applyLog(float x) {
+    return vector_math::log(x);
+}
+
+float applyNeg(float x) {
+    return -x;
+}
+
+float applyRsqrt(float x) {
+    return 1.f / std::sqrt(x);
+}
+
+float applySin(float x) {
+    return vector_math::sinAnyArgument(x);
+}
+
+float applySqrt(float x) {
+    return std::sqrt(x);
+}
+
+float applyRelu(float x) {
+    return std::min(std::max(0.f, x), std::numeric_limits<float>::max());
+}
+
+float applyRelu1(float x) {
+    return std::min(std::max(-1.f, x), 1.f);
+}
+
+float applyRelu6(float x) {
+    return std::min(std::max(0.f, x), 6.f);
+}
+
+float applyLogistic(float x) {
+    return vector_math::logistic(x);
+}
+
+float applyTanh(float x) {
+    return vector_math::tanh(x);
+}
+
+using UnaryFunction = float (*)(float);
+
+// Returns nullptr if the operation cannot be part of a unary chain.
+UnaryFunction getUnaryFunction(OperationType type) {
+    switch (type) {
+        case OperationType::ABS:
+            return applyAbs;
+        case OperationType::EXP:
+            return applyExp;
+        case OperationType::LOG:
+            return applyLog;
+        case OperationType::NEG:
+            return applyNeg;
+        case OperationType::RSQRT:
+            return applyRsqrt;
+        case OperationType::SIN:
+            return applySin;
+        case OperationType::SQRT:
+            return applySqrt;
+        case OperationType::RELU:
+            return applyRelu;
+        case OperationType::RELU1:
+            return applyRelu1;
+        case OperationType::RELU6:
+            return applyRelu6;
+        case OperationType::LOGISTIC:
+            return applyLogistic;
+        case OperationType::TANH:
+            return applyTanh;
+        default:
+            return nullptr;
+    }
+}
+
+// Whether the builtin implementation of the unary operation is registered with
+// allowZeroSizedInput and checks the rank, as the activations do.
+bool isActivation(OperationType type) {
+    return type == OperationType::RELU || type == OperationType::RELU1 ||
+           type == OperationType::RELU6 || type == OperationType::LOGISTIC ||
+           type == OperationType::TANH;
+}
+
+// The model being rewritten.  Operations are only marked as removed during a
+// pass, so that the indexes stay valid, and removed at the end of the pass.
+class ModelFuser {
+   public:
+    ModelFuser(const Model& model, const IOperationResolver* resolver)
+        : mResolver(resolver),
+          mOperands(model.operands.begin(), model.operands.end()),
+          mOperations(model.operations.begin(), model.operations.end()),
+          mOperandValues(model.operandValues.begin(), model.operandValues.end()) {}
+
+    void foldActivations();
+    void fuseResidualAdds();
+    void fuseUnaryChains();
+
+    uint32_t getNumFusedOperations() const { return mNumFusedOperations; }
+
+    void getModel(const Model& original, Model* model) const {
+        model->operands = mOperands;
+        model->operations = mOperations;
+        model->inputIndexes = original.inputIndexes;
+        model->outputIndexes = original.outputIndexes;
+        model->operandValues = mOperandValues;
+        model->relaxComputationFloat32toFloat16 = original.relaxComputationFloat32toFloat16;
+        model->extensionNameToPrefix = original.extensionNameToPrefix;
+    }
+
+   private:
+    static constexpr uint32_t kNoOperation = std::numeric_limits<uint32_t>::max();
+
+    // Finds the operation writing each operand and the operations reading it.
+    void analyze();
+    // Removes the operations marked as removed.
+    void compact();
+
+    // Returns the only operation reading the operand, or kNoOperation if it
+    // is read by several operations or it is not a temporary.
+    uint32_t getOnlyConsumer(uint32_t operandIndex) const;
+    // Marks the operand as no longer used by any operation.
+    void dropOperand(uint32_t operandIndex) { mOperands[operandIndex].numberOfConsumers = 0; }
+
+    uint32_t addConstant(OperandType type, std::vector<uint32_t> dimensions, const void* data,
+                         uint32_t length);
+    uint32_t addInt32Constant(int32_t value) {
+        return addConstant(OperandType::INT32, {}, &value, sizeof(value));
+    }
+    uint32_t addFloat32Constant(float value) {
+        return addConstant(OperandType::FLOAT32, {}, &value, sizeof(value));
+    }
+    uint32_t addTensorInt32Constant(const std::vector<int32_t>& values) {
+        return addConstant(OperandType::TENSOR_INT32, {static_cast<uint32_t>(values.size())},
+                           values.data(), values.size() * sizeof(int32_t));
+    }
+
+    // Returns the value of an INT32 operand that is a CONSTANT_COPY, or
+    // std::nullopt otherwise.
+    std::optional<int32_t> getInt32ConstantValue(uint32_t operandIndex) const;
+
+    const IOperationResolver* mResolver;
+    std::vector<Operand> mOperands;
+    std::vector<Operation> mOperations;
+    std::vector<uint8_t> mOperandValues;
+    std::vector<bool> mRemoved;
+    std::vector<uint32_t> mProducers;
+    std::vector<std::vector<uint32_t>> mConsumers;
+    uint32_t mNumFusedOperations = 0;
+};
+
+void ModelFuser::analyze() {
+    mRemoved.assign(mOperations.size(), false);
+    mProducers.assign(mOperands.size(), kNoOperation);
+    mConsumers.assign(mOperands.size(), {});
+    for (uint32_t i = 0; i < mOperations.size(); i++) {
+        for (uint32_t operandIndex : mOperations[i].inputs) {
+            mConsumers[operandIndex].push_back(i);
+        }
+        for (uint32_t operandIndex : mOperations[i].outputs) {
+            mProducers[operandIndex] = i;
+        }
+    }
+}
+
+void ModelFuser::compact() {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < mOperations.size(); i++) {
+        if (!mRemoved[i]) {
+            if (count != i) {
+                mOperations[count] = std::move(mOperations[i]);
+            }
+            count++;
+        }
+    }
+    mNumFusedOperations += mOperations.size() - count;
+    mOperations.resize(count);
+}
+
+uint32_t ModelFuser::getOnlyConsumer(uint32_t operandIndex) const {
+    const Operand& operand = mOperands[operandIndex];
+    const std::vector<uint32_t>& consumers = mConsumers[operandIndex];
+    if (operand.lifetime != OperandLifeTime::TEMPORARY_VARIABLE ||
+        operand.numberOfConsumers != 1 || consumers.size() != 1) {
+        return kNoOperation;
+    }
+    return consumers[0];
+}
+
+uint32_t ModelFuser::addConstant(OperandType type, std::vector<uint32_t> dimensions,
+                                 const void* data, uint32_t length) {
+    // Keep the values aligned as CpuExecutor reads them in place.
+    const uint32_t offset = (mOperandValues.size() + 3) & ~3u;
+    mOperandValues.resize(offset + length);
+    memcpy(mOperandValues.data() + offset, data, length);
+    mOperands.push_back({
+            .type = type,
+            .dimensions = dimensions,
+            .numberOfConsumers = 1,
+            .scale = 0.0f,
+            .zeroPoint = 0,
+            .lifetime = OperandLifeTime::CONSTANT_COPY,
+            .location = {.poolIndex = 0, .offset = offset, .length = length},
+    });
+    mProducers.push_back(kNoOperation);
+    mConsumers.emplace_back();
+    return mOperands.size() - 1;
+}
+
+std::optional<int32_t> ModelFuser::getInt32ConstantValue(uint32_t operandIndex) const {
+    const Operand& operand = mOperands[operandIndex];
+    if (operand.type != OperandType::INT32 || operand.lifetime != OperandLifeTime::CONSTANT_COPY ||
+        operand.location.length != sizeof(int32_t)) {
+        return std::nullopt;
+    }
+    int32_t value;
+    memcpy(&value, mOperandValues.data() + operand.location.offset, sizeof(value));
+    return value;
+}
+
+// Folds a RELU, RELU1 or RELU6 into the operation producing its input, by
+// making it the fused activation of that operation.
+void ModelFuser::foldActivations() {
+    analyze();
+    for (uint32_t i = 0; i < mOperations.size(); i++) {
+        const Operation& activation = mOperations[i];
+        const int32_t fusedActivation = getFusedActivation(activation.type);
+        if (fusedActivation < 0 || activation.inputs.size() != 1 ||
+            activation.outputs.size() != 1 || !isBuiltin(mResolver, activation.type)) {
+            continue;
+        }
+        const uint32_t input = activation.inputs[0];
+        const uint32_t output = activation.outputs[0];
+        const uint32_t producerIndex = mProducers[input];
+        if (getOnlyConsumer(input) != i || producerIndex == kNoOperation ||
+            mRemoved[producerIndex] || !isFusableTensorType(mOperands[input].type) ||
+            !hasSameTypeAndQuantization(mOperands[input], mOperands[output])) {
+            continue;
+        }
+        Operation& producer = mOperations[producerIndex];
+        const int activationIndex = getActivationInputIndex(mOperands, producer);
+        if (activationIndex < 0 || producer.outputs.size() != 1 ||
+            !isBuiltin(mResolver, producer.type) ||
+            getInt32ConstantValue(producer.inputs[activationIndex]) != kActivationNone) {
+            continue;
+        }
+        // The activation operand may be shared with other operations.
+        mOperands[producer.inputs[activationIndex]].numberOfConsumers--;
+        producer.inputs[activationIndex] = addInt32Constant(fusedActivation);
+        producer.outputs[0] = output;
+        mProducers[output] = producerIndex;
+        dropOperand(input);
+        mRemoved[i] = true;
+    }
+    compact();
+}
+
+// Fuses a CONV_2D or FULLY_CONNECTED into the ADD reading its output, where the
+// other input of the ADD has the same shape as the output, so that the ADD can
+// run in place in the output buffer of the fused operation.
+void ModelFuser::fuseResidualAdds() {
+    if (!isBuiltin(mResolver, OperationType::ADD)) {
+        return;
+    }
+    analyze();
+    for (uint32_t i = 0; i < mOperations.size(); i++) {
+        Operation& add = mOperations[i];
+        if (add.type != OperationType::ADD || add.inputs.size() != 3 || add.outputs.size() != 1) {
+            continue;
+        }
+        const uint32_t output = add.outputs[0];
+        for (uint32_t addendIndex = 0; addendIndex < 2; addendIndex++) {
+            const uint32_t addend = add.inputs[addendIndex];
+            const uint32_t other = add.inputs[1 - addendIndex];
+            const uint32_t producerIndex = mProducers[addend];
+            if (addend == other || getOnlyConsumer(addend) != i ||
+                producerIndex == kNoOperation || mRemoved[producerIndex]) {
+                continue;
+            }
+            const Operation& producer = mOperations[producerIndex];
+            if ((producer.type != OperationType::CONV_2D &&
+                 producer.type != OperationType::FULLY_CONNECTED) ||
+                producer.outputs.size() != 1 || !isBuiltin(mResolver, producer.type)) {
+                continue;
+            }
+            // No broadcast: the ADD reads and writes each element at the same
+            // position.
+            const Operand& addendOperand = mOperands[addend];
+            if (!isFusableTensorType(addendOperand.type) ||
+                nonExtensionOperandSizeOfData(addendOperand) == 0 ||
+                addendOperand.dimensions != mOperands[other].dimensions ||
+                addendOperand.dimensions != mOperands[output].dimensions ||
+                addendOperand.type != mOperands[other].type ||
+                addendOperand.type != mOperands[output].type) {
+                continue;
+            }
+
+            // Adding constants invalidates the references to the operands.
+            const std::vector<int32_t> descriptor = {
+                    static_cast<int32_t>(producer.type),
+                    static_cast<int32_t>(producer.inputs.size()),
+                    static_cast<int32_t>(addendIndex),
+                    addendOperand.zeroPoint,
+            };
+            const float scale = addendOperand.scale;
+            std::vector<uint32_t> inputs = producer.inputs;
+            inputs.push_back(other);
+            inputs.push_back(add.inputs[2]);
+            inputs.push_back(addTensorInt32Constant(descriptor));
+            inputs.push_back(addFloat32Constant(scale));
+            add.type = kFusedResidualAdd;
+            add.inputs = inputs;
+            dropOperand(addend);
+            mRemoved[producerIndex] = true;
+            break;
+        }
+    }
+    compact();
+}
+
+// Fuses chains of unary elementwise operations where each one is the only
+// consumer of the output of the previous one.
+void ModelFuser::fuseUnaryChains() {
+    analyze();
+    auto isChainable = [this](const Operation& operation) {
+        return getUnaryFunction(operation.type) != nullptr && operation.inputs.size() == 1 &&
+               operation.outputs.size() == 1 &&
+               isFloatTensorType(mOperands[operation.inputs[0]].type) &&
+               mOperands[operation.inputs[0]].type == mOperands[operation.outputs[0]].type &&
+               isBuiltin(mResolver, operation.type);
+    };
+    for (uint32_t i = 0; i < mOperations.size(); i++) {
+        if (mRemoved[i] || !isChainable(mOperations[i])) {
+            continue;
+        }
+        std::vector<uint32_t> chain = {i};
+        while (true) {
+            const uint32_t output = mOperations[chain.back()].outputs[0];
+            const uint32_t next = getOnlyConsumer(output);
+            if (next == kNoOperation || !isChainable(mOperations[next])) {
+                break;
+            }
+            chain.push_back(next);
+        }
+        if (chain.size() < 2) {
+            continue;
+        }
+
+        std::vector<int32_t> types;
+        for (uint32_t operationIndex : chain) {
+            types.push_back(static_cast<int32_t>(mOperations[operationIndex].type));
+        }
+        const uint32_t output = mOperations[chain.back()].outputs[0];
+        for (uint32_t j = 1; j < chain.size(); j++) {
+            dropOperand(mOperations[chain[j]].inputs[0]);
+            mRemoved[chain[j]] = true;
+        }
+        // The fused operation takes the place of the first one, which the
+        // consumers of the last output follow.
+        Operation& fused = mOperations[i];
+        fused.type = kFusedUnaryChain;
+        const std::vector<uint32_t> inputs = {fused.inputs[0], addTensorInt32Constant(types)};
+        fused.inputs = inputs;
+        fused.outputs = std::vector<uint32_t>{output};
+    }
+    compact();
+}
+
+// Presents one of the operations making up a fused operation to its builtin
+// implementation.  Each input is either an input of the fused operation or the
+// intermediate result, which is held in the output buffer of the fused
+// operation.  The output is either the intermediate result or the output of
+// the fused operation.
+class SubOperationContext : public IOperationExecutionContext {
+    DISALLOW_IMPLICIT_CONSTRUCTORS(SubOperationContext);
+
+   public:
+    static constexpr uint32_t kIntermediate = std::numeric_limits<uint32_t>::max();
+
+    SubOperationContext(IOperationExecutionContext* context, std::vector<uint32_t> inputs,
+                        Shape* intermediate, bool writesIntermediate)
+        : mContext(context),
+          mInputs(std::move(inputs)),
+          mIntermediate(intermediate),
+          mWritesIntermediate(writesIntermediate) {}
+
+    uint32_t getNumInputs() const override { return mInputs.size(); }
+    OperandType getInputType(uint32_t index) const override {
+        return isIntermediate(index) ? mIntermediate->type
+                                     : mContext->getInputType(mInputs[index]);
+    }
+    Shape getInputShape(uint32_t index) const override {
+        return isIntermediate(index) ? *mIntermediate : mContext->getInputShape(mInputs[index]);
+    }
+    const void* getInputBuffer(uint32_t index) const override {
+        return isIntermediate(index) ? mContext->getOutputBuffer(0)
+                                     : mContext->getInputBuffer(mInputs[index]);
+    }
+    const Operand::ExtraParams getInputExtraParams(uint32_t index) const override {
+        return isIntermediate(index) ? mIntermediate->extraParams
+                                     : mContext->getInputExtraParams(mInputs[index]);
+    }
+
+    uint32_t getNumOutputs() const override { return 1; }
+    OperandType getOutputType(uint32_t index) const override {
+        CHECK_EQ(index, 0u);
+        return mWritesIntermediate ? mIntermediate->type : mContext->getOutputType(0);
+    }
+    Shape getOutputShape(uint32_t index) const override {
+        CHECK_EQ(index, 0u);
+        return mWritesIntermediate ? *mIntermediate : mContext->getOutputShape(0);
+    }
+    void* getOutputBuffer(uint32_t index) override {
+        CHECK_EQ(index, 0u);
+        return mContext->getOutputBuffer(0);
+    }
+
+    bool setOutputShape(uint32_t index, const Shape& shape) override {
+        CHECK_EQ(index, 0u);
+        if (!mWritesIntermediate) {
+            return mContext->setOutputShape(0, shape);
+        }
+        NN_RET_CHECK(shape.type == mIntermediate->type);
+        NN_RET_CHECK(shape.scale == mIntermediate->scale);
+        NN_RET_CHECK_EQ(shape.offset, mIntermediate->offset);
+        std::vector<uint32_t> dimensions;
+        NN_RET_CHECK(combineDimensions(shape.dimensions, mIntermediate->dimensions, &dimensions));
+        mIntermediate->dimensions = dimensions;
+        return true;
+    }
+
+    bool isOmittedInput(uint32_t index) const override {
+        return !isIntermediate(index) && mContext->isOmittedInput(mInputs[index]);
+    }
+    bool isOmittedOutput(uint32_t index) const override {
+        CHECK_EQ(index, 0u);
+        return !mWritesIntermediate && mContext->isOmittedOutput(0);
+    }
+
+    ThreadPool* getThreadPool() const override { return mContext->getThreadPool(); }
+
+   private:
+    bool isIntermediate(uint32_t index) const {
+        CHECK_LT(index, mInputs.size());
+        return mInputs[index] == kIntermediate;
+    }
+
+    IOperationExecutionContext* mContext;
+    std::vector<uint32_t> mInputs;
+    Shape* mIntermediate;
+    bool mWritesIntermediate;
+};
+
+namespace residual_add {
+
+constexpr uint32_t kNumDescriptorValues = 4;
+
+// The sub-operations of a fused residual add.
+struct SubOperations {
+    const OperationRegistration* producer;
+    const OperationRegistration* add;
+    std::vector<uint32_t> producerInputs;
+    std::vector<uint32_t> addInputs;
+    Shape intermediate;
+
+    bool initialize(IOperationExecutionContext* context) {
+        const uint32_t inCount = context->getNumInputs();
+        NN_RET_CHECK_GE(inCount, 4u);
+        const uint32_t descriptorIndex = inCount - 2;
+        NN_RET_CHECK_EQ(getNumberOfElements(context->getInputShape(descriptorIndex)),
+                        kNumDescriptorValues);
+        const int32_t* descriptor = context->getInputBuffer<int32_t>(descriptorIndex);
+        const uint32_t producerInCount = descriptor[1];
+        const uint32_t addendIndex = descriptor[2];
+        NN_RET_CHECK_EQ(producerInCount + 4, inCount);
+        NN_RET_CHECK_LT(addendIndex, 2u);
+
+        producer = BuiltinOperationResolver::get()->findOperation(
+                static_cast<OperationType>(descriptor[0]));
+        add = BuiltinOperationResolver::get()->findOperation(OperationType::ADD);
+        NN_RET_CHECK(producer != nullptr && add != nullptr);
+
+        producerInputs.resize(producerInCount);
+        std::iota(producerInputs.begin(), producerInputs.end(), 0);
+        addInputs = {SubOperationContext::kIntermediate, SubOperationContext::kIntermediate,
+                     producerInCount + 1};
+        addInputs[1 - addendIndex] = producerInCount;
+
+        intermediate = context->getOutputShape(0);
+        intermediate.offset = descriptor[3];
+        intermediate.scale = context->getInputValue<float>(inCount - 1);
+        intermediate.extraParams = Operand::ExtraParams();
+        return true;
+    }
+};
+
+bool prepare(IOperationExecutionContext* context) {
+    SubOperations subOperations;
+    NN_RET_CHECK(subOperations.initialize(context));
+    SubOperationContext producerContext(context, subOperations.producerInputs,
+                                        &subOperations.intermediate, true);
+    NN_RET_CHECK(subOperations.producer->prepare(&producerContext));
+    SubOperationContext addContext(context, subOperations.addInputs, &subOperations.intermediate,
+                                   false);
+    NN_RET_CHECK(subOperations.add->prepare(&addContext));
+    // The ADD runs in place, which requires it not to broadcast.
+    NN_RET_CHECK(subOperations.intermediate.dimensions == context->getOutputShape(0).dimensions);
+    return true;
+}
+
+bool execute(IOperationExecutionContext* context) {
+    NNTRACE_COMP("fusedResidualAdd");
+    SubOperations subOperations;
+    NN_RET_CHECK(subOperations.initialize(context));
+    SubOperationContext producerContext(context, subOperations.producerInputs,
+                                        &subOperations.intermediate, true);
+    // Recompute the shape of the intermediate result, which prepare() did not
+    // keep.
+    NN_RET_CHECK(subOperations.producer->prepare(&producerContext));
+    NN_RET_CHECK(subOperations.producer->execute(&producerContext));
+    SubOperationContext addContext(context, subOperations.addInputs, &subOperations.intermediate,
+                                   false);
+    return subOperations.add->execute(&addContext);
+}
+
+}  // namespace residual_add
+
+namespace unary_chain {
+
+constexpr uint32_t kInputTensor = 0;
+constexpr uint32_t kTypesTensor = 1;
+constexpr uint32_t kOutputTensor = 0;
+
+// Each task processes at least this many elements.
+constexpr uint32_t kMinChunkSize = 4096;
+
+bool getFunctions(IOperationExecutionContext* context, std::vector<UnaryFunction>* functions,
+                  bool* hasActivation, bool* hasElementwise) {
+    const uint32_t count = getNumberOfElements(context->getInputShape(kTypesTensor));
+    const int32_t* types = context->getInputBuffer<int32_t>(kTypesTensor);
+    functions->clear();
+    *hasActivation = false;
+    *hasElementwise = false;
+    for (uint32_t i = 0; i < count; i++) {
+        const OperationType type = static_cast<OperationType>(types[i]);
+        const UnaryFunction function = getUnaryFunction(type);
+        NN_RET_CHECK(function != nullptr);
+        functions->push_back(function);
+        if (isActivation(type)) {
+            *hasActivation = true;
+        } else {
+            *hasElementwise = true;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+void compute(const std::vector<UnaryFunction>& functions, const T* input, T* output,
+             uint32_t size, ThreadPool* threadPool) {
+    parallelFor(threadPool, 0, size, kMinChunkSize,
+                [&functions, input, output](uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; i++) {
+                        // Round to T after each operation, as the separate
+                        // operations store their output.
+                        T value = input[i];
+                        for (UnaryFunction function : functions) {
+                            value = static_cast<T>(function(static_cast<float>(value)));
+                        }
+                        output[i] = value;
+                    }
+                });
+}
+
+bool prepare(IOperationExecutionContext* context) {
+    std::vector<UnaryFunction> functions;
+    bool hasActivation, hasElementwise;
+    NN_RET_CHECK(getFunctions(context, &functions, &hasActivation, &hasElementwise));
+    Shape input = context->getInputShape(kInputTensor);
+    // Apply the checks of the separate operations.
+    if (hasActivation) {
+        NN_RET_CHECK_LE(getNumberOfDimensions(input), 4);
+    }
+    if (hasElementwise) {
+        for (uint32_t dimension : input.dimensions) {
+            NN_RET_CHECK_GT(dimension, 0);
+        }
+    }
+    Shape output = context->getOutputShape(kOutputTensor);
+    NN_RET_CHECK(SetShape(input, &output));
+    return context->setOutputShape(kOutputTensor, output);
+}
+
+bool execute(IOperationExecutionContext* context) {
+    NNTRACE_COMP("fusedUnaryChain");
+    std::vector<UnaryFunction> functions;
+    bool hasActivation, hasElementwise;
+    NN_RET_CHECK(getFunctions(context, &functions, &hasActivation, &hasElementwise));
+    const uint32_t size = getNumberOfElements(context->getOutputShape(kOutputTensor));
+    switch (context->getInputType(kInputTensor)) {
+        case OperandType::TENSOR_FLOAT16:
+            compute(functions, context->getInputBuffer<_Float16>(kInputTensor),
+                    context->getOutputBuffer<_Float16>(kOutputTensor), size,
+                    context->getThreadPool());
+            return true;
+        case OperandType::TENSOR_FLOAT32:
+            compute(functions, context->getInputBuffer<float>(kInputTensor),
+                    context->getOutputBuffer<float>(kOutputTensor), size,
+                    context->getThreadPool());
+            return true;
+        default:
+            NN_RET_CHECK_FAIL() << "Unsupported tensor type for fused unary operations";
+    }
+}
+
+}  // namespace unary_chain
+
+const OperationRegistration* getFusedRegistration(OperationType operationType) {
+    // The fused operations are never validated, as they are not part of any
+    // model built through the NNAPI.
+    static const OperationRegistration residualAdd(
+            kFusedResidualAdd, "FUSED_RESIDUAL_ADD", nullptr, residual_add::prepare,
+            residual_add::execute, {.allowZeroSizedInput = true});
+    static const OperationRegistration unaryChain(kFusedUnaryChain, "FUSED_UNARY_CHAIN", nullptr,
+                                                  unary_chain::prepare, unary_chain::execute,
+                                                  {.allowZeroSizedInput = true});
+    if (operationType == kFusedResidualAdd) {
+        return &residualAdd;
+    } else if (operationType == kFusedUnaryChain) {
+        return &unaryChain;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+std::optional<Model> fuseOperations(const Model& model, const IOperationResolver* resolver) {
+    NNTRACE_CPU(NNTRACE_PHASE_UNSPECIFIED, "fuseOperations");
+    for (const Operation& operation : model.operations) {
+        if (static_cast<uint32_t>(operation.type) >> kLowBitsType == kFusedOperationPrefix) {
+            LOG(WARNING) << "Not fusing a model using the extension prefix of fused operations";
+            return std::nullopt;
+        }
+    }
+    ModelFuser fuser(model, resolver);
+    // Fold the activations first, so that an activation following an ADD
+    // does not prevent fusing the ADD with the operation before it.
+    fuser.foldActivations();
+    fuser.fuseResidualAdds();
+    fuser.fuseUnaryChains();
+    if (fuser.getNumFusedOperations() == 0) {
+        return std::nullopt;
+    }
+    Model fusedModel;
+    fuser.getModel(model, &fusedModel);
+    return fusedModel;
+}
+
+const OperationRegistration* FusedOperationResolver::findOperation(
+        OperationType operationType) const {
+    const OperationRegistration* registration = getFusedRegistration(operationType);
+    return registration != nullptr ? registration : mResolver->findOperation(operationType);
+}
+
+}  // namespace nn
+}  // namespace android
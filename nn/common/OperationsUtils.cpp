@@ -21,12 +21,24 @@
 #include "Utils.h"
 
 #include <cmath>
+#include <memory>
+#include <new>
+
+#include "public/gemmlowp.h"
 
 namespace android {
 namespace nn {
 
 namespace {
 
+// The buffer that getThreadScratchBuffer() returns on this thread, if bound by
+// a ScopedThreadScratchBuffer.
+thread_local uint8_t* tlsScratchBuffer = nullptr;
+
+// The context that getThreadGemmContext() returns on this thread, if bound by
+// a ScopedThreadGemmContext.
+thread_local gemmlowp::GemmContext* tlsGemmContext = nullptr;
+
 bool validateOperandTypes(const std::vector<OperandType>& expectedTypes, const char* tag,
                           uint32_t operandCount,
                           std::function<OperandType(uint32_t)> getOperandType) {
@@ -65,6 +77,51 @@ bool validateHalVersion(const IOperationValidationContext* context,
     return true;
 }
 
+uint8_t* getThreadScratchBuffer() {
+    if (tlsScratchBuffer != nullptr) {
+        return tlsScratchBuffer;
+    }
+    thread_local std::unique_ptr<uint8_t[]> buffer;
+    if (buffer == nullptr) {
+        buffer.reset(new (std::nothrow) uint8_t[kThreadScratchBufferSize]);
+    }
+    return buffer.get();
+}
+
+ScopedThreadScratchBuffer::ScopedThreadScratchBuffer(uint8_t* buffer)
+    : mPreviousBuffer(tlsScratchBuffer) {
+    if (buffer != nullptr) {
+        tlsScratchBuffer = buffer;
+    }
+}
+
+ScopedThreadScratchBuffer::~ScopedThreadScratchBuffer() {
+    tlsScratchBuffer = mPreviousBuffer;
+}
+
+gemmlowp::GemmContext* getThreadGemmContext() {
+    if (tlsGemmContext != nullptr) {
+        return tlsGemmContext;
+    }
+    thread_local std::unique_ptr<gemmlowp::GemmContext> context;
+    if (context == nullptr) {
+        context.reset(new gemmlowp::GemmContext);
+        context->set_max_num_threads(1);
+    }
+    return context.get();
+}
+
+ScopedThreadGemmContext::ScopedThreadGemmContext(gemmlowp::GemmContext* context)
+    : mPreviousContext(tlsGemmContext) {
+    if (context != nullptr) {
+        tlsGemmContext = context;
+    }
+}
+
+ScopedThreadGemmContext::~ScopedThreadGemmContext() {
+    tlsGemmContext = mPreviousContext;
+}
+
 bool SameShape(const Shape& in1, const Shape& in2) {
     if (in1.type != in2.type || in1.dimensions.size() != in2.dimensions.size()) {
         return false;
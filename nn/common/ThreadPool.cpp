@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ThreadPool"
+
+#include "ThreadPool.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <utility>
+
+namespace android {
+namespace nn {
+
+namespace {
+
+constexpr uint32_t kNoWorker = std::numeric_limits<uint32_t>::max();
+
+// The pool and the index of the worker running on the current thread, if any.
+thread_local const ThreadPool* tlsThreadPool = nullptr;
+thread_local uint32_t tlsWorkerIndex = kNoWorker;
+
+}  // namespace
+
+uint32_t ThreadPool::getDefaultNumThreads() {
+    const uint32_t numCores = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Count the cores of the slowest kind, as per their maximum frequency.
+    std::vector<uint32_t> maxFrequencies;
+    for (uint32_t i = 0; i < numCores; i++) {
+        std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(i) +
+                           "/cpufreq/cpuinfo_max_freq");
+        uint32_t maxFrequency = 0;
+        if (!(file >> maxFrequency)) {
+            maxFrequencies.clear();
+            break;
+        }
+        maxFrequencies.push_back(maxFrequency);
+    }
+    if (!maxFrequencies.empty()) {
+        const uint32_t lowestFrequency =
+                *std::min_element(maxFrequencies.begin(), maxFrequencies.end());
+        const uint32_t numLittleCores = static_cast<uint32_t>(
+                std::count(maxFrequencies.begin(), maxFrequencies.end(), lowestFrequency));
+        if (numLittleCores < numCores) {
+            return numCores - numLittleCores;
+        }
+    }
+
+    if (numCores >= 8) {
+        return numCores - 4;
+    } else if (numCores >= 4) {
+        return numCores - 2;
+    }
+    return numCores;
+}
+
+ThreadPool::ThreadPool(uint32_t numThreads) {
+    CHECK_GT(numThreads, 0u);
+    mWorkers.reserve(numThreads);
+    for (uint32_t i = 0; i < numThreads; i++) {
+        mWorkers.push_back(std::make_unique<Worker>());
+    }
+    // Start the threads only once all the queues exist, as workers look at
+    // the queues of each other.
+    for (uint32_t i = 0; i < numThreads; i++) {
+        mWorkers[i]->thread = std::thread([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+    for (auto& worker : mWorkers) {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::schedule(Task task) {
+    const uint32_t workerIndex = tlsThreadPool == this
+                                         ? tlsWorkerIndex
+                                         : mNextWorker.fetch_add(1) % mWorkers.size();
+    {
+        Worker& worker = *mWorkers[workerIndex];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingTasks++;
+    }
+    mCondition.notify_one();
+}
+
+bool ThreadPool::takeTask(uint32_t preferredWorker, Task* task) {
+    const uint32_t numWorkers = mWorkers.size();
+    if (preferredWorker != kNoWorker) {
+        Worker& worker = *mWorkers[preferredWorker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            *task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            mPendingTasks--;
+            return true;
+        }
+    }
+    const uint32_t first = preferredWorker != kNoWorker ? preferredWorker + 1 : 0;
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        const uint32_t victimIndex = (first + i) % numWorkers;
+        if (victimIndex == preferredWorker) {
+            continue;
+        }
+        Worker& victim = *mWorkers[victimIndex];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            mPendingTasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(uint32_t workerIndex) {
+    tlsThreadPool = this;
+    tlsWorkerIndex = workerIndex;
+    Task task;
+    while (true) {
+        if (takeTask(workerIndex, &task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mStopping) {
+            return;
+        }
+        mCondition.wait(lock, [this] { return mStopping || mPendingTasks.load() > 0; });
+    }
+}
+
+void TaskGroup::schedule(ThreadPool::Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mState->mutex);
+        mState->tasks.push_back(std::move(task));
+        mState->pendingTasks++;
+    }
+    // Wake up the waiting thread, if any, to help with the new task.
+    mState->condition.notify_all();
+    mThreadPool->schedule([state = mState] { runTask(state.get()); });
+}
+
+bool TaskGroup::runTask(State* state) {
+    ThreadPool::Task task;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->tasks.empty()) {
+            return false;
+        }
+        task = std::move(state->tasks.front());
+        state->tasks.pop_front();
+    }
+    task();
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        finished = --state->pendingTasks == 0;
+    }
+    if (finished) {
+        state->condition.notify_all();
+    }
+    return true;
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(mState->mutex);
+    while (mState->pendingTasks != 0) {
+        if (mState->tasks.empty()) {
+            // The tasks left are running on workers.  Tasks they schedule to
+            // the group wake this thread up to run them.
+            mState->condition.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        runTask(mState.get());
+        lock.lock();
+    }
+}
+
+void parallelFor(ThreadPool* threadPool, uint32_t begin, uint32_t end, uint32_t minChunkSize,
+                 const std::function<void(uint32_t, uint32_t)>& fn) {
+    if (begin >= end) {
+        return;
+    }
+    const uint32_t size = end - begin;
+    const uint32_t maxNumChunks = threadPool != nullptr ? threadPool->getNumThreads() : 1;
+    const uint32_t numChunks =
+            std::min(maxNumChunks, std::max(size / std::max(minChunkSize, 1u), 1u));
+    if (numChunks == 1) {
+        fn(begin, end);
+        return;
+    }
+    auto chunkBegin = [begin, size, numChunks](uint32_t chunk) {
+        return begin + static_cast<uint32_t>(uint64_t(size) * chunk / numChunks);
+    };
+    TaskGroup taskGroup(threadPool);
+    for (uint32_t chunk = 1; chunk < numChunks; chunk++) {
+        taskGroup.schedule([&fn, &chunkBegin, chunk] {
+            fn(chunkBegin(chunk), chunkBegin(chunk + 1));
+        });
+    }
+    fn(chunkBegin(0), chunkBegin(1));
+    taskGroup.wait();
+}
+
+}  // namespace nn
+}  // namespace android
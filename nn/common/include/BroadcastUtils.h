@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_COMMON_BROADCAST_UTILS_H
+#define ANDROID_ML_NN_COMMON_BROADCAST_UTILS_H
+
+#include "OperationsUtils.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace android {
+namespace nn {
+
+// Describes how the two inputs of an elementwise operation map onto its
+// output.  Dimensions of size 1 in the output are dropped, and adjacent
+// dimensions along which each input is either read or broadcast in the same
+// way are merged, so that the output is computed one contiguous row at a time:
+//  - Inputs of the same shape make a single row.
+//  - A scalar input is read once per row.
+//  - A row or a column of a matrix is a row of the other input, or a
+//    scalar read once per row.
+class BinaryBroadcast {
+   public:
+    // Returns false if the shapes do not broadcast together.
+    bool initialize(const Shape& shape1, const Shape& shape2) {
+        const uint32_t rank1 = getNumberOfDimensions(shape1);
+        const uint32_t rank2 = getNumberOfDimensions(shape2);
+        const uint32_t rank = std::max(rank1, rank2);
+        std::vector<uint32_t> sizes(rank), strides1(rank), strides2(rank);
+        uint32_t stride1 = 1, stride2 = 1;
+        mNumElements = 1;
+        for (uint32_t i = 1; i <= rank; ++i) {
+            const uint32_t size1 = i <= rank1 ? getSizeOfDimension(shape1, rank1 - i) : 1;
+            const uint32_t size2 = i <= rank2 ? getSizeOfDimension(shape2, rank2 - i) : 1;
+            NN_RET_CHECK(size1 == size2 || size1 == 1 || size2 == 1);
+            sizes[rank - i] = std::max(size1, size2);
+            strides1[rank - i] = size1 == 1 ? 0 : stride1;
+            strides2[rank - i] = size2 == 1 ? 0 : stride2;
+            stride1 *= size1;
+            stride2 *= size2;
+            mNumElements *= size1 == 1 ? size2 : size1;
+        }
+
+        mDimensions.clear();
+        for (uint32_t i = 0; i < rank; ++i) {
+            if (sizes[i] == 1) {
+                continue;
+            }
+            if (!mDimensions.empty() && (mDimensions.back().stride1 == 0) == (strides1[i] == 0) &&
+                (mDimensions.back().stride2 == 0) == (strides2[i] == 0)) {
+                Dimension& dimension = mDimensions.back();
+                dimension.size *= sizes[i];
+                dimension.stride1 = strides1[i];
+                dimension.stride2 = strides2[i];
+            } else {
+                mDimensions.push_back(
+                        {.size = sizes[i], .stride1 = strides1[i], .stride2 = strides2[i]});
+            }
+        }
+        if (mDimensions.empty()) {
+            mDimensions.push_back({.size = 1, .stride1 = 1, .stride2 = 1});
+        }
+        return true;
+    }
+
+    uint32_t getNumberOfElements() const { return mNumElements; }
+
+    // Sets out[i] to function(in1[j], in2[k]) for the elements of the inputs
+    // broadcast to each output element i.  The output may be an input of the
+    // same shape.
+    template <typename In1, typename In2, typename Out, typename Function>
+    void compute(const In1* in1, const In2* in2, Out* out, Function function,
+                 ThreadPool* threadPool) const {
+        if (mNumElements == 0) {
+            return;
+        }
+        const Dimension& inner = mDimensions.back();
+        if (mDimensions.size() == 1) {
+            parallelFor(threadPool, 0, inner.size, kMinChunkSize,
+                        [&](uint32_t begin, uint32_t end) {
+                            computeRow(in1 + begin * inner.stride1, inner.stride1,
+                                       in2 + begin * inner.stride2, inner.stride2, out + begin,
+                                       end - begin, function);
+                        });
+            return;
+        }
+        const uint32_t numOuterDimensions = mDimensions.size() - 1;
+        const uint32_t numRows = mNumElements / inner.size;
+        parallelFor(
+                threadPool, 0, numRows, std::max(kMinChunkSize / inner.size, 1u),
+                [&](uint32_t begin, uint32_t end) {
+                    // Step through the outer dimensions from the first row.
+                    std::vector<uint32_t> index(numOuterDimensions);
+                    uint32_t offset1 = 0, offset2 = 0;
+                    for (uint32_t i = numOuterDimensions, row = begin; i-- > 0;) {
+                        index[i] = row % mDimensions[i].size;
+                        offset1 += index[i] * mDimensions[i].stride1;
+                        offset2 += index[i] * mDimensions[i].stride2;
+                        row /= mDimensions[i].size;
+                    }
+                    for (uint32_t row = begin; row < end; ++row) {
+                        computeRow(in1 + offset1, inner.stride1, in2 + offset2, inner.stride2,
+                                   out + row * inner.size, inner.size, function);
+                        for (uint32_t i = numOuterDimensions; i-- > 0;) {
+                            const Dimension& dimension = mDimensions[i];
+                            offset1 += dimension.stride1;
+                            offset2 += dimension.stride2;
+                            if (++index[i] < dimension.size) {
+                                break;
+                            }
+                            offset1 -= dimension.size * dimension.stride1;
+                            offset2 -= dimension.size * dimension.stride2;
+                            index[i] = 0;
+                        }
+                    }
+                });
+    }
+
+   private:
+    // Inputs with at least this many elements per task are split across
+    // threads.
+    static constexpr uint32_t kMinChunkSize = 4096;
+
+    // A stride of 0 means that the input is broadcast along the dimension.
+    struct Dimension {
+        uint32_t size;
+        uint32_t stride1;
+        uint32_t stride2;
+    };
+
+    // The innermost dimension has a stride of 1 or 0 in each input.  Separate
+    // loops for each case let the compiler vectorize them.
+    template <typename In1, typename In2, typename Out, typename Function>
+    static void computeRow(const In1* in1, uint32_t stride1, const In2* in2, uint32_t stride2,
+                           Out* out, uint32_t size, Function function) {
+        if (stride1 == 0) {
+            const In1 value1 = *in1;
+            for (uint32_t i = 0; i < size; ++i) {
+                out[i] = function(value1, in2[i]);
+            }
+        } else if (stride2 == 0) {
+            const In2 value2 = *in2;
+            for (uint32_t i = 0; i < size; ++i) {
+                out[i] = function(in1[i], value2);
+            }
+        } else {
+            for (uint32_t i = 0; i < size; ++i) {
+                out[i] = function(in1[i], in2[i]);
+            }
+        }
+    }
+
+    std::vector<Dimension> mDimensions;
+    uint32_t mNumElements = 0;
+};
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_COMMON_BROADCAST_UTILS_H
@@ -20,11 +20,15 @@
 #include "HalInterfaces.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 #include "Utils.h"
 
 #include <android-base/macros.h>
 #include <ui/GraphicBuffer.h>
 #include <algorithm>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
@@ -120,7 +124,220 @@ class RunTimePoolInfo {
 bool setRunTimePoolInfosFromHidlMemories(std::vector<RunTimePoolInfo>* poolInfos,
                                          const hidl_vec<hidl_memory>& pools);
 
+// The dependencies between the operations of a model: an operation depends on
+// the earlier operations (in the run order of Model::operations) that write
+// the operands it reads.  Operations that do not depend on each other, directly
+// or indirectly, may run in parallel.
+class CpuOperationGraph {
+   public:
+    static CpuOperationGraph create(const Model& model);
+
+    uint32_t getNumOperations() const { return mNumPredecessors.size(); }
+
+    // The number of operations that the operation depends on directly.
+    uint32_t getNumPredecessors(uint32_t operationIndex) const {
+        return mNumPredecessors[operationIndex];
+    }
+
+    // The operations that depend directly on the operation.
+    const std::vector<uint32_t>& getSuccessors(uint32_t operationIndex) const {
+        return mSuccessors[operationIndex];
+    }
+
+    // Whether operation "before" always completes before operation "after"
+    // starts, i.e. whether "after" depends on "before", directly or indirectly.
+    bool happensBefore(uint32_t before, uint32_t after) const {
+        const uint64_t word = mAncestors[size_t(after) * mWordsPerOperation + before / 64];
+        return (word >> (before % 64)) & 1;
+    }
+
+   private:
+    std::vector<uint32_t> mNumPredecessors;
+    std::vector<std::vector<uint32_t>> mSuccessors;
+    // For each operation, a bitset of the operations it depends on.
+    uint32_t mWordsPerOperation = 0;
+    std::vector<uint64_t> mAncestors;
+};
+
+// A static memory layout for the temporary operands of a model.
+//
+// The lifetime of each TEMPORARY_VARIABLE operand spans from the operation
+// that writes it to the operation that reads it for the last time, in the run
+// order of Model::operations.  For a valid model this is the point at which
+// Operand::numberOfConsumers drops to zero during execution, i.e. where
+// CpuExecutor would otherwise free it.  Temporaries whose size is fully known
+// from the model are packed into a single arena, and temporaries with disjoint
+// lifetimes may share the same bytes.  Temporaries with unspecified dimensions
+// are not planned: they are allocated on demand during execution.
+//
+// When the operations may run in parallel, lifetimes are only disjoint if the
+// operation graph orders them: two temporaries share bytes only if all the
+// operations using one of them happen before the operation writing the other.
+//
+// RESHAPE, SQUEEZE, EXPAND_DIMS and CONCATENATION of a single tensor copy
+// their input to their output unchanged.  When the input is a temporary that
+// no other operation reads, the output is planned as a view: it has the same
+// offset as the input, the bytes are kept until both are dead, and the
+// operation does not copy anything at run time.
+class CpuMemoryPlan {
+   public:
+    // Offsets of planned operands are aligned to this many bytes.
+    static constexpr uint32_t kAlignment = 64;
+
+    // The operation graph is nullptr if the operations run sequentially.
+    static CpuMemoryPlan create(const Model& model, const CpuOperationGraph* graph = nullptr);
+
+    bool isPlanned(uint32_t operandIndex) const {
+        return operandIndex < mOffsets.size() && mOffsets[operandIndex] != kNotPlanned;
+    }
+
+    // Returns the offset in the arena of a planned operand.
+    uint32_t getOffset(uint32_t operandIndex) const {
+        CHECK(isPlanned(operandIndex));
+        return mOffsets[operandIndex];
+    }
+
+    // The number of bytes needed for the arena.
+    size_t getArenaSize() const { return mArenaSize; }
+
+    // The largest total size of planned temporaries that are alive at the same
+    // time.  This is the peak of the heap usage for these operands when each
+    // one is allocated and freed individually, and is a lower bound for
+    // getArenaSize().
+    size_t getPeakLiveSize() const { return mPeakLiveSize; }
+
+    // The number of operations whose output is planned as a view of their
+    // input.
+    uint32_t getNumViews() const { return mNumViews; }
+
+   private:
+    static constexpr uint32_t kNotPlanned = std::numeric_limits<uint32_t>::max();
+
+    std::vector<uint32_t> mOffsets;
+    size_t mArenaSize = 0;
+    size_t mPeakLiveSize = 0;
+    uint32_t mNumViews = 0;
+};
+
+// The parts of the execution of a model on the CPU that do not depend on the
+// request.  They are computed once, typically when the model is prepared, and
+// shared by all the executions of the model:
+// - the memory plan for the temporary operands;
+// - the runtime information of each operand as initialized from the model,
+//   including the location of the constant operands;
+// - how each operation is dispatched: its registration if it is implemented
+//   through the IOperationResolver, and which of the checks on its operands
+//   must still run at execution time.
+//
+// A CpuPreparedModel is not modified by execution, and may be used by several
+// CpuExecutors at the same time.  The model, the model pools and the operation
+// resolver must outlive the prepared model.
+//
+// If a thread pool is provided, operations may split their own computation
+// across the pool.  If parallelOperations is also set, executions run
+// independent operations in parallel on the pool as well, as ordered by the
+// operation graph.  The results are the same as with sequential execution.
+// The thread pool must outlive the prepared model.
+//
+// Unless fusion is disabled, the prepared model runs the model as rewritten by
+// fuseOperations(), which getModel() returns.  The operand indexes are the
+// same as in the original model.
+class CpuPreparedModel {
+   public:
+    static CpuPreparedModel create(const Model& model,
+                                   const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                                   const IOperationResolver* operationResolver,
+                                   ThreadPool* threadPool = nullptr, bool allowFusion = true,
+                                   bool parallelOperations = false);
+
+    // Prepares the model for one execution on the thread of the execution.
+    // Fusing the operations and planning the memory of the temporaries would
+    // cost more than they save in a single run, so neither is done.
+    static CpuPreparedModel createForSingleRun(const Model& model,
+                                               const std::vector<RunTimePoolInfo>& modelPoolInfos,
+                                               const IOperationResolver* operationResolver);
+
+    const Model& getModel() const { return *mModel; }
+    const std::vector<RunTimePoolInfo>& getModelPoolInfos() const { return *mModelPoolInfos; }
+    const CpuMemoryPlan& getMemoryPlan() const { return mMemoryPlan; }
+
+    // nullptr if the operations run on the thread of the execution only.
+    ThreadPool* getThreadPool() const { return mThreadPool; }
+    // nullptr if the operations run one after the other.
+    const CpuOperationGraph* getOperationGraph() const {
+        return mOperationGraph ? &*mOperationGraph : nullptr;
+    }
+
+    // The runtime information of the operands before execution.  Planned
+    // temporaries have their length set but no buffer, since the arena
+    // belongs to the executor.
+    const std::vector<RunTimeOperandInfo>& getOperands() const { return mOperands; }
+    // The operands whose runtime information a run changes: the temporaries
+    // and the model inputs and outputs.  The others are constant or omitted.
+    const std::vector<uint32_t>& getVaryingOperands() const { return mVaryingOperands; }
+
+    // Identifies the prepared model and its copies, so that an executor can
+    // tell whether its operands come from an earlier run of the same model.
+    uint64_t getId() const { return mId; }
+
+    // How CpuExecutor runs an operation, decided once for all the executions.
+    struct OperationStep {
+        // The implementation of the operation, or nullptr for operations that
+        // CpuExecutor implements itself.
+        const OperationRegistration* registration = nullptr;
+        // Whether the checks that the registration flags call for depend on
+        // the request or on shapes only known at execution time, and so run
+        // on every execution.  Otherwise they passed when preparing.
+        bool checkOmittedOperands = false;
+        bool checkZeroSizedInputs = false;
+        // Whether some input is a temporary that is not planned, whose memory
+        // is freed after its last use.
+        bool freesInputs = false;
+    };
+
+    const OperationStep& getOperationStep(uint32_t operationIndex) const {
+        return mOperationSteps[operationIndex];
+    }
+
+    // Returns nullptr for operations that are not implemented through the
+    // operation resolver.
+    const OperationRegistration* getOperationRegistration(uint32_t operationIndex) const {
+        return mOperationSteps[operationIndex].registration;
+    }
+
+   private:
+    CpuPreparedModel() = default;
+
+    static uint64_t getNextId();
+    // Initializes mOperands, mVaryingOperands and mOperationSteps from mModel,
+    // mModelPoolInfos and mMemoryPlan.
+    void initializeOperationsAndOperands(const IOperationResolver* operationResolver);
+
+    static OperationStep createOperationStep(const Model& model, const CpuMemoryPlan& memoryPlan,
+                                             const IOperationResolver& resolver,
+                                             const Operation& operation);
+
+    const Model* mModel = nullptr;
+    // The model with fused operations, if any, which mModel points to.
+    // Shared as copies of the prepared model refer to it.
+    std::shared_ptr<const Model> mFusedModel;
+    const std::vector<RunTimePoolInfo>* mModelPoolInfos = nullptr;
+    ThreadPool* mThreadPool = nullptr;
+    std::optional<CpuOperationGraph> mOperationGraph;
+    CpuMemoryPlan mMemoryPlan;
+    std::vector<RunTimeOperandInfo> mOperands;
+    std::vector<uint32_t> mVaryingOperands;
+    std::vector<OperationStep> mOperationSteps;
+    uint64_t mId = 0;
+};
+
 // This class is used to execute a model on the CPU.
+//
+// An executor keeps its memory (the arena for the temporary operands and the
+// runtime information of the operands) from one run to the next, so reusing
+// the same executor for successive executions of a model avoids allocating it
+// again.  An executor must not be used for several executions at the same
+// time.
 class CpuExecutor {
    public:
     // This constructor allows clients of CpuExecutor to provide custom CPU
@@ -136,34 +353,51 @@ class CpuExecutor {
 
     CpuExecutor() : CpuExecutor(BuiltinOperationResolver::get()) {}
 
+    ~CpuExecutor();
+
     // Executes the model. The results will be stored at the locations
     // specified in the constructor.
     // The model must outlive the executor.  We prevent it from being modified
-    // while this is executing.
+    // while this is executing.  The operations are not fused.
     int run(const Model& model, const Request& request,
             const std::vector<RunTimePoolInfo>& modelPoolInfos,
             const std::vector<RunTimePoolInfo>& requestPoolInfos);
 
+    // Executes a model prepared ahead of time.  Only the request arguments
+    // are bound to the operands at run time.  The operation resolver of the
+    // prepared model is used instead of the one of the executor.
+    int run(const CpuPreparedModel& preparedModel, const Request& request,
+            const std::vector<RunTimePoolInfo>& requestPoolInfos);
+
     const std::vector<OutputShape>& getOutputShapes() const {
         CHECK(mFinished) << "getOutputShapes() called by an unfinished CpuExecutor.";
         return mOutputShapes;
     }
 
    private:
-    bool initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& modelPoolInfos,
-                               const std::vector<RunTimePoolInfo>& requestPoolInfos);
+    // Runs the operations in parallel on the thread pool of the prepared
+    // model, and returns the result code of the failed operation that comes
+    // first in the run order, if any.
+    int runOperationsInParallel();
+    // Makes sure the arena can hold the temporaries of the memory plan.
+    bool allocateArena();
+    bool initializeRunTimeInfo(const std::vector<RunTimePoolInfo>& requestPoolInfos);
     // Runs one operation of the graph.
-    int executeOperation(const Operation& entry);
+    int executeOperation(const Operation& entry, const CpuPreparedModel::OperationStep& step);
+    // Runs an operation implemented through the operation resolver.
+    int executeRegisteredOperation(const Operation& operation,
+                                   const CpuPreparedModel::OperationStep& step);
     // Decrement the usage count for the operands listed.  Frees the memory
-    // allocated for any temporary variable with a count of zero.
-    void freeNoLongerUsedOperands(const std::vector<uint32_t>& inputs);
+    // allocated for any unplanned temporary variable with a count of zero.
+    void freeNoLongerUsedOperands(const hidl_vec<uint32_t>& inputs);
 
-    // Frees the memory allocated for any temporary variable, and sets the
-    // output operand shapes returning to the runtime.
+    // Frees the memory allocated for any unplanned temporary variable, and
+    // sets the output operand shapes returning to the runtime.
     void finish(int result);
 
     // The model and the request that we'll execute. Only valid while run()
     // is being executed.
+    const CpuPreparedModel* mPreparedModel = nullptr;
     const Model* mModel = nullptr;
     const Request* mRequest = nullptr;
 
@@ -174,6 +408,8 @@ class CpuExecutor {
     //    std::vector<uint32_t> mDimensions;
     // Runtime information about all the operands.
     std::vector<RunTimeOperandInfo> mOperands;
+    // The id of the prepared model that mOperands were copied from, or 0.
+    uint64_t mOperandsPreparedModelId = 0;
 
     // The output operand shapes returning to the runtime.
     std::vector<OutputShape> mOutputShapes;
@@ -181,6 +417,25 @@ class CpuExecutor {
     // Whether execution is finished and mOutputShapes is ready
     bool mFinished = false;
 
+    // Guards the use counts of the operands while operations run in parallel.
+    // Only valid while runOperationsInParallel() is being executed.
+    std::mutex* mUsesLeftMutex = nullptr;
+
+    // The arena backing the planned temporary operands.  mArena is the
+    // (over-allocated) storage; mArenaBase is mArena aligned to
+    // CpuMemoryPlan::kAlignment.
+    std::unique_ptr<uint8_t[]> mArena;
+    uint8_t* mArenaBase = nullptr;
+    size_t mArenaSize = 0;
+
+    // The scratch buffer of the operations run on the thread calling run(),
+    // kept from one execution to the next.
+    std::unique_ptr<uint8_t[]> mScratchBuffer;
+
+    // The gemmlowp context of the operations run on the thread calling run(),
+    // kept from one execution to the next.
+    std::unique_ptr<gemmlowp::GemmContext> mGemmContext;
+
     const IOperationResolver* mOperationResolver;
 };
 
@@ -201,13 +456,10 @@ class CpuExecutor {
 // them.  (Note that in current NNAPI usage only one instance is used in the
 // CpuExecutor thread).
 //
-// TODO(mikie): consider also setting the number of threads used. Using as many
-// threads as there are cores results in more variable performance: if we don't
-// get all cores for our threads, the latency is doubled as we wait for one core
-// to do twice the amount of work. Reality is complicated though as not all
-// cores are the same. Decision to be based on benchmarking against a
-// representative set of workloads and devices. I'm keeping the code here for
-// reference.
+// The CPU kernels no longer use OpenMP: they split their work with
+// parallelFor() on the ThreadPool of the CpuPreparedModel, which is sized by
+// ThreadPool::getDefaultNumThreads().  NNAPI_LIMIT_CPU_THREADS applies the same
+// number of threads to Eigen.
 // b/109953668, disable OpenMP
 #ifdef NNAPI_OPENMP
 class ScopedOpenmpSettings {
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_COMMON_CPU_FUSION_H
+#define ANDROID_ML_NN_COMMON_CPU_FUSION_H
+
+#include "HalInterfaces.h"
+#include "OperationResolver.h"
+
+#include <android-base/macros.h>
+#include <optional>
+
+namespace android {
+namespace nn {
+
+// Rewrites a model for CPU execution so that some sequences of operations run
+// as a single operation, saving a pass over memory and the buffer of the
+// intermediate result:
+// - A RELU, RELU1 or RELU6 following a CONV_2D, DEPTHWISE_CONV_2D,
+//   FULLY_CONNECTED, ADD, MUL, SUB or DIV without a fused activation becomes
+//   the fused activation of that operation.
+// - A CONV_2D or FULLY_CONNECTED followed by an ADD of a tensor of the same
+//   shape (a residual connection) becomes an operation that computes the sum in
+//   the output buffer of the convolution.
+// - A chain of ABS, EXP, LOG, NEG, RSQRT, SIN, SQRT, RELU, RELU1, RELU6,
+//   LOGISTIC and TANH on TENSOR_FLOAT32 or TENSOR_FLOAT16 becomes a single pass
+//   applying all of them to each element.
+//
+// Operations are only fused when the intermediate result is a temporary that
+// nothing else reads, and when the operation resolver implements them with the
+// builtin implementations.  The fused operations compute exactly the same
+// values as the original ones.
+//
+// The operand indexes are unchanged, so requests for the original model apply
+// to the fused model.  Intermediate results are left as temporaries that no
+// operation uses.  The fused model has no pools: CONSTANT_REFERENCE operands
+// refer to the pools of the original model.
+//
+// Returns std::nullopt if there is nothing to fuse.
+std::optional<Model> fuseOperations(const Model& model, const IOperationResolver* resolver);
+
+// Resolves the operation types that fuseOperations() creates, and all the
+// other operation types through the given resolver.  The resolver must
+// outlive this one.
+class FusedOperationResolver : public IOperationResolver {
+    DISALLOW_IMPLICIT_CONSTRUCTORS(FusedOperationResolver);
+
+   public:
+    explicit FusedOperationResolver(const IOperationResolver* resolver) : mResolver(resolver) {}
+
+    const OperationRegistration* findOperation(OperationType operationType) const override;
+
+   private:
+    const IOperationResolver* mResolver;
+};
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_COMMON_CPU_FUSION_H
@@ -73,6 +73,30 @@ inline void convertFloat32ToFloat16(const std::vector<float>& input, _Float16* o
     }
 }
 
+// Returns the dot product of two vectors of _Float16.  The products are
+// accumulated in float, like the float32 kernels do, so that long reductions
+// keep their precision; the elements are only widened in registers.
+inline float dotProductFloat16(const _Float16* a, const _Float16* b, uint32_t size) {
+    uint32_t i = 0;
+    // Independent partial sums, which the compiler can keep in vector lanes.
+    float sums[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (; i + 4 <= size; i += 4) {
+        for (uint32_t j = 0; j < 4; j++) {
+            sums[j] += static_cast<float>(a[i + j]) * static_cast<float>(b[i + j]);
+        }
+    }
+    float sum = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    for (; i < size; i++) {
+        sum += static_cast<float>(a[i]) * static_cast<float>(b[i]);
+    }
+    return sum;
+}
+
+// Applies the activation range of a float kernel and rounds to _Float16.
+inline _Float16 clampToFloat16(float value, float activationMin, float activationMax) {
+    return static_cast<_Float16>(std::min(std::max(value, activationMin), activationMax));
+}
+
 template <typename T>
 inline void convertQuantToFloat32(const T* input, float scale, int32_t zeroPoint,
                                   std::vector<float>* output) {
@@ -135,6 +159,49 @@ inline bool convertNhwcToNchw(const std::vector<T>& nhwc, const Shape& nhwcShape
     return true;
 }
 
+// Adds the contribution of one filter tap to an output plane of a convolution
+// on NCHW tensors.  The output position (y, x) reads the input position
+// (y * strideHeight + offsetY, x * strideWidth + offsetX), where the offsets
+// are the dilated position of the tap minus the padding; positions that read
+// the padding are left unchanged, and the others get
+// weight * (input + inputOffset) added.
+template <typename T, typename Acc>
+inline void accumulateFilterTapNchw(const T* inputPlane, int32_t inputHeight, int32_t inputWidth,
+                                    Acc inputOffset, Acc weight, int32_t offsetY, int32_t offsetX,
+                                    int32_t strideHeight, int32_t strideWidth, Acc* accumulator,
+                                    int32_t outputHeight, int32_t outputWidth) {
+    // The output positions in [begin, end) read inside the input.
+    auto validBegin = [](int32_t offset, int32_t stride) {
+        return offset >= 0 ? 0 : (stride - 1 - offset) / stride;
+    };
+    auto validEnd = [](int32_t offset, int32_t stride, int32_t inputSize, int32_t outputSize) {
+        if (inputSize <= offset) {
+            return 0;
+        }
+        return std::min(outputSize, (inputSize - offset + stride - 1) / stride);
+    };
+    const int32_t yBegin = validBegin(offsetY, strideHeight);
+    const int32_t yEnd = validEnd(offsetY, strideHeight, inputHeight, outputHeight);
+    const int32_t xBegin = validBegin(offsetX, strideWidth);
+    const int32_t xEnd = validEnd(offsetX, strideWidth, inputWidth, outputWidth);
+    for (int32_t y = yBegin; y < yEnd; y++) {
+        const T* inputRow = inputPlane + (y * strideHeight + offsetY) * inputWidth;
+        Acc* accumulatorRow = accumulator + y * outputWidth;
+        if (strideWidth == 1) {
+            // Contiguous on both sides, which the compiler vectorizes.
+            for (int32_t x = xBegin; x < xEnd; x++) {
+                const Acc value = static_cast<Acc>(inputRow[x + offsetX]);
+                accumulatorRow[x] += weight * (value + inputOffset);
+            }
+        } else {
+            for (int32_t x = xBegin; x < xEnd; x++) {
+                const Acc value = static_cast<Acc>(inputRow[x * strideWidth + offsetX]);
+                accumulatorRow[x] += weight * (value + inputOffset);
+            }
+        }
+    }
+}
+
 template <typename T>
 class InputWithLayout {
    public:
@@ -77,6 +77,43 @@ bool depthwiseConvQuant8PerChannel(const uint8_t* inputData, const Shape& inputS
                                    int32_t depthMultiplier, int32_t activation, uint8_t* outputData,
                                    const Shape& outputShape);
 
+// The same as above on NCHW input and output tensors, without converting them
+// to NHWC.  The output planes are split across the threads of threadPool.
+bool depthwiseConvFloat16Nchw(const _Float16* inputData, const Shape& inputShape,
+                              const _Float16* filterData, const Shape& filterShape,
+                              const _Float16* biasData, const Shape& biasShape,
+                              int32_t paddingLeft, int32_t paddingRight, int32_t paddingTop,
+                              int32_t paddingBottom, int32_t strideWidth, int32_t strideHeight,
+                              int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                              int32_t depthMultiplier, int32_t activation, _Float16* outputData,
+                              const Shape& outputShape, ThreadPool* threadPool);
+bool depthwiseConvFloat32Nchw(const float* inputData, const Shape& inputShape,
+                              const float* filterData, const Shape& filterShape,
+                              const float* biasData, const Shape& biasShape, int32_t paddingLeft,
+                              int32_t paddingRight, int32_t paddingTop, int32_t paddingBottom,
+                              int32_t strideWidth, int32_t strideHeight,
+                              int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                              int32_t depthMultiplier, int32_t activation, float* outputData,
+                              const Shape& outputShape, ThreadPool* threadPool);
+bool depthwiseConvQuant8Nchw(const uint8_t* inputData, const Shape& inputShape,
+                             const uint8_t* filterData, const Shape& filterShape,
+                             const int32_t* biasData, const Shape& biasShape, int32_t paddingLeft,
+                             int32_t paddingRight, int32_t paddingTop, int32_t paddingBottom,
+                             int32_t strideWidth, int32_t strideHeight,
+                             int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                             int32_t depthMultiplier, int32_t activation, uint8_t* outputData,
+                             const Shape& outputShape, ThreadPool* threadPool);
+bool depthwiseConvQuant8PerChannelNchw(const uint8_t* inputData, const Shape& inputShape,
+                                       const int8_t* filterData, const Shape& filterShape,
+                                       const float* filterScales, const int32_t* biasData,
+                                       const Shape& biasShape, int32_t paddingLeft,
+                                       int32_t paddingRight, int32_t paddingTop,
+                                       int32_t paddingBottom, int32_t strideWidth,
+                                       int32_t strideHeight, int32_t dilationWidthFactor,
+                                       int32_t dilationHeightFactor, int32_t depthMultiplier,
+                                       int32_t activation, uint8_t* outputData,
+                                       const Shape& outputShape, ThreadPool* threadPool);
+
 bool localResponseNormFloat16(const _Float16* inputData, const Shape& inputShape, int32_t radius,
                               float bias, float alpha, float beta, int32_t axis,
                               _Float16* outputData, const Shape& outputShape);
@@ -107,12 +144,9 @@ bool spaceToBatchGeneric(const T* inputData, const Shape& inputShape, const int3
                          const int32_t* padding, const Shape& paddingShape, T* outputData,
                          const Shape& outputShape);
 
-bool meanFloat16(_Float16* inputData, const Shape& inputShape, const int32_t* axis,
-                 const Shape& axisShape, bool keepDims, _Float16* outputData,
-                 const Shape& outputShape);
-template <typename T, typename U>
-bool meanGeneric(T* inputData, const Shape& inputShape, const int32_t* axis, const Shape& axisShape,
-                 bool keepDims, T* outputData, const Shape& outputShape);
+template <typename T>
+bool meanGeneric(const T* inputData, const Shape& inputShape, const int32_t* axis,
+                 const Shape& axisShape, T* outputData, ThreadPool* threadPool);
 
 bool stridedSliceGeneric(const uint8_t* inputData, const Shape& inputShape,
                          const int32_t* beginData, const int32_t* endData,
@@ -120,7 +154,8 @@ bool stridedSliceGeneric(const uint8_t* inputData, const Shape& inputShape,
                          int32_t shrinkAxisMask, uint8_t* outputData, const Shape& outputShape);
 
 bool argMinMaxGeneric(const uint8_t* inputData, const Shape& inputShape, int32_t axis,
-                      bool isArgMin, uint8_t* outputData, const Shape& outputShape);
+                      bool isArgMin, uint8_t* outputData, const Shape& outputShape,
+                      ThreadPool* threadPool);
 
 bool splitFloat16(const _Float16* inputData, const Shape& inputShape, int32_t axis,
                   const std::vector<_Float16*>* outputDataPtrs,
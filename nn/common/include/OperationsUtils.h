@@ -22,9 +22,15 @@
 #include <cstdint>
 #include <vector>
 
+namespace gemmlowp {
+class GemmContext;
+}  // namespace gemmlowp
+
 namespace android {
 namespace nn {
 
+class ThreadPool;
+
 // DEPRECATED. Use NN_RET_CHECK instead.
 #define NN_CHECK(x) NN_RET_CHECK(x)
 #define NN_OPS_CHECK(x) NN_RET_CHECK(x)
@@ -103,6 +109,10 @@ class IOperationExecutionContext {
     virtual bool isOmittedInput(uint32_t index) const = 0;
     virtual bool isOmittedOutput(uint32_t index) const = 0;
 
+    // The pool that the operation may split its computation across, e.g.
+    // with parallelFor(), or nullptr if it runs on the calling thread only.
+    virtual ThreadPool* getThreadPool() const = 0;
+
     template <typename T>
     const T* getInputBuffer(uint32_t index) const {
         return reinterpret_cast<const T*>(getInputBuffer(index));
@@ -132,6 +142,52 @@ bool validateOutputTypes(const IOperationValidationContext* context,
 bool validateHalVersion(const IOperationValidationContext* context,
                         HalVersion minSupportedHalVersion);
 
+// The size of the scratch buffer that each thread keeps for operations.
+constexpr size_t kThreadScratchBufferSize = 1605632;
+
+// Returns a buffer of kThreadScratchBufferSize bytes for the calling thread,
+// or nullptr if it cannot be allocated.  Operations use it for temporary data
+// instead of allocating memory on every execution.  A thread running a
+// CpuExecutor uses the buffer of the executor (see ScopedThreadScratchBuffer),
+// so that threads created for a single execution do not allocate one; other
+// threads, such as the workers of a ThreadPool, keep a buffer of their own.
+// The buffer is only valid until the operation returns, and the operation must
+// not wait for tasks of a ThreadPool while using it, as the waiting thread may
+// run another operation in the meantime.
+uint8_t* getThreadScratchBuffer();
+
+// Makes getThreadScratchBuffer() return the given buffer of
+// kThreadScratchBufferSize bytes on the calling thread for the lifetime of
+// this object.  A nullptr buffer leaves the calling thread with its own.
+class ScopedThreadScratchBuffer {
+   public:
+    explicit ScopedThreadScratchBuffer(uint8_t* buffer);
+    ~ScopedThreadScratchBuffer();
+
+   private:
+    uint8_t* mPreviousBuffer;
+};
+
+// Returns the gemmlowp context of the quantized operations on the calling
+// thread.  A thread running a CpuExecutor uses the context of the executor
+// (see ScopedThreadGemmContext); other threads, such as the workers of a
+// ThreadPool, keep a context of their own, which runs each GEMM on the calling
+// thread only so that the number of threads stays bounded.  The context must
+// not be used by another thread at the same time.
+gemmlowp::GemmContext* getThreadGemmContext();
+
+// Makes getThreadGemmContext() return the given context on the calling thread
+// for the lifetime of this object.  A nullptr context leaves the calling
+// thread with its own.
+class ScopedThreadGemmContext {
+   public:
+    explicit ScopedThreadGemmContext(gemmlowp::GemmContext* context);
+    ~ScopedThreadGemmContext();
+
+   private:
+    gemmlowp::GemmContext* mPreviousContext;
+};
+
 // Verifies that the two shapes are the same.
 bool SameShape(const Shape& in1, const Shape& in2);
 
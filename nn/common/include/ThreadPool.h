@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ML_NN_COMMON_THREAD_POOL_H
+#define ANDROID_ML_NN_COMMON_THREAD_POOL_H
+
+#include <android-base/macros.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace nn {
+
+// A fixed set of worker threads running tasks.
+//
+// Each worker has its own queue of tasks.  A task scheduled from a worker
+// goes to the back of that worker's queue, and a worker runs the tasks of its
+// own queue from the back (most recently scheduled first, which keeps the data
+// they use in cache).  Workers with an empty queue steal tasks from the front
+// of the queues of other workers.  Tasks scheduled from other threads are
+// distributed round-robin.
+class ThreadPool {
+    DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+
+   public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(uint32_t numThreads);
+    ~ThreadPool();
+
+    // The number of threads to use for computations on this device.
+    //
+    // Using as many threads as there are cores results in more variable
+    // performance: if we don't get all cores for our threads, the latency is
+    // doubled as we wait for one core to do twice the amount of work.  On
+    // big.LITTLE devices, the little cores are left out, as work split evenly
+    // waits for the slowest core.  Otherwise a few cores are left to the rest
+    // of the system.
+    static uint32_t getDefaultNumThreads();
+
+    uint32_t getNumThreads() const { return mWorkers.size(); }
+
+    // Queues a task to be run by one of the workers.
+    void schedule(Task task);
+
+   private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void workerLoop(uint32_t workerIndex);
+    // Takes a task from the back of the queue of worker preferredWorker, or
+    // else from the front of the queue of any other worker.
+    bool takeTask(uint32_t preferredWorker, Task* task);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+
+    // Number of tasks in all the queues.  It may transiently be negative, as
+    // a task can be taken between being queued and being counted.
+    std::atomic<int64_t> mPendingTasks{0};
+    std::atomic<uint32_t> mNextWorker{0};
+
+    // Protects the sleep and wake up of workers.
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping = false;
+};
+
+// Tracks the completion of a group of tasks run on a ThreadPool.
+//
+// The tasks of a group wait in a queue of their own, and each of them queues
+// a task on the pool that runs one task of the group, if any is left.  This
+// lets the waiting thread run the tasks of its group itself without running
+// tasks of other groups, which could take arbitrarily long.
+//
+// Tasks of the group may schedule more tasks to the same group.
+class TaskGroup {
+    DISALLOW_COPY_AND_ASSIGN(TaskGroup);
+
+   public:
+    explicit TaskGroup(ThreadPool* threadPool)
+        : mThreadPool(threadPool), mState(std::make_shared<State>()) {}
+
+    // Waits for the tasks of the group to finish.
+    ~TaskGroup() { wait(); }
+
+    void schedule(ThreadPool::Task task);
+
+    // Waits for all the tasks scheduled to the group, including the ones they
+    // schedule themselves, to finish.  While waiting, the calling thread runs
+    // the tasks of the group that no worker has started yet.
+    void wait();
+
+   private:
+    // Shared with the tasks queued on the pool, which may run after the group
+    // is gone and then find no task left to run.
+    struct State {
+        std::mutex mutex;
+        std::condition_variable condition;
+        // Tasks not started yet.
+        std::deque<ThreadPool::Task> tasks;
+        // Tasks not finished yet, including the ones in tasks.
+        uint32_t pendingTasks = 0;
+    };
+
+    // Runs the next task of the group, if any is left.  Returns whether a task
+    // was run.
+    static bool runTask(State* state);
+
+    ThreadPool* const mThreadPool;
+    const std::shared_ptr<State> mState;
+};
+
+// Splits [begin, end) into contiguous chunks, and calls fn(chunkBegin,
+// chunkEnd) for each chunk, in parallel on threadPool.  Chunks are at least
+// minChunkSize long, except when the whole range is shorter.  The calling
+// thread runs one of the chunks and returns once all of them are done.
+//
+// If threadPool is nullptr, fn(begin, end) is called on the calling thread.
+// Computations that write each output element from a single chunk give the
+// same results with and without a pool.
+void parallelFor(ThreadPool* threadPool, uint32_t begin, uint32_t end, uint32_t minChunkSize,
+                 const std::function<void(uint32_t, uint32_t)>& fn);
+
+}  // namespace nn
+}  // namespace android
+
+#endif  // ANDROID_ML_NN_COMMON_THREAD_POOL_H
@@ -17,6 +17,8 @@
 #include "ActivationFunctor.h"
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
+#include "VectorMath.h"
 
 #include "tensorflow/lite/kernels/internal/optimized/legacy_optimized_ops.h"
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
@@ -73,40 +75,40 @@ template bool relu6Float<float>(const float* inputData, const Shape& inputShape,
 template bool relu6Float<_Float16>(const _Float16* inputData, const Shape& inputShape,
                                    _Float16* outputData, const Shape& outputShape);
 
-bool tanhFloat16(const _Float16* inputData, const Shape& inputShape, _Float16* outputData,
-                 const Shape& outputShape) {
-    NNTRACE_COMP("tanhFloat16");
-    int numElements = getNumberOfElements(inputShape);
-    for (int i = 0; i < numElements; i++, inputData++, outputData++) {
-        *outputData = static_cast<_Float16>(std::tanh(static_cast<float>(*inputData)));
-    }
-    return true;
-}
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
 
-bool tanhFloat32(const float* inputData, const Shape& inputShape, float* outputData,
-                 const Shape& outputShape) {
-    NNTRACE_COMP("tanhFloat32");
-    int numElements = getNumberOfElements(inputShape);
-    for (int i = 0; i < numElements; i++, inputData++, outputData++) {
-        *outputData = std::tanh(*inputData);
-    }
+template <typename T>
+bool tanhFloat(const T* inputData, const Shape& inputShape, T* outputData,
+               ThreadPool* threadPool) {
+    NNTRACE_COMP("tanhFloat");
+    parallelFor(threadPool, 0, getNumberOfElements(inputShape), kMinChunkSize,
+                [&](uint32_t begin, uint32_t end) {
+                    vector_math::map(inputData + begin, outputData + begin, end - begin,
+                                     [](float x) { return vector_math::tanh(x); });
+                });
     return true;
 }
+template bool tanhFloat<float>(const float* inputData, const Shape& inputShape,
+                               float* outputData, ThreadPool* threadPool);
+template bool tanhFloat<_Float16>(const _Float16* inputData, const Shape& inputShape,
+                                  _Float16* outputData, ThreadPool* threadPool);
 
 template <typename T>
 bool logisticFloat(const T* inputData, const Shape& inputShape, T* outputData,
-                   const Shape& outputShape) {
+                   ThreadPool* threadPool) {
     NNTRACE_COMP("logisticFloat");
-    int numElements = getNumberOfElements(inputShape);
-    for (int i = 0; i < numElements; i++, inputData++, outputData++) {
-        *outputData = static_cast<T>(1.f / (1.f + std::exp(static_cast<float>(-*inputData))));
-    }
+    parallelFor(threadPool, 0, getNumberOfElements(inputShape), kMinChunkSize,
+                [&](uint32_t begin, uint32_t end) {
+                    vector_math::map(inputData + begin, outputData + begin, end - begin,
+                                     [](float x) { return vector_math::logistic(x); });
+                });
     return true;
 }
 template bool logisticFloat<float>(const float* inputData, const Shape& inputShape,
-                                   float* outputData, const Shape& outputShape);
+                                   float* outputData, ThreadPool* threadPool);
 template bool logisticFloat<_Float16>(const _Float16* inputData, const Shape& inputShape,
-                                      _Float16* outputData, const Shape& outputShape);
+                                      _Float16* outputData, ThreadPool* threadPool);
 
 #define ANDROID_NN_RELUX_QUANT8(activation)                                           \
     int numElements = getNumberOfElements(inputShape);                                \
@@ -331,12 +333,12 @@ bool executeLogistic(IOperationExecutionContext* context) {
             return logisticFloat(context->getInputBuffer<_Float16>(kInputTensor),
                                  context->getInputShape(kInputTensor),
                                  context->getOutputBuffer<_Float16>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return logisticFloat(context->getInputBuffer<float>(kInputTensor),
                                  context->getInputShape(kInputTensor),
                                  context->getOutputBuffer<float>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return logisticQuant8(context->getInputBuffer<uint8_t>(kInputTensor),
                                   context->getInputShape(kInputTensor),
@@ -352,15 +354,15 @@ bool executeTanh(IOperationExecutionContext* context) {
     if (getNumberOfElements(context->getOutputShape(kOutputTensor)) == 0) return true;
     switch (context->getInputType(kInputTensor)) {
         case OperandType::TENSOR_FLOAT16:
-            return tanhFloat16(context->getInputBuffer<_Float16>(kInputTensor),
-                               context->getInputShape(kInputTensor),
-                               context->getOutputBuffer<_Float16>(kOutputTensor),
-                               context->getOutputShape(kOutputTensor));
+            return tanhFloat(context->getInputBuffer<_Float16>(kInputTensor),
+                             context->getInputShape(kInputTensor),
+                             context->getOutputBuffer<_Float16>(kOutputTensor),
+                             context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
-            return tanhFloat32(context->getInputBuffer<float>(kInputTensor),
-                               context->getInputShape(kInputTensor),
-                               context->getOutputBuffer<float>(kOutputTensor),
-                               context->getOutputShape(kOutputTensor));
+            return tanhFloat(context->getInputBuffer<float>(kInputTensor),
+                             context->getInputShape(kInputTensor),
+                             context->getOutputBuffer<float>(kOutputTensor),
+                             context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return tanhQuant8(context->getInputBuffer<uint8_t>(kInputTensor),
                               context->getInputShape(kInputTensor),
@@ -20,41 +20,117 @@
 
 #include "Operations.h"
 #include "CpuOperationUtils.h"
+#include "ThreadPool.h"
 
 #include "Tracing.h"
 
+#include <algorithm>
+
 namespace android {
 namespace nn {
 
-template <typename In, typename Out>
-static void argMinMaxImpl(const In* inputData, const Shape& inputShape,
-                          int32_t axis, bool isArgMin,
-                          Out* outputData, const Shape& outputShape) {
+// Inputs with at least this many elements per task are split across threads.
+constexpr int kMinChunkSize = 4096;
+
+// The number of running extremes kept side by side when reducing a
+// contiguous row, so that the comparisons vectorize.
+constexpr int kNumLanes = 16;
+
+// The number of inner elements reduced at a time when the axis is not
+// innermost. Each step of the axis then reads a contiguous span of the input.
+constexpr int kInnerTileSize = 256;
+
+template <typename T, typename Compare>
+static int32_t argMinMaxRow(const T* row, int axisSize, Compare better) {
+    T lanes[kNumLanes];
+    std::fill(lanes, lanes + kNumLanes, row[0]);
+    int i = 0;
+    for (; i + kNumLanes <= axisSize; i += kNumLanes) {
+        for (int lane = 0; lane < kNumLanes; ++lane) {
+            const T value = row[i + lane];
+            lanes[lane] = better(value, lanes[lane]) ? value : lanes[lane];
+        }
+    }
+    T extreme = lanes[0];
+    for (int lane = 1; lane < kNumLanes; ++lane) {
+        extreme = better(lanes[lane], extreme) ? lanes[lane] : extreme;
+    }
+    for (; i < axisSize; ++i) {
+        extreme = better(row[i], extreme) ? row[i] : extreme;
+    }
+    // Ties go to the first occurrence. NaNs never win a comparison, so if the
+    // row starts with a NaN, nothing matches the extreme and the NaN is kept.
+    for (i = 0; i < axisSize; ++i) {
+        if (row[i] == extreme) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+template <typename In, typename Out, typename Compare>
+static void argMinMaxCompute(const In* inputData, const Shape& inputShape, int32_t axis,
+                             Compare better, Out* outputData, ThreadPool* threadPool) {
     const int outerSize = getNumberOfElements(inputShape, 0, axis);
     const int axisSize = getSizeOfDimension(inputShape, axis);
-    const int innerSize = getNumberOfElements(
-            inputShape, axis + 1, getNumberOfDimensions(inputShape));
-    for (int outer = 0; outer < outerSize; ++outer) {
-        for (int inner = 0; inner < innerSize; ++inner) {
-            auto minMaxValue = inputData[outer * axisSize * innerSize + inner];
-            int minMaxIndex = 0;
-            for (int i = 1; i < axisSize; ++i) {
-                const auto& value =
-                        inputData[(outer * axisSize + i) * innerSize + inner];
-                if ((isArgMin && value < minMaxValue) ||
-                    (!isArgMin && value > minMaxValue)) {
-                    minMaxValue = value;
-                    minMaxIndex = i;
-                }
+    const int innerSize =
+            getNumberOfElements(inputShape, axis + 1, getNumberOfDimensions(inputShape));
+    if (innerSize == 1) {
+        const uint32_t minRowsPerChunk = std::max(kMinChunkSize / std::max(axisSize, 1), 1);
+        parallelFor(threadPool, 0, outerSize, minRowsPerChunk, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t outer = begin; outer < end; ++outer) {
+                outputData[outer] = argMinMaxRow(inputData + outer * axisSize, axisSize, better);
             }
-            outputData[outer * innerSize + inner] = minMaxIndex;
-        }
+        });
+        return;
+    }
+
+    // Scan the axis one row of a tile at a time, keeping the running extremes
+    // of the whole tile, instead of striding through memory for each output.
+    const int numTiles = (innerSize + kInnerTileSize - 1) / kInnerTileSize;
+    const int maxTileElements = axisSize * std::min(innerSize, kInnerTileSize);
+    const uint32_t minTilesPerChunk = std::max(kMinChunkSize / std::max(maxTileElements, 1), 1);
+    parallelFor(threadPool, 0, outerSize * numTiles, minTilesPerChunk,
+                [&](uint32_t begin, uint32_t end) {
+                    In minMaxValues[kInnerTileSize];
+                    Out minMaxIndices[kInnerTileSize];
+                    for (uint32_t task = begin; task < end; ++task) {
+                        const int outer = task / numTiles;
+                        const int tileBegin = (task % numTiles) * kInnerTileSize;
+                        const int tileSize = std::min(kInnerTileSize, innerSize - tileBegin);
+                        const In* input = inputData + outer * axisSize * innerSize + tileBegin;
+                        std::copy(input, input + tileSize, minMaxValues);
+                        std::fill(minMaxIndices, minMaxIndices + tileSize, 0);
+                        for (int i = 1; i < axisSize; ++i) {
+                            const In* row = input + i * innerSize;
+                            for (int j = 0; j < tileSize; ++j) {
+                                const bool isBetter = better(row[j], minMaxValues[j]);
+                                minMaxValues[j] = isBetter ? row[j] : minMaxValues[j];
+                                minMaxIndices[j] = isBetter ? i : minMaxIndices[j];
+                            }
+                        }
+                        std::copy(minMaxIndices, minMaxIndices + tileSize,
+                                  outputData + outer * innerSize + tileBegin);
+                    }
+                });
+}
+
+template <typename In, typename Out>
+static void argMinMaxImpl(const In* inputData, const Shape& inputShape, int32_t axis,
+                          bool isArgMin, Out* outputData, ThreadPool* threadPool) {
+    if (isArgMin) {
+        argMinMaxCompute(inputData, inputShape, axis, [](In a, In b) { return a < b; },
+                         outputData, threadPool);
+    } else {
+        argMinMaxCompute(inputData, inputShape, axis, [](In a, In b) { return a > b; },
+                         outputData, threadPool);
     }
 }
 
 bool argMinMaxGeneric(const uint8_t* inputData, const Shape& inputShape,
                       int32 axis, bool isArgMin,
-                      uint8_t* outputData, const Shape& outputShape) {
+                      uint8_t* outputData, const Shape& /*outputShape*/,
+                      ThreadPool* threadPool) {
     NNTRACE_TRANS("argMinMaxGeneric");
     NN_CHECK(handleNegativeAxis(inputShape, &axis));
 
@@ -67,7 +143,7 @@ bool argMinMaxGeneric(const uint8_t* inputData, const Shape& inputShape,
             axis,                                                              \
             isArgMin,                                                          \
             reinterpret_cast<int32_t*>(outputData),                            \
-            outputShape);                                                      \
+            threadPool);                                                       \
         return true;                                                           \
     }
 
@@ -18,6 +18,7 @@
 
 #define LOG_TAG "Operations"
 
+#include "BroadcastUtils.h"
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
 
@@ -27,6 +28,7 @@
 #include "Tracing.h"
 
 #include <algorithm>
+#include <limits>
 
 namespace android {
 namespace nn {
@@ -61,23 +63,49 @@ namespace {
             return false;                                               \
     }
 
-using binaryFunctionFloat32 = std::function<bool(
-        const float* in1, const Shape& shape1, const float* in2, const Shape& shape2,
-        int32_t activation, float* out, const Shape& shapeOut)>;
+bool getActivationRangeFloat16(int32_t activation, _Float16* outputMin, _Float16* outputMax) {
+    constexpr float kInfinity = std::numeric_limits<float>::infinity();
+    switch (activation) {
+        case (int32_t)FusedActivationFunc::NONE:
+            *outputMin = -kInfinity;
+            *outputMax = kInfinity;
+            return true;
+        case (int32_t)FusedActivationFunc::RELU:
+            *outputMin = 0;
+            *outputMax = kInfinity;
+            return true;
+        case (int32_t)FusedActivationFunc::RELU1:
+            *outputMin = -1;
+            *outputMax = 1;
+            return true;
+        case (int32_t)FusedActivationFunc::RELU6:
+            *outputMin = 0;
+            *outputMax = 6;
+            return true;
+        default:
+            LOG(ERROR) << "Unsupported fused activation function type";
+            return false;
+    }
+}
 
+// Computes the operation in _Float16 with the fused activation applied to each
+// element.  The output may be the first input.  Rounding the exact result of
+// an addition, subtraction, multiplication or division of two _Float16 values
+// to float32 and then to _Float16 gives the same value as rounding it to
+// _Float16 directly, so this matches computing in float32.
+template <typename Operation>
 bool binaryOperationFloat16(const _Float16* in1, const Shape& shape1, const _Float16* in2,
                             const Shape& shape2, int32_t activation, _Float16* out,
-                            const Shape& shapeOut, binaryFunctionFloat32 operationFloat32) {
-    std::vector<float> in1_float32(getNumberOfElements(shape1));
-    convertFloat16ToFloat32(in1, &in1_float32);
-    std::vector<float> in2_float32(getNumberOfElements(shape2));
-    convertFloat16ToFloat32(in2, &in2_float32);
-    std::vector<float> out_float32(getNumberOfElements(shapeOut));
-
-    operationFloat32(in1_float32.data(), shape1, in2_float32.data(), shape2, activation,
-                     out_float32.data(), shapeOut);
-    convertFloat32ToFloat16(out_float32, out);
-
+                            Operation operation, ThreadPool* threadPool) {
+    _Float16 outputMin, outputMax;
+    NN_RET_CHECK(getActivationRangeFloat16(activation, &outputMin, &outputMax));
+    BinaryBroadcast broadcast;
+    NN_RET_CHECK(broadcast.initialize(shape1, shape2));
+    broadcast.compute(in1, in2, out,
+                      [operation, outputMin, outputMax](_Float16 a, _Float16 b) {
+                          return std::min(std::max(operation(a, b), outputMin), outputMax);
+                      },
+                      threadPool);
     return true;
 }
 
@@ -109,9 +137,11 @@ bool addFloat32(const float* in1, const Shape& shape1, const float* in2, const S
 }
 
 bool addFloat16(const _Float16* in1, const Shape& shape1, const _Float16* in2, const Shape& shape2,
-                int32_t activation, _Float16* out, const Shape& shapeOut) {
+                int32_t activation, _Float16* out, ThreadPool* threadPool) {
     NNTRACE_TRANS("addFloat16");
-    return binaryOperationFloat16(in1, shape1, in2, shape2, activation, out, shapeOut, &addFloat32);
+    return binaryOperationFloat16(
+            in1, shape1, in2, shape2, activation, out,
+            [](_Float16 a, _Float16 b) -> _Float16 { return a + b; }, threadPool);
 }
 
 bool addQuant8(const uint8_t* in1, const Shape& shape1, const uint8_t* in2, const Shape& shape2,
@@ -207,9 +237,11 @@ bool mulFloat32(const float* in1, const Shape& shape1, const float* in2, const S
 }
 
 bool mulFloat16(const _Float16* in1, const Shape& shape1, const _Float16* in2, const Shape& shape2,
-                int32_t activation, _Float16* out, const Shape& shapeOut) {
+                int32_t activation, _Float16* out, ThreadPool* threadPool) {
     NNTRACE_TRANS("mulFloat16");
-    return binaryOperationFloat16(in1, shape1, in2, shape2, activation, out, shapeOut, &mulFloat32);
+    return binaryOperationFloat16(
+            in1, shape1, in2, shape2, activation, out,
+            [](_Float16 a, _Float16 b) -> _Float16 { return a * b; }, threadPool);
 }
 
 bool mulQuant8(const uint8_t* in1, const Shape& shape1, const uint8_t* in2, const Shape& shape2,
@@ -258,9 +290,11 @@ bool subFloat32(const float* in1, const Shape& shape1, const float* in2, const S
 }
 
 bool subFloat16(const _Float16* in1, const Shape& shape1, const _Float16* in2, const Shape& shape2,
-                int32_t activation, _Float16* out, const Shape& shapeOut) {
+                int32_t activation, _Float16* out, ThreadPool* threadPool) {
     NNTRACE_TRANS("subFloat16");
-    return binaryOperationFloat16(in1, shape1, in2, shape2, activation, out, shapeOut, &subFloat32);
+    return binaryOperationFloat16(
+            in1, shape1, in2, shape2, activation, out,
+            [](_Float16 a, _Float16 b) -> _Float16 { return a - b; }, threadPool);
 }
 
 bool subQuant8(const uint8_t* in1, const Shape& shape1, const uint8_t* in2, const Shape& shape2,
@@ -340,9 +374,11 @@ bool divFloat32(const float* in1, const Shape& shape1, const float* in2, const S
 }
 
 bool divFloat16(const _Float16* in1, const Shape& shape1, const _Float16* in2, const Shape& shape2,
-                int32_t activation, _Float16* out, const Shape& shapeOut) {
+                int32_t activation, _Float16* out, ThreadPool* threadPool) {
     NNTRACE_TRANS("divFloat16");
-    return binaryOperationFloat16(in1, shape1, in2, shape2, activation, out, shapeOut, &divFloat32);
+    return binaryOperationFloat16(
+            in1, shape1, in2, shape2, activation, out,
+            [](_Float16 a, _Float16 b) -> _Float16 { return a / b; }, threadPool);
 }
 
 }  // namespace
@@ -400,7 +436,7 @@ bool executeAdd(IOperationExecutionContext* context) {
                               context->getInputShape(kInputTensor2),
                               context->getInputValue<int32_t>(kActivationScalar),
                               context->getOutputBuffer<_Float16>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return addFloat32(context->getInputBuffer<float>(kInputTensor1),
                               context->getInputShape(kInputTensor1),
@@ -433,7 +469,7 @@ bool executeMul(IOperationExecutionContext* context) {
                               context->getInputShape(kInputTensor2),
                               context->getInputValue<int32_t>(kActivationScalar),
                               context->getOutputBuffer<_Float16>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return mulFloat32(context->getInputBuffer<float>(kInputTensor1),
                               context->getInputShape(kInputTensor1),
@@ -466,7 +502,7 @@ bool executeSub(IOperationExecutionContext* context) {
                               context->getInputShape(kInputTensor2),
                               context->getInputValue<int32_t>(kActivationScalar),
                               context->getOutputBuffer<_Float16>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return subFloat32(context->getInputBuffer<float>(kInputTensor1),
                               context->getInputShape(kInputTensor1),
@@ -499,7 +535,7 @@ bool executeDiv(IOperationExecutionContext* context) {
                               context->getInputShape(kInputTensor2),
                               context->getInputValue<int32_t>(kActivationScalar),
                               context->getOutputBuffer<_Float16>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return divFloat32(context->getInputBuffer<float>(kInputTensor1),
                               context->getInputShape(kInputTensor1),
@@ -17,32 +17,52 @@
 #define LOG_TAG "Operations"
 
 #include "Cast.h"
+#include "ThreadPool.h"
 #include "Tracing.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace android {
 namespace nn {
 namespace cast {
 
 namespace {
 
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
 template <typename FromT, typename ToT>
-void copyCast(const FromT* in, ToT* out, int numElements) {
-    std::transform(in, in + numElements, out, [](FromT a) -> ToT {
-        if constexpr (std::is_same_v<ToT, uint8_t>) {
-            if (a < 0) return 0;
-            if (a > 255) return 255;
+void copyCast(const FromT* in, ToT* out, uint32_t numElements, ThreadPool* threadPool) {
+    if constexpr (std::is_same_v<FromT, ToT>) {
+        if (in != out) {
+            memcpy(out, in, numElements * sizeof(ToT));
         }
-        return static_cast<ToT>(a);
-    });
+    } else {
+        parallelFor(threadPool, 0, numElements, kMinChunkSize,
+                    [in, out](uint32_t begin, uint32_t end) {
+                        for (uint32_t i = begin; i < end; ++i) {
+                            if constexpr (std::is_same_v<ToT, uint8_t>) {
+                                // Clamped with min and max rather than
+                                // branches so that the loop is vectorized.
+                                out[i] = static_cast<ToT>(std::min<FromT>(
+                                        std::max<FromT>(in[i], 0), static_cast<FromT>(255)));
+                            } else {
+                                out[i] = static_cast<ToT>(in[i]);
+                            }
+                        }
+                    });
+    }
 }
 
 template <typename FromT>
-bool copyToTensor(const FromT* inputData, int numElements, uint8_t* outputData,
-                  const Shape& outputShape) {
+bool copyToTensor(const FromT* inputData, uint32_t numElements, uint8_t* outputData,
+                  const Shape& outputShape, ThreadPool* threadPool) {
 #define ANDROID_NN_COPY_CAST(operandType, dataType)                                \
     case operandType: {                                                            \
         NNTRACE_COMP("cast::copyCast::" #dataType);                                \
-        copyCast(inputData, reinterpret_cast<dataType*>(outputData), numElements); \
+        copyCast(inputData, reinterpret_cast<dataType*>(outputData), numElements,  \
+                 threadPool);                                                      \
         return true;                                                               \
     }
 
@@ -69,15 +89,15 @@ bool prepare(const Shape& input, Shape* output) {
 }
 
 bool eval(const uint8_t* inputData, const Shape& inputShape, uint8_t* outputData,
-          const Shape& outputShape) {
+          const Shape& outputShape, ThreadPool* threadPool) {
     NNTRACE_TRANS("cast::eval");
-    int numElements = getNumberOfElements(inputShape);
+    uint32_t numElements = getNumberOfElements(inputShape);
 
 #define ANDROID_NN_COPY_TO_TENSOR(operandType, dataType)                                    \
     case operandType: {                                                                     \
         NNTRACE_TRANS("cast::copyToTensor::" #dataType);                                    \
         copyToTensor(reinterpret_cast<const dataType*>(inputData), numElements, outputData, \
-                     outputShape);                                                          \
+                     outputShape, threadPool);                                              \
         return true;                                                                        \
     }
 
@@ -26,7 +26,7 @@ namespace cast {
 bool prepare(const Shape& input, Shape* output);
 
 bool eval(const uint8_t* inputData, const Shape& inputShape, uint8_t* outputData,
-          const Shape& outputShape);
+          const Shape& outputShape, ThreadPool* threadPool);
 
 }  // namespace cast
 }  // namespace nn
@@ -16,8 +16,8 @@
 
 #define LOG_TAG "Operations"
 
+#include "BroadcastUtils.h"
 #include "HalInterfaces.h"
-#include "IndexedShapeWrapper.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
 
@@ -34,33 +34,29 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-template <typename DataType, typename ComparisonType>
-bool compute(const std::function<bool(ComparisonType, ComparisonType)>& func, const DataType* aData,
-             const Shape& aShape, const DataType* bData, const Shape& bShape, bool8* outputData,
-             const Shape& outputShape) {
-    IndexedShapeWrapper aShapeIndexed(aShape);
-    IndexedShapeWrapper bShapeIndexed(bShape);
-    IndexedShapeWrapper outputShapeIndexed(outputShape);
-    std::vector<uint32_t> curIndex(outputShape.dimensions.size(), 0);
-    bool lastIndex = false;
-    do {
-        uint32_t outputFlatIndex;
-        NN_RET_CHECK(outputShapeIndexed.indexToFlatIndex(curIndex, &outputFlatIndex));
-        uint32_t aFlatIndex;
-        NN_RET_CHECK(aShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &aFlatIndex));
-        uint32_t bFlatIndex;
-        NN_RET_CHECK(bShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &bFlatIndex));
-
-        if (aShape.type == OperandType::TENSOR_QUANT8_ASYMM) {
-            const float realA = (aData[aFlatIndex] - aShape.offset) * aShape.scale;
-            const float realB = (bData[bFlatIndex] - bShape.offset) * bShape.scale;
-            outputData[outputFlatIndex] = func(realA, realB);
-        } else {
-            outputData[outputFlatIndex] = func(aData[aFlatIndex], bData[bFlatIndex]);
-        }
-
-        NN_RET_CHECK(outputShapeIndexed.nextIndexInplace(&curIndex, &lastIndex));
-    } while (!lastIndex);
+template <typename DataType, typename ComparisonType, typename Comparison>
+bool compute(Comparison func, const DataType* aData, const Shape& aShape, const DataType* bData,
+             const Shape& bShape, bool8* outputData, ThreadPool* threadPool) {
+    BinaryBroadcast broadcast;
+    NN_RET_CHECK(broadcast.initialize(aShape, bShape));
+    if (aShape.type == OperandType::TENSOR_QUANT8_ASYMM) {
+        const int32_t aOffset = aShape.offset;
+        const float aScale = aShape.scale;
+        const int32_t bOffset = bShape.offset;
+        const float bScale = bShape.scale;
+        broadcast.compute(
+                aData, bData, outputData,
+                [func, aOffset, aScale, bOffset, bScale](DataType a, DataType b) -> bool8 {
+                    const float realA = (a - aOffset) * aScale;
+                    const float realB = (b - bOffset) * bScale;
+                    return func(realA, realB);
+                },
+                threadPool);
+    } else {
+        broadcast.compute(
+                aData, bData, outputData,
+                [func](DataType a, DataType b) -> bool8 { return func(a, b); }, threadPool);
+    }
     return true;
 }
 
@@ -70,7 +66,7 @@ bool executeLessTyped(IOperationExecutionContext* context) {
             std::less<ComparisonType>(), context->getInputBuffer<DataType>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<DataType>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 template <typename DataType, typename ComparisonType>
@@ -79,7 +75,7 @@ bool executeLessEqualTyped(IOperationExecutionContext* context) {
             std::less_equal<ComparisonType>(), context->getInputBuffer<DataType>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<DataType>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 template <typename DataType, typename ComparisonType>
@@ -88,7 +84,7 @@ bool executeEqualTyped(IOperationExecutionContext* context) {
             std::equal_to<ComparisonType>(), context->getInputBuffer<DataType>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<DataType>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 template <typename DataType, typename ComparisonType>
@@ -97,7 +93,7 @@ bool executeNotEqualTyped(IOperationExecutionContext* context) {
             std::not_equal_to<ComparisonType>(), context->getInputBuffer<DataType>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<DataType>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 template <typename DataType, typename ComparisonType>
@@ -106,7 +102,7 @@ bool executeGreaterEqualTyped(IOperationExecutionContext* context) {
             std::greater_equal<ComparisonType>(), context->getInputBuffer<DataType>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<DataType>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 template <typename DataType, typename ComparisonType>
@@ -115,7 +111,7 @@ bool executeGreaterTyped(IOperationExecutionContext* context) {
             std::greater<ComparisonType>(), context->getInputBuffer<DataType>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<DataType>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 }  // namespace
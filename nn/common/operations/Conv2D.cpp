@@ -17,12 +17,20 @@
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
 #include "Operations.h"
+#include "ThreadPool.h"
 
+#include "Eigen/Core"
 #include "Utils.h"
+#include "public/gemmlowp.h"
 #include "tensorflow/lite/kernels/internal/optimized/legacy_optimized_ops.h"
 
 #include "Tracing.h"
 
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
 namespace android {
 namespace nn {
 namespace conv_2d {
@@ -38,14 +46,20 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-// If possible we will use this static buffer for the tensor.
-constexpr size_t kStaticBufferSize = 1605632;
-char static_scratch_buffer[kStaticBufferSize];
+// Outputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+// The number of output pixels whose im2col rows a float16 convolution gathers
+// at a time.
+constexpr uint32_t kFloat16TileSize = 32;
 
-// executionMutex is used to protect concurrent access of the static_scratch_buffer
-// and other non-threadsafe resources like gemmlowp::GemmContext.
-// std::mutex is safe for pthreads on Android.
-std::mutex executionMutex;
+// The number of output elements of a row, output channels in NHWC and pixels
+// in NCHW, that the float16 GEMMs accumulate at a time.
+constexpr uint32_t kFloat16ChannelBlock = 64;
+
+// The number of output pixels whose im2col matrix an NCHW convolution
+// gathers at a time.
+constexpr uint32_t kNchwTileSize = 256;
 
 struct Conv2dParam {
     int32_t padding_left, padding_right;
@@ -150,9 +164,11 @@ struct Conv2dParam {
         LOG(ERROR) << "Conv size is too large, not enough memory";              \
         return false;                                                           \
     }                                                                           \
-    if (im2colByteSize <= kStaticBufferSize) {                                  \
-        im2colData = reinterpret_cast<Type *>(static_scratch_buffer);           \
-    } else {                                                                    \
+    /* If possible we will use the scratch buffer of the thread. */             \
+    if (im2colByteSize <= kThreadScratchBufferSize) {                           \
+        im2colData = reinterpret_cast<Type*>(getThreadScratchBuffer());         \
+    }                                                                           \
+    if (im2colData == nullptr) {                                                \
         im2colData = new (std::nothrow) Type[im2colByteSize / sizeof(Type)];    \
         if (im2colData == nullptr) {                                            \
             LOG(ERROR) << "Conv size is too large, not enough memory";          \
@@ -166,7 +182,7 @@ bool convNhwc(const float* inputData, const Shape& inputShape, const float* filt
               int32_t padding_left, int32_t padding_right, int32_t padding_top,
               int32_t padding_bottom, int32_t stride_width, int32_t stride_height,
               int32_t dilation_width_factor, int32_t dilation_height_factor, int32_t activation,
-              float* outputData, const Shape& outputShape) {
+              float* outputData, const Shape& outputShape, ThreadPool* /*threadPool*/) {
     NNTRACE_TRANS("convFloat32");
 
     ANDROID_NN_CONV_PARAMETERS(float)
@@ -174,8 +190,6 @@ bool convNhwc(const float* inputData, const Shape& inputShape, const float* filt
     float output_activation_min, output_activation_max;
     CalculateActivationRangeFloat(activation, &output_activation_min, &output_activation_max);
 
-    // Prevent concurrent executions that may access the scratch buffer.
-    std::unique_lock<std::mutex> lock(executionMutex);
     NNTRACE_COMP_SWITCH("optimized_ops::Conv");
     tflite::optimized_ops::Conv(inputData, convertShapeToDims(inputShape), filterData,
                                 convertShapeToDims(filterShape), biasData,
@@ -191,7 +205,7 @@ bool convNhwc(const uint8_t* inputData, const Shape& inputShape, const uint8_t*
               int32_t padding_left, int32_t padding_right, int32_t padding_top,
               int32_t padding_bottom, int32_t stride_width, int32_t stride_height,
               int32_t dilation_width_factor, int32_t dilation_height_factor, int32_t activation,
-              uint8_t* outputData, const Shape& outputShape) {
+              uint8_t* outputData, const Shape& outputShape, ThreadPool* /*threadPool*/) {
     NNTRACE_TRANS("convQuant8");
 
     ANDROID_NN_CONV_PARAMETERS(uint8_t)
@@ -214,14 +228,6 @@ bool convNhwc(const uint8_t* inputData, const Shape& inputShape, const uint8_t*
     CalculateActivationRangeUint8(activation, outputShape, &output_activation_min,
                                   &output_activation_max);
 
-    static gemmlowp::GemmContext gemm_context;
-
-    // Prevent concurrent executions that may access the scratch buffer and
-    // gemm_context.
-    std::unique_lock<std::mutex> lock(executionMutex);
-    // Alow gemmlowp automatically decide how many threads to use.
-    gemm_context.set_max_num_threads(0);
-
     NNTRACE_COMP_SWITCH("optimized_ops::Conv");
     tflite::optimized_ops::Conv(
             inputData, convertShapeToDims(inputShape), inputOffset, filterData,
@@ -229,33 +235,461 @@ bool convNhwc(const uint8_t* inputData, const Shape& inputShape, const uint8_t*
             stride_width, stride_height, dilation_width_factor, dilation_height_factor,
             paddingWidth, paddingHeight, outputOffset, output_multiplier, output_shift,
             output_activation_min, output_activation_max, outputData,
-            convertShapeToDims(outputShape), im2colData, im2colDim, &gemm_context);
+            convertShapeToDims(outputShape), im2colData, im2colDim, getThreadGemmContext());
     return true;
 }
 
+// Computes numRows rows of the GEMM output[r][c] = bias[c] + sum over k of
+// patches[r][k] * transposedFilter[k][c], accumulating in float, and applies
+// the activation range.  The filter is transposed so that the inner loop runs
+// over contiguous output channels, and each output is accumulated in the
+// order of k.
+void gemmFloat16(const _Float16* patches, uint32_t numRows, uint32_t depth,
+                 const _Float16* transposedFilter, const _Float16* biasData, uint32_t outDepth,
+                 float activationMin, float activationMax, _Float16* outputData) {
+    constexpr uint32_t kRowBlock = 4;
+    float accumulators[kRowBlock][kFloat16ChannelBlock];
+    for (uint32_t channelBegin = 0; channelBegin < outDepth; channelBegin += kFloat16ChannelBlock) {
+        const uint32_t numChannels = std::min(kFloat16ChannelBlock, outDepth - channelBegin);
+        for (uint32_t rowBegin = 0; rowBegin < numRows; rowBegin += kRowBlock) {
+            const uint32_t rowCount = std::min(kRowBlock, numRows - rowBegin);
+            for (uint32_t r = 0; r < rowCount; r++) {
+                for (uint32_t c = 0; c < numChannels; c++) {
+                    accumulators[r][c] = static_cast<float>(biasData[channelBegin + c]);
+                }
+            }
+            for (uint32_t k = 0; k < depth; k++) {
+                const _Float16* filterRow = transposedFilter + k * outDepth + channelBegin;
+                for (uint32_t r = 0; r < rowCount; r++) {
+                    const float value = static_cast<float>(patches[(rowBegin + r) * depth + k]);
+                    for (uint32_t c = 0; c < numChannels; c++) {
+                        accumulators[r][c] += value * static_cast<float>(filterRow[c]);
+                    }
+                }
+            }
+            for (uint32_t r = 0; r < rowCount; r++) {
+                _Float16* output = outputData + (rowBegin + r) * outDepth + channelBegin;
+                for (uint32_t c = 0; c < numChannels; c++) {
+                    output[c] = clampToFloat16(accumulators[r][c], activationMin, activationMax);
+                }
+            }
+        }
+    }
+}
+
 bool convNhwc(const _Float16* inputData, const Shape& inputShape, const _Float16* filterData,
               const Shape& filterShape, const _Float16* biasData, const Shape& biasShape,
               int32_t padding_left, int32_t padding_right, int32_t padding_top,
               int32_t padding_bottom, int32_t stride_width, int32_t stride_height,
               int32_t dilation_width_factor, int32_t dilation_height_factor, int32_t activation,
-              _Float16* outputData, const Shape& outputShape) {
+              _Float16* outputData, const Shape& outputShape, ThreadPool* threadPool) {
     NNTRACE_TRANS("convFloat16");
+    float output_activation_min, output_activation_max;
+    CalculateActivationRangeFloat(activation, &output_activation_min, &output_activation_max);
 
-    std::vector<float> inputData_float32(getNumberOfElements(inputShape));
-    std::vector<float> filterData_float32(getNumberOfElements(filterShape));
-    std::vector<float> biasData_float32(getNumberOfElements(biasShape));
-    std::vector<float> outputData_float32(getNumberOfElements(outputShape));
+    const uint32_t batches = getSizeOfDimension(inputShape, 0);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 1);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 2);
+    const uint32_t inDepth = getSizeOfDimension(inputShape, 3);
+    const int32_t filterHeight = getSizeOfDimension(filterShape, 1);
+    const int32_t filterWidth = getSizeOfDimension(filterShape, 2);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 1);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 2);
+    const uint32_t outDepth = getSizeOfDimension(outputShape, 3);
+    const uint32_t numPixels = batches * outHeight * outWidth;
+    // The length of an im2col row: the filter taps, each with the input
+    // channels innermost, in the order of the filter.
+    const uint32_t depth = filterHeight * filterWidth * inDepth;
 
-    convertFloat16ToFloat32(inputData, &inputData_float32);
-    convertFloat16ToFloat32(filterData, &filterData_float32);
-    convertFloat16ToFloat32(biasData, &biasData_float32);
+    NNTRACE_COMP_SWITCH("convFloat16");
+    std::vector<_Float16> transposedFilter(depth * outDepth);
+    for (uint32_t outChannel = 0; outChannel < outDepth; outChannel++) {
+        for (uint32_t k = 0; k < depth; k++) {
+            transposedFilter[k * outDepth + outChannel] = filterData[outChannel * depth + k];
+        }
+    }
+    // A 1x1 convolution without stride or padding reads the input pixels as
+    // they are.
+    const bool isPointwise = filterHeight == 1 && filterWidth == 1 && stride_width == 1 &&
+                             stride_height == 1 && padding_left == 0 && padding_top == 0 &&
+                             outHeight == inHeight && outWidth == inWidth;
+    const uint32_t numTiles = (numPixels + kFloat16TileSize - 1) / kFloat16TileSize;
+    parallelFor(
+            threadPool, 0, numTiles, std::max(kMinChunkSize / (kFloat16TileSize * outDepth), 1u),
+            [&](uint32_t begin, uint32_t end) {
+                std::vector<_Float16> patches(isPointwise ? 0 : kFloat16TileSize * depth);
+                for (uint32_t tile = begin; tile < end; tile++) {
+                    const uint32_t pixelBegin = tile * kFloat16TileSize;
+                    const uint32_t numRows = std::min(kFloat16TileSize, numPixels - pixelBegin);
+                    if (isPointwise) {
+                        gemmFloat16(inputData + pixelBegin * inDepth, numRows, depth,
+                                    transposedFilter.data(), biasData, outDepth,
+                                    output_activation_min, output_activation_max,
+                                    outputData + pixelBegin * outDepth);
+                        continue;
+                    }
+                    for (uint32_t r = 0; r < numRows; r++) {
+                        const uint32_t pixel = pixelBegin + r;
+                        const uint32_t b = pixel / (outHeight * outWidth);
+                        const int32_t outY = pixel / outWidth % outHeight;
+                        const int32_t outX = pixel % outWidth;
+                        _Float16* patch = patches.data() + r * depth;
+                        for (int32_t filterY = 0; filterY < filterHeight; filterY++) {
+                            const int32_t inY = outY * stride_height - padding_top +
+                                                filterY * dilation_height_factor;
+                            for (int32_t filterX = 0; filterX < filterWidth; filterX++) {
+                                const int32_t inX = outX * stride_width - padding_left +
+                                                    filterX * dilation_width_factor;
+                                _Float16* tap = patch + (filterY * filterWidth + filterX) * inDepth;
+                                if (inY < 0 || inY >= inHeight || inX < 0 || inX >= inWidth) {
+                                    std::fill(tap, tap + inDepth, static_cast<_Float16>(0.0f));
+                                } else {
+                                    const uint32_t inPixel = (b * inHeight + inY) * inWidth + inX;
+                                    memcpy(tap, inputData + inPixel * inDepth,
+                                           inDepth * sizeof(_Float16));
+                                }
+                            }
+                        }
+                    }
+                    gemmFloat16(patches.data(), numRows, depth, transposedFilter.data(),
+                                biasData, outDepth, output_activation_min,
+                                output_activation_max, outputData + pixelBegin * outDepth);
+                }
+            });
+    return true;
+}
 
-    convNhwc(inputData_float32.data(), inputShape, filterData_float32.data(), filterShape,
-             biasData_float32.data(), biasShape, padding_left, padding_right, padding_top,
-             padding_bottom, stride_width, stride_height, dilation_width_factor,
-             dilation_height_factor, activation, outputData_float32.data(), outputShape);
-    convertFloat32ToFloat16(outputData_float32, outputData);
+// Computes a convolution of NCHW tensors one output plane at a time, for the
+// filters quantized per channel, which have no GEMM pipeline: the plane
+// starts from the bias, and every filter tap adds a scaled input plane, which
+// keeps all the accesses contiguous.  The planes are split across threads.
+// finish(outChannel, value) converts an accumulated value to the output type.
+template <typename T_Input, typename T_Filter, typename T_Bias, typename Acc, typename Finish>
+void convNchwImpl(const T_Input* inputData, const Shape& inputShape, const T_Filter* filterData,
+                  const Shape& filterShape, const T_Bias* biasData, Acc inputOffset,
+                  Acc filterOffset, int32_t padding_left, int32_t padding_top,
+                  int32_t stride_width, int32_t stride_height, int32_t dilation_width_factor,
+                  int32_t dilation_height_factor, T_Input* outputData, const Shape& outputShape,
+                  ThreadPool* threadPool, Finish finish) {
+    const uint32_t numBatches = getSizeOfDimension(inputShape, 0);
+    const uint32_t inDepth = getSizeOfDimension(inputShape, 1);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 2);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 3);
+    const int32_t filterHeight = getSizeOfDimension(filterShape, 1);
+    const int32_t filterWidth = getSizeOfDimension(filterShape, 2);
+    const uint32_t outDepth = getSizeOfDimension(outputShape, 1);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 2);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 3);
+    const uint32_t inPlaneSize = inHeight * inWidth;
+    const uint32_t outPlaneSize = outHeight * outWidth;
 
+    // The planes of all batches, in the order of the output.
+    parallelFor(
+            threadPool, 0, numBatches * outDepth, std::max(kMinChunkSize / outPlaneSize, 1u),
+            [&](uint32_t planeBegin, uint32_t planeEnd) {
+                std::vector<Acc> accumulator(outPlaneSize);
+                for (uint32_t plane = planeBegin; plane < planeEnd; plane++) {
+                    const uint32_t b = plane / outDepth;
+                    const uint32_t outChannel = plane % outDepth;
+                    std::fill(accumulator.begin(), accumulator.end(),
+                              static_cast<Acc>(biasData[outChannel]));
+                    const T_Filter* filter =
+                            filterData + outChannel * filterHeight * filterWidth * inDepth;
+                    for (uint32_t inChannel = 0; inChannel < inDepth; inChannel++) {
+                        const T_Input* inputPlane =
+                                inputData + (b * inDepth + inChannel) * inPlaneSize;
+                        for (int32_t filterY = 0; filterY < filterHeight; filterY++) {
+                            for (int32_t filterX = 0; filterX < filterWidth; filterX++) {
+                                const Acc weight =
+                                        static_cast<Acc>(
+                                                filter[(filterY * filterWidth + filterX) *
+                                                               inDepth +
+                                                       inChannel]) +
+                                        filterOffset;
+                                accumulateFilterTapNchw(
+                                        inputPlane, inHeight, inWidth, inputOffset, weight,
+                                        filterY * dilation_height_factor - padding_top,
+                                        filterX * dilation_width_factor - padding_left,
+                                        stride_height, stride_width, accumulator.data(),
+                                        outHeight, outWidth);
+                            }
+                        }
+                    }
+                    T_Input* outputPlane = outputData + plane * outPlaneSize;
+                    for (uint32_t i = 0; i < outPlaneSize; i++) {
+                        outputPlane[i] = finish(outChannel, accumulator[i]);
+                    }
+                }
+            });
+}
+
+// Gathers the im2col matrix of the output pixels [pixelBegin, pixelBegin +
+// numColumns) of one batch of an NCHW convolution straight from the input
+// planes.  Row k of columns, numColumns elements long, holds the inputs that
+// element k of a filter, in the order of the filter, multiplies for each of
+// the pixels.  Positions in the padding get padValue.
+template <typename T>
+void im2colNchw(const T* inputData, int32_t inDepth, int32_t inHeight, int32_t inWidth,
+                int32_t filterHeight, int32_t filterWidth, int32_t padding_left,
+                int32_t padding_top, int32_t stride_width, int32_t stride_height,
+                int32_t dilation_width_factor, int32_t dilation_height_factor, int32_t outWidth,
+                uint32_t pixelBegin, uint32_t numColumns, T padValue, T* columns) {
+    T* row = columns;
+    for (int32_t filterY = 0; filterY < filterHeight; filterY++) {
+        const int32_t offsetY = filterY * dilation_height_factor - padding_top;
+        for (int32_t filterX = 0; filterX < filterWidth; filterX++) {
+            const int32_t offsetX = filterX * dilation_width_factor - padding_left;
+            for (int32_t inChannel = 0; inChannel < inDepth; inChannel++) {
+                const T* inputPlane = inputData + inChannel * inHeight * inWidth;
+                int32_t outY = pixelBegin / outWidth;
+                int32_t outX = pixelBegin % outWidth;
+                // One output row at a time.
+                for (uint32_t p = 0; p < numColumns; outY++, outX = 0) {
+                    const uint32_t count = std::min<uint32_t>(outWidth - outX, numColumns - p);
+                    const int32_t inY = outY * stride_height + offsetY;
+                    if (inY < 0 || inY >= inHeight) {
+                        std::fill(row + p, row + p + count, padValue);
+                    } else {
+                        const T* inputRow = inputPlane + inY * inWidth;
+                        for (uint32_t x = 0; x < count; x++) {
+                            const int32_t inX = (outX + x) * stride_width + offsetX;
+                            row[p + x] = inX >= 0 && inX < inWidth ? inputRow[inX] : padValue;
+                        }
+                    }
+                    p += count;
+                }
+                row += numColumns;
+            }
+        }
+    }
+}
+
+// Computes the GEMM output[c][p] = bias[c] + sum over k of filter[c][k] *
+// columns[k][p] for numColumns pixels, accumulating in float, and applies the
+// activation range.  Like gemmFloat16, the inner loop runs over contiguous
+// outputs, and each output is accumulated in the order of k.  The rows of
+// columns and output are columnStride and outputStride elements apart.
+void gemmFloat16Nchw(const _Float16* filterData, const _Float16* biasData, uint32_t outDepth,
+                     uint32_t depth, const _Float16* columns, uint32_t columnStride,
+                     uint32_t numColumns, float activationMin, float activationMax,
+                     _Float16* outputData, uint32_t outputStride) {
+    constexpr uint32_t kRowBlock = 4;
+    float accumulators[kRowBlock][kFloat16ChannelBlock];
+    for (uint32_t columnBegin = 0; columnBegin < numColumns; columnBegin += kFloat16ChannelBlock) {
+        const uint32_t blockSize = std::min(kFloat16ChannelBlock, numColumns - columnBegin);
+        for (uint32_t rowBegin = 0; rowBegin < outDepth; rowBegin += kRowBlock) {
+            const uint32_t rowCount = std::min(kRowBlock, outDepth - rowBegin);
+            for (uint32_t r = 0; r < rowCount; r++) {
+                for (uint32_t c = 0; c < blockSize; c++) {
+                    accumulators[r][c] = static_cast<float>(biasData[rowBegin + r]);
+                }
+            }
+            for (uint32_t k = 0; k < depth; k++) {
+                const _Float16* columnsRow = columns + k * columnStride + columnBegin;
+                for (uint32_t r = 0; r < rowCount; r++) {
+                    const float weight = static_cast<float>(filterData[(rowBegin + r) * depth + k]);
+                    for (uint32_t c = 0; c < blockSize; c++) {
+                        accumulators[r][c] += weight * static_cast<float>(columnsRow[c]);
+                    }
+                }
+            }
+            for (uint32_t r = 0; r < rowCount; r++) {
+                _Float16* output = outputData + (rowBegin + r) * outputStride + columnBegin;
+                for (uint32_t c = 0; c < blockSize; c++) {
+                    output[c] = clampToFloat16(accumulators[r][c], activationMin, activationMax);
+                }
+            }
+        }
+    }
+}
+
+// Computes a convolution of NCHW tensors as GEMMs of the filter, a
+// [outDepth][depth] matrix, with the im2col matrices of tiles of up to
+// kNchwTileSize pixels of a batch, gathered straight from the input planes
+// into the scratch buffer of the thread.  Each GEMM writes a [outDepth]
+// [numColumns] block of the output planes, so neither tensor is transposed.
+// A 1x1 convolution without stride or padding multiplies the input planes as
+// they are.  The tiles are split across threads.
+// gemm(columns, columnStride, numColumns, output, outputStride) computes one
+// GEMM, including the bias and the activation.
+template <typename T, typename Gemm>
+void convNchwByGemm(const T* inputData, const Shape& inputShape, const Shape& filterShape,
+                    int32_t padding_left, int32_t padding_top, int32_t stride_width,
+                    int32_t stride_height, int32_t dilation_width_factor,
+                    int32_t dilation_height_factor, T padValue, T* outputData,
+                    const Shape& outputShape, ThreadPool* threadPool, Gemm gemm) {
+    const uint32_t numBatches = getSizeOfDimension(inputShape, 0);
+    const int32_t inDepth = getSizeOfDimension(inputShape, 1);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 2);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 3);
+    const int32_t filterHeight = getSizeOfDimension(filterShape, 1);
+    const int32_t filterWidth = getSizeOfDimension(filterShape, 2);
+    const uint32_t outDepth = getSizeOfDimension(outputShape, 1);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 2);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 3);
+    const uint32_t inPlaneSize = inHeight * inWidth;
+    const uint32_t outPlaneSize = outHeight * outWidth;
+    const uint32_t depth = filterHeight * filterWidth * inDepth;
+
+    const bool isPointwise = filterHeight == 1 && filterWidth == 1 && stride_width == 1 &&
+                             stride_height == 1 && padding_left == 0 && padding_top == 0 &&
+                             outHeight == inHeight && outWidth == inWidth;
+    // The im2col matrix of a tile fits in the scratch buffer if possible.
+    const uint32_t tileSize =
+            std::min({kNchwTileSize, outPlaneSize,
+                      std::max<uint32_t>(kThreadScratchBufferSize / (depth * sizeof(T)), 1)});
+    const uint32_t numTilesPerPlane = (outPlaneSize + tileSize - 1) / tileSize;
+    parallelFor(
+            threadPool, 0, numBatches * numTilesPerPlane,
+            std::max(kMinChunkSize / (tileSize * outDepth), 1u),
+            [&](uint32_t begin, uint32_t end) {
+                T* columns = nullptr;
+                std::vector<T> columnsGuard;
+                if (!isPointwise) {
+                    if (depth * tileSize * sizeof(T) <= kThreadScratchBufferSize) {
+                        columns = reinterpret_cast<T*>(getThreadScratchBuffer());
+                    }
+                    if (columns == nullptr) {
+                        columnsGuard.resize(depth * tileSize);
+                        columns = columnsGuard.data();
+                    }
+                }
+                for (uint32_t tile = begin; tile < end; tile++) {
+                    const uint32_t b = tile / numTilesPerPlane;
+                    const uint32_t pixelBegin = tile % numTilesPerPlane * tileSize;
+                    const uint32_t numColumns = std::min(tileSize, outPlaneSize - pixelBegin);
+                    const T* batchInput = inputData + b * inDepth * inPlaneSize;
+                    T* output = outputData + b * outDepth * outPlaneSize + pixelBegin;
+                    if (isPointwise) {
+                        gemm(batchInput + pixelBegin, inPlaneSize, numColumns, output,
+                             outPlaneSize);
+                        continue;
+                    }
+                    im2colNchw(batchInput, inDepth, inHeight, inWidth, filterHeight, filterWidth,
+                               padding_left, padding_top, stride_width, stride_height,
+                               dilation_width_factor, dilation_height_factor, outWidth,
+                               pixelBegin, numColumns, padValue, columns);
+                    gemm(columns, numColumns, numColumns, output, outPlaneSize);
+                }
+            });
+}
+
+bool convNchw(const float* inputData, const Shape& inputShape, const float* filterData,
+              const Shape& filterShape, const float* biasData, const Shape& biasShape,
+              int32_t padding_left, int32_t padding_right, int32_t padding_top,
+              int32_t padding_bottom, int32_t stride_width, int32_t stride_height,
+              int32_t dilation_width_factor, int32_t dilation_height_factor, int32_t activation,
+              float* outputData, const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("convFloat32Nchw");
+    float output_activation_min, output_activation_max;
+    CalculateActivationRangeFloat(activation, &output_activation_min, &output_activation_max);
+    const uint32_t outDepth = getSizeOfDimension(filterShape, 0);
+    const uint32_t depth = getNumberOfElements(filterShape) / outDepth;
+
+    using Matrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    using Stride = Eigen::OuterStride<>;
+    const Eigen::Map<const Matrix> filter(filterData, outDepth, depth);
+    NNTRACE_COMP_SWITCH("convNchwByGemm");
+    convNchwByGemm(inputData, inputShape, filterShape, padding_left, padding_top, stride_width,
+                   stride_height, dilation_width_factor, dilation_height_factor, 0.0f,
+                   outputData, outputShape, threadPool,
+                   [&](const float* columns, uint32_t columnStride, uint32_t numColumns,
+                       float* output, uint32_t outputStride) {
+                       const Eigen::Map<const Matrix, 0, Stride> input(
+                               columns, depth, numColumns, Stride(columnStride));
+                       Eigen::Map<Matrix, 0, Stride> result(output, outDepth, numColumns,
+                                                            Stride(outputStride));
+                       result.noalias() = filter * input;
+                       for (uint32_t c = 0; c < outDepth; c++) {
+                           float* row = output + c * outputStride;
+                           for (uint32_t p = 0; p < numColumns; p++) {
+                               row[p] = std::min(std::max(row[p] + biasData[c],
+                                                          output_activation_min),
+                                                 output_activation_max);
+                           }
+                       }
+                   });
+    return true;
+}
+
+bool convNchw(const _Float16* inputData, const Shape& inputShape, const _Float16* filterData,
+              const Shape& filterShape, const _Float16* biasData, const Shape& biasShape,
+              int32_t padding_left, int32_t padding_right, int32_t padding_top,
+              int32_t padding_bottom, int32_t stride_width, int32_t stride_height,
+              int32_t dilation_width_factor, int32_t dilation_height_factor, int32_t activation,
+              _Float16* outputData, const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("convFloat16Nchw");
+    float output_activation_min, output_activation_max;
+    CalculateActivationRangeFloat(activation, &output_activation_min, &output_activation_max);
+    const uint32_t outDepth = getSizeOfDimension(filterShape, 0);
+    const uint32_t depth = getNumberOfElements(filterShape) / outDepth;
+
+    NNTRACE_COMP_SWITCH("convNchwByGemm");
+    convNchwByGemm(inputData, inputShape, filterShape, padding_left, padding_top, stride_width,
+                   stride_height, dilation_width_factor, dilation_height_factor,
+                   static_cast<_Float16>(0.0f), outputData, outputShape, threadPool,
+                   [&](const _Float16* columns, uint32_t columnStride, uint32_t numColumns,
+                       _Float16* output, uint32_t outputStride) {
+                       gemmFloat16Nchw(filterData, biasData, outDepth, depth, columns,
+                                       columnStride, numColumns, output_activation_min,
+                                       output_activation_max, output, outputStride);
+                   });
+    return true;
+}
+
+bool convNchw(const uint8_t* inputData, const Shape& inputShape, const uint8_t* filterData,
+              const Shape& filterShape, const int32_t* biasData, const Shape& biasShape,
+              int32_t padding_left, int32_t padding_right, int32_t padding_top,
+              int32_t padding_bottom, int32_t stride_width, int32_t stride_height,
+              int32_t dilation_width_factor, int32_t dilation_height_factor, int32_t activation,
+              uint8_t* outputData, const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("convQuant8Nchw");
+    double real_multiplier = 0.0;
+    int32_t output_multiplier = 0;
+    int32_t output_activation_min = 0;
+    int32_t output_activation_max = 0;
+    NN_RET_CHECK(GetQuantizedConvolutionMultipler(inputShape, filterShape, biasShape, outputShape,
+                                                  &real_multiplier));
+    int exponent;
+    NN_RET_CHECK(QuantizeMultiplier(real_multiplier, &output_multiplier, &exponent));
+    CalculateActivationRangeUint8(activation, outputShape, &output_activation_min,
+                                  &output_activation_max);
+    const uint32_t outDepth = getSizeOfDimension(filterShape, 0);
+    const uint32_t depth = getNumberOfElements(filterShape) / outDepth;
+
+    // The stages of the quantized convolutions of tflite: the bias of each
+    // output channel, a row of the GEMM, is added before the rescaling.
+    using ColVectorMap = gemmlowp::VectorMap<const int32_t, gemmlowp::VectorShape::Col>;
+    gemmlowp::OutputStageBiasAddition<ColVectorMap> biasAdditionStage;
+    biasAdditionStage.bias_vector = ColVectorMap(biasData, outDepth);
+    gemmlowp::OutputStageScaleInt32ByFixedPointAndExponent quantizeDownStage;
+    quantizeDownStage.result_fixedpoint_multiplier = output_multiplier;
+    quantizeDownStage.result_exponent = exponent;
+    quantizeDownStage.result_offset_after_shift = outputShape.offset;
+    gemmlowp::OutputStageClamp clampStage;
+    clampStage.min = output_activation_min;
+    clampStage.max = output_activation_max;
+    const auto outputPipeline = std::make_tuple(biasAdditionStage, quantizeDownStage, clampStage,
+                                                gemmlowp::OutputStageSaturatingCastToUint8());
+
+    const gemmlowp::MatrixMap<const uint8_t, gemmlowp::MapOrder::RowMajor> filter(
+            filterData, outDepth, depth);
+    NNTRACE_COMP_SWITCH("convNchwByGemm");
+    // Positions in the padding hold the zero point of the input.
+    convNchwByGemm(inputData, inputShape, filterShape, padding_left, padding_top, stride_width,
+                   stride_height, dilation_width_factor, dilation_height_factor,
+                   static_cast<uint8_t>(inputShape.offset), outputData, outputShape, threadPool,
+                   [&](const uint8_t* columns, uint32_t columnStride, uint32_t numColumns,
+                       uint8_t* output, uint32_t outputStride) {
+                       const gemmlowp::MatrixMap<const uint8_t, gemmlowp::MapOrder::RowMajor>
+                               input(columns, depth, numColumns, columnStride);
+                       gemmlowp::MatrixMap<uint8_t, gemmlowp::MapOrder::RowMajor> result(
+                               output, outDepth, numColumns, outputStride);
+                       gemmlowp::GemmWithOutputPipeline<
+                               uint8_t, uint8_t, gemmlowp::L8R8WithLhsNonzeroBitDepthParams>(
+                               getThreadGemmContext(), filter, input, &result,
+                               -filterShape.offset, -inputShape.offset, outputPipeline);
+                   });
     return true;
 }
 
@@ -265,18 +699,17 @@ bool conv(const T_Input* inputData, const Shape& inputShape, const T_Filter* fil
           int32_t padding_left, int32_t padding_right, int32_t padding_top, int32_t padding_bottom,
           int32_t stride_width, int32_t stride_height, int32_t dilation_width_factor,
           int32_t dilation_height_factor, int32_t activation, bool useNchw, T_Input* outputData,
-          const Shape& outputShape) {
-    InputWithLayout<T_Input> input(useNchw);
-    OutputWithLayout<T_Input> output(useNchw);
-    NN_RET_CHECK(input.initialize(inputData, inputShape));
-    NN_RET_CHECK(output.initialize(outputData, outputShape));
-    NN_RET_CHECK(convNhwc(input.getNhwcBuffer(), input.getNhwcShape(), filterData, filterShape,
-                          biasData, biasShape, padding_left, padding_right, padding_top,
-                          padding_bottom, stride_width, stride_height, dilation_width_factor,
-                          dilation_height_factor, activation, output.getNhwcBuffer(),
-                          output.getNhwcShape()));
-    NN_RET_CHECK(output.commit());
-    return true;
+          const Shape& outputShape, ThreadPool* threadPool) {
+    if (useNchw) {
+        return convNchw(inputData, inputShape, filterData, filterShape, biasData, biasShape,
+                        padding_left, padding_right, padding_top, padding_bottom, stride_width,
+                        stride_height, dilation_width_factor, dilation_height_factor, activation,
+                        outputData, outputShape, threadPool);
+    }
+    return convNhwc(inputData, inputShape, filterData, filterShape, biasData, biasShape,
+                    padding_left, padding_right, padding_top, padding_bottom, stride_width,
+                    stride_height, dilation_width_factor, dilation_height_factor, activation,
+                    outputData, outputShape, threadPool);
 }
 
 bool convQuant8PerChannelNhwc(const uint8_t* inputData, const Shape& inputShape,
@@ -372,6 +805,50 @@ bool convQuant8PerChannelNhwc(const uint8_t* inputData, const Shape& inputShape,
     return true;
 }
 
+bool convQuant8PerChannelNchw(const uint8_t* inputData, const Shape& inputShape,
+                              const int8_t* filterData, const Shape& filterShape,
+                              const float* filterScales, const int32_t* biasData,
+                              const Shape& biasShape, int32_t paddingLeft, int32_t paddingTop,
+                              int32_t strideWidth, int32_t strideHeight,
+                              int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                              int32_t activation, uint8_t* outputData, const Shape& outputShape,
+                              ThreadPool* threadPool) {
+    NNTRACE_TRANS("convQuant8PerChannelNchw");
+    const uint32_t outputDepth = getSizeOfDimension(outputShape, 1);
+    std::vector<int32_t> outputMultiplier(outputDepth);
+    std::vector<int32_t> outputExponent(outputDepth);
+    for (uint32_t i = 0; i < outputDepth; ++i) {
+        Shape filterChannelShape = filterShape;
+        filterChannelShape.scale = filterScales[i];
+        Shape biasChannelShape = biasShape;
+        biasChannelShape.scale = filterScales[i] * inputShape.scale;
+        double realMultiplier = 0.0;
+        NN_RET_CHECK(GetQuantizedConvolutionMultipler(inputShape, filterChannelShape,
+                                                      biasChannelShape, outputShape,
+                                                      &realMultiplier));
+        int exponent;
+        NN_RET_CHECK(QuantizeMultiplier(realMultiplier, &outputMultiplier[i], &exponent));
+        outputExponent[i] = exponent;
+    }
+    int32_t output_activation_min = 0, output_activation_max = 0;
+    CalculateActivationRangeUint8(activation, outputShape, &output_activation_min,
+                                  &output_activation_max);
+    const int32_t outputOffset = outputShape.offset;
+    NNTRACE_COMP_SWITCH("convNchwImpl");
+    convNchwImpl(inputData, inputShape, filterData, filterShape, biasData, -inputShape.offset, 0,
+                 paddingLeft, paddingTop, strideWidth, strideHeight, dilationWidthFactor,
+                 dilationHeightFactor, outputData, outputShape, threadPool,
+                 [&](uint32_t outChannel, int32_t value) {
+                     value = tflite::MultiplyByQuantizedMultiplier(
+                                     value, outputMultiplier[outChannel],
+                                     outputExponent[outChannel]) +
+                             outputOffset;
+                     return static_cast<uint8_t>(std::max(
+                             std::min(value, output_activation_max), output_activation_min));
+                 });
+    return true;
+}
+
 bool convQuant8PerChannel(const uint8_t* inputData, const Shape& inputShape,
                           const int8_t* filterData, const Shape& filterShape,
                           const float* filterScales, const int32_t* biasData,
@@ -379,18 +856,20 @@ bool convQuant8PerChannel(const uint8_t* inputData, const Shape& inputShape,
                           int32_t paddingTop, int32_t paddingBottom, int32_t strideWidth,
                           int32_t strideHeight, int32_t dilationWidthFactor,
                           int32_t dilationHeightFactor, int32_t activation, bool useNchw,
-                          uint8_t* outputData, const Shape& outputShape) {
-    InputWithLayout<uint8_t> input(useNchw);
-    OutputWithLayout<uint8_t> output(useNchw);
-    NN_RET_CHECK(input.initialize(inputData, inputShape));
-    NN_RET_CHECK(output.initialize(outputData, outputShape));
-    NN_RET_CHECK(convQuant8PerChannelNhwc(
-            input.getNhwcBuffer(), input.getNhwcShape(), filterData, filterShape, filterScales,
-            biasData, biasShape, paddingLeft, paddingRight, paddingTop, paddingBottom, strideWidth,
-            strideHeight, dilationWidthFactor, dilationHeightFactor, activation,
-            output.getNhwcBuffer(), output.getNhwcShape()));
-    NN_RET_CHECK(output.commit());
-    return true;
+                          uint8_t* outputData, const Shape& outputShape, ThreadPool* threadPool) {
+    // The NHWC kernel for per-channel filters is a direct loop too, so NCHW
+    // tensors are not transposed to it.
+    if (useNchw) {
+        return convQuant8PerChannelNchw(inputData, inputShape, filterData, filterShape,
+                                        filterScales, biasData, biasShape, paddingLeft, paddingTop,
+                                        strideWidth, strideHeight, dilationWidthFactor,
+                                        dilationHeightFactor, activation, outputData, outputShape,
+                                        threadPool);
+    }
+    return convQuant8PerChannelNhwc(inputData, inputShape, filterData, filterShape, filterScales,
+                                    biasData, biasShape, paddingLeft, paddingRight, paddingTop,
+                                    paddingBottom, strideWidth, strideHeight, dilationWidthFactor,
+                                    dilationHeightFactor, activation, outputData, outputShape);
 }
 
 #undef ANDROID_NN_CONV_PARAMETERS
@@ -564,7 +1043,7 @@ bool execute(IOperationExecutionContext* context) {
                         param.stride_width, param.stride_height, param.dilation_width_factor,
                         param.dilation_height_factor, param.activation, param.useNchw,
                         context->getOutputBuffer<float>(kOutputTensor),
-                        context->getOutputShape(kOutputTensor));
+                        context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_FLOAT16:
             return conv(context->getInputBuffer<_Float16>(kInputTensor),
                         context->getInputShape(kInputTensor),
@@ -576,7 +1055,7 @@ bool execute(IOperationExecutionContext* context) {
                         param.stride_width, param.stride_height, param.dilation_width_factor,
                         param.dilation_height_factor, param.activation, param.useNchw,
                         context->getOutputBuffer<_Float16>(kOutputTensor),
-                        context->getOutputShape(kOutputTensor));
+                        context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             if (context->getInputType(kFilterTensor) ==
                 OperandType::TENSOR_QUANT8_SYMM_PER_CHANNEL) {
@@ -592,7 +1071,7 @@ bool execute(IOperationExecutionContext* context) {
                         param.stride_width, param.stride_height, param.dilation_width_factor,
                         param.dilation_height_factor, param.activation, param.useNchw,
                         context->getOutputBuffer<uint8_t>(kOutputTensor),
-                        context->getOutputShape(kOutputTensor));
+                        context->getOutputShape(kOutputTensor), context->getThreadPool());
             } else if (context->getInputType(kFilterTensor) == OperandType::TENSOR_QUANT8_ASYMM) {
                 return conv(context->getInputBuffer<uint8_t>(kInputTensor),
                             context->getInputShape(kInputTensor),
@@ -604,7 +1083,7 @@ bool execute(IOperationExecutionContext* context) {
                             param.stride_width, param.stride_height, param.dilation_width_factor,
                             param.dilation_height_factor, param.activation, param.useNchw,
                             context->getOutputBuffer<uint8_t>(kOutputTensor),
-                            context->getOutputShape(kOutputTensor));
+                            context->getOutputShape(kOutputTensor), context->getThreadPool());
             } else {
                 NN_RET_CHECK_FAIL() << "Unsupported filter type for operation " << kOperationName;
             }
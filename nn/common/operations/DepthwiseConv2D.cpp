@@ -16,12 +16,16 @@
 
 #include "CpuOperationUtils.h"
 #include "Operations.h"
+#include "ThreadPool.h"
 
 #include "tensorflow/lite/kernels/internal/optimized/depthwiseconv_float.h"
 #include "tensorflow/lite/kernels/internal/optimized/depthwiseconv_uint8.h"
 
 #include "Tracing.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace android {
 namespace nn {
 
@@ -33,21 +37,64 @@ bool depthwiseConvFloat16(const _Float16* inputData, const Shape& inputShape,
                           int32_t dilationHeightFactor, int32_t depthMultiplier, int32_t activation,
                           _Float16* outputData, const Shape& outputShape) {
     NNTRACE_TRANS("depthwiseConvFloat16");
-    std::vector<float> inputDataFloat32(getNumberOfElements(inputShape));
-    convertFloat16ToFloat32(inputData, &inputDataFloat32);
-    std::vector<float> filterDataFloat32(getNumberOfElements(filterShape));
-    convertFloat16ToFloat32(filterData, &filterDataFloat32);
-    std::vector<float> biasDataFloat32(getNumberOfElements(biasShape));
-    convertFloat16ToFloat32(biasData, &biasDataFloat32);
-
-    std::vector<float> outputDataFloat32(getNumberOfElements(outputShape));
-    depthwiseConvFloat32(inputDataFloat32.data(), inputShape, filterDataFloat32.data(), filterShape,
-                         biasDataFloat32.data(), biasShape, paddingLeft, paddingRight, paddingTop,
-                         paddingBottom, strideWidth, strideHeight, dilationWidthFactor,
-                         dilationHeightFactor, depthMultiplier, activation,
-                         outputDataFloat32.data(), outputShape);
-
-    convertFloat32ToFloat16(outputDataFloat32, outputData);
+    float outputActivationMin, outputActivationMax;
+    CalculateActivationRangeFloat(activation, &outputActivationMin, &outputActivationMax);
+
+    const int32_t batches = getSizeOfDimension(inputShape, 0);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 1);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 2);
+    const int32_t inDepth = getSizeOfDimension(inputShape, 3);
+    const int32_t filterHeight = getSizeOfDimension(filterShape, 1);
+    const int32_t filterWidth = getSizeOfDimension(filterShape, 2);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 1);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 2);
+    const int32_t outDepth = getSizeOfDimension(outputShape, 3);
+
+    // Accumulates one output pixel at a time in float, so that each filter tap
+    // is a contiguous multiply-add over all the output channels.
+    NNTRACE_COMP_SWITCH("depthwiseConvFloat16");
+    std::vector<float> accumulator(outDepth);
+    for (int32_t b = 0; b < batches; b++) {
+        for (int32_t outY = 0; outY < outHeight; outY++) {
+            const int32_t inYOrigin = outY * strideHeight - paddingTop;
+            for (int32_t outX = 0; outX < outWidth; outX++) {
+                const int32_t inXOrigin = outX * strideWidth - paddingLeft;
+                for (int32_t outChannel = 0; outChannel < outDepth; outChannel++) {
+                    accumulator[outChannel] = static_cast<float>(biasData[outChannel]);
+                }
+                for (int32_t filterY = 0; filterY < filterHeight; filterY++) {
+                    const int32_t inY = inYOrigin + filterY * dilationHeightFactor;
+                    if (inY < 0 || inY >= inHeight) {
+                        continue;
+                    }
+                    for (int32_t filterX = 0; filterX < filterWidth; filterX++) {
+                        const int32_t inX = inXOrigin + filterX * dilationWidthFactor;
+                        if (inX < 0 || inX >= inWidth) {
+                            continue;
+                        }
+                        const _Float16* input =
+                                inputData + ((b * inHeight + inY) * inWidth + inX) * inDepth;
+                        const _Float16* filter =
+                                filterData + (filterY * filterWidth + filterX) * outDepth;
+                        for (int32_t inChannel = 0; inChannel < inDepth; inChannel++) {
+                            const float inputValue = static_cast<float>(input[inChannel]);
+                            const int32_t base = inChannel * depthMultiplier;
+                            for (int32_t m = 0; m < depthMultiplier; m++) {
+                                accumulator[base + m] +=
+                                        inputValue * static_cast<float>(filter[base + m]);
+                            }
+                        }
+                    }
+                }
+                _Float16* output =
+                        outputData + ((b * outHeight + outY) * outWidth + outX) * outDepth;
+                for (int32_t outChannel = 0; outChannel < outDepth; outChannel++) {
+                    output[outChannel] = clampToFloat16(accumulator[outChannel],
+                                                        outputActivationMin, outputActivationMax);
+                }
+            }
+        }
+    }
     return true;
 }
 
@@ -241,6 +288,205 @@ bool depthwiseConvQuant8PerChannel(const uint8_t* inputData, const Shape& inputS
     return true;
 }
 
+namespace {
+
+// Outputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+// Computes a depthwise convolution of NCHW tensors one output plane at a time.
+// Output channel c reads input channel c / depthMultiplier: the plane starts
+// from the bias, and every filter tap adds the scaled input plane.  Every
+// plane depends on a single input plane, so there is no GEMM to use; the
+// planes are split across threads instead.
+// finish(outChannel, value) converts an accumulated value to the output type.
+template <typename T_Input, typename T_Filter, typename T_Bias, typename Acc, typename Finish>
+void depthwiseConvNchwImpl(const T_Input* inputData, const Shape& inputShape,
+                           const T_Filter* filterData, const Shape& filterShape,
+                           const T_Bias* biasData, Acc inputOffset, Acc filterOffset,
+                           int32_t paddingLeft, int32_t paddingTop, int32_t strideWidth,
+                           int32_t strideHeight, int32_t dilationWidthFactor,
+                           int32_t dilationHeightFactor, int32_t depthMultiplier,
+                           T_Input* outputData, const Shape& outputShape, ThreadPool* threadPool,
+                           Finish finish) {
+    const uint32_t numBatches = getSizeOfDimension(inputShape, 0);
+    const uint32_t inDepth = getSizeOfDimension(inputShape, 1);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 2);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 3);
+    const int32_t filterHeight = getSizeOfDimension(filterShape, 1);
+    const int32_t filterWidth = getSizeOfDimension(filterShape, 2);
+    const uint32_t outDepth = getSizeOfDimension(outputShape, 1);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 2);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 3);
+    const uint32_t inPlaneSize = inHeight * inWidth;
+    const uint32_t outPlaneSize = outHeight * outWidth;
+
+    // The planes of all batches, in the order of the output.
+    parallelFor(
+            threadPool, 0, numBatches * outDepth, std::max(kMinChunkSize / outPlaneSize, 1u),
+            [&](uint32_t planeBegin, uint32_t planeEnd) {
+                std::vector<Acc> accumulator(outPlaneSize);
+                for (uint32_t plane = planeBegin; plane < planeEnd; plane++) {
+                    const uint32_t b = plane / outDepth;
+                    const uint32_t outChannel = plane % outDepth;
+                    std::fill(accumulator.begin(), accumulator.end(),
+                              static_cast<Acc>(biasData[outChannel]));
+                    const T_Input* inputPlane =
+                            inputData + (b * inDepth + outChannel / depthMultiplier) * inPlaneSize;
+                    for (int32_t filterY = 0; filterY < filterHeight; filterY++) {
+                        for (int32_t filterX = 0; filterX < filterWidth; filterX++) {
+                            const Acc weight = static_cast<Acc>(
+                                                       filterData[(filterY * filterWidth +
+                                                                   filterX) * outDepth +
+                                                                  outChannel]) +
+                                               filterOffset;
+                            accumulateFilterTapNchw(inputPlane, inHeight, inWidth, inputOffset,
+                                                    weight,
+                                                    filterY * dilationHeightFactor - paddingTop,
+                                                    filterX * dilationWidthFactor - paddingLeft,
+                                                    strideHeight, strideWidth, accumulator.data(),
+                                                    outHeight, outWidth);
+                        }
+                    }
+                    T_Input* outputPlane = outputData + plane * outPlaneSize;
+                    for (uint32_t i = 0; i < outPlaneSize; i++) {
+                        outputPlane[i] = finish(outChannel, accumulator[i]);
+                    }
+                }
+            });
+}
+
+template <typename T>
+bool depthwiseConvFloatNchw(const T* inputData, const Shape& inputShape, const T* filterData,
+                            const Shape& filterShape, const T* biasData, int32_t paddingLeft,
+                            int32_t paddingTop, int32_t strideWidth, int32_t strideHeight,
+                            int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                            int32_t depthMultiplier, int32_t activation, T* outputData,
+                            const Shape& outputShape, ThreadPool* threadPool) {
+    float outputActivationMin, outputActivationMax;
+    CalculateActivationRangeFloat(activation, &outputActivationMin, &outputActivationMax);
+    NNTRACE_COMP_SWITCH("depthwiseConvNchwImpl");
+    depthwiseConvNchwImpl(inputData, inputShape, filterData, filterShape, biasData, 0.0f, 0.0f,
+                          paddingLeft, paddingTop, strideWidth, strideHeight, dilationWidthFactor,
+                          dilationHeightFactor, depthMultiplier, outputData, outputShape,
+                          threadPool,
+                          [outputActivationMin, outputActivationMax](uint32_t, float value) {
+                              return static_cast<T>(std::min(std::max(value, outputActivationMin),
+                                                             outputActivationMax));
+                          });
+    return true;
+}
+
+}  // namespace
+
+bool depthwiseConvFloat16Nchw(const _Float16* inputData, const Shape& inputShape,
+                              const _Float16* filterData, const Shape& filterShape,
+                              const _Float16* biasData, const Shape& biasShape,
+                              int32_t paddingLeft, int32_t paddingRight, int32_t paddingTop,
+                              int32_t paddingBottom, int32_t strideWidth, int32_t strideHeight,
+                              int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                              int32_t depthMultiplier, int32_t activation, _Float16* outputData,
+                              const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("depthwiseConvFloat16Nchw");
+    return depthwiseConvFloatNchw(inputData, inputShape, filterData, filterShape, biasData,
+                                  paddingLeft, paddingTop, strideWidth, strideHeight,
+                                  dilationWidthFactor, dilationHeightFactor, depthMultiplier,
+                                  activation, outputData, outputShape, threadPool);
+}
+
+bool depthwiseConvFloat32Nchw(const float* inputData, const Shape& inputShape,
+                              const float* filterData, const Shape& filterShape,
+                              const float* biasData, const Shape& biasShape, int32_t paddingLeft,
+                              int32_t paddingRight, int32_t paddingTop, int32_t paddingBottom,
+                              int32_t strideWidth, int32_t strideHeight,
+                              int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                              int32_t depthMultiplier, int32_t activation, float* outputData,
+                              const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("depthwiseConvFloat32Nchw");
+    return depthwiseConvFloatNchw(inputData, inputShape, filterData, filterShape, biasData,
+                                  paddingLeft, paddingTop, strideWidth, strideHeight,
+                                  dilationWidthFactor, dilationHeightFactor, depthMultiplier,
+                                  activation, outputData, outputShape, threadPool);
+}
+
+bool depthwiseConvQuant8Nchw(const uint8_t* inputData, const Shape& inputShape,
+                             const uint8_t* filterData, const Shape& filterShape,
+                             const int32_t* biasData, const Shape& biasShape, int32_t paddingLeft,
+                             int32_t paddingRight, int32_t paddingTop, int32_t paddingBottom,
+                             int32_t strideWidth, int32_t strideHeight,
+                             int32_t dilationWidthFactor, int32_t dilationHeightFactor,
+                             int32_t depthMultiplier, int32_t activation, uint8_t* outputData,
+                             const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("depthwiseConvQuant8Nchw");
+    double realMultiplier = 0.0;
+    int32_t outputMultiplier = 0;
+    int exponent;
+    NN_RET_CHECK(GetQuantizedConvolutionMultipler(inputShape, filterShape, biasShape, outputShape,
+                                                  &realMultiplier));
+    NN_RET_CHECK(QuantizeMultiplier(realMultiplier, &outputMultiplier, &exponent));
+    int32_t outputActivationMin = 0, outputActivationMax = 0;
+    CalculateActivationRangeUint8(activation, outputShape, &outputActivationMin,
+                                  &outputActivationMax);
+    const int32_t outputOffset = outputShape.offset;
+    NNTRACE_COMP_SWITCH("depthwiseConvNchwImpl");
+    depthwiseConvNchwImpl(
+            inputData, inputShape, filterData, filterShape, biasData, -inputShape.offset,
+            -filterShape.offset, paddingLeft, paddingTop, strideWidth, strideHeight,
+            dilationWidthFactor, dilationHeightFactor, depthMultiplier, outputData, outputShape,
+            threadPool, [&](uint32_t, int32_t value) {
+                value = tflite::MultiplyByQuantizedMultiplier(value, outputMultiplier, exponent) +
+                        outputOffset;
+                return static_cast<uint8_t>(
+                        std::max(std::min(value, outputActivationMax), outputActivationMin));
+            });
+    return true;
+}
+
+bool depthwiseConvQuant8PerChannelNchw(const uint8_t* inputData, const Shape& inputShape,
+                                       const int8_t* filterData, const Shape& filterShape,
+                                       const float* filterScales, const int32_t* biasData,
+                                       const Shape& biasShape, int32_t paddingLeft,
+                                       int32_t paddingRight, int32_t paddingTop,
+                                       int32_t paddingBottom, int32_t strideWidth,
+                                       int32_t strideHeight, int32_t dilationWidthFactor,
+                                       int32_t dilationHeightFactor, int32_t depthMultiplier,
+                                       int32_t activation, uint8_t* outputData,
+                                       const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("depthwiseConvQuant8PerChannelNchw");
+    const uint32_t outputDepth = getSizeOfDimension(outputShape, 1);
+    std::vector<int32_t> outputMultiplier(outputDepth);
+    std::vector<int32_t> outputExponent(outputDepth);
+    for (uint32_t i = 0; i < outputDepth; ++i) {
+        Shape filterChannelShape = filterShape;
+        filterChannelShape.scale = filterScales[i];
+        Shape biasChannelShape = biasShape;
+        biasChannelShape.scale = filterScales[i] * inputShape.scale;
+        double realMultiplier = 0.0;
+        NN_RET_CHECK(GetQuantizedConvolutionMultipler(inputShape, filterChannelShape,
+                                                      biasChannelShape, outputShape,
+                                                      &realMultiplier));
+        int exponent;
+        NN_RET_CHECK(QuantizeMultiplier(realMultiplier, &outputMultiplier[i], &exponent));
+        outputExponent[i] = exponent;
+    }
+    int32_t outputActivationMin = 0, outputActivationMax = 0;
+    CalculateActivationRangeUint8(activation, outputShape, &outputActivationMin,
+                                  &outputActivationMax);
+    const int32_t outputOffset = outputShape.offset;
+    NNTRACE_COMP_SWITCH("depthwiseConvNchwImpl");
+    depthwiseConvNchwImpl(
+            inputData, inputShape, filterData, filterShape, biasData, -inputShape.offset, 0,
+            paddingLeft, paddingTop, strideWidth, strideHeight, dilationWidthFactor,
+            dilationHeightFactor, depthMultiplier, outputData, outputShape, threadPool,
+            [&](uint32_t outChannel, int32_t value) {
+                value = tflite::MultiplyByQuantizedMultiplier(value, outputMultiplier[outChannel],
+                                                              outputExponent[outChannel]) +
+                        outputOffset;
+                return static_cast<uint8_t>(
+                        std::max(std::min(value, outputActivationMax), outputActivationMin));
+            });
+    return true;
+}
+
 #undef ANDROID_NN_DEPTHWISE_CONV_PARAMETERS
 }  // namespace nn
 }  // namespace android
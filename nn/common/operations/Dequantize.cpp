@@ -18,8 +18,11 @@
 #define LOG_TAG "Operations"
 
 #include "HalInterfaces.h"
-#include "IndexedShapeWrapper.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
+#include "Tracing.h"
+
+#include <algorithm>
 
 namespace android {
 namespace nn {
@@ -33,42 +36,53 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
 template <typename InputType, typename OutputType>
-bool compute(const InputType* inputData, const Shape& inputShape, OutputType* outputData) {
-    const int numElements = getNumberOfElements(inputShape);
-    const int32_t zeroPoint = inputShape.offset;
-    const float scale = inputShape.scale;
-    for (int i = 0; i < numElements; ++i) {
+void dequantize(const InputType* inputData, OutputType* outputData, uint32_t size, float scale,
+                int32_t zeroPoint) {
+    for (uint32_t i = 0; i < size; ++i) {
         const int32_t value = inputData[i];
         outputData[i] = static_cast<OutputType>(scale * (value - zeroPoint));
     }
+}
+
+template <typename InputType, typename OutputType>
+bool compute(const InputType* inputData, const Shape& inputShape, OutputType* outputData,
+             ThreadPool* threadPool) {
+    NNTRACE_COMP("dequantize::compute");
+    const int32_t zeroPoint = inputShape.offset;
+    const float scale = inputShape.scale;
+    parallelFor(threadPool, 0, getNumberOfElements(inputShape), kMinChunkSize,
+                [&](uint32_t begin, uint32_t end) {
+                    dequantize(inputData + begin, outputData + begin, end - begin, scale,
+                               zeroPoint);
+                });
     return true;
 }
 
 template <typename OutputType>
-bool computePerChannel(const int8_t* inputData, const Shape& inputShape, OutputType* outputData) {
-    // First we calculate a stride which is the number of elements we need to
-    // skip to change an index along a dimension with different quantization
-    // scales.
-    const int channelDim = inputShape.extraParams.channelQuant().channelDim;
-    int stride = 1;
-    for (int i = getNumberOfDimensions(inputShape) - 1; i > channelDim; --i) {
-        stride *= getSizeOfDimension(inputShape, i);
-    }
-
-    const int numElements = getNumberOfElements(inputShape);
+bool computePerChannel(const int8_t* inputData, const Shape& inputShape, OutputType* outputData,
+                       ThreadPool* threadPool) {
+    NNTRACE_COMP("dequantize::computePerChannel");
+    // The input is a sequence of rows of |innerSize| elements, each with the
+    // scale of its channel, which is the row index modulo the number of
+    // channels.
+    const auto& channelQuant = inputShape.extraParams.channelQuant();
+    const uint32_t channelDim = channelQuant.channelDim;
+    const uint32_t numChannels = getSizeOfDimension(inputShape, channelDim);
+    const uint32_t innerSize = getNumberOfElements(inputShape, channelDim + 1,
+                                                   getNumberOfDimensions(inputShape));
+    const uint32_t numRows = getNumberOfElements(inputShape) / innerSize;
     const int32_t zeroPoint = inputShape.offset;
-
-    for (int i = 0; i < numElements; ++i) {
-        // To get current index along the quantized dimension we calculate how
-        // many even |strides| we looped through and take this number modulo the
-        // size of the dimension (so that we don't have an overflow if the
-        // channelDim is not 0).
-        const int scaleIndex = (i / stride) % getSizeOfDimension(inputShape, channelDim);
-        const float scale = inputShape.extraParams.channelQuant().scales[scaleIndex];
-        const int32_t value = inputData[i];
-        outputData[i] = static_cast<OutputType>(scale * (value - zeroPoint));
-    }
+    parallelFor(threadPool, 0, numRows, std::max(kMinChunkSize / innerSize, 1u),
+                [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t row = begin; row < end; ++row) {
+                        dequantize(inputData + row * innerSize, outputData + row * innerSize,
+                                   innerSize, channelQuant.scales[row % numChannels], zeroPoint);
+                    }
+                });
     return true;
 }
 
@@ -115,26 +129,32 @@ bool execute(IOperationExecutionContext* context) {
         const uint8_t* inputBuffer = context->getInputBuffer<uint8_t>(kInputTensor);
         if (outputType == OperandType::TENSOR_FLOAT16) {
             return compute(inputBuffer, inputShape,
-                           context->getOutputBuffer<_Float16>(kOutputTensor));
+                           context->getOutputBuffer<_Float16>(kOutputTensor),
+                           context->getThreadPool());
         } else if (outputType == OperandType::TENSOR_FLOAT32) {
-            return compute(inputBuffer, inputShape, context->getOutputBuffer<float>(kOutputTensor));
+            return compute(inputBuffer, inputShape, context->getOutputBuffer<float>(kOutputTensor),
+                           context->getThreadPool());
         }
     } else if (inputType == OperandType::TENSOR_QUANT8_SYMM) {
         const int8_t* inputBuffer = context->getInputBuffer<int8_t>(kInputTensor);
         if (outputType == OperandType::TENSOR_FLOAT16) {
             return compute(inputBuffer, inputShape,
-                           context->getOutputBuffer<_Float16>(kOutputTensor));
+                           context->getOutputBuffer<_Float16>(kOutputTensor),
+                           context->getThreadPool());
         } else if (outputType == OperandType::TENSOR_FLOAT32) {
-            return compute(inputBuffer, inputShape, context->getOutputBuffer<float>(kOutputTensor));
+            return compute(inputBuffer, inputShape, context->getOutputBuffer<float>(kOutputTensor),
+                           context->getThreadPool());
         }
     } else if (inputType == OperandType::TENSOR_QUANT8_SYMM_PER_CHANNEL) {
         const int8_t* inputBuffer = context->getInputBuffer<int8_t>(kInputTensor);
         if (outputType == OperandType::TENSOR_FLOAT16) {
             return computePerChannel(inputBuffer, inputShape,
-                                     context->getOutputBuffer<_Float16>(kOutputTensor));
+                                     context->getOutputBuffer<_Float16>(kOutputTensor),
+                                     context->getThreadPool());
         } else if (outputType == OperandType::TENSOR_FLOAT32) {
             return computePerChannel(inputBuffer, inputShape,
-                                     context->getOutputBuffer<float>(kOutputTensor));
+                                     context->getOutputBuffer<float>(kOutputTensor),
+                                     context->getThreadPool());
         }
     }
     NN_RET_CHECK_FAIL() << "Unsupported tensor types combination for dequantize op. (input type: "
@@ -19,7 +19,9 @@
 #include "HalInterfaces.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 #include "Tracing.h"
+#include "VectorMath.h"
 
 #include <cmath>
 
@@ -35,30 +37,46 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-template <typename T>
-inline bool compute(float func(float), const T* input, const Shape& shape, T* output) {
-    const auto size = getNumberOfElements(shape);
-    for (uint32_t i = 0; i < size; ++i) {
-        output[i] = static_cast<T>(func(static_cast<float>(input[i])));
-    }
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+template <typename T, typename Kernel>
+inline bool compute(Kernel kernel, const T* input, const Shape& shape, T* output,
+                    ThreadPool* threadPool) {
+    parallelFor(threadPool, 0, getNumberOfElements(shape), kMinChunkSize,
+                [&](uint32_t begin, uint32_t end) {
+                    kernel(input + begin, output + begin, end - begin);
+                });
     return true;
 }
 
-bool execute(IOperationExecutionContext* context, float func(float)) {
+// The kernel is called with input and output pointers and a number of
+// elements, for the input type.
+template <typename Kernel>
+bool execute(IOperationExecutionContext* context, Kernel kernel) {
     switch (context->getInputType(kInputTensor)) {
         case OperandType::TENSOR_FLOAT16:
-            return compute(func, context->getInputBuffer<_Float16>(kInputTensor),
+            return compute(kernel, context->getInputBuffer<_Float16>(kInputTensor),
                            context->getInputShape(kInputTensor),
-                           context->getOutputBuffer<_Float16>(kOutputTensor));
+                           context->getOutputBuffer<_Float16>(kOutputTensor),
+                           context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
-            return compute(func, context->getInputBuffer<float>(kInputTensor),
+            return compute(kernel, context->getInputBuffer<float>(kInputTensor),
                            context->getInputShape(kInputTensor),
-                           context->getOutputBuffer<float>(kOutputTensor));
+                           context->getOutputBuffer<float>(kOutputTensor),
+                           context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for elementwise operation";
     }
 }
 
+template <typename Function>
+bool executeMap(IOperationExecutionContext* context, Function function) {
+    return execute(context, [function](auto input, auto output, uint32_t size) {
+        vector_math::map(input, output, size, function);
+    });
+}
+
 }  // namespace
 
 bool validate(const IOperationValidationContext* context) {
@@ -81,27 +99,29 @@ bool prepare(IOperationExecutionContext* context) {
 }
 
 bool executeAbs(IOperationExecutionContext* context) {
-    return execute(context, std::abs);
+    return executeMap(context, [](float x) { return std::abs(x); });
 }
 
 bool executeExp(IOperationExecutionContext* context) {
-    return execute(context, std::exp);
+    return executeMap(context, [](float x) { return vector_math::exp(x); });
 }
 
 bool executeLog(IOperationExecutionContext* context) {
-    return execute(context, std::log);
+    return executeMap(context, [](float x) { return vector_math::log(x); });
 }
 
 bool executeRsqrt(IOperationExecutionContext* context) {
-    return execute(context, [](float x) { return 1.f / std::sqrt(x); });
+    return executeMap(context, [](float x) { return 1.f / std::sqrt(x); });
 }
 
 bool executeSin(IOperationExecutionContext* context) {
-    return execute(context, std::sin);
+    return execute(context, [](auto input, auto output, uint32_t size) {
+        vector_math::mapSin(input, output, size);
+    });
 }
 
 bool executeSqrt(IOperationExecutionContext* context) {
-    return execute(context, std::sqrt);
+    return executeMap(context, [](float x) { return std::sqrt(x); });
 }
 
 }  // namespace elementwise
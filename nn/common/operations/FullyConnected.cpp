@@ -39,11 +39,6 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-// executionMutex is used to protect concurrent access of non-threadsafe resources
-// like gemmlowp::GemmContext.
-// std::mutex is safe for pthreads on Android.
-static std::mutex executionMutex;
-
 bool fullyConnectedFloat32(const float* inputData, const Shape& inputShape,
                            const float* weightsData, const Shape& weightsShape,
                            const float* biasData, const Shape& biasShape, int32_t activation,
@@ -79,19 +74,22 @@ bool fullyConnectedFloat16(const _Float16* inputData, const Shape& inputShape,
                            const _Float16* biasData, const Shape& biasShape, int32_t activation,
                            _Float16* outputData, const Shape& outputShape) {
     NNTRACE_TRANS("fullyConnectedFloat16");
-    std::vector<float> inputDataFloat32(getNumberOfElements(inputShape));
-    convertFloat16ToFloat32(inputData, &inputDataFloat32);
-    std::vector<float> weightsDataFloat32(getNumberOfElements(weightsShape));
-    convertFloat16ToFloat32(weightsData, &weightsDataFloat32);
-    std::vector<float> biasDataFloat32(getNumberOfElements(biasShape));
-    convertFloat16ToFloat32(biasData, &biasDataFloat32);
-
-    std::vector<float> outputDataFloat32(getNumberOfElements(outputShape));
-    fullyConnectedFloat32(inputDataFloat32.data(), inputShape, weightsDataFloat32.data(),
-                          weightsShape, biasDataFloat32.data(), biasShape, activation,
-                          outputDataFloat32.data(), outputShape);
-    convertFloat32ToFloat16(outputDataFloat32, outputData);
+    float output_activation_min, output_activation_max;
+    CalculateActivationRangeFloat(activation, &output_activation_min, &output_activation_max);
 
+    const uint32_t batchSize = getSizeOfDimension(outputShape, 0);
+    const uint32_t numUnits = getSizeOfDimension(weightsShape, 0);
+    const uint32_t inputSize = getSizeOfDimension(weightsShape, 1);
+    NNTRACE_COMP_SWITCH("fullyConnectedFloat16");
+    for (uint32_t b = 0; b < batchSize; b++) {
+        const _Float16* input = inputData + b * inputSize;
+        _Float16* output = outputData + b * numUnits;
+        for (uint32_t u = 0; u < numUnits; u++) {
+            const float sum = static_cast<float>(biasData[u]) +
+                              dotProductFloat16(input, weightsData + u * inputSize, inputSize);
+            output[u] = clampToFloat16(sum, output_activation_min, output_activation_max);
+        }
+    }
     return true;
 }
 
@@ -118,20 +116,13 @@ bool fullyConnectedQuant8(const uint8_t* inputData, const Shape& inputShape,
     CalculateActivationRangeUint8(activation, outputShape, &outputActivationMin,
                                   &outputActivationMax);
 
-    static gemmlowp::GemmContext gemmContext;
-
-    // Prevent concurrent executions that access gemmContext.
-    std::unique_lock<std::mutex> lock(executionMutex);
-    // Alow gemmlowp automatically decide how many threads to use.
-    gemmContext.set_max_num_threads(0);
-
     NNTRACE_COMP_SWITCH("optimized_ops::FullyConnected");
     tflite::optimized_ops::FullyConnected(inputData, convertShapeToDims(inputShape), inputOffset,
                                           weightsData, convertShapeToDims(weightsShape),
                                           weightsOffset, biasData, convertShapeToDims(biasShape),
                                           outputOffset, outputMultiplier, outputShift,
                                           outputActivationMin, outputActivationMax, outputData,
-                                          convertShapeToDims(outputShape), &gemmContext);
+                                          convertShapeToDims(outputShape), getThreadGemmContext());
 
     return true;
 }
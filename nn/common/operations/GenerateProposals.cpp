@@ -17,10 +17,14 @@
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <limits>
 #include <numeric>
+#include <vector>
 
 #include "Tracing.h"
 
@@ -49,6 +53,20 @@ BoxEncodingCenter toBoxEncodingCenter(const BoxEncodingCorner& cnr) {
             .y = (cnr.y1 + cnr.y2) / 2};
 }
 
+// Applies the deltas (dx, dy, dw, dh) to a box and clips the result to the
+// image, writing it to out as (x1, y1, x2, y2).
+inline void transformBox(const BoxEncodingCenter& roiBefore, float dx, float dy, float dw,
+                         float dh, float imageHeight, float imageWidth, float* out) {
+    auto roiAfter = toBoxEncodingCorner({.w = std::exp(dw) * roiBefore.w,
+                                         .h = std::exp(dh) * roiBefore.h,
+                                         .x = roiBefore.x + dx * roiBefore.w,
+                                         .y = roiBefore.y + dy * roiBefore.h});
+    out[0] = std::min(std::max(roiAfter.x1, 0.0f), imageWidth);
+    out[1] = std::min(std::max(roiAfter.y1, 0.0f), imageHeight);
+    out[2] = std::min(std::max(roiAfter.x2, 0.0f), imageWidth);
+    out[3] = std::min(std::max(roiAfter.y2, 0.0f), imageHeight);
+}
+
 inline bool bboxTransformFloat32(const float* roiData, const Shape& roiShape,
                                  const float* bboxDeltasData, const Shape& bboxDeltasShape,
                                  const int32_t* batchesData, const Shape& batchesShape,
@@ -80,18 +98,8 @@ inline bool bboxTransformFloat32(const float* roiData, const Shape& roiShape,
         auto roiBefore = toBoxEncodingCenter(
                 {.x1 = roiBase[0], .y1 = roiBase[1], .x2 = roiBase[2], .y2 = roiBase[3]});
         for (uint32_t i = 0; i < numClasses; i++) {
-            auto roiAfter = toBoxEncodingCorner({.w = std::exp(deltas[2]) * roiBefore.w,
-                                                 .h = std::exp(deltas[3]) * roiBefore.h,
-                                                 .x = roiBefore.x + deltas[0] * roiBefore.w,
-                                                 .y = roiBefore.y + deltas[1] * roiBefore.h});
-            BoxEncodingCorner cliped = {.x1 = std::min(std::max(roiAfter.x1, 0.0f), imageWidth),
-                                        .y1 = std::min(std::max(roiAfter.y1, 0.0f), imageHeight),
-                                        .x2 = std::min(std::max(roiAfter.x2, 0.0f), imageWidth),
-                                        .y2 = std::min(std::max(roiAfter.y2, 0.0f), imageHeight)};
-            outPtr[0] = cliped.x1;
-            outPtr[1] = cliped.y1;
-            outPtr[2] = cliped.x2;
-            outPtr[3] = cliped.y2;
+            transformBox(roiBefore, deltas[0], deltas[1], deltas[2], deltas[3], imageHeight,
+                         imageWidth, outPtr);
             deltas += roiLength;
             outPtr += roiLength;
         }
@@ -141,21 +149,6 @@ inline bool bboxTransformQuant(const uint16_t* roiData, const Shape& roiShape,
     return true;
 }
 
-// Taking two indices of bounding boxes, return the intersection-of-union.
-float getIoUAxisAligned(const float* roi1, const float* roi2) {
-    const float area1 = (roi1[2] - roi1[0]) * (roi1[3] - roi1[1]);
-    const float area2 = (roi2[2] - roi2[0]) * (roi2[3] - roi2[1]);
-    const float x1 = std::max(roi1[0], roi2[0]);
-    const float x2 = std::min(roi1[2], roi2[2]);
-    const float y1 = std::max(roi1[1], roi2[1]);
-    const float y2 = std::min(roi1[3], roi2[3]);
-    const float w = std::max(x2 - x1, 0.0f);
-    const float h = std::max(y2 - y1, 0.0f);
-    const float areaIntersect = w * h;
-    const float areaUnion = area1 + area2 - areaIntersect;
-    return areaIntersect / areaUnion;
-}
-
 }  // namespace
 
 namespace axis_aligned_bbox_transform {
@@ -301,133 +294,228 @@ constexpr uint32_t kOutputBatchesTensor = 3;
 
 namespace {
 
-// TODO(xusongw): Reduce code duplication with hard/soft nms path.
+// The number of candidates hard NMS sorts at a time is at least kMinNmsBlockSize.
+constexpr uint32_t kMinNmsBlockSize = 64;
+
+// The boxes of NMS candidates in structure-of-arrays layout with their areas
+// precomputed, so that the IoU of one box against a range of candidates is a
+// loop the compiler can vectorize.
+class NmsBoxes {
+   public:
+    explicit NmsBoxes(uint32_t size)
+        : mX1(size), mY1(size), mX2(size), mY2(size), mArea(size) {}
+
+    void set(uint32_t i, const float* roi) {
+        mX1[i] = roi[0];
+        mY1[i] = roi[1];
+        mX2[i] = roi[2];
+        mY2[i] = roi[3];
+        mArea[i] = (roi[2] - roi[0]) * (roi[3] - roi[1]);
+    }
+
+    void swap(uint32_t i, uint32_t j) {
+        std::swap(mX1[i], mX1[j]);
+        std::swap(mY1[i], mY1[j]);
+        std::swap(mX2[i], mX2[j]);
+        std::swap(mY2[i], mY2[j]);
+        std::swap(mArea[i], mArea[j]);
+    }
+
+    // Writes the IoU of box i with each of the boxes [begin, end) to iou.
+    void computeIoU(uint32_t i, uint32_t begin, uint32_t end, float* iou) const {
+        const float x1 = mX1[i], y1 = mY1[i], x2 = mX2[i], y2 = mY2[i], area = mArea[i];
+        for (uint32_t j = begin; j < end; j++) {
+            const float w = std::max(std::min(mX2[j], x2) - std::max(mX1[j], x1), 0.0f);
+            const float h = std::max(std::min(mY2[j], y2) - std::max(mY1[j], y1), 0.0f);
+            const float areaIntersect = w * h;
+            iou[j - begin] = areaIntersect / (mArea[j] + area - areaIntersect);
+        }
+    }
+
+   private:
+    std::vector<float> mX1, mY1, mX2, mY2, mArea;
+};
 
 // Inplace hard NMS within range [select, select + selectLength).
+//
+// Candidates are visited in descending order of score.  Only the blocks of
+// candidates that are needed to find maxNumDetections boxes are sorted: each
+// block is taken from the rest with std::nth_element, first suppressed by the
+// boxes already kept and then by each other.
 uint32_t* hardNmsSingleClass(const float* scoresData, float iouThreshold, int32_t maxNumDetections,
                              std::function<const float*(uint32_t)> getRoiBase, uint32_t* select,
                              uint32_t selectLength) {
-    uint32_t *selectStart = select, *selectEnd = select + selectLength, numDetections = 0;
-    if (maxNumDetections < 0) {
-        maxNumDetections = selectLength;
+    uint32_t maxNumKept = selectLength;
+    if (maxNumDetections >= 0) {
+        maxNumKept = std::min<uint32_t>(maxNumDetections, selectLength);
     }
-    while (selectStart < selectEnd && numDetections < maxNumDetections) {
-        // find max score and swap to the front
-        auto& maxScore = *std::max_element(selectStart, selectEnd,
-                                           [&scoresData](const uint32_t& lhs, const uint32_t& rhs) {
-                                               return scoresData[lhs] < scoresData[rhs];
-                                           });
-        std::swap(maxScore, *selectStart);
-
-        // Calculate IoU of the rest, swap to the end (disgard) if needed.
-        for (uint32_t* i = selectStart + 1; i < selectEnd; i++) {
-            float iou = getIoUAxisAligned(getRoiBase(*i), getRoiBase(*selectStart));
-            if (iou >= iouThreshold) {
-                std::swap(*i--, *(--selectEnd));
-            }
+    const auto higherScore = [scoresData](uint32_t lhs, uint32_t rhs) {
+        return scoresData[lhs] > scoresData[rhs] ||
+               (scoresData[lhs] == scoresData[rhs] && lhs < rhs);
+    };
+
+    NmsBoxes boxes(selectLength);
+    std::vector<uint8_t> suppressed(selectLength, 0);
+    std::vector<float> iou(selectLength);
+    std::vector<uint32_t> kept;
+    const auto suppress = [&](uint32_t i, uint32_t begin, uint32_t end) {
+        boxes.computeIoU(i, begin, end, iou.data());
+        for (uint32_t j = begin; j < end; j++) {
+            suppressed[j] |= iou[j - begin] >= iouThreshold;
+        }
+    };
+
+    uint32_t numDetections = 0;
+    uint32_t blockSize = std::max(kMinNmsBlockSize, 2 * maxNumKept);
+    for (uint32_t blockBegin = 0; blockBegin < selectLength && numDetections < maxNumKept;
+         blockBegin += blockSize, blockSize *= 2) {
+        const uint32_t blockEnd = std::min(selectLength, blockBegin + blockSize);
+        if (blockEnd < selectLength) {
+            std::nth_element(select + blockBegin, select + blockEnd, select + selectLength,
+                             higherScore);
+        }
+        std::sort(select + blockBegin, select + blockEnd, higherScore);
+        for (uint32_t i = blockBegin; i < blockEnd; i++) {
+            boxes.set(i, getRoiBase(select[i]));
+        }
+        for (uint32_t i : kept) {
+            suppress(i, blockBegin, blockEnd);
+        }
+        for (uint32_t i = blockBegin; i < blockEnd && numDetections < maxNumKept; i++) {
+            if (suppressed[i]) continue;
+            kept.push_back(i);
+            // Kept boxes are compacted to the front; their boxes stay at i.
+            select[numDetections++] = select[i];
+            suppress(i, i + 1, blockEnd);
         }
-        selectStart++;
-        numDetections++;
     }
-    return selectStart;
+    return select + numDetections;
 }
 
-void hardNmsMultiClass(const float* scoresData, uint32_t numClasses, uint32_t numRois,
-                       float scoreThreshold, float iouThreshold, int32_t maxNumDetections,
-                       int32_t maxNumDetectionsPerClass,
-                       std::function<const float*(uint32_t)> getRoiBase,
-                       std::vector<uint32_t>* select) {
+// Runs nms(select, selectLength), an inplace NMS of a single class returning
+// the end of the selected range, on the boxes of every class but the
+// background scoring above scoreThreshold.  Classes are independent and are
+// split among the threads of the pool.  Returns the top maxNumDetections
+// boxes of all classes in descending order of score.
+template <typename SingleClassNms>
+void nmsMultiClass(const float* scoresData, uint32_t numClasses, uint32_t numRois,
+                   float scoreThreshold, int32_t maxNumDetections, ThreadPool* threadPool,
+                   SingleClassNms nms, std::vector<uint32_t>* select) {
+    std::vector<std::vector<uint32_t>> classSelect(numClasses);
     // Exclude class 0 (background)
-    for (uint32_t c = 1; c < numClasses; c++) {
-        uint32_t size = select->size();
-        for (uint32_t b = 0; b < numRois; b++) {
-            const uint32_t index = b * numClasses + c;
-            const float score = scoresData[index];
-            if (score > scoreThreshold) {
-                select->push_back(index);
+    parallelFor(threadPool, 1, numClasses, 1, [&](uint32_t classBegin, uint32_t classEnd) {
+        for (uint32_t c = classBegin; c < classEnd; c++) {
+            std::vector<uint32_t>& candidates = classSelect[c];
+            for (uint32_t b = 0; b < numRois; b++) {
+                const uint32_t index = b * numClasses + c;
+                const float score = scoresData[index];
+                if (score > scoreThreshold) {
+                    candidates.push_back(index);
+                }
             }
+            uint32_t* selectEnd = nms(candidates.data(), candidates.size());
+            candidates.resize(selectEnd - candidates.data());
         }
-        uint32_t* selectStart = select->data() + size;
-        uint32_t selectLength = select->size() - size;
-        uint32_t* selectEnd = hardNmsSingleClass(scoresData, iouThreshold, maxNumDetectionsPerClass,
-                                                 getRoiBase, selectStart, selectLength);
-        select->resize(selectEnd - select->data());
+    });
+    for (uint32_t c = 1; c < numClasses; c++) {
+        select->insert(select->end(), classSelect[c].begin(), classSelect[c].end());
     }
 
     // Take top maxNumDetections.
-    std::sort(select->begin(), select->end(),
-              [&scoresData](const uint32_t& lhs, const uint32_t& rhs) {
-                  return scoresData[lhs] > scoresData[rhs];
-              });
+    // Ties go to the lower index, so that the detections kept do not depend on
+    // the order in which the classes were processed.
+    const auto higherScore = [&scoresData](const uint32_t& lhs, const uint32_t& rhs) {
+        return scoresData[lhs] > scoresData[rhs] ||
+               (scoresData[lhs] == scoresData[rhs] && lhs < rhs);
+    };
     if (maxNumDetections < 0 || select->size() <= maxNumDetections) {
+        std::sort(select->begin(), select->end(), higherScore);
         return;
     }
+    std::partial_sort(select->begin(), select->begin() + maxNumDetections, select->end(),
+                      higherScore);
     select->resize(maxNumDetections);
 }
 
+void hardNmsMultiClass(const float* scoresData, uint32_t numClasses, uint32_t numRois,
+                       float scoreThreshold, float iouThreshold, int32_t maxNumDetections,
+                       int32_t maxNumDetectionsPerClass,
+                       std::function<const float*(uint32_t)> getRoiBase, ThreadPool* threadPool,
+                       std::vector<uint32_t>* select) {
+    nmsMultiClass(scoresData, numClasses, numRois, scoreThreshold, maxNumDetections, threadPool,
+                  [&](uint32_t* classSelect, uint32_t classSelectLength) {
+                      return hardNmsSingleClass(scoresData, iouThreshold,
+                                                maxNumDetectionsPerClass, getRoiBase,
+                                                classSelect, classSelectLength);
+                  },
+                  select);
+}
+
 // Inplace soft NMS within range [select, select + selectLength).
-using SoftNmsKernel = std::function<float(float)>;
+//
+// kernel(iou) is the factor that decays the score of a candidate with the given
+// IoU with the box just selected.  The boxes and scores of the candidates are
+// kept in structure-of-arrays layout in the same order as select, so that the
+// scores of all remaining candidates are decayed in one pass.  The decayed
+// scores are written back to scoresData.
+template <typename SoftNmsKernel>
 uint32_t* softNmsSingleClass(float* scoresData, float scoreThreshold, int32_t maxNumDetections,
                              std::function<const float*(uint32_t)> getRoiBase, SoftNmsKernel kernel,
                              uint32_t* select, uint32_t selectLength) {
-    uint32_t *selectStart = select, *selectEnd = select + selectLength, numDetections = 0;
     if (maxNumDetections < 0) {
         maxNumDetections = selectLength;
     }
+    NmsBoxes boxes(selectLength);
+    std::vector<float> scores(selectLength), iou(selectLength);
+    for (uint32_t i = 0; i < selectLength; i++) {
+        boxes.set(i, getRoiBase(select[i]));
+        scores[i] = scoresData[select[i]];
+    }
+    const auto swapCandidates = [&](uint32_t i, uint32_t j) {
+        std::swap(select[i], select[j]);
+        std::swap(scores[i], scores[j]);
+        boxes.swap(i, j);
+    };
+
+    uint32_t selectStart = 0, selectEnd = selectLength, numDetections = 0;
     while (selectStart < selectEnd && numDetections < maxNumDetections) {
         // find max score and swap to the front
-        auto& maxScore = *std::max_element(selectStart, selectEnd,
-                                           [&scoresData](const uint32_t& lhs, const uint32_t& rhs) {
-                                               return scoresData[lhs] < scoresData[rhs];
-                                           });
-        std::swap(maxScore, *selectStart);
-
-        // Calculate IoU of the rest, swap to the end (disgard) if needed.
-        for (uint32_t* i = selectStart + 1; i < selectEnd; i++) {
-            float iou = getIoUAxisAligned(getRoiBase(*i), getRoiBase(*selectStart));
-            scoresData[*i] *= kernel(iou);
-            if (scoresData[*i] < scoreThreshold) {
-                std::swap(*i--, *(--selectEnd));
+        const uint32_t best =
+                std::max_element(scores.begin() + selectStart, scores.begin() + selectEnd) -
+                scores.begin();
+        swapCandidates(best, selectStart);
+
+        // Decay the scores of the rest, swap to the end (disgard) if needed.
+        const uint32_t restStart = selectStart + 1;
+        boxes.computeIoU(selectStart, restStart, selectEnd, iou.data());
+        for (uint32_t i = restStart; i < selectEnd; i++) {
+            scores[i] *= kernel(iou[i - restStart]);
+            scoresData[select[i]] = scores[i];
+        }
+        for (uint32_t i = restStart; i < selectEnd; i++) {
+            if (scores[i] < scoreThreshold) {
+                swapCandidates(i--, --selectEnd);
             }
         }
         selectStart++;
         numDetections++;
     }
-    return selectStart;
+    return select + selectStart;
 }
 
+template <typename SoftNmsKernel>
 void softNmsMultiClass(float* scoresData, uint32_t numClasses, uint32_t numRois,
                        float scoreThreshold, float nmsScoreThreshold, int32_t maxNumDetections,
                        int32_t maxNumDetectionsPerClass,
                        std::function<const float*(uint32_t)> getRoiBase, SoftNmsKernel kernel,
-                       std::vector<uint32_t>* select) {
-    // Exclude class 0 (background)
-    for (uint32_t c = 1; c < numClasses; c++) {
-        uint32_t size = select->size();
-        for (uint32_t b = 0; b < numRois; b++) {
-            const uint32_t index = b * numClasses + c;
-            const float score = scoresData[index];
-            if (score > scoreThreshold) {
-                select->push_back(index);
-            }
-        }
-        uint32_t* selectStart = select->data() + size;
-        uint32_t selectLength = select->size() - size;
-        uint32_t* selectEnd =
-                softNmsSingleClass(scoresData, nmsScoreThreshold, maxNumDetectionsPerClass,
-                                   getRoiBase, kernel, selectStart, selectLength);
-        select->resize(selectEnd - select->data());
-    }
-
-    // Take top maxNumDetections.
-    std::sort(select->begin(), select->end(),
-              [&scoresData](const uint32_t& lhs, const uint32_t& rhs) {
-                  return scoresData[lhs] > scoresData[rhs];
-              });
-    if (maxNumDetections < 0 || select->size() <= maxNumDetections) {
-        return;
-    }
-    select->resize(maxNumDetections);
+                       ThreadPool* threadPool, std::vector<uint32_t>* select) {
+    nmsMultiClass(scoresData, numClasses, numRois, scoreThreshold, maxNumDetections, threadPool,
+                  [&](uint32_t* classSelect, uint32_t classSelectLength) {
+                      return softNmsSingleClass(scoresData, nmsScoreThreshold,
+                                                maxNumDetectionsPerClass, getRoiBase, kernel,
+                                                classSelect, classSelectLength);
+                  },
+                  select);
 }
 
 bool boxWithNmsLimitFloat32Compute(float* scoresData, const Shape& scoresShape,
@@ -437,17 +525,9 @@ bool boxWithNmsLimitFloat32Compute(float* scoresData, const Shape& scoresShape,
                                    int32_t softNmsKernel, float iouThreshold, float sigma,
                                    float nmsScoreThreshold, std::vector<uint32_t>* batchSplitIn,
                                    std::vector<uint32_t>* batchSplitOut,
-                                   std::vector<uint32_t>* selected) {
-    SoftNmsKernel kernel = nullptr;
-    if (softNmsKernel == 0) {
-        kernel = [&iouThreshold](float iou) { return iou < iouThreshold ? 1.0f : 0.0f; };
-    } else if (softNmsKernel == 1) {
-        kernel = [&iouThreshold](float iou) { return iou < iouThreshold ? 1.0f : 1.0f - iou; };
-    } else if (softNmsKernel == 2) {
-        kernel = [&sigma](float iou) { return std::exp(-1.0f * iou * iou / sigma); };
-    } else {
-        NN_RET_CHECK_FAIL() << "Unsupported soft NMS kernel " << softNmsKernel;
-    }
+                                   std::vector<uint32_t>* selected, ThreadPool* threadPool) {
+    NN_RET_CHECK(softNmsKernel >= 0 && softNmsKernel <= 2)
+            << "Unsupported soft NMS kernel " << softNmsKernel;
 
     const uint32_t kRoiDim = 4;
     uint32_t numRois = getSizeOfDimension(scoresShape, 0);
@@ -475,10 +555,19 @@ bool boxWithNmsLimitFloat32Compute(float* scoresData, const Shape& scoresShape,
             NN_RET_CHECK_LE(roi[1], roi[3]);
         }
         std::vector<uint32_t> result;
-        softNmsMultiClass(scoresBase, numClasses, batchSplitIn->at(b), scoreThreshold,
-                          nmsScoreThreshold, maxNumDetections, maxNumDetections,
-                          [&roiBase](uint32_t ind) { return roiBase + ind * kRoiDim; }, kernel,
-                          &result);
+        auto softNms = [&](auto kernel) {
+            softNmsMultiClass(scoresBase, numClasses, batchSplitIn->at(b), scoreThreshold,
+                              nmsScoreThreshold, maxNumDetections, maxNumDetections,
+                              [&roiBase](uint32_t ind) { return roiBase + ind * kRoiDim; },
+                              kernel, threadPool, &result);
+        };
+        if (softNmsKernel == 0) {
+            softNms([iouThreshold](float iou) { return iou < iouThreshold ? 1.0f : 0.0f; });
+        } else if (softNmsKernel == 1) {
+            softNms([iouThreshold](float iou) { return iou < iouThreshold ? 1.0f : 1.0f - iou; });
+        } else {
+            softNms([sigma](float iou) { return std::exp(-1.0f * iou * iou / sigma); });
+        }
         // Sort again by class.
         std::sort(result.begin(), result.end(),
                   [&scoresBase, numClasses](const uint32_t& lhs, const uint32_t& rhs) {
@@ -577,7 +666,7 @@ bool boxWithNmsLimitFloat32(const float* scoresData, const Shape& scoresShape, c
     NN_RET_CHECK(boxWithNmsLimitFloat32Compute(
             scores_float32.data(), scoresShape, roiData, roiShape, batchesData, batchesShape,
             scoreThreshold, maxNumDetections, softNmsKernel, iouThreshold, sigma, nmsScoreThreshold,
-            &batchSplitIn, &batchSplitOut, &selected));
+            &batchSplitIn, &batchSplitOut, &selected, context->getThreadPool()));
     return boxWithNmsLimitWriteOutput<float, float>(selected, batchSplitIn, batchSplitOut,
                                                     scores_float32, context);
 }
@@ -600,7 +689,8 @@ bool boxWithNmsLimitFloat16(const _Float16* scoresData, const Shape& scoresShape
     NN_RET_CHECK(boxWithNmsLimitFloat32Compute(
             scores_float32.data(), scoresShape, roi_float32.data(), roiShape, batchesData,
             batchesShape, scoreThreshold, maxNumDetections, softNmsKernel, iouThreshold, sigma,
-            nmsScoreThreshold, &batchSplitIn, &batchSplitOut, &selected));
+            nmsScoreThreshold, &batchSplitIn, &batchSplitOut, &selected,
+            context->getThreadPool()));
     return boxWithNmsLimitWriteOutput<_Float16, _Float16>(selected, batchSplitIn, batchSplitOut,
                                                           scores_float32, context);
 }
@@ -622,7 +712,8 @@ bool boxWithNmsLimitQuant(const uint8_t* scoresData, const Shape& scoresShape,
     NN_RET_CHECK(boxWithNmsLimitFloat32Compute(
             scores_float32.data(), scoresShape, roi_float32.data(), roiShape, batchesData,
             batchesShape, scoreThreshold, maxNumDetections, softNmsKernel, iouThreshold, sigma,
-            nmsScoreThreshold, &batchSplitIn, &batchSplitOut, &selected));
+            nmsScoreThreshold, &batchSplitIn, &batchSplitOut, &selected,
+            context->getThreadPool()));
     return boxWithNmsLimitWriteOutput<uint8_t, uint16_t>(selected, batchSplitIn, batchSplitOut,
                                                          scores_float32, context);
 }
@@ -840,245 +931,204 @@ void filterBoxes(const float* roiBase, const float* imageInfoBase, float minSize
     select->resize(i);
 }
 
-bool generateProposalsNhwcFloat32Compute(const float* scoresData, const Shape& scoresShape,
-                                         const float* bboxDeltasData, const Shape& bboxDeltasShape,
-                                         const float* anchorsData, const Shape& anchorsShape,
-                                         const float* imageInfoData, const Shape& imageInfoShape,
-                                         float heightStride, float widthStride, int32_t preNmsTopN,
-                                         int32_t postNmsTopN, float iouThreshold, float minSize,
-                                         std::vector<float>* scoresOutData,
-                                         std::vector<float>* roiOutData,
-                                         std::vector<int32_t>* batchesOutData) {
-    const uint32_t kRoiDim = 4;
-    uint32_t numBatches = getSizeOfDimension(scoresShape, 0);
-    uint32_t height = getSizeOfDimension(scoresShape, 1);
-    uint32_t width = getSizeOfDimension(scoresShape, 2);
-    uint32_t numAnchors = getSizeOfDimension(scoresShape, 3);
-    uint32_t imageInfoLength = getSizeOfDimension(imageInfoShape, 1);
-
-    uint32_t batchSize = height * width * numAnchors;
-    uint32_t roiBufferSize = batchSize * kRoiDim;
-    std::vector<float> roiBuffer(roiBufferSize);
-    std::vector<float> roiTransformedBuffer(roiBufferSize);
-    scoresOutData->clear();
-    roiOutData->clear();
-    batchesOutData->clear();
-
-    // Compute the roi region for each anchor.
-    float* roiBase = roiBuffer.data();
-    for (uint32_t h = 0; h < height; h++) {
-        float hShift = h * heightStride;
-        for (uint32_t w = 0; w < width; w++) {
-            const float* anchorsBase = anchorsData;
-            float wShift = w * widthStride;
-            for (uint32_t a = 0; a < numAnchors; a++, roiBase += kRoiDim, anchorsBase += kRoiDim) {
-                roiBase[0] = anchorsBase[0] + wShift;
-                roiBase[1] = anchorsBase[1] + hShift;
-                roiBase[2] = anchorsBase[2] + wShift;
-                roiBase[3] = anchorsBase[3] + hShift;
-            }
-        }
-    }
-
-    const float* scoresBase = scoresData;
-    const float* bboxDeltasBase = bboxDeltasData;
-    const float* imageInfoBase = imageInfoData;
-    // Need to fake some data to satisfy bboxTransform.
-    Shape tempRoiShape = anchorsShape;
-    tempRoiShape.dimensions = {batchSize, kRoiDim};
-    Shape tempBBoxDeltasShape = bboxDeltasShape;
-    tempBBoxDeltasShape.dimensions = {batchSize, kRoiDim};
-    std::vector<int32_t> tempBatchSplitData(batchSize, 0);
-    Shape tempbatchSplitShape = {.dimensions = {batchSize}};
-    Shape tempImageInfoShape = imageInfoShape;
-    tempImageInfoShape.dimensions = {1, imageInfoLength};
+inline float toFloat32(float value, const Shape&) {
+    return value;
+}
 
-    for (uint32_t b = 0; b < numBatches; b++) {
-        // Apply bboxDeltas to anchor locations.
-        float tempImageInfo[] = {imageInfoBase[0], imageInfoBase[1]};
-        if (!bboxTransformFloat32(roiBuffer.data(), tempRoiShape, bboxDeltasBase,
-                                  tempBBoxDeltasShape, tempBatchSplitData.data(),
-                                  tempbatchSplitShape, tempImageInfo, tempImageInfoShape,
-                                  roiTransformedBuffer.data(), tempRoiShape)) {
-            LOG(ERROR) << "BBoxTransform step failed in GENERATE_PROPOSALS op.";
-            return false;
-        }
+inline float toFloat32(_Float16 value, const Shape&) {
+    return value;
+}
 
-        // Find the top preNmsTopN scores.
-        std::vector<uint32_t> select(batchSize);
-        std::iota(select.begin(), select.end(), 0);
-        if (preNmsTopN > 0 && preNmsTopN < select.size()) {
-            std::sort(select.begin(), select.end(),
-                      [&scoresBase](const uint32_t lhs, const uint32_t rhs) {
-                          return scoresBase[lhs] > scoresBase[rhs];
-                      });
-            select.resize(preNmsTopN);
-        }
+template <typename T>
+inline float toFloat32(T value, const Shape& shape) {
+    return (static_cast<float>(value) - shape.offset) * shape.scale;
+}
 
-        // Filter boxes, disgard regions with height or width < minSize.
-        filterBoxes(roiTransformedBuffer.data(), imageInfoBase, minSize, &select);
-
-        // Apply hard NMS.
-        uint32_t* selectEnd = box_with_nms_limit::hardNmsSingleClass(
-                scoresBase, iouThreshold, postNmsTopN,
-                [&roiTransformedBuffer](uint32_t ind) {
-                    return roiTransformedBuffer.data() + ind * kRoiDim;
-                },
-                select.data(), select.size());
-        uint32_t selectSize = selectEnd - select.data();
-        select.resize(selectSize);
-
-        // Write output.
-        for (auto i : select) {
-            roiOutData->insert(roiOutData->end(), roiTransformedBuffer.begin() + i * kRoiDim,
-                               roiTransformedBuffer.begin() + (i + 1) * kRoiDim);
-            scoresOutData->push_back(scoresBase[i]);
-            batchesOutData->push_back(b);
-        }
-        scoresBase += batchSize;
-        bboxDeltasBase += roiBufferSize;
-        imageInfoBase += imageInfoLength;
-    }
-    return true;
+template <typename T>
+inline T fromFloat32(float value, const Shape& shape) {
+    int32_t intVal = std::round(value / shape.scale + shape.offset);
+    intVal = std::min<int32_t>(std::max<int32_t>(intVal, std::numeric_limits<T>::min()),
+                               std::numeric_limits<T>::max());
+    return static_cast<T>(intVal);
 }
 
-bool generateProposalsFloat32Compute(const float* scoresData, const Shape& scoresShape,
-                                     const float* bboxDeltasData, const Shape& bboxDeltasShape,
-                                     const float* anchorsData, const Shape& anchorsShape,
-                                     const float* imageInfoData, const Shape& imageInfoShape,
-                                     float heightStride, float widthStride, int32_t preNmsTopN,
-                                     int32_t postNmsTopN, float iouThreshold, float minSize,
-                                     bool useNchw, std::vector<float>* scoresOutData,
-                                     std::vector<float>* roiOutData,
-                                     std::vector<int32_t>* batchesOutData) {
-    InputWithLayout<float> score_nhwc(useNchw), delta_nhwc(useNchw);
-    NN_RET_CHECK(score_nhwc.initialize(scoresData, scoresShape));
-    NN_RET_CHECK(delta_nhwc.initialize(bboxDeltasData, bboxDeltasShape));
-    return generateProposalsNhwcFloat32Compute(
-            score_nhwc.getNhwcBuffer(), score_nhwc.getNhwcShape(), delta_nhwc.getNhwcBuffer(),
-            delta_nhwc.getNhwcShape(), anchorsData, anchorsShape, imageInfoData, imageInfoShape,
-            heightStride, widthStride, preNmsTopN, postNmsTopN, iouThreshold, minSize,
-            scoresOutData, roiOutData, batchesOutData);
+template <>
+inline float fromFloat32<float>(float value, const Shape&) {
+    return value;
 }
 
-bool generateProposalsFloat32(const float* scoresData, const Shape& scoresShape,
-                              const float* bboxDeltasData, const Shape& bboxDeltasShape,
-                              const float* anchorsData, const Shape& anchorsShape,
-                              const float* imageInfoData, const Shape& imageInfoShape,
-                              float heightStride, float widthStride, int32_t preNmsTopN,
-                              int32_t postNmsTopN, float iouThreshold, float minSize, bool useNchw,
-                              IOperationExecutionContext* context) {
-    std::vector<float> scoresOut_float32, roiOut_float32;
-    std::vector<int32_t> batchesOut;
-    NN_RET_CHECK(generateProposalsFloat32Compute(
-            scoresData, scoresShape, bboxDeltasData, bboxDeltasShape, anchorsData, anchorsShape,
-            imageInfoData, imageInfoShape, heightStride, widthStride, preNmsTopN, postNmsTopN,
-            iouThreshold, minSize, useNchw, &scoresOut_float32, &roiOut_float32, &batchesOut));
+template <>
+inline _Float16 fromFloat32<_Float16>(float value, const Shape&) {
+    return value;
+}
 
-    // Set output dimensions.
-    uint32_t numOutRois = scoresOut_float32.size();
-    if (numOutRois == 0) return true;
-    Shape scoresOutShape = context->getOutputShape(kOutputScoreTensor);
-    scoresOutShape.dimensions = {numOutRois};
-    NN_RET_CHECK(context->setOutputShape(kOutputScoreTensor, scoresOutShape));
-    Shape roiOutShape = context->getOutputShape(kOutputRoiTensor);
-    roiOutShape.dimensions = {numOutRois, 4};
-    NN_RET_CHECK(context->setOutputShape(kOutputRoiTensor, roiOutShape));
-    Shape batchesOutShape = context->getOutputShape(kOutputBatchesTensor);
-    batchesOutShape.dimensions = {numOutRois};
-    NN_RET_CHECK(context->setOutputShape(kOutputBatchesTensor, batchesOutShape));
+// The proposals of one batch.
+struct Proposals {
+    std::vector<float> scores;
+    std::vector<float> rois;
+};
 
-    // Write outputs.
-    float* scoresOutData = context->getOutputBuffer<float>(kOutputScoreTensor);
-    for (uint32_t i = 0; i < scoresOut_float32.size(); i++) {
-        scoresOutData[i] = scoresOut_float32[i];
-    }
-    float* roiOutData = context->getOutputBuffer<float>(kOutputRoiTensor);
-    for (uint32_t i = 0; i < roiOut_float32.size(); i++) {
-        roiOutData[i] = roiOut_float32[i];
+// Generates the proposals of every batch, reading the operands in their own
+// type and layout.
+//
+// The proposals of a batch are the top preNmsTopN anchors by score, selected
+// with std::nth_element before any box is decoded.  Only the boxes of the
+// selected anchors are decoded, filtered by minSize and reduced by hard NMS.
+// Batches are independent and are split among the threads of the pool.  Each
+// task keeps its buffers across the batches it computes, and reads the scores
+// of a batch into the scratch buffer of its thread when they fit.
+template <typename T_Score, typename T_Delta, typename T_Anchor, typename T_ImageInfo>
+bool generateProposals(const T_Score* scoresData, const Shape& scoresShape,
+                       const T_Delta* bboxDeltasData, const Shape& bboxDeltasShape,
+                       const T_Anchor* anchorsData, const Shape& anchorsShape,
+                       const T_ImageInfo* imageInfoData, const Shape& imageInfoShape,
+                       float heightStride, float widthStride, int32_t preNmsTopN,
+                       int32_t postNmsTopN, float iouThreshold, float minSize, bool useNchw,
+                       ThreadPool* threadPool, std::vector<Proposals>* proposals) {
+    const uint32_t kRoiDim = 4;
+    uint32_t numBatches = getSizeOfDimension(scoresShape, 0);
+    uint32_t height = getSizeOfDimension(scoresShape, useNchw ? 2 : 1);
+    uint32_t width = getSizeOfDimension(scoresShape, useNchw ? 3 : 2);
+    uint32_t numAnchors = getSizeOfDimension(scoresShape, useNchw ? 1 : 3);
+    uint32_t imageInfoLength = getSizeOfDimension(imageInfoShape, 1);
+    uint32_t planeSize = height * width;
+    uint32_t batchSize = planeSize * numAnchors;
+
+    // The anchors are the same for every batch and are converted once.
+    // Check for malformed data: invalid region: x2 < x1 || y2 < y1
+    std::vector<float> anchors(numAnchors * kRoiDim);
+    for (uint32_t i = 0; i < anchors.size(); i++) {
+        anchors[i] = toFloat32(anchorsData[i], anchorsShape);
     }
-    int32_t* batchesOutData = context->getOutputBuffer<int32_t>(kOutputBatchesTensor);
-    for (uint32_t i = 0; i < batchesOut.size(); i++) {
-        batchesOutData[i] = batchesOut[i];
+    for (uint32_t a = 0; a < numAnchors; a++) {
+        NN_RET_CHECK_LE(anchors[a * kRoiDim], anchors[a * kRoiDim + 2]);
+        NN_RET_CHECK_LE(anchors[a * kRoiDim + 1], anchors[a * kRoiDim + 3]);
     }
-    return true;
-}
 
-bool generateProposalsFloat16(const _Float16* scoresData, const Shape& scoresShape,
-                              const _Float16* bboxDeltasData, const Shape& bboxDeltasShape,
-                              const _Float16* anchorsData, const Shape& anchorsShape,
-                              const _Float16* imageInfoData, const Shape& imageInfoShape,
-                              float heightStride, float widthStride, int32_t preNmsTopN,
-                              int32_t postNmsTopN, float iouThreshold, float minSize, bool useNchw,
-                              IOperationExecutionContext* context) {
-    std::vector<float> score_float32(getNumberOfElements(scoresShape));
-    convertFloat16ToFloat32(scoresData, &score_float32);
-    std::vector<float> delta_float32(getNumberOfElements(bboxDeltasShape));
-    convertFloat16ToFloat32(bboxDeltasData, &delta_float32);
-    std::vector<float> anchors_float32(getNumberOfElements(anchorsShape));
-    convertFloat16ToFloat32(anchorsData, &anchors_float32);
-    std::vector<float> imageInfo_float32(getNumberOfElements(imageInfoShape));
-    convertFloat16ToFloat32(imageInfoData, &imageInfo_float32);
-    std::vector<float> scoresOut_float32, roiOut_float32;
-    std::vector<int32_t> batchesOut;
-    NN_RET_CHECK(generateProposalsFloat32Compute(
-            score_float32.data(), scoresShape, delta_float32.data(), bboxDeltasShape,
-            anchors_float32.data(), anchorsShape, imageInfo_float32.data(), imageInfoShape,
-            heightStride, widthStride, preNmsTopN, postNmsTopN, iouThreshold, minSize, useNchw,
-            &scoresOut_float32, &roiOut_float32, &batchesOut));
+    // Anchor boxes are indexed in NHWC order: index = (h * width + w) * numAnchors + a.
+    auto getDelta = [&](uint32_t b, uint32_t index, uint32_t i) {
+        if (useNchw) {
+            const uint32_t pixel = index / numAnchors, a = index % numAnchors;
+            return toFloat32(
+                    bboxDeltasData[((b * numAnchors + a) * kRoiDim + i) * planeSize + pixel],
+                    bboxDeltasShape);
+        }
+        return toFloat32(bboxDeltasData[(b * batchSize + index) * kRoiDim + i], bboxDeltasShape);
+    };
+
+    proposals->resize(numBatches);
+    parallelFor(threadPool, 0, numBatches, 1, [&](uint32_t batchBegin, uint32_t batchEnd) {
+        std::vector<float> scoresStorage;
+        float* scores = nullptr;
+        if (batchSize * sizeof(float) <= kThreadScratchBufferSize) {
+            scores = reinterpret_cast<float*>(getThreadScratchBuffer());
+        }
+        if (scores == nullptr) {
+            scoresStorage.resize(batchSize);
+            scores = scoresStorage.data();
+        }
+        std::vector<uint32_t> select, selectAfterNms;
+        std::vector<float> selectScores, selectRois;
+
+        for (uint32_t b = batchBegin; b < batchEnd; b++) {
+            if (useNchw) {
+                for (uint32_t a = 0; a < numAnchors; a++) {
+                    const T_Score* scoresBase = scoresData + (b * numAnchors + a) * planeSize;
+                    for (uint32_t pixel = 0; pixel < planeSize; pixel++) {
+                        scores[pixel * numAnchors + a] = toFloat32(scoresBase[pixel], scoresShape);
+                    }
+                }
+            } else {
+                const T_Score* scoresBase = scoresData + b * batchSize;
+                for (uint32_t i = 0; i < batchSize; i++) {
+                    scores[i] = toFloat32(scoresBase[i], scoresShape);
+                }
+            }
 
-    // Set output dimensions.
-    uint32_t numOutRois = scoresOut_float32.size();
-    if (numOutRois == 0) return true;
-    Shape scoresOutShape = context->getOutputShape(kOutputScoreTensor);
-    scoresOutShape.dimensions = {numOutRois};
-    NN_RET_CHECK(context->setOutputShape(kOutputScoreTensor, scoresOutShape));
-    Shape roiOutShape = context->getOutputShape(kOutputRoiTensor);
-    roiOutShape.dimensions = {numOutRois, 4};
-    NN_RET_CHECK(context->setOutputShape(kOutputRoiTensor, roiOutShape));
-    Shape batchesOutShape = context->getOutputShape(kOutputBatchesTensor);
-    batchesOutShape.dimensions = {numOutRois};
-    NN_RET_CHECK(context->setOutputShape(kOutputBatchesTensor, batchesOutShape));
+            // Find the top preNmsTopN scores.
+            select.resize(batchSize);
+            std::iota(select.begin(), select.end(), 0);
+            if (preNmsTopN > 0 && preNmsTopN < select.size()) {
+                const auto higherScore = [scores](const uint32_t lhs, const uint32_t rhs) {
+                    return scores[lhs] > scores[rhs] || (scores[lhs] == scores[rhs] && lhs < rhs);
+                };
+                std::nth_element(select.begin(), select.begin() + preNmsTopN, select.end(),
+                                 higherScore);
+                select.resize(preNmsTopN);
+                std::sort(select.begin(), select.end(), higherScore);
+            }
 
-    // Write outputs.
-    _Float16* scoresOutData = context->getOutputBuffer<_Float16>(kOutputScoreTensor);
-    convertFloat32ToFloat16(scoresOut_float32, scoresOutData);
-    _Float16* roiOutData = context->getOutputBuffer<_Float16>(kOutputRoiTensor);
-    convertFloat32ToFloat16(roiOut_float32, roiOutData);
-    int32_t* batchesOutData = context->getOutputBuffer<int32_t>(kOutputBatchesTensor);
-    for (uint32_t i = 0; i < batchesOut.size(); i++) {
-        batchesOutData[i] = batchesOut[i];
-    }
+            // Decode the boxes of the selected anchors, which are from now on
+            // referred to by their position in select.
+            float imageInfo[] = {toFloat32(imageInfoData[b * imageInfoLength], imageInfoShape),
+                                 toFloat32(imageInfoData[b * imageInfoLength + 1],
+                                           imageInfoShape)};
+            const uint32_t numSelected = select.size();
+            selectScores.resize(numSelected);
+            selectRois.resize(numSelected * kRoiDim);
+            for (uint32_t i = 0; i < numSelected; i++) {
+                const uint32_t index = select[i];
+                const uint32_t pixel = index / numAnchors, a = index % numAnchors;
+                const float hShift = (pixel / width) * heightStride;
+                const float wShift = (pixel % width) * widthStride;
+                const float* anchor = anchors.data() + a * kRoiDim;
+                auto roi = toBoxEncodingCenter({.x1 = anchor[0] + wShift,
+                                                .y1 = anchor[1] + hShift,
+                                                .x2 = anchor[2] + wShift,
+                                                .y2 = anchor[3] + hShift});
+                transformBox(roi, getDelta(b, index, 0), getDelta(b, index, 1),
+                             getDelta(b, index, 2), getDelta(b, index, 3), imageInfo[0],
+                             imageInfo[1], selectRois.data() + i * kRoiDim);
+                selectScores[i] = scores[index];
+            }
+            select.resize(numSelected);
+            std::iota(select.begin(), select.end(), 0);
+
+            // Filter boxes, disgard regions with height or width < minSize.
+            filterBoxes(selectRois.data(), imageInfo, minSize, &select);
+
+            // Apply hard NMS.
+            uint32_t* selectEnd = box_with_nms_limit::hardNmsSingleClass(
+                    selectScores.data(), iouThreshold, postNmsTopN,
+                    [&](uint32_t ind) { return selectRois.data() + ind * kRoiDim; },
+                    select.data(), select.size());
+            select.resize(selectEnd - select.data());
+
+            Proposals& batchProposals = (*proposals)[b];
+            batchProposals.scores.resize(select.size());
+            batchProposals.rois.resize(select.size() * kRoiDim);
+            for (uint32_t i = 0; i < select.size(); i++) {
+                batchProposals.scores[i] = selectScores[select[i]];
+                std::copy(selectRois.begin() + select[i] * kRoiDim,
+                          selectRois.begin() + (select[i] + 1) * kRoiDim,
+                          batchProposals.rois.begin() + i * kRoiDim);
+            }
+        }
+    });
     return true;
 }
 
-bool generateProposalsQuant(const uint8_t* scoresData, const Shape& scoresShape,
-                            const uint8_t* bboxDeltasData, const Shape& bboxDeltasShape,
-                            const int16_t* anchorsData, const Shape& anchorsShape,
-                            const uint16_t* imageInfoData, const Shape& imageInfoShape,
-                            float heightStride, float widthStride, int32_t preNmsTopN,
-                            int32_t postNmsTopN, float iouThreshold, float minSize, bool useNchw,
-                            IOperationExecutionContext* context) {
-    std::vector<float> score_float32(getNumberOfElements(scoresShape));
-    convertQuantToFloat32(scoresData, scoresShape.scale, scoresShape.offset, &score_float32);
-    std::vector<float> delta_float32(getNumberOfElements(bboxDeltasShape));
-    convertQuantToFloat32(bboxDeltasData, bboxDeltasShape.scale, bboxDeltasShape.offset,
-                          &delta_float32);
-    std::vector<float> anchors_float32(getNumberOfElements(anchorsShape));
-    convertQuantToFloat32(anchorsData, anchorsShape.scale, anchorsShape.offset, &anchors_float32);
-    std::vector<float> imageInfo_float32(getNumberOfElements(imageInfoShape));
-    convertQuantToFloat32(imageInfoData, imageInfoShape.scale, imageInfoShape.offset,
-                          &imageInfo_float32);
-    std::vector<float> scoresOut_float32, roiOut_float32;
-    std::vector<int32_t> batchesOut;
-    NN_RET_CHECK(generateProposalsFloat32Compute(
-            score_float32.data(), scoresShape, delta_float32.data(), bboxDeltasShape,
-            anchors_float32.data(), anchorsShape, imageInfo_float32.data(), imageInfoShape,
-            heightStride, widthStride, preNmsTopN, postNmsTopN, iouThreshold, minSize, useNchw,
-            &scoresOut_float32, &roiOut_float32, &batchesOut));
+template <typename T_Roi, typename T_Score, typename T_Delta, typename T_Anchor,
+          typename T_ImageInfo>
+bool generateProposalsWriteOutput(const T_Score* scoresData, const Shape& scoresShape,
+                                  const T_Delta* bboxDeltasData, const Shape& bboxDeltasShape,
+                                  const T_Anchor* anchorsData, const Shape& anchorsShape,
+                                  const T_ImageInfo* imageInfoData, const Shape& imageInfoShape,
+                                  float heightStride, float widthStride, int32_t preNmsTopN,
+                                  int32_t postNmsTopN, float iouThreshold, float minSize,
+                                  bool useNchw, IOperationExecutionContext* context) {
+    std::vector<Proposals> proposals;
+    NN_RET_CHECK(generateProposals(scoresData, scoresShape, bboxDeltasData, bboxDeltasShape,
+                                   anchorsData, anchorsShape, imageInfoData, imageInfoShape,
+                                   heightStride, widthStride, preNmsTopN, postNmsTopN,
+                                   iouThreshold, minSize, useNchw, context->getThreadPool(),
+                                   &proposals));
 
     // Set output dimensions.
-    uint32_t numOutRois = scoresOut_float32.size();
+    uint32_t numOutRois = 0;
+    for (const auto& batchProposals : proposals) {
+        numOutRois += batchProposals.scores.size();
+    }
     if (numOutRois == 0) return true;
     Shape scoresOutShape = context->getOutputShape(kOutputScoreTensor);
     scoresOutShape.dimensions = {numOutRois};
@@ -1091,14 +1141,17 @@ bool generateProposalsQuant(const uint8_t* scoresData, const Shape& scoresShape,
     NN_RET_CHECK(context->setOutputShape(kOutputBatchesTensor, batchesOutShape));
 
     // Write outputs.
-    uint8_t* scoresOutData = context->getOutputBuffer<uint8_t>(kOutputScoreTensor);
-    convertFloat32ToQuant(scoresOut_float32, scoresOutShape.scale, scoresOutShape.offset,
-                          scoresOutData);
-    uint16_t* roiOutData = context->getOutputBuffer<uint16_t>(kOutputRoiTensor);
-    convertFloat32ToQuant(roiOut_float32, roiOutShape.scale, roiOutShape.offset, roiOutData);
+    T_Score* scoresOutData = context->getOutputBuffer<T_Score>(kOutputScoreTensor);
+    T_Roi* roiOutData = context->getOutputBuffer<T_Roi>(kOutputRoiTensor);
     int32_t* batchesOutData = context->getOutputBuffer<int32_t>(kOutputBatchesTensor);
-    for (uint32_t i = 0; i < batchesOut.size(); i++) {
-        batchesOutData[i] = batchesOut[i];
+    for (uint32_t b = 0; b < proposals.size(); b++) {
+        for (float score : proposals[b].scores) {
+            *scoresOutData++ = fromFloat32<T_Score>(score, scoresOutShape);
+            *batchesOutData++ = b;
+        }
+        for (float roi : proposals[b].rois) {
+            *roiOutData++ = fromFloat32<T_Roi>(roi, roiOutShape);
+        }
     }
     return true;
 }
@@ -1219,55 +1272,58 @@ bool execute(IOperationExecutionContext* context) {
     NNTRACE_TRANS("generateProposals");
     switch (context->getInputType(kScoreTensor)) {
         case OperandType::TENSOR_FLOAT16: {
-            return generateProposalsFloat16(context->getInputBuffer<_Float16>(kScoreTensor),
-                                            context->getInputShape(kScoreTensor),
-                                            context->getInputBuffer<_Float16>(kDeltaTensor),
-                                            context->getInputShape(kDeltaTensor),
-                                            context->getInputBuffer<_Float16>(kAnchorTensor),
-                                            context->getInputShape(kAnchorTensor),
-                                            context->getInputBuffer<_Float16>(kImageInfoTensor),
-                                            context->getInputShape(kImageInfoTensor),
-                                            context->getInputValue<_Float16>(kHeightStrideSalar),
-                                            context->getInputValue<_Float16>(kWidthStrideScalar),
-                                            context->getInputValue<int32_t>(kPreNmsMaxScalar),
-                                            context->getInputValue<int32_t>(kPostNmsMaxScalar),
-                                            context->getInputValue<_Float16>(kIoUThresholdScalar),
-                                            context->getInputValue<_Float16>(kMinSizeScalar),
-                                            context->getInputValue<bool>(kLayoutScalar), context);
+            return generateProposalsWriteOutput<_Float16>(
+                    context->getInputBuffer<_Float16>(kScoreTensor),
+                    context->getInputShape(kScoreTensor),
+                    context->getInputBuffer<_Float16>(kDeltaTensor),
+                    context->getInputShape(kDeltaTensor),
+                    context->getInputBuffer<_Float16>(kAnchorTensor),
+                    context->getInputShape(kAnchorTensor),
+                    context->getInputBuffer<_Float16>(kImageInfoTensor),
+                    context->getInputShape(kImageInfoTensor),
+                    context->getInputValue<_Float16>(kHeightStrideSalar),
+                    context->getInputValue<_Float16>(kWidthStrideScalar),
+                    context->getInputValue<int32_t>(kPreNmsMaxScalar),
+                    context->getInputValue<int32_t>(kPostNmsMaxScalar),
+                    context->getInputValue<_Float16>(kIoUThresholdScalar),
+                    context->getInputValue<_Float16>(kMinSizeScalar),
+                    context->getInputValue<bool>(kLayoutScalar), context);
         }
         case OperandType::TENSOR_FLOAT32: {
-            return generateProposalsFloat32(context->getInputBuffer<float>(kScoreTensor),
-                                            context->getInputShape(kScoreTensor),
-                                            context->getInputBuffer<float>(kDeltaTensor),
-                                            context->getInputShape(kDeltaTensor),
-                                            context->getInputBuffer<float>(kAnchorTensor),
-                                            context->getInputShape(kAnchorTensor),
-                                            context->getInputBuffer<float>(kImageInfoTensor),
-                                            context->getInputShape(kImageInfoTensor),
-                                            context->getInputValue<float>(kHeightStrideSalar),
-                                            context->getInputValue<float>(kWidthStrideScalar),
-                                            context->getInputValue<int32_t>(kPreNmsMaxScalar),
-                                            context->getInputValue<int32_t>(kPostNmsMaxScalar),
-                                            context->getInputValue<float>(kIoUThresholdScalar),
-                                            context->getInputValue<float>(kMinSizeScalar),
-                                            context->getInputValue<bool>(kLayoutScalar), context);
+            return generateProposalsWriteOutput<float>(
+                    context->getInputBuffer<float>(kScoreTensor),
+                    context->getInputShape(kScoreTensor),
+                    context->getInputBuffer<float>(kDeltaTensor),
+                    context->getInputShape(kDeltaTensor),
+                    context->getInputBuffer<float>(kAnchorTensor),
+                    context->getInputShape(kAnchorTensor),
+                    context->getInputBuffer<float>(kImageInfoTensor),
+                    context->getInputShape(kImageInfoTensor),
+                    context->getInputValue<float>(kHeightStrideSalar),
+                    context->getInputValue<float>(kWidthStrideScalar),
+                    context->getInputValue<int32_t>(kPreNmsMaxScalar),
+                    context->getInputValue<int32_t>(kPostNmsMaxScalar),
+                    context->getInputValue<float>(kIoUThresholdScalar),
+                    context->getInputValue<float>(kMinSizeScalar),
+                    context->getInputValue<bool>(kLayoutScalar), context);
         }
         case OperandType::TENSOR_QUANT8_ASYMM: {
-            return generateProposalsQuant(context->getInputBuffer<uint8_t>(kScoreTensor),
-                                          context->getInputShape(kScoreTensor),
-                                          context->getInputBuffer<uint8_t>(kDeltaTensor),
-                                          context->getInputShape(kDeltaTensor),
-                                          context->getInputBuffer<int16_t>(kAnchorTensor),
-                                          context->getInputShape(kAnchorTensor),
-                                          context->getInputBuffer<uint16_t>(kImageInfoTensor),
-                                          context->getInputShape(kImageInfoTensor),
-                                          context->getInputValue<float>(kHeightStrideSalar),
-                                          context->getInputValue<float>(kWidthStrideScalar),
-                                          context->getInputValue<int32_t>(kPreNmsMaxScalar),
-                                          context->getInputValue<int32_t>(kPostNmsMaxScalar),
-                                          context->getInputValue<float>(kIoUThresholdScalar),
-                                          context->getInputValue<float>(kMinSizeScalar),
-                                          context->getInputValue<bool>(kLayoutScalar), context);
+            return generateProposalsWriteOutput<uint16_t>(
+                    context->getInputBuffer<uint8_t>(kScoreTensor),
+                    context->getInputShape(kScoreTensor),
+                    context->getInputBuffer<uint8_t>(kDeltaTensor),
+                    context->getInputShape(kDeltaTensor),
+                    context->getInputBuffer<int16_t>(kAnchorTensor),
+                    context->getInputShape(kAnchorTensor),
+                    context->getInputBuffer<uint16_t>(kImageInfoTensor),
+                    context->getInputShape(kImageInfoTensor),
+                    context->getInputValue<float>(kHeightStrideSalar),
+                    context->getInputValue<float>(kWidthStrideScalar),
+                    context->getInputValue<int32_t>(kPreNmsMaxScalar),
+                    context->getInputValue<int32_t>(kPostNmsMaxScalar),
+                    context->getInputValue<float>(kIoUThresholdScalar),
+                    context->getInputValue<float>(kMinSizeScalar),
+                    context->getInputValue<bool>(kLayoutScalar), context);
         }
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
@@ -1311,7 +1367,8 @@ bool detectionPostprocessFloat32(
         int32_t maxClassesPerDetection, int32_t maxNumDetectionsPerClass, float iouThreshold,
         float scoreThreshold, bool isBGInLabel, float* scoreOutData, const Shape& scoreOutShape,
         float* roiOutData, const Shape& roiOutShape, int32_t* classOutData,
-        const Shape& classOutShape, int32_t* detectionOutData, const Shape& detectionOutShape) {
+        const Shape& classOutShape, int32_t* detectionOutData, const Shape& detectionOutShape,
+        ThreadPool* threadPool) {
     const uint32_t kRoiDim = 4;
     uint32_t numBatches = getSizeOfDimension(scoreShape, 0);
     uint32_t numAnchors = getSizeOfDimension(scoreShape, 1);
@@ -1354,7 +1411,7 @@ bool detectionPostprocessFloat32(
                     [&roiBuffer, numClasses](uint32_t ind) {
                         return roiBuffer.data() + (ind / numClasses) * kRoiDim;
                     },
-                    &select);
+                    threadPool, &select);
             for (uint32_t i = 0; i < select.size(); i++) {
                 uint32_t ind = select[i];
                 scoreOutBase[i] = scoreBase[ind];
@@ -1388,10 +1445,12 @@ bool detectionPostprocessFloat32(
                 const float* score = scoreBase + i * numClasses;
                 std::vector<uint32_t> scoreInds(numClasses - 1);
                 std::iota(scoreInds.begin(), scoreInds.end(), 1);
-                std::sort(scoreInds.begin(), scoreInds.end(),
-                          [&score](const uint32_t lhs, const uint32_t rhs) {
-                              return score[lhs] > score[rhs];
-                          });
+                std::partial_sort(scoreInds.begin(), scoreInds.begin() + numOutClasses,
+                                  scoreInds.end(),
+                                  [&score](const uint32_t lhs, const uint32_t rhs) {
+                                      return score[lhs] > score[rhs] ||
+                                             (score[lhs] == score[rhs] && lhs < rhs);
+                                  });
                 for (uint32_t c = 0; c < numOutClasses; c++) {
                     *scoreOutPtr++ = score[scoreInds[c]];
                     memcpy(roiOutPtr, &roiBuffer[i * kRoiDim], kRoiDim * sizeof(float));
@@ -1416,7 +1475,8 @@ bool detectionPostprocessFloat16(
         int32_t maxClassesPerDetection, int32_t maxNumDetectionsPerClass, float iouThreshold,
         float scoreThreshold, bool isBGInLabel, _Float16* scoreOutData, const Shape& scoreOutShape,
         _Float16* roiOutData, const Shape& roiOutShape, int32_t* classOutData,
-        const Shape& classOutShape, int32_t* detectionOutData, const Shape& detectionOutShape) {
+        const Shape& classOutShape, int32_t* detectionOutData, const Shape& detectionOutShape,
+        ThreadPool* threadPool) {
     std::vector<float> scores_float32(getNumberOfElements(scoreShape));
     convertFloat16ToFloat32(scoreData, &scores_float32);
     std::vector<float> delta_float32(getNumberOfElements(deltaShape));
@@ -1431,7 +1491,7 @@ bool detectionPostprocessFloat16(
             maxNumDetections, maxClassesPerDetection, maxNumDetectionsPerClass, iouThreshold,
             scoreThreshold, isBGInLabel, outputScore_float32.data(), scoreOutShape,
             outputRoi_float32.data(), roiOutShape, classOutData, classOutShape, detectionOutData,
-            detectionOutShape));
+            detectionOutShape, threadPool));
     convertFloat32ToFloat16(outputScore_float32, scoreOutData);
     convertFloat32ToFloat16(outputRoi_float32, roiOutData);
     return true;
@@ -1572,7 +1632,7 @@ bool execute(IOperationExecutionContext* context) {
                     context->getOutputBuffer<int32_t>(kOutputClassTensor),
                     context->getOutputShape(kOutputClassTensor),
                     context->getOutputBuffer<int32_t>(kOutputDetectionTensor),
-                    context->getOutputShape(kOutputDetectionTensor));
+                    context->getOutputShape(kOutputDetectionTensor), context->getThreadPool());
         }
         case OperandType::TENSOR_FLOAT32: {
             return detectionPostprocessFloat32(
@@ -1600,7 +1660,7 @@ bool execute(IOperationExecutionContext* context) {
                     context->getOutputBuffer<int32_t>(kOutputClassTensor),
                     context->getOutputShape(kOutputClassTensor),
                     context->getOutputBuffer<int32_t>(kOutputDetectionTensor),
-                    context->getOutputShape(kOutputDetectionTensor));
+                    context->getOutputShape(kOutputDetectionTensor), context->getThreadPool());
         }
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
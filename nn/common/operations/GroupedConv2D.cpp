@@ -17,11 +17,15 @@
 #include "CpuOperationUtils.h"
 #include "Operations.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <memory>
+#include <vector>
 
 #include "Tracing.h"
 #include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/optimized/legacy_optimized_ops.h"
 
 namespace android {
 namespace nn {
@@ -39,6 +43,125 @@ namespace nn {
     uint32_t outputDepth = getSizeOfDimension(outputShape, 3);  \
     uint32_t outputGroupDepth = outputDepth / numGroups;
 
+namespace {
+
+// Provides the im2col matrix that tflite::optimized_ops::Conv needs for the
+// given shapes, from the scratch buffer of the thread when it fits.
+template <typename T>
+class Im2colBuffer {
+   public:
+    bool initialize(const Shape& inputShape, const Shape& filterShape, const Shape& outputShape) {
+        mDims.sizes[3] = getSizeOfDimension(outputShape, 0);
+        mDims.sizes[2] = getSizeOfDimension(outputShape, 1);
+        mDims.sizes[1] = getSizeOfDimension(outputShape, 2);
+        mDims.sizes[0] = getSizeOfDimension(inputShape, 3) * getSizeOfDimension(filterShape, 1) *
+                         getSizeOfDimension(filterShape, 2);
+        mDims.strides[0] = 1;
+        uint64_t byteSize = sizeof(T) * mDims.sizes[0];
+        for (int i = 1; i < 4; i++) {
+            mDims.strides[i] = mDims.strides[i - 1] * mDims.sizes[i - 1];
+            byteSize *= mDims.sizes[i];
+        }
+        // tflite::optimized_ops::Conv uses int for offsets.
+        NN_RET_CHECK_LT(byteSize, 0x7fffffffu) << "Conv size is too large, not enough memory";
+        if (byteSize <= kThreadScratchBufferSize) {
+            mData = reinterpret_cast<T*>(getThreadScratchBuffer());
+        }
+        if (mData == nullptr) {
+            mGuard.reset(new (std::nothrow) T[byteSize / sizeof(T)]);
+            mData = mGuard.get();
+            NN_RET_CHECK(mData != nullptr) << "Conv size is too large, not enough memory";
+        }
+        return true;
+    }
+
+    T* data() const { return mData; }
+    const tflite::Dims<4>& dims() const { return mDims; }
+
+   private:
+    T* mData = nullptr;
+    std::unique_ptr<T[]> mGuard;
+    tflite::Dims<4> mDims;
+};
+
+// Computes a grouped convolution as one regular convolution per group.  The
+// input channels of a group are gathered into a contiguous NHWC tensor, which
+// convGroup() convolves with the filters of the group, and the result is
+// scattered to the output channels of the group.  convGroup has the signature
+// of a convolution on NHWC tensors.
+template <typename T_Input, typename T_Filter, typename T_Bias, typename ConvGroup>
+bool convByGroup(const T_Input* inputData, const Shape& inputShape, const T_Filter* filterData,
+                 const Shape& filterShape, const T_Bias* biasData, const Shape& biasShape,
+                 int32_t numGroups, T_Input* outputData, const Shape& outputShape,
+                 ConvGroup convGroup) {
+    ANDROID_NN_GROUPED_CONV_PARAMETERS
+    if (numGroups == 1) {
+        return convGroup(inputData, inputShape, filterData, filterShape, biasData, biasShape,
+                         outputData, outputShape);
+    }
+
+    Shape groupInputShape = inputShape;
+    groupInputShape.dimensions[3] = filterDepth;
+    Shape groupFilterShape = filterShape;
+    groupFilterShape.dimensions[0] = outputGroupDepth;
+    Shape groupBiasShape = biasShape;
+    groupBiasShape.dimensions = {outputGroupDepth};
+    Shape groupOutputShape = outputShape;
+    groupOutputShape.dimensions[3] = outputGroupDepth;
+
+    const uint32_t numInputPixels = numBatches * inputHeight * inputWidth;
+    const uint32_t numOutputPixels = numBatches * outputHeight * outputWidth;
+    const uint32_t groupFilterSize = outputGroupDepth * filterHeight * filterWidth * filterDepth;
+    std::vector<T_Input> groupInput(numInputPixels * filterDepth);
+    std::vector<T_Input> groupOutput(numOutputPixels * outputGroupDepth);
+    for (uint32_t g = 0; g < numGroups; g++) {
+        for (uint32_t i = 0; i < numInputPixels; i++) {
+            const T_Input* from = inputData + i * inputDepth + g * filterDepth;
+            std::copy(from, from + filterDepth, groupInput.data() + i * filterDepth);
+        }
+        NN_RET_CHECK(convGroup(groupInput.data(), groupInputShape,
+                               filterData + g * groupFilterSize, groupFilterShape,
+                               biasData + g * outputGroupDepth, groupBiasShape,
+                               groupOutput.data(), groupOutputShape));
+        for (uint32_t i = 0; i < numOutputPixels; i++) {
+            const T_Input* from = groupOutput.data() + i * outputGroupDepth;
+            std::copy(from, from + outputGroupDepth,
+                      outputData + i * outputDepth + g * outputGroupDepth);
+        }
+    }
+    return true;
+}
+
+// Returns whether every group has a single input channel, in which case the
+// grouped convolution is a depthwise convolution with a depth multiplier of
+// the number of output channels per group.
+bool isDepthwise(const Shape& filterShape, int32_t numGroups) {
+    return getSizeOfDimension(filterShape, 3) == 1 && numGroups > 1;
+}
+
+// Rearranges a grouped convolution filter of shape [depth_out, height, width,
+// 1] into a depthwise convolution filter of shape [1, height, width,
+// depth_out].
+template <typename T>
+std::vector<T> toDepthwiseFilter(const T* filterData, const Shape& filterShape,
+                                 Shape* depthwiseFilterShape) {
+    const uint32_t outputDepth = getSizeOfDimension(filterShape, 0);
+    const uint32_t filterSize =
+            getSizeOfDimension(filterShape, 1) * getSizeOfDimension(filterShape, 2);
+    std::vector<T> depthwiseFilter(outputDepth * filterSize);
+    for (uint32_t d = 0; d < outputDepth; d++) {
+        for (uint32_t i = 0; i < filterSize; i++) {
+            depthwiseFilter[i * outputDepth + d] = filterData[d * filterSize + i];
+        }
+    }
+    *depthwiseFilterShape = filterShape;
+    depthwiseFilterShape->dimensions = {1, filterShape.dimensions[1], filterShape.dimensions[2],
+                                        outputDepth};
+    return depthwiseFilter;
+}
+
+}  // namespace
+
 bool groupedConvFloat32(const float* inputData, const Shape& inputShape, const float* filterData,
                         const Shape& filterShape, const float* biasData, const Shape& biasShape,
                         int32_t padding_left, int32_t padding_right, int32_t padding_top,
@@ -46,54 +169,40 @@ bool groupedConvFloat32(const float* inputData, const Shape& inputShape, const f
                         int32_t numGroups, int32_t activation, float* outputData,
                         const Shape& outputShape) {
     NNTRACE_TRANS("groupConvFloat32");
-    ANDROID_NN_GROUPED_CONV_PARAMETERS
+    if (isDepthwise(filterShape, numGroups)) {
+        Shape depthwiseFilterShape;
+        const auto depthwiseFilter =
+                toDepthwiseFilter(filterData, filterShape, &depthwiseFilterShape);
+        return depthwiseConvFloat32(
+                inputData, inputShape, depthwiseFilter.data(), depthwiseFilterShape, biasData,
+                biasShape, padding_left, padding_right, padding_top, padding_bottom, stride_width,
+                stride_height, 1, 1, getSizeOfDimension(outputShape, 3) / numGroups, activation,
+                outputData, outputShape);
+    }
 
     float output_activation_min = 0.0f, output_activation_max = 0.0f;
     CalculateActivationRangeFloat(activation, &output_activation_min, &output_activation_max);
 
-    const float* inputBase = inputData;
-    float* outPtr = outputData;
-    for (uint32_t b = 0; b < numBatches; b++) {
-        for (uint32_t h = 0; h < outputHeight; h++) {
-            for (uint32_t w = 0; w < outputWidth; w++) {
-                const float* filterBase = filterData;
-                for (uint32_t g = 0; g < numGroups; g++) {
-                    for (uint32_t d = 0; d < outputGroupDepth; d++) {
-                        int32_t wInputOrigin =
-                                static_cast<int32_t>(w) * stride_width - padding_left;
-                        int32_t hInputOrigin =
-                                static_cast<int32_t>(h) * stride_height - padding_top;
-                        float sum = 0.0f;
-                        for (uint32_t i = 0; i < filterHeight; i++) {
-                            for (uint32_t j = 0; j < filterWidth; j++) {
-                                for (uint32_t k = 0; k < filterDepth; k++) {
-                                    int32_t hInput = hInputOrigin + static_cast<int32_t>(i);
-                                    int32_t wInput = wInputOrigin + static_cast<int32_t>(j);
-                                    uint32_t dInput = filterDepth * g + k;
-                                    if (hInput >= 0 && hInput < static_cast<int32_t>(inputHeight) &&
-                                        wInput >= 0 && wInput < static_cast<int32_t>(inputWidth)) {
-                                        uint32_t filterIndex =
-                                                i * filterWidth * filterDepth + j * filterDepth + k;
-                                        uint32_t inputIndex = hInput * inputWidth * inputDepth +
-                                                              wInput * inputDepth + dInput;
-                                        sum += filterBase[filterIndex] * inputBase[inputIndex];
-                                    }
-                                }
-                            }
-                        }
-                        sum += biasData[g * outputGroupDepth + d];
-                        sum = std::max(std::min(sum, output_activation_max), output_activation_min);
-                        outPtr[d] = sum;
-                        filterBase += filterHeight * filterWidth * filterDepth;
-                    }
-                    outPtr += outputGroupDepth;
-                }
-            }
-        }
-        inputBase += inputHeight * inputWidth * inputDepth;
-    }
-
-    return true;
+    NNTRACE_COMP_SWITCH("optimized_ops::Conv");
+    return convByGroup(
+            inputData, inputShape, filterData, filterShape, biasData, biasShape, numGroups,
+            outputData, outputShape,
+            [&](const float* groupInputData, const Shape& groupInputShape,
+                const float* groupFilterData, const Shape& groupFilterShape,
+                const float* groupBiasData, const Shape& groupBiasShape, float* groupOutputData,
+                const Shape& groupOutputShape) {
+                Im2colBuffer<float> im2col;
+                NN_RET_CHECK(im2col.initialize(groupInputShape, groupFilterShape,
+                                               groupOutputShape));
+                tflite::optimized_ops::Conv(
+                        groupInputData, convertShapeToDims(groupInputShape), groupFilterData,
+                        convertShapeToDims(groupFilterShape), groupBiasData,
+                        convertShapeToDims(groupBiasShape), stride_width, stride_height, 1, 1,
+                        padding_left, padding_top, output_activation_min, output_activation_max,
+                        groupOutputData, convertShapeToDims(groupOutputShape), im2col.data(),
+                        im2col.dims());
+                return true;
+            });
 }
 
 bool groupedConvQuant8(const uint8_t* inputData, const Shape& inputShape, const uint8_t* filterData,
@@ -103,7 +212,16 @@ bool groupedConvQuant8(const uint8_t* inputData, const Shape& inputShape, const
                        int32_t numGroups, int32_t activation, uint8_t* outputData,
                        const Shape& outputShape) {
     NNTRACE_TRANS("groupConvQuant8");
-    ANDROID_NN_GROUPED_CONV_PARAMETERS
+    if (isDepthwise(filterShape, numGroups)) {
+        Shape depthwiseFilterShape;
+        const auto depthwiseFilter =
+                toDepthwiseFilter(filterData, filterShape, &depthwiseFilterShape);
+        return depthwiseConvQuant8(
+                inputData, inputShape, depthwiseFilter.data(), depthwiseFilterShape, biasData,
+                biasShape, padding_left, padding_right, padding_top, padding_bottom, stride_width,
+                stride_height, 1, 1, getSizeOfDimension(outputShape, 3) / numGroups, activation,
+                outputData, outputShape);
+    }
 
     int32_t inputOffset = -inputShape.offset;
     int32_t filterOffset = -filterShape.offset;
@@ -122,55 +240,28 @@ bool groupedConvQuant8(const uint8_t* inputData, const Shape& inputShape, const
     CalculateActivationRangeUint8(activation, outputShape, &output_activation_min,
                                   &output_activation_max);
 
-    const uint8_t* inputBase = inputData;
-    uint8_t* outPtr = outputData;
-    for (uint32_t b = 0; b < numBatches; b++) {
-        for (uint32_t h = 0; h < outputHeight; h++) {
-            for (uint32_t w = 0; w < outputWidth; w++) {
-                const uint8_t* filterBase = filterData;
-                for (uint32_t g = 0; g < numGroups; g++) {
-                    for (uint32_t d = 0; d < outputGroupDepth; d++) {
-                        int32_t wInputOrigin =
-                                static_cast<int32_t>(w) * stride_width - padding_left;
-                        int32_t hInputOrigin =
-                                static_cast<int32_t>(h) * stride_height - padding_top;
-                        int32_t sum = 0.0f;
-                        for (uint32_t i = 0; i < filterHeight; i++) {
-                            for (uint32_t j = 0; j < filterWidth; j++) {
-                                for (uint32_t k = 0; k < filterDepth; k++) {
-                                    int32_t hInput = hInputOrigin + static_cast<int32_t>(i);
-                                    int32_t wInput = wInputOrigin + static_cast<int32_t>(j);
-                                    uint32_t dInput = filterDepth * g + k;
-                                    if (hInput >= 0 && hInput < static_cast<int32_t>(inputHeight) &&
-                                        wInput >= 0 && wInput < static_cast<int32_t>(inputWidth)) {
-                                        uint32_t filterIndex =
-                                                i * filterWidth * filterDepth + j * filterDepth + k;
-                                        uint32_t inputIndex = hInput * inputWidth * inputDepth +
-                                                              wInput * inputDepth + dInput;
-                                        sum += (static_cast<int32_t>(filterBase[filterIndex]) +
-                                                filterOffset) *
-                                               (static_cast<int32_t>(inputBase[inputIndex]) +
-                                                inputOffset);
-                                    }
-                                }
-                            }
-                        }
-                        sum += biasData[g * outputGroupDepth + d];
-                        sum = tflite::MultiplyByQuantizedMultiplier(sum, outputMultiplier,
-                                                                    -outputShift);
-                        sum += outputOffset;
-                        sum = std::max(std::min(sum, output_activation_max), output_activation_min);
-                        outPtr[d] = static_cast<uint8_t>(sum);
-                        filterBase += filterHeight * filterWidth * filterDepth;
-                    }
-                    outPtr += outputGroupDepth;
-                }
-            }
-        }
-        inputBase += inputHeight * inputWidth * inputDepth;
-    }
-
-    return true;
+    NNTRACE_COMP_SWITCH("optimized_ops::Conv");
+    return convByGroup(
+            inputData, inputShape, filterData, filterShape, biasData, biasShape, numGroups,
+            outputData, outputShape,
+            [&](const uint8_t* groupInputData, const Shape& groupInputShape,
+                const uint8_t* groupFilterData, const Shape& groupFilterShape,
+                const int32_t* groupBiasData, const Shape& groupBiasShape,
+                uint8_t* groupOutputData, const Shape& groupOutputShape) {
+                Im2colBuffer<uint8_t> im2col;
+                NN_RET_CHECK(im2col.initialize(groupInputShape, groupFilterShape,
+                                               groupOutputShape));
+                tflite::optimized_ops::Conv(
+                        groupInputData, convertShapeToDims(groupInputShape), inputOffset,
+                        groupFilterData, convertShapeToDims(groupFilterShape), filterOffset,
+                        groupBiasData, convertShapeToDims(groupBiasShape), stride_width,
+                        stride_height, 1, 1, padding_left, padding_top, outputOffset,
+                        outputMultiplier, outputShift, output_activation_min,
+                        output_activation_max, groupOutputData,
+                        convertShapeToDims(groupOutputShape), im2col.data(), im2col.dims(),
+                        getThreadGemmContext());
+                return true;
+            });
 }
 
 bool groupedConvQuant8PerChannel(const uint8_t* inputData, const Shape& inputShape,
@@ -182,6 +273,18 @@ bool groupedConvQuant8PerChannel(const uint8_t* inputData, const Shape& inputSha
                                  int32_t activation, uint8_t* outputData,
                                  const Shape& outputShape) {
     NNTRACE_TRANS("groupConvQuant8");
+    if (isDepthwise(filterShape, numGroups)) {
+        Shape depthwiseFilterShape;
+        const auto depthwiseFilter =
+                toDepthwiseFilter(filterData, filterShape, &depthwiseFilterShape);
+        return depthwiseConvQuant8PerChannel(
+                inputData, inputShape, depthwiseFilter.data(), depthwiseFilterShape,
+                filterScales, biasData, biasShape, padding_left, padding_right, padding_top,
+                padding_bottom, stride_width, stride_height, 1, 1,
+                getSizeOfDimension(outputShape, 3) / numGroups, activation, outputData,
+                outputShape);
+    }
+
     ANDROID_NN_GROUPED_CONV_PARAMETERS
 
     int32_t inputOffset = -inputShape.offset;
@@ -208,52 +311,55 @@ bool groupedConvQuant8PerChannel(const uint8_t* inputData, const Shape& inputSha
     CalculateActivationRangeUint8(activation, outputShape, &output_activation_min,
                                   &output_activation_max);
 
-    const uint8_t* inputBase = inputData;
+    // There is no per-channel gemm pipeline, so the taps are accumulated
+    // directly.  The window is clipped to the input once per output position,
+    // and each tap is a dot product of contiguous input and filter channels.
+    NNTRACE_COMP_SWITCH("groupedConvQuant8PerChannel");
+    const uint32_t filterSize = filterHeight * filterWidth * filterDepth;
     uint8_t* outPtr = outputData;
     for (uint32_t b = 0; b < numBatches; b++) {
+        const uint8_t* inputBase = inputData + b * inputHeight * inputWidth * inputDepth;
         for (uint32_t h = 0; h < outputHeight; h++) {
+            const int32_t hInputOrigin = static_cast<int32_t>(h) * stride_height - padding_top;
+            const int32_t iBegin = std::max(0, -hInputOrigin);
+            const int32_t iEnd = std::min<int32_t>(
+                    filterHeight, static_cast<int32_t>(inputHeight) - hInputOrigin);
             for (uint32_t w = 0; w < outputWidth; w++) {
-                const int8_t* filterBase = filterData;
+                const int32_t wInputOrigin = static_cast<int32_t>(w) * stride_width - padding_left;
+                const int32_t jBegin = std::max(0, -wInputOrigin);
+                const int32_t jEnd = std::min<int32_t>(
+                        filterWidth, static_cast<int32_t>(inputWidth) - wInputOrigin);
                 for (uint32_t g = 0; g < numGroups; g++) {
                     for (uint32_t d = 0; d < outputGroupDepth; d++) {
-                        int32_t wInputOrigin =
-                                static_cast<int32_t>(w) * stride_width - padding_left;
-                        int32_t hInputOrigin =
-                                static_cast<int32_t>(h) * stride_height - padding_top;
-                        int32_t sum = 0.0f;
-                        for (uint32_t i = 0; i < filterHeight; i++) {
-                            for (uint32_t j = 0; j < filterWidth; j++) {
+                        const uint32_t channelIndex = g * outputGroupDepth + d;
+                        const int8_t* filterBase = filterData + channelIndex * filterSize;
+                        int32_t sum = 0;
+                        for (int32_t i = iBegin; i < iEnd; i++) {
+                            const uint8_t* inputRow =
+                                    inputBase + (hInputOrigin + i) * inputWidth * inputDepth;
+                            for (int32_t j = jBegin; j < jEnd; j++) {
+                                const uint8_t* input = inputRow +
+                                                       (wInputOrigin + j) * inputDepth +
+                                                       g * filterDepth;
+                                const int8_t* filter =
+                                        filterBase + (i * filterWidth + j) * filterDepth;
                                 for (uint32_t k = 0; k < filterDepth; k++) {
-                                    int32_t hInput = hInputOrigin + static_cast<int32_t>(i);
-                                    int32_t wInput = wInputOrigin + static_cast<int32_t>(j);
-                                    uint32_t dInput = filterDepth * g + k;
-                                    if (hInput >= 0 && hInput < static_cast<int32_t>(inputHeight) &&
-                                        wInput >= 0 && wInput < static_cast<int32_t>(inputWidth)) {
-                                        uint32_t filterIndex =
-                                                i * filterWidth * filterDepth + j * filterDepth + k;
-                                        uint32_t inputIndex = hInput * inputWidth * inputDepth +
-                                                              wInput * inputDepth + dInput;
-                                        sum += (static_cast<int32_t>(filterBase[filterIndex])) *
-                                               (static_cast<int32_t>(inputBase[inputIndex]) +
-                                                inputOffset);
-                                    }
+                                    sum += static_cast<int32_t>(filter[k]) *
+                                           (static_cast<int32_t>(input[k]) + inputOffset);
                                 }
                             }
                         }
-                        int channelIndex = g * outputGroupDepth + d;
                         sum += biasData[channelIndex];
                         sum = tflite::MultiplyByQuantizedMultiplier(
                                 sum, outputMultiplier[channelIndex], -outputShift[channelIndex]);
                         sum += outputOffset;
                         sum = std::max(std::min(sum, output_activation_max), output_activation_min);
                         outPtr[d] = static_cast<uint8_t>(sum);
-                        filterBase += filterHeight * filterWidth * filterDepth;
                     }
                     outPtr += outputGroupDepth;
                 }
             }
         }
-        inputBase += inputHeight * inputWidth * inputDepth;
     }
 
     return true;
@@ -266,6 +372,16 @@ bool groupedConvFloat16(const _Float16* inputData, const Shape& inputShape,
                         int32_t stride_width, int32_t stride_height, int32_t numGroups,
                         int32_t activation, _Float16* outputData, const Shape& outputShape) {
     NNTRACE_TRANS("groupConvFloat16");
+    if (isDepthwise(filterShape, numGroups)) {
+        Shape depthwiseFilterShape;
+        const auto depthwiseFilter =
+                toDepthwiseFilter(filterData, filterShape, &depthwiseFilterShape);
+        return depthwiseConvFloat16(
+                inputData, inputShape, depthwiseFilter.data(), depthwiseFilterShape, biasData,
+                biasShape, padding_left, padding_right, padding_top, padding_bottom, stride_width,
+                stride_height, 1, 1, getSizeOfDimension(outputShape, 3) / numGroups, activation,
+                outputData, outputShape);
+    }
 
     std::vector<float> inputData_float32(getNumberOfElements(inputShape));
     std::vector<float> filterData_float32(getNumberOfElements(filterShape));
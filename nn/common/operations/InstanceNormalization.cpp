@@ -19,6 +19,7 @@
 #include "CpuOperationUtils.h"
 #include "HalInterfaces.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
 #include "Tracing.h"
 
 #include <cmath>
@@ -42,48 +43,41 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
+// Normalizes each (batch, channel) instance independently.  In NHWC the
+// elements of an instance are depth apart, in NCHW they are contiguous, so
+// either layout is read in place.
 template <typename T>
-inline bool instanceNormNhwc(const T* inputData, const Shape& inputShape, T gamma, T beta,
-                             T epsilon, T* outputData, const Shape& outputShape) {
-    NNTRACE_TRANS("InstanceNormalizationNhwc");
+inline bool instanceNorm(const T* inputData, const Shape& inputShape, T gamma, T beta, T epsilon,
+                         bool useNchw, T* outputData, const Shape& outputShape,
+                         ThreadPool* threadPool) {
+    NNTRACE_TRANS("InstanceNormalization");
+    NN_RET_CHECK_EQ(getNumberOfDimensions(inputShape), 4);
     uint32_t numBatches = getSizeOfDimension(inputShape, 0);
-    uint32_t height = getSizeOfDimension(inputShape, 1);
-    uint32_t width = getSizeOfDimension(inputShape, 2);
-    uint32_t depth = getSizeOfDimension(inputShape, 3);
-    for (uint32_t b = 0; b < numBatches; b++) {
-        for (uint32_t d = 0; d < depth; d++) {
-            uint32_t indexBase = b * height * width * depth + d;
+    uint32_t height = getSizeOfDimension(inputShape, useNchw ? 2 : 1);
+    uint32_t width = getSizeOfDimension(inputShape, useNchw ? 3 : 2);
+    uint32_t depth = getSizeOfDimension(inputShape, useNchw ? 1 : 3);
+    const uint32_t spatialSize = height * width;
+    const uint32_t elementStride = useNchw ? 1 : depth;
+    parallelFor(threadPool, 0, numBatches * depth, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t instance = begin; instance < end; instance++) {
+            const uint32_t b = instance / depth;
+            const uint32_t d = instance % depth;
+            const uint32_t indexBase =
+                    useNchw ? instance * spatialSize : b * spatialSize * depth + d;
             T mean = 0, var = 0;
-            for (uint32_t h = 0; h < height; h++) {
-                for (uint32_t w = 0; w < width; w++) {
-                    T val = inputData[indexBase + (h * width + w) * depth];
-                    mean += val;
-                    var += val * val;
-                }
+            for (uint32_t i = 0; i < spatialSize; i++) {
+                T val = inputData[indexBase + i * elementStride];
+                mean += val;
+                var += val * val;
             }
-            mean /= static_cast<T>(height * width);
-            var = std::sqrt(static_cast<float>(var / static_cast<T>(height * width)) + epsilon);
-            for (uint32_t h = 0; h < height; h++) {
-                for (uint32_t w = 0; w < width; w++) {
-                    uint32_t ind = indexBase + (h * width + w) * depth;
-                    outputData[ind] = (inputData[ind] - mean) * gamma / var + beta;
-                }
+            mean /= static_cast<T>(spatialSize);
+            var = std::sqrt(static_cast<float>(var / static_cast<T>(spatialSize)) + epsilon);
+            for (uint32_t i = 0; i < spatialSize; i++) {
+                uint32_t ind = indexBase + i * elementStride;
+                outputData[ind] = (inputData[ind] - mean) * gamma / var + beta;
             }
         }
-    }
-    return true;
-}
-
-template <typename T>
-inline bool instanceNorm(const T* inputData, const Shape& inputShape, T gamma, T beta, T epsilon,
-                         bool useNchw, T* outputData, const Shape& outputShape) {
-    InputWithLayout<T> input(useNchw);
-    OutputWithLayout<T> output(useNchw);
-    NN_RET_CHECK(input.initialize(inputData, inputShape));
-    NN_RET_CHECK(output.initialize(outputData, outputShape));
-    NN_RET_CHECK(instanceNormNhwc(input.getNhwcBuffer(), input.getNhwcShape(), gamma, beta, epsilon,
-                                  output.getNhwcBuffer(), output.getNhwcShape()));
-    NN_RET_CHECK(output.commit());
+    });
     return true;
 }
 
@@ -125,7 +119,8 @@ bool execute(IOperationExecutionContext* context) {
                                 context->getInputValue<_Float16>(kEpsilonScalar),
                                 context->getInputValue<bool>(kLayoutScalar),
                                 context->getOutputBuffer<_Float16>(kOutputTensor),
-                                context->getOutputShape(kOutputTensor));
+                                context->getOutputShape(kOutputTensor),
+                                context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return instanceNorm(context->getInputBuffer<float>(kInputTensor),
                                 context->getInputShape(kInputTensor),
@@ -134,7 +129,8 @@ bool execute(IOperationExecutionContext* context) {
                                 context->getInputValue<float>(kEpsilonScalar),
                                 context->getInputValue<bool>(kLayoutScalar),
                                 context->getOutputBuffer<float>(kOutputTensor),
-                                context->getOutputShape(kOutputTensor));
+                                context->getOutputShape(kOutputTensor),
+                                context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
     }
@@ -19,10 +19,9 @@
 #include "HalInterfaces.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "Softmax.h"
 #include "Tracing.h"
 
-#include <cmath>
-
 namespace android {
 namespace nn {
 namespace log_softmax {
@@ -37,38 +36,6 @@ constexpr uint32_t kInputAxis = 2;
 constexpr uint32_t kNumOutputs = 1;
 constexpr uint32_t kOutputTensor = 0;
 
-template <typename T>
-inline bool compute(const T* input, const Shape& shape, T beta, uint32_t axis, T* output) {
-    const uint32_t outerSize = getNumberOfElements(shape, 0, axis);
-    const uint32_t axisSize = getSizeOfDimension(shape, axis);
-    const uint32_t innerSize = getNumberOfElements(shape, axis + 1, getNumberOfDimensions(shape));
-    for (uint32_t outer = 0; outer < outerSize; ++outer) {
-        for (uint32_t inner = 0; inner < innerSize; ++inner) {
-            // We subtract the maximum value from each element to ensure
-            // numerical stability, taking advantage of the following equality:
-            // exp(x[i])/sum(exp(x[i])) == exp(x[i]+C)/sum(exp(x[i]+C))
-            T maxValue = input[outer * axisSize * innerSize + inner];
-            for (uint32_t i = 1; i < axisSize; ++i) {
-                maxValue = std::max(maxValue, input[(outer * axisSize + i) * innerSize + inner]);
-            }
-
-            T sum = 0;
-            for (uint32_t i = 0; i < axisSize; ++i) {
-                sum += std::exp(static_cast<double>(
-                        (input[(outer * axisSize + i) * innerSize + inner] - maxValue) * beta));
-            }
-
-            const T logSum = std::log(static_cast<double>(sum));
-            for (uint32_t i = 0; i < axisSize; ++i) {
-                output[(outer * axisSize + i) * innerSize + inner] =
-                        (input[(outer * axisSize + i) * innerSize + inner] - maxValue) * beta -
-                        logSum;
-            }
-        }
-    }
-    return true;
-}
-
 bool validate(const IOperationValidationContext* context) {
     NN_RET_CHECK_EQ(context->getNumInputs(), kNumInputs);
     NN_RET_CHECK_EQ(context->getNumOutputs(), kNumOutputs);
@@ -99,15 +66,19 @@ bool execute(IOperationExecutionContext* context) {
     NN_RET_CHECK(handleNegativeAxis(context->getInputShape(kInputTensor), &axis));
     switch (context->getInputType(kInputTensor)) {
         case OperandType::TENSOR_FLOAT16:
-            return compute(context->getInputBuffer<_Float16>(kInputTensor),
-                           context->getInputShape(kInputTensor),
-                           context->getInputValue<_Float16>(kInputBeta), axis,
-                           context->getOutputBuffer<_Float16>(kOutputTensor));
+            return softmax::softmaxFloat(context->getInputBuffer<_Float16>(kInputTensor),
+                                         context->getInputShape(kInputTensor),
+                                         context->getInputValue<_Float16>(kInputBeta), axis,
+                                         /*isLog=*/true,
+                                         context->getOutputBuffer<_Float16>(kOutputTensor),
+                                         context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
-            return compute(context->getInputBuffer<float>(kInputTensor),
-                           context->getInputShape(kInputTensor),
-                           context->getInputValue<float>(kInputBeta), axis,
-                           context->getOutputBuffer<float>(kOutputTensor));
+            return softmax::softmaxFloat(context->getInputBuffer<float>(kInputTensor),
+                                         context->getInputShape(kInputTensor),
+                                         context->getInputValue<float>(kInputBeta), axis,
+                                         /*isLog=*/true,
+                                         context->getOutputBuffer<float>(kOutputTensor),
+                                         context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
     }
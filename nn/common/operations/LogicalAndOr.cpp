@@ -16,8 +16,8 @@
 
 #define LOG_TAG "Operations"
 
+#include "BroadcastUtils.h"
 #include "HalInterfaces.h"
-#include "IndexedShapeWrapper.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
 
@@ -34,25 +34,14 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-bool compute(const std::function<bool(bool, bool)>& func, const bool8* aData, const Shape& aShape,
-             const bool8* bData, const Shape& bShape, bool8* outputData, const Shape& outputShape) {
-    IndexedShapeWrapper aShapeIndexed(aShape);
-    IndexedShapeWrapper bShapeIndexed(bShape);
-    IndexedShapeWrapper outputShapeIndexed(outputShape);
-    std::vector<uint32_t> curIndex(outputShape.dimensions.size(), 0);
-    bool lastIndex = false;
-    do {
-        uint32_t outputFlatIndex;
-        NN_RET_CHECK(outputShapeIndexed.indexToFlatIndex(curIndex, &outputFlatIndex));
-        uint32_t aFlatIndex;
-        NN_RET_CHECK(aShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &aFlatIndex));
-        uint32_t bFlatIndex;
-        NN_RET_CHECK(bShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &bFlatIndex));
-
-        outputData[outputFlatIndex] = func(aData[aFlatIndex], bData[bFlatIndex]);
-
-        NN_RET_CHECK(outputShapeIndexed.nextIndexInplace(&curIndex, &lastIndex));
-    } while (!lastIndex);
+template <typename Function>
+bool compute(Function func, const bool8* aData, const Shape& aShape, const bool8* bData,
+             const Shape& bShape, bool8* outputData, ThreadPool* threadPool) {
+    BinaryBroadcast broadcast;
+    NN_RET_CHECK(broadcast.initialize(aShape, bShape));
+    broadcast.compute(
+            aData, bData, outputData, [func](bool8 a, bool8 b) -> bool8 { return func(a, b); },
+            threadPool);
     return true;
 }
 
@@ -82,7 +71,7 @@ bool executeAnd(IOperationExecutionContext* context) {
             std::logical_and<bool>(), context->getInputBuffer<bool8>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<bool8>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 bool executeOr(IOperationExecutionContext* context) {
@@ -90,7 +79,7 @@ bool executeOr(IOperationExecutionContext* context) {
             std::logical_or<bool>(), context->getInputBuffer<bool8>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<bool8>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<bool8>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getThreadPool());
 }
 
 }  // namespace logical
@@ -17,7 +17,7 @@
 #define LOG_TAG "Operations"
 
 #include "MaximumMinimum.h"
-#include "IndexedShapeWrapper.h"
+#include "BroadcastUtils.h"
 #include "OperationsUtils.h"
 #include "Tracing.h"
 
@@ -29,55 +29,45 @@ namespace {
 
 template <typename T>
 bool evalGeneric(const T* aData, const Shape& aShape, const T* bData, const Shape& bShape,
-                 bool isMinimum, T* outputData, const Shape& outputShape) {
-    IndexedShapeWrapper aShapeIndexed(aShape);
-    IndexedShapeWrapper bShapeIndexed(bShape);
-    IndexedShapeWrapper outputShapeIndexed(outputShape);
-
-    std::vector<uint32_t> curIndex(outputShape.dimensions.size(), 0);
-    bool lastIndex = false;
-    do {
-        uint32_t outputFlatIndex;
-        NN_CHECK(outputShapeIndexed.indexToFlatIndex(curIndex, &outputFlatIndex));
-        uint32_t aFlatIndex;
-        NN_CHECK(aShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &aFlatIndex));
-        uint32_t bFlatIndex;
-        NN_CHECK(bShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &bFlatIndex));
-
-        outputData[outputFlatIndex] = isMinimum ? std::min(aData[aFlatIndex], bData[bFlatIndex])
-                                                : std::max(aData[aFlatIndex], bData[bFlatIndex]);
-
-        NN_CHECK(outputShapeIndexed.nextIndexInplace(&curIndex, &lastIndex));
-    } while (!lastIndex);
-
+                 bool isMinimum, T* outputData, ThreadPool* threadPool) {
+    BinaryBroadcast broadcast;
+    NN_CHECK(broadcast.initialize(aShape, bShape));
+    if (isMinimum) {
+        broadcast.compute(
+                aData, bData, outputData, [](T a, T b) { return std::min(a, b); }, threadPool);
+    } else {
+        broadcast.compute(
+                aData, bData, outputData, [](T a, T b) { return std::max(a, b); }, threadPool);
+    }
     return true;
 }
 
 bool evalQuant8(const uint8_t* aData, const Shape& aShape, const uint8_t* bData,
                 const Shape& bShape, bool isMinimum, uint8_t* outputData,
-                const Shape& outputShape) {
-    IndexedShapeWrapper aShapeIndexed(aShape);
-    IndexedShapeWrapper bShapeIndexed(bShape);
-    IndexedShapeWrapper outputShapeIndexed(outputShape);
-
-    std::vector<uint32_t> curIndex(outputShape.dimensions.size(), 0);
-    bool lastIndex = false;
-    do {
-        uint32_t outputFlatIndex;
-        NN_CHECK(outputShapeIndexed.indexToFlatIndex(curIndex, &outputFlatIndex));
-        uint32_t aFlatIndex;
-        NN_CHECK(aShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &aFlatIndex));
-        uint32_t bFlatIndex;
-        NN_CHECK(bShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &bFlatIndex));
-
-        uint8_t aValue = requantize(aData[aFlatIndex], aShape, outputShape);
-        uint8_t bValue = requantize(bData[bFlatIndex], bShape, outputShape);
-        outputData[outputFlatIndex] =
-                isMinimum ? std::min(aValue, bValue) : std::max(aValue, bValue);
-
-        NN_CHECK(outputShapeIndexed.nextIndexInplace(&curIndex, &lastIndex));
-    } while (!lastIndex);
-
+                const Shape& outputShape, ThreadPool* threadPool) {
+    BinaryBroadcast broadcast;
+    NN_CHECK(broadcast.initialize(aShape, bShape));
+    // Requantize through tables of all the possible values.
+    uint8_t aTable[256], bTable[256];
+    for (uint32_t value = 0; value < 256; ++value) {
+        aTable[value] = requantize(value, aShape, outputShape);
+        bTable[value] = requantize(value, bShape, outputShape);
+    }
+    if (isMinimum) {
+        broadcast.compute(
+                aData, bData, outputData,
+                [&aTable, &bTable](uint8_t a, uint8_t b) {
+                    return std::min(aTable[a], bTable[b]);
+                },
+                threadPool);
+    } else {
+        broadcast.compute(
+                aData, bData, outputData,
+                [&aTable, &bTable](uint8_t a, uint8_t b) {
+                    return std::max(aTable[a], bTable[b]);
+                },
+                threadPool);
+    }
     return true;
 }
 
@@ -89,28 +79,28 @@ bool prepare(const Shape& in1, const Shape& in2, Shape* out) {
 }
 
 bool eval(const void* in1, const Shape& shape1, const void* in2, const Shape& shape2,
-          bool isMinimum, void* output, const Shape& outputShape) {
+          bool isMinimum, void* output, const Shape& outputShape, ThreadPool* threadPool) {
     NNTRACE_COMP("maximum_minimum::eval");
     switch (shape1.type) {
         case OperandType::TENSOR_FLOAT16: {
             return evalGeneric(reinterpret_cast<const _Float16*>(in1), shape1,
                                reinterpret_cast<const _Float16*>(in2), shape2, isMinimum,
-                               reinterpret_cast<_Float16*>(output), outputShape);
+                               reinterpret_cast<_Float16*>(output), threadPool);
         }
         case OperandType::TENSOR_FLOAT32: {
             return evalGeneric(reinterpret_cast<const float*>(in1), shape1,
                                reinterpret_cast<const float*>(in2), shape2, isMinimum,
-                               reinterpret_cast<float*>(output), outputShape);
+                               reinterpret_cast<float*>(output), threadPool);
         }
         case OperandType::TENSOR_INT32: {
             return evalGeneric(reinterpret_cast<const int32_t*>(in1), shape1,
                                reinterpret_cast<const int32_t*>(in2), shape2, isMinimum,
-                               reinterpret_cast<int32_t*>(output), outputShape);
+                               reinterpret_cast<int32_t*>(output), threadPool);
         }
         case OperandType::TENSOR_QUANT8_ASYMM: {
             return evalQuant8(reinterpret_cast<const uint8_t*>(in1), shape1,
                               reinterpret_cast<const uint8_t*>(in2), shape2, isMinimum,
-                              reinterpret_cast<uint8_t*>(output), outputShape);
+                              reinterpret_cast<uint8_t*>(output), outputShape, threadPool);
         }
         default: {
             LOG(ERROR) << "Unsupported data type: " << toString(shape1.type);
@@ -26,7 +26,7 @@ namespace maximum_minimum {
 bool prepare(const Shape& in1, const Shape& in2, Shape* output);
 
 bool eval(const void* in1, const Shape& shape1, const void* in2, const Shape& shape2,
-          bool isMinimum, void* output, const Shape& outputShape);
+          bool isMinimum, void* output, const Shape& outputShape, ThreadPool* threadPool);
 
 }  // namespace maximum_minimum
 }  // namespace nn
@@ -16,8 +16,8 @@
 
 #define LOG_TAG "Operations"
 
+#include "BroadcastUtils.h"
 #include "HalInterfaces.h"
-#include "IndexedShapeWrapper.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
 #include "Tracing.h"
@@ -36,32 +36,18 @@ constexpr uint32_t kAlphaTensor = 1;
 constexpr uint32_t kNumOutputs = 1;
 constexpr uint32_t kOutputTensor = 0;
 
-template <typename T>
-inline bool eval(const std::function<T(const T&, const T&)>& func, const T* aData,
-                 const Shape& aShape, const T* bData, const Shape& bShape, T* outputData,
-                 const Shape& outputShape) {
-    IndexedShapeWrapper aShapeIndexed(aShape);
-    IndexedShapeWrapper bShapeIndexed(bShape);
-    IndexedShapeWrapper outputShapeIndexed(outputShape);
-    std::vector<uint32_t> curIndex(outputShape.dimensions.size(), 0);
-    bool lastIndex = false;
-    do {
-        uint32_t outputFlatIndex;
-        NN_RET_CHECK(outputShapeIndexed.indexToFlatIndex(curIndex, &outputFlatIndex));
-        uint32_t aFlatIndex;
-        NN_RET_CHECK(aShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &aFlatIndex));
-        uint32_t bFlatIndex;
-        NN_RET_CHECK(bShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &bFlatIndex));
-
-        outputData[outputFlatIndex] = func(aData[aFlatIndex], bData[bFlatIndex]);
-
-        NN_RET_CHECK(outputShapeIndexed.nextIndexInplace(&curIndex, &lastIndex));
-    } while (!lastIndex);
+template <typename T, typename Function>
+inline bool eval(Function func, const T* aData, const Shape& aShape, const T* bData,
+                 const Shape& bShape, T* outputData, ThreadPool* threadPool) {
+    BinaryBroadcast broadcast;
+    NN_RET_CHECK(broadcast.initialize(aShape, bShape));
+    broadcast.compute(aData, bData, outputData, func, threadPool);
     return true;
 }
 
 bool evalQuant8(const uint8_t* aData, const Shape& aShape, const uint8_t* bData,
-                const Shape& bShape, uint8_t* outputData, const Shape& outputShape) {
+                const Shape& bShape, uint8_t* outputData, const Shape& outputShape,
+                ThreadPool* threadPool) {
     const int32_t input_offset = -aShape.offset;
     const int32_t alpha_offset = -bShape.offset;
     const int32_t output_offset = outputShape.offset;
@@ -73,7 +59,7 @@ bool evalQuant8(const uint8_t* aData, const Shape& aShape, const uint8_t* bData,
     tflite::QuantizeMultiplier(real_multiplier_pos, &output_multiplier_pos, &output_shift_pos);
     tflite::QuantizeMultiplier(real_multiplier_neg, &output_multiplier_neg, &output_shift_neg);
     return eval<uint8_t>(
-            [&](const uint8_t& val1, const uint8_t& val2) -> uint8_t {
+            [&](uint8_t val1, uint8_t val2) -> uint8_t {
                 const int32_t input = input_offset + static_cast<int32_t>(val1);
                 int32_t output_val;
                 if (input >= 0) {
@@ -89,7 +75,7 @@ bool evalQuant8(const uint8_t* aData, const Shape& aShape, const uint8_t* bData,
                 output_val = std::max(0, std::min(255, output_val));
                 return static_cast<uint8_t>(output_val);
             },
-            aData, aShape, bData, bShape, outputData, outputShape);
+            aData, aShape, bData, bShape, outputData, threadPool);
 }
 
 bool validate(const IOperationValidationContext* context) {
@@ -118,7 +104,7 @@ bool execute(IOperationExecutionContext* context) {
     switch (context->getInputType(kInputTensor)) {
         case OperandType::TENSOR_FLOAT16:
             return eval<_Float16>(
-                    [](const _Float16& val1, const _Float16& val2) -> _Float16 {
+                    [](_Float16 val1, _Float16 val2) -> _Float16 {
                         return val1 >= 0.0f ? val1 : val1 * val2;
                     },
                     context->getInputBuffer<_Float16>(kInputTensor),
@@ -126,10 +112,10 @@ bool execute(IOperationExecutionContext* context) {
                     context->getInputBuffer<_Float16>(kAlphaTensor),
                     context->getInputShape(kAlphaTensor),
                     context->getOutputBuffer<_Float16>(kOutputTensor),
-                    context->getOutputShape(kOutputTensor));
+                    context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return eval<float>(
-                    [](const float& val1, const float& val2) -> float {
+                    [](float val1, float val2) -> float {
                         return val1 >= 0.0f ? val1 : val1 * val2;
                     },
                     context->getInputBuffer<float>(kInputTensor),
@@ -137,14 +123,14 @@ bool execute(IOperationExecutionContext* context) {
                     context->getInputBuffer<float>(kAlphaTensor),
                     context->getInputShape(kAlphaTensor),
                     context->getOutputBuffer<float>(kOutputTensor),
-                    context->getOutputShape(kOutputTensor));
+                    context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM: {
             return evalQuant8(context->getInputBuffer<uint8_t>(kInputTensor),
                               context->getInputShape(kInputTensor),
                               context->getInputBuffer<uint8_t>(kAlphaTensor),
                               context->getInputShape(kAlphaTensor),
                               context->getOutputBuffer<uint8_t>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getOutputShape(kOutputTensor), context->getThreadPool());
         }
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
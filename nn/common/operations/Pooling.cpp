@@ -16,11 +16,18 @@
 
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
 
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
 
 #include "Tracing.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+
 namespace android {
 namespace nn {
 namespace pooling {
@@ -118,6 +125,54 @@ struct PoolingParam {
     }
 };
 
+// Pools a _Float16 tensor directly, accumulating each window in float.
+// accumulate(sum, x) folds an input value into the window, and finish(sum,
+// count) turns it into the output value given the number of input values under
+// the window, which excludes the padding as in the tflite kernels.
+template <typename Accumulate, typename Finish>
+void poolFloat16Nhwc(const _Float16* inputData, const Shape& inputShape, const PoolingParam& param,
+                     _Float16* outputData, const Shape& outputShape, float initialValue,
+                     Accumulate accumulate, Finish finish) {
+    float activationMin, activationMax;
+    CalculateActivationRangeFloat(param.activation, &activationMin, &activationMax);
+
+    const int32_t batches = getSizeOfDimension(inputShape, 0);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 1);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 2);
+    const int32_t depth = getSizeOfDimension(inputShape, 3);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 1);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 2);
+    std::vector<float> window(depth);
+    for (int32_t b = 0; b < batches; b++) {
+        for (int32_t outY = 0; outY < outHeight; outY++) {
+            const int32_t inYOrigin = outY * param.stride_height - param.padding_top;
+            const int32_t yBegin = std::max(0, inYOrigin);
+            const int32_t yEnd = std::min(inHeight, inYOrigin + param.filter_height);
+            for (int32_t outX = 0; outX < outWidth; outX++) {
+                const int32_t inXOrigin = outX * param.stride_width - param.padding_left;
+                const int32_t xBegin = std::max(0, inXOrigin);
+                const int32_t xEnd = std::min(inWidth, inXOrigin + param.filter_width);
+                std::fill(window.begin(), window.end(), initialValue);
+                for (int32_t inY = yBegin; inY < yEnd; inY++) {
+                    for (int32_t inX = xBegin; inX < xEnd; inX++) {
+                        const _Float16* input =
+                                inputData + ((b * inHeight + inY) * inWidth + inX) * depth;
+                        for (int32_t c = 0; c < depth; c++) {
+                            window[c] = accumulate(window[c], static_cast<float>(input[c]));
+                        }
+                    }
+                }
+                const int32_t count = std::max(0, yEnd - yBegin) * std::max(0, xEnd - xBegin);
+                _Float16* output = outputData + ((b * outHeight + outY) * outWidth + outX) * depth;
+                for (int32_t c = 0; c < depth; c++) {
+                    output[c] = clampToFloat16(finish(window[c], count), activationMin,
+                                               activationMax);
+                }
+            }
+        }
+    }
+}
+
 bool averagePoolNhwc(const float* inputData, const Shape& inputShape, const PoolingParam& param,
                      float* outputData, const Shape& outputShape) {
     NNTRACE_TRANS("averagePoolFloat32");
@@ -131,13 +186,11 @@ bool averagePoolNhwc(const float* inputData, const Shape& inputShape, const Pool
 bool averagePoolNhwc(const _Float16* inputData, const Shape& inputShape, const PoolingParam& param,
                      _Float16* outputData, const Shape& outputShape) {
     NNTRACE_TRANS("averagePoolFloat16");
-    std::vector<float> inputDataFloat32(getNumberOfElements(inputShape));
-    std::vector<float> outputDataFloat32(getNumberOfElements(outputShape));
-
-    convertFloat16ToFloat32(inputData, &inputDataFloat32);
-    averagePoolNhwc(inputDataFloat32.data(), inputShape, param, outputDataFloat32.data(),
-                    outputShape);
-    convertFloat32ToFloat16(outputDataFloat32, outputData);
+    NNTRACE_COMP_SWITCH("poolFloat16Nhwc");
+    poolFloat16Nhwc(
+            inputData, inputShape, param, outputData, outputShape, 0.0f,
+            [](float sum, float x) { return sum + x; },
+            [](float sum, int32_t count) { return count > 0 ? sum / count : 0.0f; });
     return true;
 }
 
@@ -164,12 +217,11 @@ bool l2PoolNhwc(const float* inputData, const Shape& inputShape, const PoolingPa
 bool l2PoolNhwc(const _Float16* inputData, const Shape& inputShape, const PoolingParam& param,
                 _Float16* outputData, const Shape& outputShape) {
     NNTRACE_TRANS("l2PoolFloat16");
-    std::vector<float> inputDataFloat32(getNumberOfElements(inputShape));
-    std::vector<float> outputDataFloat32(getNumberOfElements(outputShape));
-
-    convertFloat16ToFloat32(inputData, &inputDataFloat32);
-    l2PoolNhwc(inputDataFloat32.data(), inputShape, param, outputDataFloat32.data(), outputShape);
-    convertFloat32ToFloat16(outputDataFloat32, outputData);
+    NNTRACE_COMP_SWITCH("poolFloat16Nhwc");
+    poolFloat16Nhwc(
+            inputData, inputShape, param, outputData, outputShape, 0.0f,
+            [](float sum, float x) { return sum + x * x; },
+            [](float sum, int32_t count) { return count > 0 ? std::sqrt(sum / count) : 0.0f; });
     return true;
 }
 
@@ -196,53 +248,226 @@ bool maxPoolNhwc(const uint8_t* inputData, const Shape& inputShape, const Poolin
 bool maxPoolNhwc(const _Float16* inputData, const Shape& inputShape, const PoolingParam& param,
                  _Float16* outputData, const Shape& outputShape) {
     NNTRACE_TRANS("maxPoolFloat16");
-    std::vector<float> inputData_float32(getNumberOfElements(inputShape));
-    std::vector<float> outputData_float32(getNumberOfElements(outputShape));
+    NNTRACE_COMP_SWITCH("poolFloat16Nhwc");
+    poolFloat16Nhwc(
+            inputData, inputShape, param, outputData, outputShape,
+            std::numeric_limits<float>::lowest(),
+            [](float maxValue, float x) { return std::max(maxValue, x); },
+            [](float maxValue, int32_t) { return maxValue; });
+    return true;
+}
 
-    convertFloat16ToFloat32(inputData, &inputData_float32);
-    maxPoolNhwc(inputData_float32.data(), inputShape, param, outputData_float32.data(),
-                outputShape);
-    convertFloat32ToFloat16(outputData_float32, outputData);
+// Runs poolNhwc in parallel on bands of output rows of each batch.  Each band
+// is pooled from the input rows under its windows, with the top padding
+// adjusted, which gives the same results as pooling the whole tensor.
+template <typename T, typename PoolNhwc>
+bool poolNhwcInParallel(ThreadPool* threadPool, const T* inputData, const Shape& inputShape,
+                        const PoolingParam& param, T* outputData, const Shape& outputShape,
+                        PoolNhwc poolNhwc) {
+    const uint32_t numBatches = getSizeOfDimension(outputShape, 0);
+    const uint32_t inputHeight = getSizeOfDimension(inputShape, 1);
+    const uint32_t outputHeight = getSizeOfDimension(outputShape, 1);
+    const uint32_t inputRowSize =
+            getSizeOfDimension(inputShape, 2) * getSizeOfDimension(inputShape, 3);
+    const uint32_t outputRowSize =
+            getSizeOfDimension(outputShape, 2) * getSizeOfDimension(outputShape, 3);
+    std::atomic<bool> success(true);
+    parallelFor(threadPool, 0, numBatches * outputHeight, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t row = begin; row < end;) {
+            const uint32_t batch = row / outputHeight;
+            const uint32_t bandBegin = row % outputHeight;
+            const uint32_t bandEnd = std::min(outputHeight, bandBegin + (end - row));
+            // The input rows read by the windows of output rows [bandBegin, bandEnd).
+            const int32_t windowBegin = static_cast<int32_t>(bandBegin) * param.stride_height -
+                                        param.padding_top;
+            const int32_t windowEnd = static_cast<int32_t>(bandEnd - 1) * param.stride_height -
+                                      param.padding_top + param.filter_height;
+            const uint32_t inputBegin = std::max(windowBegin, 0);
+            const uint32_t inputEnd =
+                    std::min(static_cast<uint32_t>(std::max(windowEnd, 0)), inputHeight);
+
+            PoolingParam bandParam = param;
+            bandParam.padding_top = static_cast<int32_t>(inputBegin) - windowBegin;
+            Shape bandInputShape = inputShape;
+            bandInputShape.dimensions = {1, inputEnd - inputBegin, inputShape.dimensions[2],
+                                         inputShape.dimensions[3]};
+            Shape bandOutputShape = outputShape;
+            bandOutputShape.dimensions = {1, bandEnd - bandBegin, outputShape.dimensions[2],
+                                          outputShape.dimensions[3]};
+            if (!poolNhwc(inputData + (batch * inputHeight + inputBegin) * inputRowSize,
+                          bandInputShape, bandParam,
+                          outputData + (batch * outputHeight + bandBegin) * outputRowSize,
+                          bandOutputShape)) {
+                success = false;
+            }
+            row += bandEnd - bandBegin;
+        }
+    });
+    return success;
+}
+
+// Pools an NCHW tensor one (batch, channel) plane at a time, in parallel.
+// accumulate(acc, x) folds an input value into a window that starts at
+// initialValue, and finish(acc, count) turns it into the output value given the
+// number of input values under the window.
+template <typename T, typename Acc, typename Accumulate, typename Finish>
+bool poolNchw(ThreadPool* threadPool, const T* inputData, const Shape& inputShape,
+              const PoolingParam& param, T* outputData, const Shape& outputShape, Acc initialValue,
+              Accumulate accumulate, Finish finish) {
+    const uint32_t numPlanes =
+            getSizeOfDimension(inputShape, 0) * getSizeOfDimension(inputShape, 1);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 2);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 3);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 2);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 3);
+    parallelFor(threadPool, 0, numPlanes, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t plane = begin; plane < end; plane++) {
+            const T* input = inputData + plane * inHeight * inWidth;
+            T* output = outputData + plane * outHeight * outWidth;
+            for (int32_t outY = 0; outY < outHeight; outY++) {
+                const int32_t inYOrigin = outY * param.stride_height - param.padding_top;
+                const int32_t yBegin = std::max(0, inYOrigin);
+                const int32_t yEnd = std::min(inHeight, inYOrigin + param.filter_height);
+                for (int32_t outX = 0; outX < outWidth; outX++) {
+                    const int32_t inXOrigin = outX * param.stride_width - param.padding_left;
+                    const int32_t xBegin = std::max(0, inXOrigin);
+                    const int32_t xEnd = std::min(inWidth, inXOrigin + param.filter_width);
+                    Acc window = initialValue;
+                    for (int32_t inY = yBegin; inY < yEnd; inY++) {
+                        const T* row = input + inY * inWidth;
+                        for (int32_t inX = xBegin; inX < xEnd; inX++) {
+                            window = accumulate(window, row[inX]);
+                        }
+                    }
+                    const int32_t count =
+                            std::max(0, yEnd - yBegin) * std::max(0, xEnd - xBegin);
+                    output[outY * outWidth + outX] = finish(window, count);
+                }
+            }
+        }
+    });
     return true;
 }
 
+template <typename T>
+bool averagePoolNchw(ThreadPool* threadPool, const T* inputData, const Shape& inputShape,
+                     const PoolingParam& param, T* outputData, const Shape& outputShape) {
+    NNTRACE_TRANS("averagePoolNchw");
+    float activationMin, activationMax;
+    CalculateActivationRangeFloat(param.activation, &activationMin, &activationMax);
+    return poolNchw(
+            threadPool, inputData, inputShape, param, outputData, outputShape, 0.0f,
+            [](float sum, T x) { return sum + static_cast<float>(x); },
+            [activationMin, activationMax](float sum, int32_t count) {
+                const float average = count > 0 ? sum / count : 0.0f;
+                return static_cast<T>(std::min(std::max(average, activationMin), activationMax));
+            });
+}
+
+template <>
+bool averagePoolNchw<uint8_t>(ThreadPool* threadPool, const uint8_t* inputData,
+                              const Shape& inputShape, const PoolingParam& param,
+                              uint8_t* outputData, const Shape& outputShape) {
+    NNTRACE_TRANS("averagePoolNchw");
+    int32_t activationMin = 0, activationMax = 0;
+    CalculateActivationRangeUint8(param.activation, outputShape, &activationMin, &activationMax);
+    // Rounds the average to nearest, like the tflite kernel.
+    return poolNchw(
+            threadPool, inputData, inputShape, param, outputData, outputShape, 0,
+            [](int32_t sum, uint8_t x) { return sum + static_cast<int32_t>(x); },
+            [activationMin, activationMax](int32_t sum, int32_t count) {
+                const int32_t average = count > 0 ? (sum + count / 2) / count : 0;
+                return static_cast<uint8_t>(
+                        std::min(std::max(average, activationMin), activationMax));
+            });
+}
+
+template <typename T>
+bool l2PoolNchw(ThreadPool* threadPool, const T* inputData, const Shape& inputShape,
+                const PoolingParam& param, T* outputData, const Shape& outputShape) {
+    NNTRACE_TRANS("l2PoolNchw");
+    float activationMin, activationMax;
+    CalculateActivationRangeFloat(param.activation, &activationMin, &activationMax);
+    return poolNchw(
+            threadPool, inputData, inputShape, param, outputData, outputShape, 0.0f,
+            [](float sum, T x) { return sum + static_cast<float>(x) * static_cast<float>(x); },
+            [activationMin, activationMax](float sum, int32_t count) {
+                const float l2 = count > 0 ? std::sqrt(sum / count) : 0.0f;
+                return static_cast<T>(std::min(std::max(l2, activationMin), activationMax));
+            });
+}
+
+template <typename T>
+bool maxPoolNchw(ThreadPool* threadPool, const T* inputData, const Shape& inputShape,
+                 const PoolingParam& param, T* outputData, const Shape& outputShape) {
+    NNTRACE_TRANS("maxPoolNchw");
+    float activationMin, activationMax;
+    CalculateActivationRangeFloat(param.activation, &activationMin, &activationMax);
+    return poolNchw(
+            threadPool, inputData, inputShape, param, outputData, outputShape,
+            std::numeric_limits<float>::lowest(),
+            [](float maxValue, T x) { return std::max(maxValue, static_cast<float>(x)); },
+            [activationMin, activationMax](float maxValue, int32_t) {
+                return static_cast<T>(std::min(std::max(maxValue, activationMin), activationMax));
+            });
+}
+
+template <>
+bool maxPoolNchw<uint8_t>(ThreadPool* threadPool, const uint8_t* inputData,
+                          const Shape& inputShape, const PoolingParam& param, uint8_t* outputData,
+                          const Shape& outputShape) {
+    NNTRACE_TRANS("maxPoolNchw");
+    int32_t activationMin = 0, activationMax = 0;
+    CalculateActivationRangeUint8(param.activation, outputShape, &activationMin, &activationMax);
+    return poolNchw(
+            threadPool, inputData, inputShape, param, outputData, outputShape, 0,
+            [](int32_t maxValue, uint8_t x) { return std::max(maxValue, static_cast<int32_t>(x)); },
+            [activationMin, activationMax](int32_t maxValue, int32_t) {
+                return static_cast<uint8_t>(
+                        std::min(std::max(maxValue, activationMin), activationMax));
+            });
+}
+
 template <typename T>
 bool averagePool(const T* inputData, const Shape& inputShape, const PoolingParam& param,
-                 T* outputData, const Shape& outputShape) {
-    InputWithLayout<T> input(param.useNchw);
-    OutputWithLayout<T> output(param.useNchw);
-    NN_RET_CHECK(input.initialize(inputData, inputShape));
-    NN_RET_CHECK(output.initialize(outputData, outputShape));
-    NN_RET_CHECK(averagePoolNhwc(input.getNhwcBuffer(), input.getNhwcShape(), param,
-                                 output.getNhwcBuffer(), output.getNhwcShape()));
-    NN_RET_CHECK(output.commit());
-    return true;
+                 T* outputData, const Shape& outputShape, ThreadPool* threadPool) {
+    if (param.useNchw) {
+        return averagePoolNchw(threadPool, inputData, inputShape, param, outputData, outputShape);
+    }
+    return poolNhwcInParallel(
+            threadPool, inputData, inputShape, param, outputData, outputShape,
+            [](const T* inputData, const Shape& inputShape, const PoolingParam& param,
+               T* outputData, const Shape& outputShape) {
+                return averagePoolNhwc(inputData, inputShape, param, outputData, outputShape);
+            });
 }
 
 template <typename T>
 bool l2Pool(const T* inputData, const Shape& inputShape, const PoolingParam& param, T* outputData,
-            const Shape& outputShape) {
-    InputWithLayout<T> input(param.useNchw);
-    OutputWithLayout<T> output(param.useNchw);
-    NN_RET_CHECK(input.initialize(inputData, inputShape));
-    NN_RET_CHECK(output.initialize(outputData, outputShape));
-    NN_RET_CHECK(l2PoolNhwc(input.getNhwcBuffer(), input.getNhwcShape(), param,
-                            output.getNhwcBuffer(), output.getNhwcShape()));
-    NN_RET_CHECK(output.commit());
-    return true;
+            const Shape& outputShape, ThreadPool* threadPool) {
+    if (param.useNchw) {
+        return l2PoolNchw(threadPool, inputData, inputShape, param, outputData, outputShape);
+    }
+    return poolNhwcInParallel(
+            threadPool, inputData, inputShape, param, outputData, outputShape,
+            [](const T* inputData, const Shape& inputShape, const PoolingParam& param,
+               T* outputData, const Shape& outputShape) {
+                return l2PoolNhwc(inputData, inputShape, param, outputData, outputShape);
+            });
 }
 
 template <typename T>
 bool maxPool(const T* inputData, const Shape& inputShape, const PoolingParam& param, T* outputData,
-             const Shape& outputShape) {
-    InputWithLayout<T> input(param.useNchw);
-    OutputWithLayout<T> output(param.useNchw);
-    NN_RET_CHECK(input.initialize(inputData, inputShape));
-    NN_RET_CHECK(output.initialize(outputData, outputShape));
-    NN_RET_CHECK(maxPoolNhwc(input.getNhwcBuffer(), input.getNhwcShape(), param,
-                             output.getNhwcBuffer(), output.getNhwcShape()));
-    NN_RET_CHECK(output.commit());
-    return true;
+             const Shape& outputShape, ThreadPool* threadPool) {
+    if (param.useNchw) {
+        return maxPoolNchw(threadPool, inputData, inputShape, param, outputData, outputShape);
+    }
+    return poolNhwcInParallel(
+            threadPool, inputData, inputShape, param, outputData, outputShape,
+            [](const T* inputData, const Shape& inputShape, const PoolingParam& param,
+               T* outputData, const Shape& outputShape) {
+                return maxPoolNhwc(inputData, inputShape, param, outputData, outputShape);
+            });
 }
 
 }  // namespace
@@ -333,7 +558,7 @@ bool prepare(IOperationExecutionContext* context) {
         return name(context->getInputBuffer<cppType>(kInputTensor),   \
                     context->getInputShape(kInputTensor), param,      \
                     context->getOutputBuffer<cppType>(kOutputTensor), \
-                    context->getOutputShape(kOutputTensor))
+                    context->getOutputShape(kOutputTensor), context->getThreadPool())
 
 bool executeAveragePool(IOperationExecutionContext* context) {
     // Bypass execution in the case of zero-sized input.
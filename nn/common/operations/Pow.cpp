@@ -17,7 +17,7 @@
 #define LOG_TAG "Operations"
 
 #include "Pow.h"
-#include "IndexedShapeWrapper.h"
+#include "BroadcastUtils.h"
 #include "OperationsUtils.h"
 
 #include <cmath>
@@ -30,27 +30,15 @@ namespace {
 
 template <typename T>
 bool evalGeneric(const T* baseData, const Shape& baseShape, const T* exponentData,
-                 const Shape& exponentShape, T* outputData, const Shape& outputShape) {
-    IndexedShapeWrapper baseShapeIndexed(baseShape);
-    IndexedShapeWrapper exponentShapeIndexed(exponentShape);
-    IndexedShapeWrapper outputShapeIndexed(outputShape);
-
-    std::vector<uint32_t> curIndex(outputShape.dimensions.size(), 0);
-    bool lastIndex = false;
-    do {
-        uint32_t outputFlatIndex;
-        NN_CHECK(outputShapeIndexed.indexToFlatIndex(curIndex, &outputFlatIndex));
-        uint32_t baseFlatIndex;
-        NN_CHECK(baseShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &baseFlatIndex));
-        uint32_t exponentFlatIndex;
-        NN_CHECK(exponentShapeIndexed.broadcastedIndexToFlatIndex(curIndex, &exponentFlatIndex));
-
-        outputData[outputFlatIndex] = std::pow(static_cast<float>(baseData[baseFlatIndex]),
-                                               static_cast<float>(exponentData[exponentFlatIndex]));
-
-        NN_CHECK(outputShapeIndexed.nextIndexInplace(&curIndex, &lastIndex));
-    } while (!lastIndex);
-
+                 const Shape& exponentShape, T* outputData, ThreadPool* threadPool) {
+    BinaryBroadcast broadcast;
+    NN_CHECK(broadcast.initialize(baseShape, exponentShape));
+    broadcast.compute(
+            baseData, exponentData, outputData,
+            [](T base, T exponent) -> T {
+                return std::pow(static_cast<float>(base), static_cast<float>(exponent));
+            },
+            threadPool);
     return true;
 }
 
@@ -65,17 +53,18 @@ bool prepare(const Shape& baseShape, const Shape& exponentShape, Shape* output)
 }
 
 bool eval(const void* baseData, const Shape& baseShape, const void* exponentData,
-          const Shape& exponentShape, void* outputData, const Shape& outputShape) {
+          const Shape& exponentShape, void* outputData, const Shape& /*outputShape*/,
+          ThreadPool* threadPool) {
     switch (baseShape.type) {
         case OperandType::TENSOR_FLOAT16: {
             return evalGeneric(reinterpret_cast<const _Float16*>(baseData), baseShape,
                                reinterpret_cast<const _Float16*>(exponentData), exponentShape,
-                               reinterpret_cast<_Float16*>(outputData), outputShape);
+                               reinterpret_cast<_Float16*>(outputData), threadPool);
         } break;
         case OperandType::TENSOR_FLOAT32: {
             return evalGeneric(reinterpret_cast<const float*>(baseData), baseShape,
                                reinterpret_cast<const float*>(exponentData), exponentShape,
-                               reinterpret_cast<float*>(outputData), outputShape);
+                               reinterpret_cast<float*>(outputData), threadPool);
         } break;
         default: {
             LOG(ERROR) << "Unsupported data type: " << toString(baseShape.type);
@@ -26,7 +26,8 @@ namespace pow {
 bool prepare(const Shape& in1, const Shape& in2, Shape* output);
 
 bool eval(const void* baseData, const Shape& baseShape, const void* exponentData,
-          const Shape& exponentShape, void* outputData, const Shape& outputShape);
+          const Shape& exponentShape, void* outputData, const Shape& outputShape,
+          ThreadPool* threadPool);
 
 }  // namespace pow
 }  // namespace nn
@@ -18,10 +18,11 @@
 #define LOG_TAG "Operations"
 
 #include "HalInterfaces.h"
-#include "IndexedShapeWrapper.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
 #include "Tracing.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace android {
@@ -36,27 +37,23 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-bool quantizeFloat32ToQuant8(const float* inputData, uint8_t* outputData,
-                             const Shape& outputShape) {
-    NNTRACE_COMP("quantizeFloat32ToQuant8");
-    uint32_t size = getNumberOfElements(outputShape);
-    for (uint32_t i = 0; i < size; ++i) {
-        outputData[i] = static_cast<uint8_t>(std::max<float>(
-                0, std::min<float>(255, outputShape.offset +
-                                                std::round(inputData[i] / outputShape.scale))));
-    }
-    return true;
-}
-
-bool quantizeFloat16ToQuant8(const _Float16* inputData, uint8_t* outputData,
-                             const Shape& outputShape) {
-    NNTRACE_COMP("quantizeFloat16ToQuant8");
-    uint32_t size = getNumberOfElements(outputShape);
-    for (uint32_t i = 0; i < size; ++i) {
-        outputData[i] = static_cast<uint8_t>(std::max<float>(
-                0, std::min<float>(255, outputShape.offset +
-                                                std::round(inputData[i] / outputShape.scale))));
-    }
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+template <typename T>
+bool quantizeToQuant8(const T* inputData, uint8_t* outputData, const Shape& outputShape,
+                      ThreadPool* threadPool) {
+    NNTRACE_COMP("quantizeToQuant8");
+    const float scale = outputShape.scale;
+    const float offset = outputShape.offset;
+    parallelFor(threadPool, 0, getNumberOfElements(outputShape), kMinChunkSize,
+                [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; ++i) {
+                        const float value = offset + std::round(inputData[i] / scale);
+                        outputData[i] =
+                                static_cast<uint8_t>(std::max(0.f, std::min(255.f, value)));
+                    }
+                });
     return true;
 }
 
@@ -90,13 +87,13 @@ bool execute(IOperationExecutionContext* context) {
 
     const OperandType inputType = context->getInputType(kInputTensor);
     if (inputType == OperandType::TENSOR_FLOAT32) {
-        return quantizeFloat32ToQuant8(context->getInputBuffer<float>(kInputTensor),
-                                       context->getOutputBuffer<uint8_t>(kOutputTensor),
-                                       context->getOutputShape(kOutputTensor));
+        return quantizeToQuant8(context->getInputBuffer<float>(kInputTensor),
+                                context->getOutputBuffer<uint8_t>(kOutputTensor),
+                                context->getOutputShape(kOutputTensor), context->getThreadPool());
     } else if (inputType == OperandType::TENSOR_FLOAT16) {
-        return quantizeFloat16ToQuant8(context->getInputBuffer<_Float16>(kInputTensor),
-                                       context->getOutputBuffer<uint8_t>(kOutputTensor),
-                                       context->getOutputShape(kOutputTensor));
+        return quantizeToQuant8(context->getInputBuffer<_Float16>(kInputTensor),
+                                context->getOutputBuffer<uint8_t>(kOutputTensor),
+                                context->getOutputShape(kOutputTensor), context->getThreadPool());
     }
     NN_RET_CHECK_FAIL() << "Unsupported tensor types combination for QUANTIZE op. (input type: "
                         << toString(inputType)
@@ -16,13 +16,18 @@
 
 #define LOG_TAG "Operations"
 
-#include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
+#include "Reduce.h"
 
 #include "HalInterfaces.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 #include "Tracing.h"
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 namespace android {
 namespace nn {
 namespace reduce {
@@ -42,27 +47,239 @@ constexpr _Float16 kFloat16Lowest = -kFloat16Max;
 
 namespace {
 
-template <typename T>
-inline bool compute(IOperationExecutionContext* context, T init, T func(T, T)) {
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+// The number of partial results kept side by side when reducing a contiguous
+// row, so that the reduction vectorizes.
+constexpr uint32_t kNumLanes = 16;
+
+// The number of kept inner elements reduced at a time when the innermost
+// dimension is kept.
+constexpr uint32_t kInnerTileSize = 256;
+
+struct ReducedDimension {
+    uint32_t size;
+    uint32_t stride;
+};
+
+// Describes a reduction with the input viewed as dimensions that alternate
+// between kept and reduced, after merging adjacent dimensions of the same kind
+// and dropping those of size 1.
+struct ReductionLayout {
+    // The kept and reduced dimensions other than the innermost one, outermost
+    // first, with their strides in the input.
+    std::vector<ReducedDimension> keptDimensions;
+    std::vector<ReducedDimension> reducedDimensions;
+    uint32_t innerSize = 1;
+    bool isInnerReduced = false;
+
+    uint32_t numOutputs = 1;
+    uint32_t numReducedElements = 1;
+};
+
+bool getReductionLayout(const Shape& inputShape, const int32_t* axes, uint32_t numAxes,
+                        ReductionLayout* layout) {
+    const uint32_t inputRank = getNumberOfDimensions(inputShape);
+    std::vector<bool> shouldReduce(inputRank);
+    for (uint32_t i = 0; i < numAxes; ++i) {
+        int32_t axis = axes[i];
+        NN_RET_CHECK(handleNegativeAxis(inputRank, &axis));
+        shouldReduce[axis] = true;
+    }
+
+    std::vector<uint32_t> sizes;
+    std::vector<bool> isReduced;
+    for (uint32_t axis = 0; axis < inputRank; ++axis) {
+        const uint32_t size = getSizeOfDimension(inputShape, axis);
+        if (shouldReduce[axis]) {
+            layout->numReducedElements *= size;
+        } else {
+            layout->numOutputs *= size;
+        }
+        if (size == 1) {
+            continue;
+        }
+        if (!sizes.empty() && isReduced.back() == shouldReduce[axis]) {
+            sizes.back() *= size;
+        } else {
+            sizes.push_back(size);
+            isReduced.push_back(shouldReduce[axis]);
+        }
+    }
+    if (sizes.empty()) {
+        sizes.push_back(1);
+        isReduced.push_back(false);
+    }
+
+    layout->innerSize = sizes.back();
+    layout->isInnerReduced = isReduced.back();
+    uint32_t stride = sizes.back();
+    for (int i = static_cast<int>(sizes.size()) - 2; i >= 0; --i) {
+        auto& dimensions = isReduced[i] ? layout->reducedDimensions : layout->keptDimensions;
+        dimensions.insert(dimensions.begin(), ReducedDimension{sizes[i], stride});
+        stride *= sizes[i];
+    }
+    return true;
+}
+
+uint32_t getNumberOfPositions(const std::vector<ReducedDimension>& dimensions) {
+    uint32_t count = 1;
+    for (const ReducedDimension& dimension : dimensions) {
+        count *= dimension.size;
+    }
+    return count;
+}
+
+// Returns the input offset of the index-th position in the given dimensions.
+uint32_t getInputOffset(const std::vector<ReducedDimension>& dimensions, uint32_t index) {
+    uint32_t offset = 0;
+    for (auto it = dimensions.rbegin(); it != dimensions.rend(); ++it) {
+        offset += (index % it->size) * it->stride;
+        index /= it->size;
+    }
+    return offset;
+}
+
+template <typename T, typename Acc, typename Reducer>
+Acc reduceRow(const T* row, uint32_t size, Acc init, Reducer reducer) {
+    Acc lanes[kNumLanes];
+    std::fill(lanes, lanes + kNumLanes, init);
+    uint32_t i = 0;
+    for (; i + kNumLanes <= size; i += kNumLanes) {
+        for (uint32_t lane = 0; lane < kNumLanes; ++lane) {
+            lanes[lane] = reducer(lanes[lane], static_cast<Acc>(row[i + lane]));
+        }
+    }
+    Acc result = lanes[0];
+    for (uint32_t lane = 1; lane < kNumLanes; ++lane) {
+        result = reducer(result, lanes[lane]);
+    }
+    for (; i < size; ++i) {
+        result = reducer(result, static_cast<Acc>(row[i]));
+    }
+    return result;
+}
+
+// Reduces the input with the given reducer, starting from init, which must be
+// the identity of the reducer, and stores finish(result) for each output.
+template <typename T, typename Acc, typename Reducer, typename Finish>
+void reduceImpl(const T* inputData, const ReductionLayout& layout, Acc init, Reducer reducer,
+                Finish finish, T* outputData, ThreadPool* threadPool) {
+    if (layout.numOutputs == 0) {
+        return;
+    }
+    if (layout.numReducedElements == 0) {
+        std::fill(outputData, outputData + layout.numOutputs, finish(init));
+        return;
+    }
+    const uint32_t numKeptPositions = getNumberOfPositions(layout.keptDimensions);
+    const uint32_t numReducedPositions = getNumberOfPositions(layout.reducedDimensions);
+
+    if (layout.isInnerReduced) {
+        // Each output reduces contiguous rows of the input.
+        const uint32_t minOutputsPerChunk =
+                std::max(kMinChunkSize / layout.numReducedElements, 1u);
+        parallelFor(threadPool, 0, numKeptPositions, minOutputsPerChunk,
+                    [&](uint32_t begin, uint32_t end) {
+                        for (uint32_t output = begin; output < end; ++output) {
+                            const T* input =
+                                    inputData + getInputOffset(layout.keptDimensions, output);
+                            Acc result = init;
+                            for (uint32_t i = 0; i < numReducedPositions; ++i) {
+                                const T* row =
+                                        input + getInputOffset(layout.reducedDimensions, i);
+                                result = reducer(result,
+                                                 reduceRow(row, layout.innerSize, init, reducer));
+                            }
+                            outputData[output] = finish(result);
+                        }
+                    });
+        return;
+    }
+
+    // Each tile of contiguous outputs accumulates contiguous rows of the input.
+    const uint32_t numTiles = (layout.innerSize + kInnerTileSize - 1) / kInnerTileSize;
+    const uint32_t tileElements =
+            std::min(layout.innerSize, kInnerTileSize) * layout.numReducedElements;
+    const uint32_t minTilesPerChunk = std::max(kMinChunkSize / tileElements, 1u);
+    parallelFor(threadPool, 0, numKeptPositions * numTiles, minTilesPerChunk,
+                [&](uint32_t begin, uint32_t end) {
+                    Acc results[kInnerTileSize];
+                    for (uint32_t task = begin; task < end; ++task) {
+                        const uint32_t position = task / numTiles;
+                        const uint32_t tileBegin = (task % numTiles) * kInnerTileSize;
+                        const uint32_t tileSize =
+                                std::min(kInnerTileSize, layout.innerSize - tileBegin);
+                        const T* input = inputData +
+                                         getInputOffset(layout.keptDimensions, position) +
+                                         tileBegin;
+                        std::fill(results, results + tileSize, init);
+                        for (uint32_t i = 0; i < numReducedPositions; ++i) {
+                            const T* row = input + getInputOffset(layout.reducedDimensions, i);
+                            for (uint32_t j = 0; j < tileSize; ++j) {
+                                results[j] = reducer(results[j], static_cast<Acc>(row[j]));
+                            }
+                        }
+                        T* output = outputData + position * layout.innerSize + tileBegin;
+                        for (uint32_t j = 0; j < tileSize; ++j) {
+                            output[j] = finish(results[j]);
+                        }
+                    }
+                });
+}
+
+// Results are accumulated in the type returned by the reducer.
+template <typename T, typename Reducer>
+inline bool compute(IOperationExecutionContext* context, T init, Reducer reducer) {
+    using Acc = decltype(reducer(init, init));
     const Shape inputShape = context->getInputShape(kInputTensor);
     const Shape axesShape = context->getInputShape(kInputAxes);
-    const Shape outputShape = context->getOutputShape(kOutputTensor);
-    const uint32_t inputRank = getNumberOfDimensions(inputShape);
-    const uint32_t numAxes = getNumberOfElements(axesShape);
-    std::vector<int> tempIndex(inputShape.dimensions.size());
-    std::vector<int> tempAxes(numAxes);
-    return tflite::reference_ops::ReduceGeneric<T>(
-            context->getInputBuffer<T>(kInputTensor),
-            reinterpret_cast<const int32_t*>(inputShape.dimensions.data()), inputRank,
-            context->getOutputBuffer<T>(kOutputTensor),
-            reinterpret_cast<const int32_t*>(outputShape.dimensions.data()),
-            outputShape.dimensions.size(), context->getInputBuffer<int32_t>(kInputAxes), numAxes,
-            context->getInputValue<bool8>(kInputKeepDims), tempIndex.data(), tempAxes.data(), init,
-            func);
+    ReductionLayout layout;
+    NN_RET_CHECK(getReductionLayout(inputShape, context->getInputBuffer<int32_t>(kInputAxes),
+                                    getNumberOfElements(axesShape), &layout));
+    reduceImpl(
+            context->getInputBuffer<T>(kInputTensor), layout, static_cast<Acc>(init), reducer,
+            [](Acc result) { return static_cast<T>(result); },
+            context->getOutputBuffer<T>(kOutputTensor), context->getThreadPool());
+    return true;
+}
+
+template <typename T, typename Acc>
+bool meanImpl(const T* inputData, const Shape& inputShape, const int32_t* axes, uint32_t numAxes,
+              T* outputData, ThreadPool* threadPool) {
+    ReductionLayout layout;
+    NN_RET_CHECK(getReductionLayout(inputShape, axes, numAxes, &layout));
+    const uint32_t count = layout.numReducedElements;
+    reduceImpl(
+            inputData, layout, static_cast<Acc>(0), [](Acc a, Acc b) { return a + b; },
+            [count](Acc sum) {
+                return count == 0 ? static_cast<T>(0)
+                                  : static_cast<T>(sum / static_cast<Acc>(count));
+            },
+            outputData, threadPool);
+    return true;
 }
 
 }  // namespace
 
+bool mean(const _Float16* inputData, const Shape& inputShape, const int32_t* axes,
+          uint32_t numAxes, _Float16* outputData, ThreadPool* threadPool) {
+    return meanImpl<_Float16, float>(inputData, inputShape, axes, numAxes, outputData,
+                                     threadPool);
+}
+
+bool mean(const float* inputData, const Shape& inputShape, const int32_t* axes, uint32_t numAxes,
+          float* outputData, ThreadPool* threadPool) {
+    return meanImpl<float, float>(inputData, inputShape, axes, numAxes, outputData, threadPool);
+}
+
+bool mean(const uint8_t* inputData, const Shape& inputShape, const int32_t* axes,
+          uint32_t numAxes, uint8_t* outputData, ThreadPool* threadPool) {
+    return meanImpl<uint8_t, int32_t>(inputData, inputShape, axes, numAxes, outputData,
+                                      threadPool);
+}
+
 bool validateProdSum(const IOperationValidationContext* context) {
     NN_RET_CHECK_EQ(context->getNumInputs(), kNumInputs);
     NN_RET_CHECK_EQ(context->getNumOutputs(), kNumOutputs);
@@ -137,7 +354,7 @@ bool prepare(IOperationExecutionContext* context) {
 bool executeProd(IOperationExecutionContext* context) {
     switch (context->getInputType(kInputTensor)) {
         case OperandType::TENSOR_FLOAT16:
-            return compute<_Float16>(context, 1, [](_Float16 a, _Float16 b) { return a * b; });
+            return compute<_Float16>(context, 1, [](float a, float b) { return a * b; });
         case OperandType::TENSOR_FLOAT32:
             return compute<float>(context, 1, [](float a, float b) { return a * b; });
         default:
@@ -148,7 +365,7 @@ bool executeProd(IOperationExecutionContext* context) {
 bool executeSum(IOperationExecutionContext* context) {
     switch (context->getInputType(kInputTensor)) {
         case OperandType::TENSOR_FLOAT16:
-            return compute<_Float16>(context, 0, [](_Float16 a, _Float16 b) { return a + b; });
+            return compute<_Float16>(context, 0, [](float a, float b) { return a + b; });
         case OperandType::TENSOR_FLOAT32:
             return compute<float>(context, 0, [](float a, float b) { return a + b; });
         default:
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_ML_NN_REDUCE_H
+#define FRAMEWORKS_ML_NN_REDUCE_H
+
+#include "OperationsUtils.h"
+
+namespace android {
+namespace nn {
+namespace reduce {
+
+// Computes the mean over the given axes, which may be negative or repeated,
+// with the same engine as the REDUCE_* operations. Float16 inputs are summed
+// in float32 and quant8 inputs in int32.
+bool mean(const _Float16* inputData, const Shape& inputShape, const int32_t* axes,
+          uint32_t numAxes, _Float16* outputData, ThreadPool* threadPool);
+bool mean(const float* inputData, const Shape& inputShape, const int32_t* axes, uint32_t numAxes,
+          float* outputData, ThreadPool* threadPool);
+bool mean(const uint8_t* inputData, const Shape& inputShape, const int32_t* axes,
+          uint32_t numAxes, uint8_t* outputData, ThreadPool* threadPool);
+
+}  // namespace reduce
+}  // namespace nn
+}  // namespace android
+
+#endif  // FRAMEWORKS_ML_NN_REDUCE_H
@@ -32,6 +32,10 @@ namespace nn {
 bool copyData(const void* inputData, const Shape& inputShape, void* outputData,
               const Shape& outputShape) {
     NNTRACE_COMP("copyData");
+    // The output may be planned as a view of the input.
+    if (outputData == inputData) {
+        return true;
+    }
     size_t count = nonExtensionOperandSizeOfData(inputShape.type, inputShape.dimensions);
     memcpy(outputData, inputData, count);
     return true;
@@ -19,10 +19,14 @@
 #include "CpuOperationUtils.h"
 #include "HalInterfaces.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
 #include "Tracing.h"
 
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <functional>
 #include <vector>
 
@@ -85,19 +89,106 @@ bool resizeImageOpNhwc<_Float16>(OperationType opType, const _Float16* inputData
     return true;
 }
 
+// Resizes the images of different batches in parallel.  The scales are derived
+// from the sizes of whole images, so images are not split any further.
 template <typename T>
-bool resizeImageOp(OperationType opType, const T* inputData, const Shape& inputShape, bool useNchw,
-                   T* outputData, const Shape& outputShape) {
-    InputWithLayout<T> input(useNchw);
-    OutputWithLayout<T> output(useNchw);
-    NN_RET_CHECK(input.initialize(inputData, inputShape));
-    NN_RET_CHECK(output.initialize(outputData, outputShape));
-    NN_RET_CHECK(resizeImageOpNhwc(opType, input.getNhwcBuffer(), input.getNhwcShape(),
-                                   output.getNhwcBuffer(), output.getNhwcShape()));
-    NN_RET_CHECK(output.commit());
+bool resizeImageOpNhwcInParallel(OperationType opType, const T* inputData,
+                                 const Shape& inputShape, T* outputData, const Shape& outputShape,
+                                 ThreadPool* threadPool) {
+    const uint32_t numBatches = getSizeOfDimension(inputShape, 0);
+    Shape imageInputShape = inputShape;
+    imageInputShape.dimensions[0] = 1;
+    Shape imageOutputShape = outputShape;
+    imageOutputShape.dimensions[0] = 1;
+    const uint32_t inputImageSize = getNumberOfElements(imageInputShape);
+    const uint32_t outputImageSize = getNumberOfElements(imageOutputShape);
+    std::atomic<bool> success(true);
+    parallelFor(threadPool, 0, numBatches, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t b = begin; b < end; b++) {
+            if (!resizeImageOpNhwc(opType, inputData + b * inputImageSize, imageInputShape,
+                                   outputData + b * outputImageSize, imageOutputShape)) {
+                success = false;
+            }
+        }
+    });
+    return success;
+}
+
+// Resizes an NCHW tensor one (batch, channel) plane at a time, with the same
+// sampling and arithmetic as the tflite reference kernels use on NHWC.
+template <typename T>
+bool resizeImageOpNchw(OperationType opType, const T* inputData, const Shape& inputShape,
+                       T* outputData, const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("resizeImageOpNchw");
+    const uint32_t numPlanes =
+            getSizeOfDimension(inputShape, 0) * getSizeOfDimension(inputShape, 1);
+    const int32_t inHeight = getSizeOfDimension(inputShape, 2);
+    const int32_t inWidth = getSizeOfDimension(inputShape, 3);
+    const int32_t outHeight = getSizeOfDimension(outputShape, 2);
+    const int32_t outWidth = getSizeOfDimension(outputShape, 3);
+    const float heightScale = static_cast<float>(inHeight) / outHeight;
+    const float widthScale = static_cast<float>(inWidth) / outWidth;
+
+    // The horizontal sampling is the same for every row of every plane.
+    std::vector<int32_t> x0(outWidth), x1(outWidth);
+    std::vector<float> dx(outWidth);
+    for (int32_t x = 0; x < outWidth; x++) {
+        const float inputX = x * widthScale;
+        if (opType == OperationType::RESIZE_BILINEAR) {
+            x0[x] = static_cast<int32_t>(std::floor(inputX));
+            x1[x] = std::min(x0[x] + 1, inWidth - 1);
+            dx[x] = inputX - x0[x];
+        } else {
+            x0[x] = std::min(static_cast<int32_t>(std::floor(inputX)), inWidth - 1);
+        }
+    }
+
+    NNTRACE_COMP_SWITCH("resizeImageOpNchw");
+    parallelFor(threadPool, 0, numPlanes, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t plane = begin; plane < end; plane++) {
+            const T* input = inputData + plane * inHeight * inWidth;
+            T* output = outputData + plane * outHeight * outWidth;
+            for (int32_t y = 0; y < outHeight; y++) {
+                const float inputY = y * heightScale;
+                T* outputRow = output + y * outWidth;
+                if (opType == OperationType::RESIZE_BILINEAR) {
+                    const int32_t y0 = static_cast<int32_t>(std::floor(inputY));
+                    const int32_t y1 = std::min(y0 + 1, inHeight - 1);
+                    const float dy = inputY - y0;
+                    const T* row0 = input + y0 * inWidth;
+                    const T* row1 = input + y1 * inWidth;
+                    for (int32_t x = 0; x < outWidth; x++) {
+                        outputRow[x] = static_cast<T>(
+                                static_cast<float>(row0[x0[x]]) * (1 - dy) * (1 - dx[x]) +
+                                static_cast<float>(row1[x0[x]]) * dy * (1 - dx[x]) +
+                                static_cast<float>(row0[x1[x]]) * (1 - dy) * dx[x] +
+                                static_cast<float>(row1[x1[x]]) * dy * dx[x]);
+                    }
+                } else {
+                    const int32_t inY =
+                            std::min(static_cast<int32_t>(std::floor(inputY)), inHeight - 1);
+                    const T* row = input + inY * inWidth;
+                    for (int32_t x = 0; x < outWidth; x++) {
+                        outputRow[x] = row[x0[x]];
+                    }
+                }
+            }
+        }
+    });
     return true;
 }
 
+template <typename T>
+bool resizeImageOp(OperationType opType, const T* inputData, const Shape& inputShape, bool useNchw,
+                   T* outputData, const Shape& outputShape, ThreadPool* threadPool) {
+    if (useNchw) {
+        return resizeImageOpNchw(opType, inputData, inputShape, outputData, outputShape,
+                                 threadPool);
+    }
+    return resizeImageOpNhwcInParallel(opType, inputData, inputShape, outputData, outputShape,
+                                       threadPool);
+}
+
 }  // namespace
 
 bool validate(OperationType opType, const IOperationValidationContext* context) {
@@ -201,17 +292,20 @@ bool execute(OperationType opType, IOperationExecutionContext* context) {
             return resizeImageOp(opType, context->getInputBuffer<_Float16>(kInputTensor),
                                  context->getInputShape(kInputTensor), useNchw,
                                  context->getOutputBuffer<_Float16>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getOutputShape(kOutputTensor),
+                                 context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return resizeImageOp(opType, context->getInputBuffer<float>(kInputTensor),
                                  context->getInputShape(kInputTensor), useNchw,
                                  context->getOutputBuffer<float>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getOutputShape(kOutputTensor),
+                                 context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return resizeImageOp(opType, context->getInputBuffer<uint8_t>(kInputTensor),
                                  context->getInputShape(kInputTensor), useNchw,
                                  context->getOutputBuffer<uint8_t>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getOutputShape(kOutputTensor),
+                                 context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation "
                                 << getOperationName(opType);
@@ -17,9 +17,12 @@
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <vector>
 
 #include "Tracing.h"
 #include "tensorflow/lite/kernels/internal/common.h"
@@ -47,12 +50,138 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
+// The sampling grid of a ROI in input coordinates.
+template <typename T_Roi>
+struct RoiAlignBox {
+    uint32_t batchId;
+    T_Roi wRoiStart, hRoiStart;
+    T_Roi wStepSize, hStepSize;
+    T_Roi wBinSize, hBinSize;
+    uint32_t wSamplingRatio, hSamplingRatio;
+    int32_t numSamplingPoints;
+};
+
+// A sampling point along one axis: the offsets of the two input rows or
+// columns around the point and their bilinear interpolation weights.
+template <typename T_Roi>
+struct SamplingPoint {
+    uint32_t offset1, offset2;
+    T_Roi weight1, weight2;
+};
+
+// Fills the grid of a ROI from its corners, already scaled to input coordinates.
+template <typename T_Roi>
+void initializeRoiAlignBox(uint32_t batchId, T_Roi wRoiStart, T_Roi hRoiStart, T_Roi wRoiEnd,
+                           T_Roi hRoiEnd, uint32_t outHeight, uint32_t outWidth,
+                           int32_t heightSamplingRatio, int32_t widthSamplingRatio,
+                           RoiAlignBox<T_Roi>* box) {
+    T_Roi roiWidth = std::max(static_cast<float>(wRoiEnd - wRoiStart), 1.0f);
+    T_Roi roiHeight = std::max(static_cast<float>(hRoiEnd - hRoiStart), 1.0f);
+    box->batchId = batchId;
+    box->wRoiStart = wRoiStart;
+    box->hRoiStart = hRoiStart;
+    box->wStepSize = roiWidth / static_cast<T_Roi>(outWidth);
+    box->hStepSize = roiHeight / static_cast<T_Roi>(outHeight);
+
+    // if samplingRatio = 0, use adaptive value of ceil(roiWidth/outWidth), same for height
+    box->wSamplingRatio = widthSamplingRatio > 0
+                                  ? widthSamplingRatio
+                                  : std::ceil(static_cast<float>(box->wStepSize));
+    box->hSamplingRatio = heightSamplingRatio > 0
+                                  ? heightSamplingRatio
+                                  : std::ceil(static_cast<float>(box->hStepSize));
+    box->numSamplingPoints = box->wSamplingRatio * box->hSamplingRatio;
+    box->wBinSize = box->wStepSize / static_cast<T_Roi>(box->wSamplingRatio);
+    box->hBinSize = box->hStepSize / static_cast<T_Roi>(box->hSamplingRatio);
+}
+
+// Computes the sampling points of numBins output bins along one axis of a ROI,
+// samplingRatio points per bin.  stride is the input stride along the axis.
+template <typename T_Roi>
+void computeSamplingPoints(T_Roi roiStart, T_Roi stepSize, T_Roi binSize, uint32_t numBins,
+                           uint32_t samplingRatio, uint32_t inSize, uint32_t stride,
+                           std::vector<SamplingPoint<T_Roi>>* points) {
+    points->resize(numBins * samplingRatio);
+    for (uint32_t i = 0; i < numBins; i++) {
+        T_Roi binStart = stepSize * i + roiStart;
+        for (uint32_t ind = 0; ind < samplingRatio; ind++) {
+            T_Roi pos = binStart + binSize / 2 + binSize * ind;
+            uint32_t pos1 = std::floor(static_cast<float>(pos));
+            uint32_t pos2 = pos1 + 1;
+            T_Roi delta = pos - static_cast<T_Roi>(pos1);
+
+            // dealing with out of bound samples
+            if (pos1 >= inSize - 1) {
+                pos1 = pos2 = inSize - 1;
+                delta = 0;
+            }
+
+            SamplingPoint<T_Roi>& point = (*points)[i * samplingRatio + ind];
+            point.offset1 = pos1 * stride;
+            point.offset2 = pos2 * stride;
+            point.weight1 = 1.0f - delta;
+            point.weight2 = delta;
+        }
+    }
+}
+
+// Computes the output of every ROI in [roiBegin, roiEnd).  For each output bin,
+// accumulate(acc, corners, weights) adds the bilinear interpolation of a
+// sampling point to the per-channel accumulator, and finish(roiIndex, acc, out)
+// writes the average of the bin.
+template <typename T_Input, typename T_Roi, typename Acc, typename Accumulate, typename Finish>
+void roiAlignRange(const T_Input* inputData, const Shape& inputShape,
+                   const std::vector<RoiAlignBox<T_Roi>>& boxes, uint32_t roiBegin,
+                   uint32_t roiEnd, T_Input* outputData, const Shape& outputShape,
+                   Accumulate accumulate, Finish finish) {
+    uint32_t inHeight = getSizeOfDimension(inputShape, 1);
+    uint32_t inWidth = getSizeOfDimension(inputShape, 2);
+    uint32_t inDepth = getSizeOfDimension(inputShape, 3);
+    uint32_t outHeight = getSizeOfDimension(outputShape, 1);
+    uint32_t outWidth = getSizeOfDimension(outputShape, 2);
+
+    std::vector<SamplingPoint<T_Roi>> xPoints, yPoints;
+    std::vector<Acc> accumulator(inDepth);
+    for (uint32_t roiIndex = roiBegin; roiIndex < roiEnd; roiIndex++) {
+        const RoiAlignBox<T_Roi>& box = boxes[roiIndex];
+        computeSamplingPoints(box.wRoiStart, box.wStepSize, box.wBinSize, outWidth,
+                              box.wSamplingRatio, inWidth, inDepth, &xPoints);
+        computeSamplingPoints(box.hRoiStart, box.hStepSize, box.hBinSize, outHeight,
+                              box.hSamplingRatio, inHeight, inWidth * inDepth, &yPoints);
+
+        const T_Input* batchBase = inputData + box.batchId * inHeight * inWidth * inDepth;
+        T_Input* outPtr = outputData + roiIndex * outHeight * outWidth * inDepth;
+        for (uint32_t i = 0; i < outHeight; i++) {
+            for (uint32_t j = 0; j < outWidth; j++) {
+                std::fill(accumulator.begin(), accumulator.end(), static_cast<Acc>(0));
+                for (uint32_t yInd = 0; yInd < box.hSamplingRatio; yInd++) {
+                    const auto& y = yPoints[i * box.hSamplingRatio + yInd];
+                    for (uint32_t xInd = 0; xInd < box.wSamplingRatio; xInd++) {
+                        const auto& x = xPoints[j * box.wSamplingRatio + xInd];
+                        // bilinear interpolation of point (x,y)
+                        // w.r.t box [(x1,y1), (x1,y2), (x2,y1), (x2,y2)]
+                        const T_Input* corners[] = {batchBase + y.offset1 + x.offset1,
+                                                    batchBase + y.offset1 + x.offset2,
+                                                    batchBase + y.offset2 + x.offset1,
+                                                    batchBase + y.offset2 + x.offset2};
+                        const T_Roi ws[] = {x.weight1 * y.weight1, x.weight2 * y.weight1,
+                                            x.weight1 * y.weight2, x.weight2 * y.weight2};
+                        accumulate(accumulator.data(), corners, ws);
+                    }
+                }
+                finish(roiIndex, accumulator.data(), outPtr);
+                outPtr += inDepth;
+            }
+        }
+    }
+}
+
 template <typename T_Input, typename T_Roi>
 inline bool roiAlignNhwc(const T_Input* inputData, const Shape& inputShape, const T_Roi* roiData,
                          const Shape& roiShape, const int32_t* batchSplitData,
                          const Shape& batchSplitShape, float heightStride, float widthStride,
                          int32_t heightSamplingRatio, int32_t widthSamplingRatio,
-                         T_Input* outputData, const Shape& outputShape) {
+                         T_Input* outputData, const Shape& outputShape, ThreadPool* threadPool) {
     NNTRACE_TRANS("RoiAlign");
 
     const uint32_t kRoiDim = 4;
@@ -68,7 +197,7 @@ inline bool roiAlignNhwc(const T_Input* inputData, const Shape& inputShape, cons
     uint32_t numRois = getSizeOfDimension(roiShape, 0);
     uint32_t roiInfoLength = getSizeOfDimension(roiShape, 1);
 
-    T_Input* outPtr = outputData;
+    std::vector<RoiAlignBox<T_Roi>> boxes(numRois);
     const T_Roi* roiDataEnd = roiData + numRois * roiInfoLength;
     uint32_t roiIndex = 0;
     for (const T_Roi* roiInfo = roiData; roiInfo < roiDataEnd; roiInfo += kRoiDim, roiIndex++) {
@@ -90,85 +219,32 @@ inline bool roiAlignNhwc(const T_Input* inputData, const Shape& inputShape, cons
         NN_RET_CHECK(roiInfo[0] <= roiInfo[2]);
         NN_RET_CHECK(roiInfo[1] <= roiInfo[3]);
 
-        T_Roi wRoiStart = roiInfo[0] * widthScale;
-        T_Roi hRoiStart = roiInfo[1] * heightScale;
-        T_Roi wRoiEnd = roiInfo[2] * widthScale;
-        T_Roi hRoiEnd = roiInfo[3] * heightScale;
-
-        T_Roi roiWidth = std::max(static_cast<float>(wRoiEnd - wRoiStart), 1.0f);
-        T_Roi roiHeight = std::max(static_cast<float>(hRoiEnd - hRoiStart), 1.0f);
-        T_Roi wStepSize = roiWidth / static_cast<T_Roi>(outWidth);
-        T_Roi hStepSize = roiHeight / static_cast<T_Roi>(outHeight);
-
-        // if samplingRatio = 0, use adaptive value of ceil(roiWidth/outWidth), same for height
-        uint32_t wSamplingRatio = widthSamplingRatio > 0 ? widthSamplingRatio
-                                                         : std::ceil(static_cast<float>(wStepSize));
-        uint32_t hSamplingRatio = heightSamplingRatio > 0
-                                          ? heightSamplingRatio
-                                          : std::ceil(static_cast<float>(hStepSize));
-        int32_t numSamplingPoints = wSamplingRatio * hSamplingRatio;
-        T_Roi wBinSize = wStepSize / static_cast<T_Roi>(wSamplingRatio);
-        T_Roi hBinSize = hStepSize / static_cast<T_Roi>(hSamplingRatio);
-
-        const T_Input* batchBase = inputData + batchId * inHeight * inWidth * inDepth;
-        for (uint32_t i = 0; i < outHeight; i++) {
-            for (uint32_t j = 0; j < outWidth; j++) {
-                T_Roi wStart = wStepSize * j + wRoiStart;
-                T_Roi wEnd = wStepSize * (j + 1) + wRoiStart;
-                T_Roi hStart = hStepSize * i + hRoiStart;
-                T_Roi hEnd = hStepSize * (i + 1) + hRoiStart;
-
-                // initialize output to zero
-                for (uint32_t k = 0; k < inDepth; k++) outPtr[k] = 0;
-
-                // calculate the sum of the sampling points
-                for (uint32_t yInd = 0; yInd < hSamplingRatio; yInd++) {
-                    for (uint32_t xInd = 0; xInd < wSamplingRatio; xInd++) {
-                        T_Roi y = hStart + hBinSize / 2 + hBinSize * yInd;
-                        T_Roi x = wStart + wBinSize / 2 + wBinSize * xInd;
+        initializeRoiAlignBox<T_Roi>(batchId, roiInfo[0] * widthScale, roiInfo[1] * heightScale,
+                                     roiInfo[2] * widthScale, roiInfo[3] * heightScale, outHeight,
+                                     outWidth, heightSamplingRatio, widthSamplingRatio,
+                                     &boxes[roiIndex]);
+    }
 
-                        // bilinear interpolation of point (x,y)
-                        // w.r.t box [(x1,y1), (x1,y2), (x2,y1), (x2,y2)]
-                        uint32_t x1 = std::floor(static_cast<float>(x));
-                        uint32_t y1 = std::floor(static_cast<float>(y));
-                        uint32_t x2 = x1 + 1, y2 = y1 + 1;
-                        T_Roi dx1 = x - static_cast<T_Roi>(x1);
-                        T_Roi dy1 = y - static_cast<T_Roi>(y1);
-
-                        // dealing with out of bound samples
-                        if (x1 >= inWidth - 1) {
-                            x1 = x2 = inWidth - 1;
-                            dx1 = 0;
-                        }
-                        if (y1 >= inHeight - 1) {
-                            y1 = y2 = inHeight - 1;
-                            dy1 = 0;
-                        }
-
-                        T_Roi dx2 = 1.0f - dx1, dy2 = 1.0f - dy1;
-                        T_Roi ws[] = {dx2 * dy2, dx1 * dy2, dx2 * dy1, dx1 * dy1};
-                        uint32_t offsets[] = {y1 * inWidth * inDepth + x1 * inDepth,
-                                              y1 * inWidth * inDepth + x2 * inDepth,
-                                              y2 * inWidth * inDepth + x1 * inDepth,
-                                              y2 * inWidth * inDepth + x2 * inDepth};
-
-                        for (uint32_t k = 0; k < inDepth; k++) {
-                            T_Input interpolation = 0;
-                            for (uint32_t c = 0; c < 4; c++) {
-                                interpolation += ws[c] * batchBase[offsets[c] + k];
-                            }
-                            outPtr[k] += interpolation;
-                        }
+    // Accumulate in float, which also keeps the sums of _Float16 inputs accurate.
+    parallelFor(threadPool, 0, numRois, 1, [&](uint32_t roiBegin, uint32_t roiEnd) {
+        roiAlignRange<T_Input, T_Roi, float>(
+                inputData, inputShape, boxes, roiBegin, roiEnd, outputData, outputShape,
+                [inDepth](float* acc, const T_Input* const* corners, const T_Roi* ws) {
+                    const float w0 = ws[0], w1 = ws[1], w2 = ws[2], w3 = ws[3];
+                    const T_Input *in0 = corners[0], *in1 = corners[1];
+                    const T_Input *in2 = corners[2], *in3 = corners[3];
+                    for (uint32_t k = 0; k < inDepth; k++) {
+                        acc[k] += w0 * in0[k] + w1 * in1[k] + w2 * in2[k] + w3 * in3[k];
                     }
-                }
-
-                // take average
-                for (uint32_t k = 0; k < inDepth; k++)
-                    outPtr[k] /= static_cast<T_Input>(numSamplingPoints);
-                outPtr += inDepth;
-            }
-        }
-    }
+                },
+                [&](uint32_t roiIndex, const float* acc, T_Input* out) {
+                    // take average
+                    const float numSamplingPoints = boxes[roiIndex].numSamplingPoints;
+                    for (uint32_t k = 0; k < inDepth; k++) {
+                        out[k] = static_cast<T_Input>(acc[k] / numSamplingPoints);
+                    }
+                });
+    });
     return true;
 }
 
@@ -179,7 +255,7 @@ inline bool roiAlignNhwc<uint8_t, uint16_t>(const uint8_t* inputData, const Shap
                                             const Shape& batchSplitShape, float heightStride,
                                             float widthStride, int32_t heightSamplingRatio,
                                             int32_t widthSamplingRatio, uint8_t* outputData,
-                                            const Shape& outputShape) {
+                                            const Shape& outputShape, ThreadPool* threadPool) {
     NNTRACE_TRANS("RoiAlignQuant8");
 
     constexpr float wScale = 1.0f / 255.0f;
@@ -196,7 +272,9 @@ inline bool roiAlignNhwc<uint8_t, uint16_t>(const uint8_t* inputData, const Shap
     uint32_t numRois = getSizeOfDimension(roiShape, 0);
     uint32_t roiInfoLength = getSizeOfDimension(roiShape, 1);
 
-    uint8_t* outPtr = outputData;
+    std::vector<RoiAlignBox<float>> boxes(numRois);
+    std::vector<int32_t> outputMultiplier(numRois, 0);
+    std::vector<int32_t> outputShift(numRois, 0);
     const uint16_t* roiDataEnd = roiData + numRois * roiInfoLength;
     uint32_t roiIndex = 0;
     for (const uint16_t* roiInfo = roiData; roiInfo < roiDataEnd; roiInfo += kRoiDim, roiIndex++) {
@@ -219,91 +297,48 @@ inline bool roiAlignNhwc<uint8_t, uint16_t>(const uint8_t* inputData, const Shap
         NN_RET_CHECK_LE(wRoiStart, wRoiEnd);
         NN_RET_CHECK_LE(hRoiStart, hRoiEnd);
 
-        float roiWidth = std::max(wRoiEnd - wRoiStart, 1.0f);
-        float roiHeight = std::max(hRoiEnd - hRoiStart, 1.0f);
-        float wStepSize = roiWidth / static_cast<float>(outWidth);
-        float hStepSize = roiHeight / static_cast<float>(outHeight);
-
-        // if samplingRatio = 0, use adaptive value of ceil(roiWidth/outWidth), same for height
-        uint32_t wSamplingRatio =
-                widthSamplingRatio > 0 ? widthSamplingRatio : std::ceil(wStepSize);
-        uint32_t hSamplingRatio =
-                heightSamplingRatio > 0 ? heightSamplingRatio : std::ceil(hStepSize);
-        int32_t numSamplingPoints = wSamplingRatio * hSamplingRatio;
-        float wBinSize = wStepSize / static_cast<float>(wSamplingRatio);
-        float hBinSize = hStepSize / static_cast<float>(hSamplingRatio);
-
-        float realMultiplier = inputShape.scale * wScale / outputShape.scale / numSamplingPoints;
-        int32_t outputMultiplier = 0;
-        int32_t outputShift = 0;
-        if (!QuantizeMultiplierSmallerThanOne(realMultiplier, &outputMultiplier, &outputShift)) {
-            return false;
-        }
+        RoiAlignBox<float>& box = boxes[roiIndex];
+        initializeRoiAlignBox(batchId, wRoiStart, hRoiStart, wRoiEnd, hRoiEnd, outHeight, outWidth,
+                              heightSamplingRatio, widthSamplingRatio, &box);
 
-        const uint8_t* batchBase = inputData + batchId * inHeight * inWidth * inDepth;
-        for (uint32_t i = 0; i < outHeight; i++) {
-            for (uint32_t j = 0; j < outWidth; j++) {
-                float wStart = wStepSize * j + wRoiStart;
-                float wEnd = wStepSize * (j + 1) + wRoiStart;
-                float hStart = hStepSize * i + hRoiStart;
-                float hEnd = hStepSize * (i + 1) + hRoiStart;
-
-                std::vector<int32_t> outTemp(inDepth, 0);
-                // calculate the sum of the sampling points
-                for (uint32_t yInd = 0; yInd < hSamplingRatio; yInd++) {
-                    for (uint32_t xInd = 0; xInd < wSamplingRatio; xInd++) {
-                        float y = hStart + hBinSize / 2 + hBinSize * yInd;
-                        float x = wStart + wBinSize / 2 + wBinSize * xInd;
+        float realMultiplier =
+                inputShape.scale * wScale / outputShape.scale / box.numSamplingPoints;
+        NN_RET_CHECK(QuantizeMultiplierSmallerThanOne(realMultiplier, &outputMultiplier[roiIndex],
+                                                      &outputShift[roiIndex]));
+    }
 
-                        // bilinear interpolation of point (x,y)
-                        // w.r.t box [(x1,y1), (x1,y2), (x2,y1), (x2,y2)]
-                        uint32_t x1 = std::floor(x), y1 = std::floor(y);
-                        uint32_t x2 = x1 + 1, y2 = y1 + 1;
-                        float dx1 = x - static_cast<float>(x1);
-                        float dy1 = y - static_cast<float>(y1);
-
-                        // dealing with out of bound samples
-                        if (x1 >= inWidth - 1) {
-                            x1 = x2 = inWidth - 1;
-                            dx1 = 0;
-                        }
-                        if (y1 >= inHeight - 1) {
-                            y1 = y2 = inHeight - 1;
-                            dy1 = 0;
-                        }
-
-                        float dx2 = 1.0f - dx1, dy2 = 1.0f - dy1;
-                        float ws[] = {dx2 * dy2, dx1 * dy2, dx2 * dy1, dx1 * dy1};
-                        uint32_t offsets[] = {y1 * inWidth * inDepth + x1 * inDepth,
-                                              y1 * inWidth * inDepth + x2 * inDepth,
-                                              y2 * inWidth * inDepth + x1 * inDepth,
-                                              y2 * inWidth * inDepth + x2 * inDepth};
-
-                        for (uint32_t k = 0; k < inDepth; k++) {
-                            int32_t interpolation = 0;
-                            for (uint32_t c = 0; c < 4; c++) {
-                                int32_t wQuant = static_cast<int32_t>(std::round(ws[c] / wScale));
-                                interpolation +=
-                                        wQuant * (static_cast<int32_t>(batchBase[offsets[c] + k]) -
-                                                  inputShape.offset);
-                            }
-                            outTemp[k] += interpolation;
-                        }
+    // The interpolation weights are quantized with scale wScale.
+    const int32_t inputOffset = inputShape.offset;
+    parallelFor(threadPool, 0, numRois, 1, [&](uint32_t roiBegin, uint32_t roiEnd) {
+        roiAlignRange<uint8_t, float, int32_t>(
+                inputData, inputShape, boxes, roiBegin, roiEnd, outputData, outputShape,
+                [inDepth, inputOffset](int32_t* acc, const uint8_t* const* corners,
+                                       const float* ws) {
+                    int32_t wQuant[4];
+                    for (uint32_t c = 0; c < 4; c++) {
+                        wQuant[c] = static_cast<int32_t>(std::round(ws[c] / wScale));
                     }
-                }
-
-                // take average and cast to output quantization
-                for (uint32_t k = 0; k < inDepth; k++) {
-                    int32_t raw_out = tflite::MultiplyByQuantizedMultiplier(
-                                              outTemp[k], outputMultiplier, -outputShift) +
-                                      outputShape.offset;
-                    int32_t clamped_out = std::min(255, std::max(0, raw_out));
-                    outPtr[k] = static_cast<uint8_t>(clamped_out);
-                }
-                outPtr += inDepth;
-            }
-        }
-    }
+                    const uint8_t *in0 = corners[0], *in1 = corners[1];
+                    const uint8_t *in2 = corners[2], *in3 = corners[3];
+                    for (uint32_t k = 0; k < inDepth; k++) {
+                        acc[k] += wQuant[0] * (in0[k] - inputOffset) +
+                                  wQuant[1] * (in1[k] - inputOffset) +
+                                  wQuant[2] * (in2[k] - inputOffset) +
+                                  wQuant[3] * (in3[k] - inputOffset);
+                    }
+                },
+                [&](uint32_t roiIndex, const int32_t* acc, uint8_t* out) {
+                    // take average and cast to output quantization
+                    for (uint32_t k = 0; k < inDepth; k++) {
+                        int32_t raw_out = tflite::MultiplyByQuantizedMultiplier(
+                                                  acc[k], outputMultiplier[roiIndex],
+                                                  -outputShift[roiIndex]) +
+                                          outputShape.offset;
+                        int32_t clamped_out = std::min(255, std::max(0, raw_out));
+                        out[k] = static_cast<uint8_t>(clamped_out);
+                    }
+                });
+    });
     return true;
 }
 
@@ -312,7 +347,7 @@ inline bool roiAlign(const T_Input* inputData, const Shape& inputShape, const T_
                      const Shape& roiShape, const int32_t* batchSplitData,
                      const Shape& batchSplitShape, float heightStride, float widthStride,
                      int32_t heightSamplingRatio, int32_t widthSamplingRatio, bool useNchw,
-                     T_Input* outputData, const Shape& outputShape) {
+                     T_Input* outputData, const Shape& outputShape, ThreadPool* threadPool) {
     InputWithLayout<T_Input> input(useNchw);
     OutputWithLayout<T_Input> output(useNchw);
     NN_RET_CHECK(input.initialize(inputData, inputShape));
@@ -320,7 +355,7 @@ inline bool roiAlign(const T_Input* inputData, const Shape& inputShape, const T_
     NN_RET_CHECK(roiAlignNhwc(input.getNhwcBuffer(), input.getNhwcShape(), roiData, roiShape,
                               batchSplitData, batchSplitShape, heightStride, widthStride,
                               heightSamplingRatio, widthSamplingRatio, output.getNhwcBuffer(),
-                              output.getNhwcShape()));
+                              output.getNhwcShape(), threadPool));
     NN_RET_CHECK(output.commit());
     return true;
 }
@@ -439,7 +474,7 @@ bool execute(IOperationExecutionContext* context) {
                             context->getInputValue<int32_t>(kWidthSamplingRatioScalar),
                             context->getInputValue<bool>(kLayoutScalar),
                             context->getOutputBuffer<_Float16>(kOutputTensor),
-                            context->getOutputShape(kOutputTensor));
+                            context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return roiAlign(context->getInputBuffer<float>(kInputTensor),
                             context->getInputShape(kInputTensor),
@@ -453,7 +488,7 @@ bool execute(IOperationExecutionContext* context) {
                             context->getInputValue<int32_t>(kWidthSamplingRatioScalar),
                             context->getInputValue<bool>(kLayoutScalar),
                             context->getOutputBuffer<float>(kOutputTensor),
-                            context->getOutputShape(kOutputTensor));
+                            context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return roiAlign(context->getInputBuffer<uint8_t>(kInputTensor),
                             context->getInputShape(kInputTensor),
@@ -467,7 +502,7 @@ bool execute(IOperationExecutionContext* context) {
                             context->getInputValue<int32_t>(kWidthSamplingRatioScalar),
                             context->getInputValue<bool>(kLayoutScalar),
                             context->getOutputBuffer<uint8_t>(kOutputTensor),
-                            context->getOutputShape(kOutputTensor));
+                            context->getOutputShape(kOutputTensor), context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
     }
@@ -17,9 +17,12 @@
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <vector>
 
 #include "Tracing.h"
 
@@ -48,7 +51,8 @@ template <typename T_Input, typename T_Roi>
 inline bool roiPoolingNhwc(const T_Input* inputData, const Shape& inputShape, const T_Roi* roiData,
                            const Shape& roiShape, const int32_t* batchSplitData,
                            const Shape& batchSplitShape, float heightStride, float widthStride,
-                           T_Input* outputData, const Shape& outputShape) {
+                           T_Input* outputData, const Shape& outputShape,
+                           ThreadPool* threadPool) {
     NNTRACE_TRANS("RoiPooling");
 
     const uint32_t kRoiDim = 4;
@@ -64,7 +68,6 @@ inline bool roiPoolingNhwc(const T_Input* inputData, const Shape& inputShape, co
     uint32_t numRois = getSizeOfDimension(roiShape, 0);
     uint32_t roiInfoLength = getSizeOfDimension(roiShape, 1);
 
-    T_Input* outPtr = outputData;
     const T_Roi* roiDataEnd = roiData + numRois * roiInfoLength;
     uint32_t roiIndex = 0;
     for (const T_Roi* roiInfo = roiData; roiInfo < roiDataEnd; roiInfo += kRoiDim, roiIndex++) {
@@ -85,51 +88,71 @@ inline bool roiPoolingNhwc(const T_Input* inputData, const Shape& inputShape, co
         NN_RET_CHECK(roiInfo[3] * heightScale <= inHeight);
         NN_RET_CHECK(roiInfo[0] <= roiInfo[2]);
         NN_RET_CHECK(roiInfo[1] <= roiInfo[3]);
+    }
 
-        int32_t wRoiStart = std::round(static_cast<float>(roiInfo[0] * widthScale));
-        int32_t hRoiStart = std::round(static_cast<float>(roiInfo[1] * heightScale));
-        int32_t wRoiEnd = std::round(static_cast<float>(roiInfo[2] * widthScale));
-        int32_t hRoiEnd = std::round(static_cast<float>(roiInfo[3] * heightScale));
+    // Computes the input range [start, end) of every output bin of a ROI
+    // along one axis, clamped to the input size.
+    auto computeBins = [](T_Roi roiStartScaled, T_Roi roiEndScaled, uint32_t numBins,
+                          uint32_t inSize, std::vector<uint32_t>* starts,
+                          std::vector<uint32_t>* ends) {
+        int32_t roiStart = std::round(static_cast<float>(roiStartScaled));
+        int32_t roiEnd = std::round(static_cast<float>(roiEndScaled));
 
         // Rois with width/height < 1 are considered malformed and are forced to be 1
-        T_Roi roiWidth = static_cast<T_Roi>(std::max(wRoiEnd - wRoiStart + 1, 1));
-        T_Roi roiHeight = static_cast<T_Roi>(std::max(hRoiEnd - hRoiStart + 1, 1));
-        T_Roi wStepSize = roiWidth / static_cast<T_Roi>(outWidth);
-        T_Roi hStepSize = roiHeight / static_cast<T_Roi>(outHeight);
+        T_Roi roiSize = static_cast<T_Roi>(std::max(roiEnd - roiStart + 1, 1));
+        T_Roi stepSize = roiSize / static_cast<T_Roi>(numBins);
+        starts->resize(numBins);
+        ends->resize(numBins);
+        for (uint32_t i = 0; i < numBins; i++) {
+            // Take floor on start, ceil on end, start included, end excluded, i.e. [start, end)
+            // end is guaranteed to larger than start by at least 1
+            uint32_t start = std::floor(static_cast<float>(stepSize * i + roiStart));
+            uint32_t end = std::ceil(static_cast<float>(stepSize * (i + 1) + roiStart));
+            (*starts)[i] = std::min(start, inSize);
+            (*ends)[i] = std::min(end, inSize);
+        }
+    };
 
-        const T_Input* batchBase = inputData + batchId * inHeight * inWidth * inDepth;
-        for (uint32_t i = 0; i < outHeight; i++) {
-            for (uint32_t j = 0; j < outWidth; j++) {
-                // Take floor on start, ceil on end, start included, end excluded, i.e. [start, end)
-                // end is guaranteed to larger than start by at least 1
-                uint32_t wStart = std::floor(static_cast<float>(wStepSize * j + wRoiStart));
-                uint32_t wEnd = std::ceil(static_cast<float>(wStepSize * (j + 1) + wRoiStart));
-                uint32_t hStart = std::floor(static_cast<float>(hStepSize * i + hRoiStart));
-                uint32_t hEnd = std::ceil(static_cast<float>(hStepSize * (i + 1) + hRoiStart));
+    parallelFor(threadPool, 0, numRois, 1, [&](uint32_t roiBegin, uint32_t roiEnd) {
+        std::vector<uint32_t> wStarts, wEnds, hStarts, hEnds;
+        for (uint32_t roiIndex = roiBegin; roiIndex < roiEnd; roiIndex++) {
+            const T_Roi* roiInfo = roiData + roiIndex * kRoiDim;
+            computeBins(roiInfo[0] * widthScale, roiInfo[2] * widthScale, outWidth, inWidth,
+                        &wStarts, &wEnds);
+            computeBins(roiInfo[1] * heightScale, roiInfo[3] * heightScale, outHeight, inHeight,
+                        &hStarts, &hEnds);
 
-                wStart = std::min(wStart, inWidth);
-                wEnd = std::min(wEnd, inWidth);
-                hStart = std::min(hStart, inHeight);
-                hEnd = std::min(hEnd, inHeight);
+            const T_Input* batchBase =
+                    inputData + batchSplitData[roiIndex] * inHeight * inWidth * inDepth;
+            T_Input* outPtr = outputData + roiIndex * outHeight * outWidth * inDepth;
+            for (uint32_t i = 0; i < outHeight; i++) {
+                for (uint32_t j = 0; j < outWidth; j++) {
+                    const uint32_t hStart = hStarts[i], hEnd = hEnds[i];
+                    const uint32_t wStart = wStarts[j], wEnd = wEnds[j];
+                    if (hStart >= hEnd || wStart >= wEnd) {
+                        std::fill(outPtr, outPtr + inDepth,
+                                  static_cast<T_Input>(inputShape.offset));
+                        outPtr += inDepth;
+                        continue;
+                    }
 
-                for (uint32_t k = 0; k < inDepth; k++) {
-                    T_Input maxValue = static_cast<T_Input>(inputShape.offset);
-                    bool first = true;
+                    // Scan the bin a pixel at a time, taking the maximum of all
+                    // channels at once.
+                    const T_Input* first = batchBase + (hStart * inWidth + wStart) * inDepth;
+                    std::copy(first, first + inDepth, outPtr);
                     for (uint32_t h = hStart; h < hEnd; h++) {
                         for (uint32_t w = wStart; w < wEnd; w++) {
-                            T_Input inputValue = batchBase[h * inWidth * inDepth + w * inDepth + k];
-                            if (first || inputValue > maxValue) {
-                                maxValue = inputValue;
-                                first = false;
+                            const T_Input* in = batchBase + (h * inWidth + w) * inDepth;
+                            for (uint32_t k = 0; k < inDepth; k++) {
+                                outPtr[k] = in[k] > outPtr[k] ? in[k] : outPtr[k];
                             }
                         }
                     }
-                    outPtr[k] = maxValue;
+                    outPtr += inDepth;
                 }
-                outPtr += inDepth;
             }
         }
-    }
+    });
     return true;
 }
 
@@ -137,14 +160,15 @@ template <typename T_Input, typename T_Roi>
 inline bool roiPooling(const T_Input* inputData, const Shape& inputShape, const T_Roi* roiData,
                        const Shape& roiShape, const int32_t* batchSplitData,
                        const Shape& batchSplitShape, float heightStride, float widthStride,
-                       bool useNchw, T_Input* outputData, const Shape& outputShape) {
+                       bool useNchw, T_Input* outputData, const Shape& outputShape,
+                       ThreadPool* threadPool) {
     InputWithLayout<T_Input> input(useNchw);
     OutputWithLayout<T_Input> output(useNchw);
     NN_RET_CHECK(input.initialize(inputData, inputShape));
     NN_RET_CHECK(output.initialize(outputData, outputShape));
     NN_RET_CHECK(roiPoolingNhwc(input.getNhwcBuffer(), input.getNhwcShape(), roiData, roiShape,
                                 batchSplitData, batchSplitShape, heightStride, widthStride,
-                                output.getNhwcBuffer(), output.getNhwcShape()));
+                                output.getNhwcBuffer(), output.getNhwcShape(), threadPool));
     NN_RET_CHECK(output.commit());
     return true;
 }
@@ -155,12 +179,12 @@ inline bool roiPooling<uint8_t, uint16_t>(const uint8_t* inputData, const Shape&
                                           const int32_t* batchSplitData,
                                           const Shape& batchSplitShape, float heightStride,
                                           float widthStride, bool useNchw, uint8_t* outputData,
-                                          const Shape& outputShape) {
+                                          const Shape& outputShape, ThreadPool* threadPool) {
     std::vector<float> roi_float32(getNumberOfElements(roiShape));
     convertQuantToFloat32(roiData, roiShape.scale, roiShape.offset, &roi_float32);
     NN_RET_CHECK(roiPooling(inputData, inputShape, roi_float32.data(), roiShape, batchSplitData,
                             batchSplitShape, heightStride, widthStride, useNchw, outputData,
-                            outputShape));
+                            outputShape, threadPool));
     return true;
 }
 
@@ -259,7 +283,7 @@ bool execute(IOperationExecutionContext* context) {
                               context->getInputValue<_Float16>(kWidthStrideScalar),
                               context->getInputValue<bool>(kLayoutScalar),
                               context->getOutputBuffer<_Float16>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return roiPooling(context->getInputBuffer<float>(kInputTensor),
                               context->getInputShape(kInputTensor),
@@ -271,7 +295,7 @@ bool execute(IOperationExecutionContext* context) {
                               context->getInputValue<float>(kWidthStrideScalar),
                               context->getInputValue<bool>(kLayoutScalar),
                               context->getOutputBuffer<float>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return roiPooling(context->getInputBuffer<uint8_t>(kInputTensor),
                               context->getInputShape(kInputTensor),
@@ -283,7 +307,7 @@ bool execute(IOperationExecutionContext* context) {
                               context->getInputValue<float>(kWidthStrideScalar),
                               context->getInputValue<bool>(kLayoutScalar),
                               context->getOutputBuffer<uint8_t>(kOutputTensor),
-                              context->getOutputShape(kOutputTensor));
+                              context->getOutputShape(kOutputTensor), context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
     }
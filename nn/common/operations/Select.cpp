@@ -17,9 +17,9 @@
 #define LOG_TAG "Operations"
 
 #include "HalInterfaces.h"
-#include "IndexedShapeWrapper.h"
 #include "OperationResolver.h"
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 
 namespace android {
 namespace nn {
@@ -35,33 +35,50 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
 template <typename T>
 bool compute(const bool8* conditionData, const Shape& conditionShape, const T* aData,
-             const Shape& aShape, const T* bData, const Shape& bShape, T* outputData,
-             const Shape& outputShape) {
+             const Shape& /*aShape*/, const T* bData, const Shape& /*bShape*/, T* outputData,
+             const Shape& /*outputShape*/, ThreadPool* threadPool) {
     // The code assumes that condition has the same shape as all other tensors.
     // This should be checked during preparation stage.
     uint32_t size = getNumberOfElements(conditionShape);
-    for (uint32_t i = 0; i < size; ++i) {
-        T a = aData[i];
-        T b = bData[i];
-        if (aShape.type == OperandType::TENSOR_QUANT8_ASYMM) {
-            a = requantize(a, aShape, outputShape);
-            b = requantize(b, bShape, outputShape);
+    parallelFor(threadPool, 0, size, kMinChunkSize, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            outputData[i] = conditionData[i] ? aData[i] : bData[i];
         }
-        outputData[i] = conditionData[i] ? a : b;
+    });
+    return true;
+}
+
+bool compute(const bool8* conditionData, const Shape& conditionShape, const uint8_t* aData,
+             const Shape& aShape, const uint8_t* bData, const Shape& bShape, uint8_t* outputData,
+             const Shape& outputShape, ThreadPool* threadPool) {
+    // Requantize through tables of all the possible values.
+    uint8_t aTable[256], bTable[256];
+    for (uint32_t value = 0; value < 256; ++value) {
+        aTable[value] = requantize(value, aShape, outputShape);
+        bTable[value] = requantize(value, bShape, outputShape);
     }
+    uint32_t size = getNumberOfElements(conditionShape);
+    parallelFor(threadPool, 0, size, kMinChunkSize, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            outputData[i] = conditionData[i] ? aTable[aData[i]] : bTable[bData[i]];
+        }
+    });
     return true;
 }
 
 template <typename T>
 bool executeTyped(IOperationExecutionContext* context) {
-    return compute<T>(
+    return compute(
             context->getInputBuffer<bool8>(kInputCondition),
             context->getInputShape(kInputCondition), context->getInputBuffer<T>(kInputTensor1),
             context->getInputShape(kInputTensor1), context->getInputBuffer<T>(kInputTensor2),
             context->getInputShape(kInputTensor2), context->getOutputBuffer<T>(kOutputTensor),
-            context->getOutputShape(kOutputTensor));
+            context->getOutputShape(kOutputTensor), context->getThreadPool());
 }
 
 }  // namespace
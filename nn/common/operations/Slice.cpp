@@ -14,9 +14,11 @@
  * limitations under the License.
  */
 #include "CpuOperationUtils.h"
-#include "IndexedShapeWrapper.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 namespace android {
@@ -35,41 +37,48 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-template <typename T>
-void addVectors(const std::vector<T>& a, const std::vector<T>& b, std::vector<T>* res) {
-    for (int i = 0; i < res->size(); ++i) {
-        res->at(i) = a[i] + b[i];
-    }
-}
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
 
 template <typename T>
 bool evalGeneric(const T* inputData, const Shape& inputShape, const int32_t* beginData,
-                 const Shape& beginShape, const int32_t* sizeData, const Shape& sizeShape,
-                 T* outputData, const Shape& outputShape) {
-    const int outputSize = getNumberOfElements(outputShape);
-    const IndexedShapeWrapper indexedOutput = IndexedShapeWrapper(outputShape);
-    const IndexedShapeWrapper indexedInput = IndexedShapeWrapper(inputShape);
-    std::vector<uint32_t> outputIndex(getNumberOfDimensions(outputShape), 0);
-    std::vector<uint32_t> beginIndex(getSizeOfDimension(beginShape, 0));
-    std::vector<uint32_t> inputIndex(getNumberOfDimensions(inputShape));
-
-    for (int i = 0; i < beginIndex.size(); ++i) {
-        beginIndex[i] = static_cast<uint32_t>(beginData[i]);
+                 const Shape& /*beginShape*/, const int32_t* /*sizeData*/,
+                 const Shape& /*sizeShape*/, T* outputData, const Shape& outputShape,
+                 ThreadPool* threadPool) {
+    const int numDims = getNumberOfDimensions(inputShape);
+    std::vector<uint32_t> inputStrides(numDims);
+    uint32_t stride = 1;
+    for (int i = numDims - 1; i >= 0; --i) {
+        inputStrides[i] = stride;
+        stride *= getSizeOfDimension(inputShape, i);
     }
 
-    bool lastIndex = false;
-    uint32_t outputOffset;
-    uint32_t inputOffset;
-
-    do {
-        addVectors(outputIndex, beginIndex, &inputIndex);
-
-        NN_RET_CHECK(indexedOutput.indexToFlatIndex(outputIndex, &outputOffset));
-        NN_RET_CHECK(indexedInput.indexToFlatIndex(inputIndex, &inputOffset));
-
-        outputData[outputOffset] = inputData[inputOffset];
-        NN_RET_CHECK(indexedOutput.nextIndexInplace(&outputIndex, &lastIndex));
-    } while (!lastIndex);
+    // The output is made of contiguous rows of the input, which span the
+    // innermost dimension that is not copied whole, and those inside it.
+    int rowDim = numDims - 1;
+    while (rowDim > 0 &&
+           getSizeOfDimension(outputShape, rowDim) == getSizeOfDimension(inputShape, rowDim)) {
+        --rowDim;
+    }
+    const uint32_t rowSize = getSizeOfDimension(outputShape, rowDim) * inputStrides[rowDim];
+    uint32_t rowOffset = 0;
+    for (int i = 0; i < numDims; ++i) {
+        rowOffset += beginData[i] * inputStrides[i];
+    }
+    const uint32_t numRows = getNumberOfElements(outputShape) / rowSize;
+    parallelFor(threadPool, 0, numRows, std::max(kMinChunkSize / rowSize, 1u),
+                [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t row = begin; row < end; ++row) {
+                        uint32_t inputOffset = rowOffset;
+                        for (int i = rowDim - 1, index = row; i >= 0; --i) {
+                            const uint32_t size = getSizeOfDimension(outputShape, i);
+                            inputOffset += (index % size) * inputStrides[i];
+                            index /= size;
+                        }
+                        memcpy(outputData + row * rowSize, inputData + inputOffset,
+                               rowSize * sizeof(T));
+                    }
+                });
     return true;
 }
 
@@ -134,7 +143,7 @@ bool execute(IOperationExecutionContext* context) {
                                context->getInputBuffer<int32_t>(kSizeTensor),
                                context->getInputShape(kSizeTensor),
                                context->getOutputBuffer<_Float16>(kOutputTensor),
-                               context->getOutputShape(kOutputTensor));
+                               context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
             return evalGeneric(context->getInputBuffer<float>(kInputTensor),
                                context->getInputShape(kInputTensor),
@@ -143,7 +152,7 @@ bool execute(IOperationExecutionContext* context) {
                                context->getInputBuffer<int32_t>(kSizeTensor),
                                context->getInputShape(kSizeTensor),
                                context->getOutputBuffer<float>(kOutputTensor),
-                               context->getOutputShape(kOutputTensor));
+                               context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_INT32:
             return evalGeneric(context->getInputBuffer<int32_t>(kInputTensor),
                                context->getInputShape(kInputTensor),
@@ -152,7 +161,7 @@ bool execute(IOperationExecutionContext* context) {
                                context->getInputBuffer<int32_t>(kSizeTensor),
                                context->getInputShape(kSizeTensor),
                                context->getOutputBuffer<int32_t>(kOutputTensor),
-                               context->getOutputShape(kOutputTensor));
+                               context->getOutputShape(kOutputTensor), context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return evalGeneric(context->getInputBuffer<uint8_t>(kInputTensor),
                                context->getInputShape(kInputTensor),
@@ -161,7 +170,7 @@ bool execute(IOperationExecutionContext* context) {
                                context->getInputBuffer<int32_t>(kSizeTensor),
                                context->getInputShape(kSizeTensor),
                                context->getOutputBuffer<uint8_t>(kOutputTensor),
-                               context->getOutputShape(kOutputTensor));
+                               context->getOutputShape(kOutputTensor), context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
     }
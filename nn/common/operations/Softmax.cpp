@@ -14,14 +14,21 @@
  * limitations under the License.
  */
 
+#include "Softmax.h"
+
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
+#include "VectorMath.h"
 
 #include "tensorflow/lite/kernels/internal/optimized/legacy_optimized_ops.h"
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
 
 #include "Tracing.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace android {
 namespace nn {
 
@@ -39,152 +46,238 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-inline bool softmaxSlowFloat32(const float* inputData, const Shape& inputShape, const float beta,
-                               int32_t axis, float* outputData, const Shape& outputShape) {
-    NNTRACE_TRANS("softmaxFloatSlow32");
-    const uint32_t outerSize = getNumberOfElements(inputShape, 0, axis);
-    const uint32_t axisSize = getSizeOfDimension(inputShape, axis);
-    const uint32_t innerSize =
-            getNumberOfElements(inputShape, axis + 1, getNumberOfDimensions(inputShape));
-    for (uint32_t outer = 0; outer < outerSize; ++outer) {
-        const float* inputBeg = inputData + outer * axisSize * innerSize;
-        const float* inputEnd = inputBeg + axisSize * innerSize;
-        float* outputBeg = outputData + outer * axisSize * innerSize;
-        for (uint32_t inner = 0; inner < innerSize; ++inner, ++inputBeg, ++inputEnd, ++outputBeg) {
-            // Find max
-            float maxValue = -FLT_MAX;
-            for (const float* p = inputBeg; p < inputEnd; p += innerSize) {
-                maxValue = std::max(maxValue, *p);
-            }
-            // Compute sum
-            float sum = 0.0f;
-            for (const float* p = inputBeg; p < inputEnd; p += innerSize) {
-                sum += std::exp((*p - maxValue) * beta);
-            }
-            // Compute result
-            float* pOut = outputBeg;
-            for (const float* p = inputBeg; p < inputEnd; p += innerSize, pOut += innerSize) {
-                *pOut = std::exp((*p - maxValue) * beta) / sum;
-            }
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+// The number of independent partial maxima and sums along a contiguous axis.
+constexpr uint32_t kNumLanes = 16;
+
+// The number of inner elements processed together when the axis is not
+// innermost.  The elements of a tile are contiguous at each position along
+// the axis.
+constexpr uint32_t kTileSize = 256;
+
+// The number of positions along the axis whose maximum is found before their
+// exponentials are added to the running sums, so that the sums are rescaled
+// once per block rather than once per element.
+constexpr uint32_t kBlockSize = 8;
+
+struct SoftmaxLayout {
+    uint32_t outerSize;
+    uint32_t axisSize;
+    uint32_t innerSize;
+};
+
+SoftmaxLayout getSoftmaxLayout(const Shape& shape, uint32_t axis) {
+    return {.outerSize = getNumberOfElements(shape, 0, axis),
+            .axisSize = getSizeOfDimension(shape, axis),
+            .innerSize = getNumberOfElements(shape, axis + 1, getNumberOfDimensions(shape))};
+}
+
+// Computes a contiguous row of the output of softmaxFloat.
+template <typename T>
+void softmaxRow(const T* input, uint32_t size, float beta, bool isLog, T* output) {
+    float maxLanes[kNumLanes];
+    std::fill(maxLanes, maxLanes + kNumLanes, -std::numeric_limits<float>::infinity());
+    uint32_t i = 0;
+    for (; i + kNumLanes <= size; i += kNumLanes) {
+        for (uint32_t lane = 0; lane < kNumLanes; ++lane) {
+            maxLanes[lane] = std::max(maxLanes[lane], static_cast<float>(input[i + lane]));
         }
     }
-    return true;
-}
+    for (; i < size; ++i) {
+        maxLanes[0] = std::max(maxLanes[0], static_cast<float>(input[i]));
+    }
+    const float maxValue = *std::max_element(maxLanes, maxLanes + kNumLanes);
+
+    float sumLanes[kNumLanes] = {};
+    i = 0;
+    for (; i + kNumLanes <= size; i += kNumLanes) {
+        for (uint32_t lane = 0; lane < kNumLanes; ++lane) {
+            sumLanes[lane] +=
+                    vector_math::exp((static_cast<float>(input[i + lane]) - maxValue) * beta);
+        }
+    }
+    for (; i < size; ++i) {
+        sumLanes[0] += vector_math::exp((static_cast<float>(input[i]) - maxValue) * beta);
+    }
+    float sum = 0;
+    for (uint32_t lane = 0; lane < kNumLanes; ++lane) {
+        sum += sumLanes[lane];
+    }
 
-bool softmaxFloat32(const float* inputData, const Shape& inputShape, const float beta, int32_t axis,
-                    float* outputData, const Shape& outputShape) {
-    int32_t ndim = getNumberOfDimensions(inputShape);
-    NN_CHECK(handleNegativeAxis(inputShape, &axis));
-    // TFLite optimized implementation only supports computation along the last axis
-    if (axis == ndim - 1) {
-        NNTRACE_COMP("optimized_ops::Softmax::float");
-        tflite::SoftmaxParams param = {.beta = beta};
-        tflite::optimized_ops::Softmax(param, convertShapeToTflshape(inputShape), inputData,
-                                       convertShapeToTflshape(outputShape), outputData);
-        return true;
+    if (isLog) {
+        const float logSum = std::log(sum);
+        for (i = 0; i < size; ++i) {
+            output[i] = static_cast<T>((static_cast<float>(input[i]) - maxValue) * beta - logSum);
+        }
     } else {
-        return softmaxSlowFloat32(inputData, inputShape, beta, axis, outputData, outputShape);
+        const float scale = 1.f / sum;
+        for (i = 0; i < size; ++i) {
+            output[i] = static_cast<T>(
+                    vector_math::exp((static_cast<float>(input[i]) - maxValue) * beta) * scale);
+        }
     }
 }
 
-bool softmaxFloat16(const _Float16* inputData, const Shape& inputShape, const float beta,
-                    int32_t axis, _Float16* outputData, const Shape& outputShape) {
-    NNTRACE_TRANS("softmaxFloat16");
-    std::vector<float> inputData_float32(getNumberOfElements(inputShape));
-    convertFloat16ToFloat32(inputData, &inputData_float32);
-    std::vector<float> outputData_float32(getNumberOfElements(outputShape));
+// Computes a tile of |size| contiguous inner elements of the output of
+// softmaxFloat, whose positions along the axis are |stride| apart.
+template <typename T>
+void softmaxTile(const T* input, uint32_t axisSize, uint32_t stride, uint32_t size, float beta,
+                 bool isLog, T* output) {
+    // The running maxima and sums of exp(beta * (x - max)) of each element,
+    // read in a single pass over the axis.
+    float maxValues[kTileSize], sums[kTileSize], blockMaxValues[kTileSize];
+    std::fill(maxValues, maxValues + size, -std::numeric_limits<float>::infinity());
+    std::fill(sums, sums + size, 0.f);
+    for (uint32_t blockBegin = 0; blockBegin < axisSize; blockBegin += kBlockSize) {
+        const uint32_t blockEnd = std::min(blockBegin + kBlockSize, axisSize);
+        std::copy(maxValues, maxValues + size, blockMaxValues);
+        for (uint32_t i = blockBegin; i < blockEnd; ++i) {
+            const T* row = input + i * stride;
+            for (uint32_t j = 0; j < size; ++j) {
+                blockMaxValues[j] = std::max(blockMaxValues[j], static_cast<float>(row[j]));
+            }
+        }
+        for (uint32_t j = 0; j < size; ++j) {
+            sums[j] *= vector_math::exp((maxValues[j] - blockMaxValues[j]) * beta);
+            maxValues[j] = blockMaxValues[j];
+        }
+        for (uint32_t i = blockBegin; i < blockEnd; ++i) {
+            const T* row = input + i * stride;
+            for (uint32_t j = 0; j < size; ++j) {
+                sums[j] += vector_math::exp((static_cast<float>(row[j]) - maxValues[j]) * beta);
+            }
+        }
+    }
 
-    softmaxFloat32(inputData_float32.data(), inputShape, beta, axis, outputData_float32.data(),
-                   outputShape);
-    convertFloat32ToFloat16(outputData_float32, outputData);
+    if (isLog) {
+        for (uint32_t j = 0; j < size; ++j) {
+            sums[j] = std::log(sums[j]);
+        }
+        for (uint32_t i = 0; i < axisSize; ++i) {
+            const T* row = input + i * stride;
+            T* outputRow = output + i * stride;
+            for (uint32_t j = 0; j < size; ++j) {
+                outputRow[j] = static_cast<T>((static_cast<float>(row[j]) - maxValues[j]) * beta -
+                                              sums[j]);
+            }
+        }
+    } else {
+        for (uint32_t j = 0; j < size; ++j) {
+            sums[j] = 1.f / sums[j];
+        }
+        for (uint32_t i = 0; i < axisSize; ++i) {
+            const T* row = input + i * stride;
+            T* outputRow = output + i * stride;
+            for (uint32_t j = 0; j < size; ++j) {
+                outputRow[j] = static_cast<T>(
+                        vector_math::exp((static_cast<float>(row[j]) - maxValues[j]) * beta) *
+                        sums[j]);
+            }
+        }
+    }
+}
 
+template <typename T>
+bool softmaxFloatImpl(const T* inputData, const Shape& inputShape, float beta, uint32_t axis,
+                      bool isLog, T* outputData, ThreadPool* threadPool) {
+    NNTRACE_COMP("softmaxFloat");
+    const SoftmaxLayout layout = getSoftmaxLayout(inputShape, axis);
+    if (layout.axisSize == 0) {
+        return true;
+    }
+    if (layout.innerSize == 1) {
+        parallelFor(threadPool, 0, layout.outerSize,
+                    std::max(kMinChunkSize / layout.axisSize, 1u),
+                    [&](uint32_t begin, uint32_t end) {
+                        for (uint32_t outer = begin; outer < end; ++outer) {
+                            const uint32_t offset = outer * layout.axisSize;
+                            softmaxRow(inputData + offset, layout.axisSize, beta, isLog,
+                                       outputData + offset);
+                        }
+                    });
+        return true;
+    }
+    const uint32_t numTiles = (layout.innerSize + kTileSize - 1) / kTileSize;
+    const uint32_t tileElements = layout.axisSize * std::min(layout.innerSize, kTileSize);
+    parallelFor(threadPool, 0, layout.outerSize * numTiles,
+                std::max(kMinChunkSize / tileElements, 1u), [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t task = begin; task < end; ++task) {
+                        const uint32_t outer = task / numTiles;
+                        const uint32_t tileBegin = task % numTiles * kTileSize;
+                        const uint32_t offset =
+                                outer * layout.axisSize * layout.innerSize + tileBegin;
+                        softmaxTile(inputData + offset, layout.axisSize, layout.innerSize,
+                                    std::min(kTileSize, layout.innerSize - tileBegin), beta,
+                                    isLog, outputData + offset);
+                    }
+                });
     return true;
 }
 
+// Computes quant8 softmax along an axis that is not innermost from a table
+// of exp(-beta * scale * d) for each difference d between an input and the
+// maximum along the axis.
 bool softmaxQuant8Impl(const uint8_t* inputData, const Shape& inputShape, const float beta,
-                       int32_t axis, int32_t inputMultiplier, int32_t inputLeftShift, float diffMin,
-                       uint8_t* outputData, const Shape& outputShape) {
+                       uint32_t axis, uint8_t* outputData, ThreadPool* threadPool) {
     NNTRACE_TRANS("softmaxQuant8");
-    // The representation chosen for the input to the exp() function is Q5.26.
-    // We need to leave extra space since values that we skip might be as large as
-    // -32 before multiplying by input_beta_multiplier, and therefore as large as
-    // -16 afterwards.  Note that exp(-8) is definitely not insignificant to
-    // accumulation, but exp(-16) definitely is.
-    static const int32_t kScaledDiffIntegerBits = 5;
-    static const int kAccumulationIntegerBits = 12;
-    using FixedPointScaledDiff = gemmlowp::FixedPoint<int32_t, kScaledDiffIntegerBits>;
-    using FixedPointAccum = gemmlowp::FixedPoint<int32_t, kAccumulationIntegerBits>;
-    using FixedPoint0 = gemmlowp::FixedPoint<int32_t, 0>;
-
-    const uint32_t outerSize = getNumberOfElements(inputShape, 0, axis);
-    const uint32_t axisSize = getSizeOfDimension(inputShape, axis);
-    const uint32_t innerSize =
-            getNumberOfElements(inputShape, axis + 1, getNumberOfDimensions(inputShape));
-    for (uint32_t outer = 0; outer < outerSize; ++outer) {
-        const uint8_t* inputBeg = inputData + outer * axisSize * innerSize;
-        const uint8_t* inputEnd = inputBeg + axisSize * innerSize;
-        uint8_t* outputBeg = outputData + outer * axisSize * innerSize;
-        for (uint32_t inner = 0; inner < innerSize; ++inner, ++inputBeg, ++inputEnd, ++outputBeg) {
-            // Find max
-            uint8_t maxValue = 0;
-            for (const uint8_t* p = inputBeg; p < inputEnd; p += innerSize) {
-                maxValue = std::max(maxValue, *p);
-            }
-
-            // Compute sum
-            FixedPointAccum sum_of_exps = FixedPointAccum::Zero();
-            for (const uint8_t* p = inputBeg; p < inputEnd; p += innerSize) {
-                int32_t input_diff = static_cast<int32_t>(*p) - maxValue;
-                if (input_diff >= diffMin) {
-                    const int32_t input_diff_rescaled =
-                            tflite::MultiplyByQuantizedMultiplierGreaterThanOne(
-                                    input_diff, inputMultiplier, inputLeftShift);
-                    const auto scaled_diff_f8 = FixedPointScaledDiff::FromRaw(input_diff_rescaled);
-                    sum_of_exps = sum_of_exps + gemmlowp::Rescale<kAccumulationIntegerBits>(
-                                                        exp_on_negative_values(scaled_diff_f8));
-                }
-            }
-
-            uint32_t fixed_sum_of_exps = static_cast<uint32_t>(sum_of_exps.raw());
-            int32_t headroom_plus_one = tflite::CountLeadingZeros(fixed_sum_of_exps);
-            // This is the number of bits to the left of the binary point above 1.0.
-            // Consider fixed_sum_of_exps=1.25.  In that case shifted_scale=0.8 and
-            // no later adjustment will be needed.
-            int32_t num_bits_over_unit = kAccumulationIntegerBits - headroom_plus_one;
-            int32_t shifted_sum_minus_one = static_cast<int32_t>(
-                    (fixed_sum_of_exps << headroom_plus_one) - (static_cast<uint32_t>(1) << 31));
-
-            FixedPoint0 shifted_scale = gemmlowp::one_over_one_plus_x_for_x_in_0_1(
-                    FixedPoint0::FromRaw(shifted_sum_minus_one));
-
-            // Compute result
-            uint8_t* pOut = outputBeg;
-            for (const uint8_t* p = inputBeg; p < inputEnd; p += innerSize, pOut += innerSize) {
-                int32_t input_diff = static_cast<int32_t>(*p) - maxValue;
-                if (input_diff >= diffMin) {
-                    const int32_t input_diff_rescaled =
-                            tflite::MultiplyByQuantizedMultiplierGreaterThanOne(
-                                    input_diff, inputMultiplier, inputLeftShift);
-                    const auto scaled_diff_f8 = FixedPointScaledDiff::FromRaw(input_diff_rescaled);
-
-                    FixedPoint0 exp_in_0 = exp_on_negative_values(scaled_diff_f8);
-                    int32_t unsat_output = gemmlowp::RoundingDivideByPOT(
-                            (shifted_scale * exp_in_0).raw(), num_bits_over_unit + 31 - 8);
-
-                    *pOut = static_cast<uint8_t>(
-                            std::max(std::min(unsat_output, static_cast<int32_t>(255)), 0));
-
-                } else {
-                    *pOut = 0;
-                }
-            }
-        }
+    float table[256];
+    for (uint32_t d = 0; d < 256; ++d) {
+        table[d] = std::exp(-beta * inputShape.scale * d);
     }
+    const SoftmaxLayout layout = getSoftmaxLayout(inputShape, axis);
+    const uint32_t numTiles = (layout.innerSize + kTileSize - 1) / kTileSize;
+    const uint32_t tileElements = layout.axisSize * std::min(layout.innerSize, kTileSize);
+    NNTRACE_COMP_SWITCH("softmaxQuant8Impl");
+    parallelFor(
+            threadPool, 0, layout.outerSize * numTiles,
+            std::max(kMinChunkSize / tileElements, 1u), [&](uint32_t begin, uint32_t end) {
+                uint8_t maxValues[kTileSize];
+                float scales[kTileSize];
+                for (uint32_t task = begin; task < end; ++task) {
+                    const uint32_t outer = task / numTiles;
+                    const uint32_t tileBegin = task % numTiles * kTileSize;
+                    const uint32_t size = std::min(kTileSize, layout.innerSize - tileBegin);
+                    const uint32_t offset = outer * layout.axisSize * layout.innerSize + tileBegin;
+                    const uint8_t* input = inputData + offset;
+                    uint8_t* output = outputData + offset;
+
+                    std::fill(maxValues, maxValues + size, 0);
+                    for (uint32_t i = 0; i < layout.axisSize; ++i) {
+                        const uint8_t* row = input + i * layout.innerSize;
+                        for (uint32_t j = 0; j < size; ++j) {
+                            maxValues[j] = std::max(maxValues[j], row[j]);
+                        }
+                    }
+                    std::fill(scales, scales + size, 0.f);
+                    for (uint32_t i = 0; i < layout.axisSize; ++i) {
+                        const uint8_t* row = input + i * layout.innerSize;
+                        for (uint32_t j = 0; j < size; ++j) {
+                            scales[j] += table[maxValues[j] - row[j]];
+                        }
+                    }
+                    // The output scale is 1 / 256.
+                    for (uint32_t j = 0; j < size; ++j) {
+                        scales[j] = 256.f / scales[j];
+                    }
+                    for (uint32_t i = 0; i < layout.axisSize; ++i) {
+                        const uint8_t* row = input + i * layout.innerSize;
+                        uint8_t* outputRow = output + i * layout.innerSize;
+                        for (uint32_t j = 0; j < size; ++j) {
+                            const int32_t value = static_cast<int32_t>(
+                                    table[maxValues[j] - row[j]] * scales[j] + 0.5f);
+                            outputRow[j] = static_cast<uint8_t>(std::min(value, 255));
+                        }
+                    }
+                }
+            });
     return true;
 }
 
 bool softmaxQuant8(const uint8_t* inputData, const Shape& inputShape, const float beta,
-                   int32_t axis, uint8_t* outputData, const Shape& outputShape) {
+                   int32_t axis, uint8_t* outputData, const Shape& outputShape,
+                   ThreadPool* threadPool) {
     int32_t ndim = getNumberOfDimensions(inputShape);
     NN_CHECK(handleNegativeAxis(inputShape, &axis));
 
@@ -193,6 +286,11 @@ bool softmaxQuant8(const uint8_t* inputData, const Shape& inputShape, const floa
         return false;
     }
 
+    // TFLite optimized implementation only supports computation along the last axis
+    if (axis != ndim - 1) {
+        return softmaxQuant8Impl(inputData, inputShape, beta, axis, outputData, threadPool);
+    }
+
     static const int32_t kScaledDiffIntegerBits = 5;
     const double input_beta_real_multiplier =
             std::min(1.0 * beta * inputShape.scale * (1 << (31 - kScaledDiffIntegerBits)),
@@ -205,24 +303,28 @@ bool softmaxQuant8(const uint8_t* inputData, const Shape& inputShape, const floa
     }
     int32_t diffMin = -CalculateInputRadius(kScaledDiffIntegerBits, inputLeftShift);
 
-    // TFLite optimized implementation only supports computation along the last axis
-    if (axis == ndim - 1) {
-        NNTRACE_COMP("optimized_ops::Softmax::uint8");
-        tflite::SoftmaxParams param = {.beta = beta,
-                                       .input_multiplier = inputMultiplier,
-                                       .input_left_shift = inputLeftShift,
-                                       .diff_min = diffMin};
-        tflite::optimized_ops::Softmax(param, convertShapeToTflshape(inputShape), inputData,
-                                       convertShapeToTflshape(outputShape), outputData);
-        return true;
-    } else {
-        return softmaxQuant8Impl(inputData, inputShape, beta, axis, inputMultiplier, inputLeftShift,
-                                 diffMin, outputData, outputShape);
-    }
+    NNTRACE_COMP("optimized_ops::Softmax::uint8");
+    tflite::SoftmaxParams param = {.beta = beta,
+                                   .input_multiplier = inputMultiplier,
+                                   .input_left_shift = inputLeftShift,
+                                   .diff_min = diffMin};
+    tflite::optimized_ops::Softmax(param, convertShapeToTflshape(inputShape), inputData,
+                                   convertShapeToTflshape(outputShape), outputData);
+    return true;
 }
 
 }  // namespace
 
+bool softmaxFloat(const _Float16* inputData, const Shape& inputShape, float beta, uint32_t axis,
+                  bool isLog, _Float16* outputData, ThreadPool* threadPool) {
+    return softmaxFloatImpl(inputData, inputShape, beta, axis, isLog, outputData, threadPool);
+}
+
+bool softmaxFloat(const float* inputData, const Shape& inputShape, float beta, uint32_t axis,
+                  bool isLog, float* outputData, ThreadPool* threadPool) {
+    return softmaxFloatImpl(inputData, inputShape, beta, axis, isLog, outputData, threadPool);
+}
+
 bool validate(const IOperationValidationContext* context) {
     NN_RET_CHECK(context->getNumInputs() == kNumInputs ||
                  context->getNumInputs() == kNumInputs - 1);
@@ -271,23 +373,25 @@ bool execute(IOperationExecutionContext* context) {
                            : -1;
     switch (context->getInputType(kInputTensor)) {
         case OperandType::TENSOR_FLOAT16:
-            return softmaxFloat16(context->getInputBuffer<_Float16>(kInputTensor),
-                                  context->getInputShape(kInputTensor),
-                                  context->getInputValue<_Float16>(kBetaScalar), axis,
-                                  context->getOutputBuffer<_Float16>(kOutputTensor),
-                                  context->getOutputShape(kOutputTensor));
+            NN_RET_CHECK(handleNegativeAxis(context->getInputShape(kInputTensor), &axis));
+            return softmaxFloat(context->getInputBuffer<_Float16>(kInputTensor),
+                                context->getInputShape(kInputTensor),
+                                context->getInputValue<_Float16>(kBetaScalar), axis,
+                                /*isLog=*/false, context->getOutputBuffer<_Float16>(kOutputTensor),
+                                context->getThreadPool());
         case OperandType::TENSOR_FLOAT32:
-            return softmaxFloat32(context->getInputBuffer<float>(kInputTensor),
-                                  context->getInputShape(kInputTensor),
-                                  context->getInputValue<float>(kBetaScalar), axis,
-                                  context->getOutputBuffer<float>(kOutputTensor),
-                                  context->getOutputShape(kOutputTensor));
+            NN_RET_CHECK(handleNegativeAxis(context->getInputShape(kInputTensor), &axis));
+            return softmaxFloat(context->getInputBuffer<float>(kInputTensor),
+                                context->getInputShape(kInputTensor),
+                                context->getInputValue<float>(kBetaScalar), axis,
+                                /*isLog=*/false, context->getOutputBuffer<float>(kOutputTensor),
+                                context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return softmaxQuant8(context->getInputBuffer<uint8_t>(kInputTensor),
                                  context->getInputShape(kInputTensor),
                                  context->getInputValue<float>(kBetaScalar), axis,
                                  context->getOutputBuffer<uint8_t>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getOutputShape(kOutputTensor), context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
     }
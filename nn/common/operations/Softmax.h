@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_ML_NN_SOFTMAX_H
+#define FRAMEWORKS_ML_NN_SOFTMAX_H
+
+#include "OperationsUtils.h"
+
+namespace android {
+namespace nn {
+namespace softmax {
+
+// Computes softmax(beta * x) along the axis, which must not be negative, or
+// its logarithm if isLog is true. Float16 inputs are computed in float32.
+bool softmaxFloat(const _Float16* inputData, const Shape& inputShape, float beta, uint32_t axis,
+                  bool isLog, _Float16* outputData, ThreadPool* threadPool);
+bool softmaxFloat(const float* inputData, const Shape& inputShape, float beta, uint32_t axis,
+                  bool isLog, float* outputData, ThreadPool* threadPool);
+
+}  // namespace softmax
+}  // namespace nn
+}  // namespace android
+
+#endif  // FRAMEWORKS_ML_NN_SOFTMAX_H
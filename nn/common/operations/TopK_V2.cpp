@@ -16,8 +16,11 @@
 #include "TopK_V2.h"
 
 #include "OperationsUtils.h"
+#include "ThreadPool.h"
 
 #include <algorithm>
+#include <utility>
+#include <vector>
 
 namespace android {
 namespace nn {
@@ -25,29 +28,64 @@ namespace topk_v2 {
 
 namespace {
 
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+// Orders the candidates from best to worst: larger values first, and larger
+// indices first among equal values.
+template <typename T>
+bool isBetter(const std::pair<T, int32_t>& a, const std::pair<T, int32_t>& b) {
+    return a.first > b.first || (a.first == b.first && a.second > b.second);
+}
+
 template <typename T>
 bool evalGeneric(const T* inputData, const Shape& inputShape, const int32_t k, T* valuesData,
-                 const Shape& /*valuesShape*/, int32_t* indicesData,
-                 const Shape& /*indicesShape*/) {
-    const int rowSize = inputShape.dimensions.back();
-    const int totalSize = getNumberOfElements(inputShape);
-    std::vector<std::pair<T, int32_t>> values(rowSize);
-    T* curOutputValue = valuesData;
-    int32_t* curOutputIndex = indicesData;
-    for (int rowBegin = 0; rowBegin < totalSize; rowBegin += rowSize) {
-        for (int i = 0; i < rowSize; ++i) {
-            values[i] = std::make_pair(inputData[rowBegin + i], i);
+                 const Shape& /*valuesShape*/, int32_t* indicesData, const Shape& /*indicesShape*/,
+                 ThreadPool* threadPool) {
+    const uint32_t rowSize = inputShape.dimensions.back();
+    const uint32_t numRows = getNumberOfElements(inputShape) / rowSize;
+    const uint32_t minRowsPerChunk = std::max(kMinChunkSize / rowSize, 1u);
+    parallelFor(threadPool, 0, numRows, minRowsPerChunk, [&](uint32_t rowBegin, uint32_t rowEnd) {
+        if (k == 1) {
+            for (uint32_t row = rowBegin; row < rowEnd; ++row) {
+                const T* input = inputData + row * rowSize;
+                int32_t bestIndex = 0;
+                for (uint32_t i = 1; i < rowSize; ++i) {
+                    if (!(input[i] < input[bestIndex])) {
+                        bestIndex = i;
+                    }
+                }
+                valuesData[row] = input[bestIndex];
+                indicesData[row] = bestIndex;
+            }
+            return;
         }
-        std::nth_element(values.begin(), values.begin() + (rowSize - k), values.end());
-        std::sort(values.begin() + (rowSize - k), values.end());
-        std::reverse(values.begin(), values.end());
-        for (int i = 0; i < k; ++i) {
-            *curOutputValue = values[i].first;
-            *curOutputIndex = values[i].second;
-            curOutputValue++;
-            curOutputIndex++;
+
+        // Stream over each row once, keeping the best k candidates in a heap
+        // whose top is the worst of them. Since the indices increase, a value
+        // equal to the worst candidate replaces it.
+        std::vector<std::pair<T, int32_t>> heap(k);
+        for (uint32_t row = rowBegin; row < rowEnd; ++row) {
+            const T* input = inputData + row * rowSize;
+            for (int32_t i = 0; i < k; ++i) {
+                heap[i] = std::make_pair(input[i], i);
+            }
+            std::make_heap(heap.begin(), heap.end(), isBetter<T>);
+            for (uint32_t i = k; i < rowSize; ++i) {
+                if (input[i] < heap.front().first) {
+                    continue;
+                }
+                std::pop_heap(heap.begin(), heap.end(), isBetter<T>);
+                heap.back() = std::make_pair(input[i], static_cast<int32_t>(i));
+                std::push_heap(heap.begin(), heap.end(), isBetter<T>);
+            }
+            std::sort_heap(heap.begin(), heap.end(), isBetter<T>);
+            for (int32_t i = 0; i < k; ++i) {
+                valuesData[row * k + i] = heap[i].first;
+                indicesData[row * k + i] = heap[i].second;
+            }
         }
-    }
+    });
     return true;
 }
 
@@ -65,27 +103,32 @@ bool prepare(const Shape& input, int32_t k, Shape* values, Shape* indices) {
 }
 
 bool eval(const void* inputData, const Shape& inputShape, const int32_t k, void* valuesData,
-          const Shape& valuesShape, void* indicesData, const Shape& indicesShape) {
+          const Shape& valuesShape, void* indicesData, const Shape& indicesShape,
+          ThreadPool* threadPool) {
     switch (inputShape.type) {
         case OperandType::TENSOR_FLOAT16: {
             return evalGeneric(reinterpret_cast<const _Float16*>(inputData), inputShape, k,
                                reinterpret_cast<_Float16*>(valuesData), valuesShape,
-                               reinterpret_cast<int32_t*>(indicesData), indicesShape);
+                               reinterpret_cast<int32_t*>(indicesData), indicesShape,
+                               threadPool);
         } break;
         case OperandType::TENSOR_FLOAT32: {
             return evalGeneric(reinterpret_cast<const float*>(inputData), inputShape, k,
                                reinterpret_cast<float*>(valuesData), valuesShape,
-                               reinterpret_cast<int32_t*>(indicesData), indicesShape);
+                               reinterpret_cast<int32_t*>(indicesData), indicesShape,
+                               threadPool);
         } break;
         case OperandType::TENSOR_INT32: {
             return evalGeneric(reinterpret_cast<const int32_t*>(inputData), inputShape, k,
                                reinterpret_cast<int32_t*>(valuesData), valuesShape,
-                               reinterpret_cast<int32_t*>(indicesData), indicesShape);
+                               reinterpret_cast<int32_t*>(indicesData), indicesShape,
+                               threadPool);
         } break;
         case OperandType::TENSOR_QUANT8_ASYMM: {
             return evalGeneric(reinterpret_cast<const uint8_t*>(inputData), inputShape, k,
                                reinterpret_cast<uint8_t*>(valuesData), valuesShape,
-                               reinterpret_cast<int32_t*>(indicesData), indicesShape);
+                               reinterpret_cast<int32_t*>(indicesData), indicesShape,
+                               threadPool);
         } break;
         default: {
             LOG(ERROR) << "Unsupported data type: " << toString(inputShape.type);
@@ -26,7 +26,8 @@ namespace topk_v2 {
 bool prepare(const Shape& input, int32_t k, Shape* values, Shape* indices);
 
 bool eval(const void* inputData, const Shape& inputShape, const int32_t k, void* valuesData,
-          const Shape& valuesShape, void* indicesData, const Shape& indicesShape);
+          const Shape& valuesShape, void* indicesData, const Shape& indicesShape,
+          ThreadPool* threadPool);
 
 }  // namespace topk_v2
 }  // namespace nn
@@ -16,12 +16,14 @@
 
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
-
-#include "tensorflow/lite/kernels/internal/optimized/legacy_optimized_ops.h"
-#include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
+#include "ThreadPool.h"
 
 #include "Tracing.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 namespace android {
 namespace nn {
 namespace transpose {
@@ -37,30 +39,173 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
+// Inputs with at least this many elements per task are split across threads.
+constexpr uint32_t kMinChunkSize = 4096;
+
+// The 2D transposes go through square blocks that fit in the L1 cache, each
+// made of tiles small enough for the compiler to keep in registers.
+constexpr uint32_t kBlockSize = 64;
+constexpr uint32_t kTileSize = 8;
+
+struct TransposeDimension {
+    uint32_t size;
+    uint32_t inputStride;
+    uint32_t outputStride;
+};
+
+// Returns the dimensions of the output, outermost first, after dropping those
+// of size 1 and merging those that are adjacent in both the input and the
+// output.
+std::vector<TransposeDimension> getTransposeDimensions(const Shape& inputShape,
+                                                       const int32_t* perm, uint32_t permSize) {
+    std::vector<uint32_t> inputStrides(permSize);
+    uint32_t stride = 1;
+    for (int i = permSize - 1; i >= 0; --i) {
+        inputStrides[i] = stride;
+        stride *= getSizeOfDimension(inputShape, i);
+    }
+    std::vector<TransposeDimension> dimensions;
+    int32_t previousAxis = -1;
+    for (uint32_t i = 0; i < permSize; ++i) {
+        const int32_t axis = perm[i];
+        const uint32_t size = getSizeOfDimension(inputShape, axis);
+        if (size == 1) {
+            continue;
+        }
+        bool isAdjacent = previousAxis >= 0 && previousAxis < axis;
+        for (int32_t j = previousAxis + 1; isAdjacent && j < axis; ++j) {
+            isAdjacent = getSizeOfDimension(inputShape, j) == 1;
+        }
+        if (isAdjacent) {
+            dimensions.back().size *= size;
+            dimensions.back().inputStride = inputStrides[axis];
+        } else {
+            dimensions.push_back({.size = size, .inputStride = inputStrides[axis]});
+        }
+        previousAxis = axis;
+    }
+    stride = 1;
+    for (auto it = dimensions.rbegin(); it != dimensions.rend(); ++it) {
+        it->outputStride = stride;
+        stride *= it->size;
+    }
+    return dimensions;
+}
+
+// Returns the input and output offsets of the index-th position in the given
+// dimensions.
+void getOffsets(const std::vector<TransposeDimension>& dimensions, uint32_t index,
+                uint32_t* inputOffset, uint32_t* outputOffset) {
+    *inputOffset = 0;
+    *outputOffset = 0;
+    for (auto it = dimensions.rbegin(); it != dimensions.rend(); ++it) {
+        const uint32_t position = index % it->size;
+        *inputOffset += position * it->inputStride;
+        *outputOffset += position * it->outputStride;
+        index /= it->size;
+    }
+}
+
+// Sets output[col * outputStride + row] to input[row * inputStride + col].
+template <typename T>
+void transposeBlock(const T* input, uint32_t inputStride, uint32_t numRows, uint32_t numCols,
+                    T* output, uint32_t outputStride) {
+    uint32_t row = 0;
+    for (; row + kTileSize <= numRows; row += kTileSize) {
+        uint32_t col = 0;
+        for (; col + kTileSize <= numCols; col += kTileSize) {
+            const T* in = input + row * inputStride + col;
+            T* out = output + col * outputStride + row;
+            for (uint32_t i = 0; i < kTileSize; ++i) {
+                for (uint32_t j = 0; j < kTileSize; ++j) {
+                    out[i * outputStride + j] = in[j * inputStride + i];
+                }
+            }
+        }
+        for (; col < numCols; ++col) {
+            for (uint32_t j = 0; j < kTileSize; ++j) {
+                output[col * outputStride + row + j] = input[(row + j) * inputStride + col];
+            }
+        }
+    }
+    for (; row < numRows; ++row) {
+        for (uint32_t col = 0; col < numCols; ++col) {
+            output[col * outputStride + row] = input[row * inputStride + col];
+        }
+    }
+}
+
 template <typename T>
 bool transposeGeneric(const T* inputData, const Shape& inputShape, const int32_t* perm,
-                      const Shape& permShape, T* outputData, const Shape& outputShape) {
+                      const Shape& permShape, T* outputData, ThreadPool* threadPool) {
     NNTRACE_TRANS("transposeGeneric");
-    // Reverse the permuted axes and convert to 4D due to the way Dims are
-    // constructed.
-    const int32_t kOutputDimensionNum = 4;
-
     // permData can be NO_VALUE representing a regular 2D matrix transpose
-    int32_t permSize = perm == nullptr ? 2 : static_cast<int32_t>(getSizeOfDimension(permShape, 0));
-    int32_t perm_tmp[2] = {1, 0};
+    const uint32_t permSize = perm == nullptr ? 2 : getSizeOfDimension(permShape, 0);
+    const int32_t defaultPerm[2] = {1, 0};
     if (perm == nullptr) {
-        perm = perm_tmp;
+        perm = defaultPerm;
     }
-    int32_t reversed_perm[kOutputDimensionNum];
-    for (int32_t output_k = 0, input_k = permSize - 1; output_k < permSize; ++output_k, --input_k) {
-        reversed_perm[output_k] = permSize - perm[input_k] - 1;
+    const std::vector<TransposeDimension> dimensions =
+            getTransposeDimensions(inputShape, perm, permSize);
+
+    // The data stays in place if at most one dimension is left.
+    if (dimensions.size() <= 1) {
+        NNTRACE_COMP_SWITCH("transposeCopy");
+        // The output may be planned as a view of the input.
+        if (outputData != inputData) {
+            memcpy(outputData, inputData, getNumberOfElements(inputShape) * sizeof(T));
+        }
+        return true;
     }
-    for (int32_t k = permSize; k < kOutputDimensionNum; ++k) {
-        reversed_perm[k] = k;
+
+    const TransposeDimension& inner = dimensions.back();
+    if (inner.inputStride == 1) {
+        // Copy contiguous rows.
+        NNTRACE_COMP_SWITCH("transposeRows");
+        const std::vector<TransposeDimension> outer(dimensions.begin(), dimensions.end() - 1);
+        const uint32_t numRows = getNumberOfElements(inputShape) / inner.size;
+        parallelFor(threadPool, 0, numRows, std::max(kMinChunkSize / inner.size, 1u),
+                    [&](uint32_t begin, uint32_t end) {
+                        for (uint32_t row = begin; row < end; ++row) {
+                            uint32_t inputOffset, outputOffset;
+                            getOffsets(outer, row, &inputOffset, &outputOffset);
+                            memcpy(outputData + outputOffset, inputData + inputOffset,
+                                   inner.size * sizeof(T));
+                        }
+                    });
+        return true;
     }
-    NNTRACE_COMP_SWITCH("reference_ops::Transpose");
-    tflite::reference_ops::Transpose(inputData, convertShapeToDims(inputShape), outputData,
-                                     convertShapeToDims(outputShape), reversed_perm);
+
+    // Transpose planes made of the innermost dimension of the output and the
+    // innermost dimension of the input, one band of kBlockSize input
+    // columns at a time.
+    NNTRACE_COMP_SWITCH("transposePlanes");
+    const auto contiguous = std::find_if(
+            dimensions.begin(), dimensions.end(),
+            [](const TransposeDimension& dimension) { return dimension.inputStride == 1; });
+    const TransposeDimension rows = inner;
+    const TransposeDimension cols = *contiguous;
+    std::vector<TransposeDimension> outer(dimensions.begin(), dimensions.end() - 1);
+    outer.erase(outer.begin() + (contiguous - dimensions.begin()));
+    const uint32_t numBands = (cols.size + kBlockSize - 1) / kBlockSize;
+    const uint32_t numPlanes = getNumberOfElements(inputShape) / (rows.size * cols.size);
+    const uint32_t bandSize = rows.size * std::min(cols.size, kBlockSize);
+    parallelFor(threadPool, 0, numPlanes * numBands, std::max(kMinChunkSize / bandSize, 1u),
+                [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t task = begin; task < end; ++task) {
+                        uint32_t inputOffset, outputOffset;
+                        getOffsets(outer, task / numBands, &inputOffset, &outputOffset);
+                        const uint32_t colBegin = (task % numBands) * kBlockSize;
+                        const uint32_t numCols = std::min(kBlockSize, cols.size - colBegin);
+                        const T* input = inputData + inputOffset + colBegin;
+                        T* output = outputData + outputOffset + colBegin * cols.outputStride;
+                        for (uint32_t rowBegin = 0; rowBegin < rows.size; rowBegin += kBlockSize) {
+                            transposeBlock(input + rowBegin * rows.inputStride, rows.inputStride,
+                                           std::min(kBlockSize, rows.size - rowBegin), numCols,
+                                           output + rowBegin, cols.outputStride);
+                        }
+                    }
+                });
     return true;
 }
 
@@ -111,8 +256,11 @@ bool prepare(IOperationExecutionContext* context) {
         NN_RET_CHECK_EQ(numInputDims, getSizeOfDimension(permShape, 0));
 
         std::vector<uint32_t> outDims(numInputDims);
+        std::vector<bool> isPermuted(numInputDims);
         for (int32_t idx = 0; idx < static_cast<int32_t>(numInputDims); ++idx) {
             NN_RET_CHECK(permData[idx] >= 0 && permData[idx] < static_cast<int32_t>(numInputDims));
+            NN_RET_CHECK(!isPermuted[permData[idx]]);
+            isPermuted[permData[idx]] = true;
             outDims[idx] = getSizeOfDimension(input, permData[idx]);
         }
         output.dimensions = outDims;
@@ -131,21 +279,21 @@ bool execute(IOperationExecutionContext* context) {
                                     context->getInputBuffer<int32_t>(kPermTensor),
                                     context->getInputShape(kPermTensor),
                                     context->getOutputBuffer<float>(kOutputTensor),
-                                    context->getOutputShape(kOutputTensor));
+                                    context->getThreadPool());
         case OperandType::TENSOR_FLOAT16:
             return transposeGeneric(context->getInputBuffer<_Float16>(kInputTensor),
                                     context->getInputShape(kInputTensor),
                                     context->getInputBuffer<int32_t>(kPermTensor),
                                     context->getInputShape(kPermTensor),
                                     context->getOutputBuffer<_Float16>(kOutputTensor),
-                                    context->getOutputShape(kOutputTensor));
+                                    context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             return transposeGeneric(context->getInputBuffer<uint8_t>(kInputTensor),
                                     context->getInputShape(kInputTensor),
                                     context->getInputBuffer<int32_t>(kPermTensor),
                                     context->getInputShape(kPermTensor),
                                     context->getOutputBuffer<uint8_t>(kOutputTensor),
-                                    context->getOutputShape(kOutputTensor));
+                                    context->getThreadPool());
         default:
             NN_RET_CHECK_FAIL() << "Unsupported tensor type for operation " << kOperationName;
     }
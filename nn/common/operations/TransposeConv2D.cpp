@@ -16,10 +16,14 @@
 
 #include "CpuOperationUtils.h"
 #include "OperationResolver.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <vector>
 
+#include "Eigen/Core"
 #include "Tracing.h"
 #include "tensorflow/lite/kernels/internal/common.h"
 
@@ -38,14 +42,6 @@ constexpr uint32_t kOutputTensor = 0;
 
 namespace {
 
-// If possible we will use this static buffer for the tensor.
-constexpr size_t kStaticBufferSize = 1605632;
-char static_scratch_buffer[kStaticBufferSize];
-
-// executionMutex is used to protect concurrent access of the static_scratch_buffer.
-// std::mutex is safe for pthreads on Android.
-std::mutex executionMutex;
-
 struct TransposeConv2dParam {
     int32_t paddingLeft, paddingRight;
     int32_t paddingTop, paddingBottom;
@@ -97,98 +93,179 @@ struct TransposeConv2dParam {
     }
 };
 
-#define ANDROID_NN_TRANSPOSE_CONV_PARAMETERS                                    \
-    uint32_t numBatches = getSizeOfDimension(inputShape, 0);                    \
-    uint32_t inputHeight = getSizeOfDimension(inputShape, 1);                   \
-    uint32_t inputWidth = getSizeOfDimension(inputShape, 2);                    \
-    uint32_t inputDepth = getSizeOfDimension(inputShape, 3);                    \
-    uint32_t filterHeight = getSizeOfDimension(filterShape, 1);                 \
-    uint32_t filterWidth = getSizeOfDimension(filterShape, 2);                  \
-    uint32_t outputHeight = getSizeOfDimension(outputShape, 1);                 \
-    uint32_t outputWidth = getSizeOfDimension(outputShape, 2);                  \
-    uint32_t outputDepth = getSizeOfDimension(outputShape, 3);                  \
-    int32_t paddingLeft = param.paddingLeft, paddingRight = param.paddingRight; \
-    int32_t paddingTop = param.paddingTop, paddingBottom = param.paddingBottom; \
-    int32_t strideWidth = param.strideWidth, strideHeight = param.strideHeight; \
-    int32_t activation = param.activation;
+// The number of elements of the GEMM result that a task computes at a time.
+constexpr uint32_t kMaxColumnsSize = 64 * 1024;
+
+// Computes TRANSPOSE_CONV_2D on NHWC tensors as a GEMM followed by col2im.
+//
+// The filter [outputDepth, filterHeight, filterWidth, inputDepth] is a matrix
+// with a row per output channel and filter tap.  For a band of input rows,
+// gemm(input, numPixels, filterRows, numRows, columns) multiplies the input
+// pixels by the transposed filter rows, which gives the contribution of every
+// input pixel to every tap of every output channel:
+//     columns[pixel * numRows + row] = sum(input[pixel][d] * filterRows[row][d])
+// with the zero points of quantized operands applied.  col2im then adds each
+// contribution to the output position under the tap.  Output channels are
+// split among the threads of the pool, and each thread accumulates its own
+// channels, so the results do not depend on the number of threads.
+// finish(channel, value) converts an accumulated value plus bias to the output.
+template <typename T_Input, typename T_Filter, typename Acc, typename Gemm, typename Finish>
+bool transposeConvGemm(const T_Input* inputData, const Shape& inputShape,
+                       const T_Filter* filterData, const Shape& filterShape,
+                       const TransposeConv2dParam& param, T_Input* outputData,
+                       const Shape& outputShape, ThreadPool* threadPool, Gemm gemm,
+                       Finish finish) {
+    const uint32_t numBatches = getSizeOfDimension(inputShape, 0);
+    const uint32_t inputHeight = getSizeOfDimension(inputShape, 1);
+    const uint32_t inputWidth = getSizeOfDimension(inputShape, 2);
+    const uint32_t inputDepth = getSizeOfDimension(inputShape, 3);
+    const int32_t filterHeight = getSizeOfDimension(filterShape, 1);
+    const int32_t filterWidth = getSizeOfDimension(filterShape, 2);
+    const int32_t outputHeight = getSizeOfDimension(outputShape, 1);
+    const int32_t outputWidth = getSizeOfDimension(outputShape, 2);
+    const uint32_t outputDepth = getSizeOfDimension(outputShape, 3);
+    const uint32_t numTaps = filterHeight * filterWidth;
+    const uint32_t outputPlaneSize = outputHeight * outputWidth;
+
+    parallelFor(threadPool, 0, outputDepth, 4, [&](uint32_t channelBegin, uint32_t channelEnd) {
+        const uint32_t numChannels = channelEnd - channelBegin;
+        const uint32_t numRows = numChannels * numTaps;
+        const uint32_t bandHeight =
+                std::max(1u, std::min(inputHeight, kMaxColumnsSize / (inputWidth * numRows)));
+        std::vector<Acc> columns(bandHeight * inputWidth * numRows);
+        std::vector<Acc> accumulator(outputPlaneSize * numChannels);
+        const T_Filter* filterRows = filterData + channelBegin * numTaps * inputDepth;
+        for (uint32_t b = 0; b < numBatches; b++) {
+            std::fill(accumulator.begin(), accumulator.end(), static_cast<Acc>(0));
+            for (uint32_t bandBegin = 0; bandBegin < inputHeight; bandBegin += bandHeight) {
+                const uint32_t bandEnd = std::min(inputHeight, bandBegin + bandHeight);
+                const T_Input* input =
+                        inputData + ((b * inputHeight + bandBegin) * inputWidth) * inputDepth;
+                gemm(input, (bandEnd - bandBegin) * inputWidth, filterRows, numRows,
+                     columns.data());
+
+                // col2im: the taps of output channel c are numTaps apart.
+                for (uint32_t h = bandBegin; h < bandEnd; h++) {
+                    const int32_t hOutputOrigin =
+                            static_cast<int32_t>(h) * param.strideHeight - param.paddingTop;
+                    const int32_t iBegin = std::max(0, -hOutputOrigin);
+                    const int32_t iEnd = std::min(filterHeight, outputHeight - hOutputOrigin);
+                    for (uint32_t w = 0; w < inputWidth; w++) {
+                        const int32_t wOutputOrigin =
+                                static_cast<int32_t>(w) * param.strideWidth - param.paddingLeft;
+                        const int32_t jBegin = std::max(0, -wOutputOrigin);
+                        const int32_t jEnd = std::min(filterWidth, outputWidth - wOutputOrigin);
+                        const Acc* pixelColumns =
+                                columns.data() + ((h - bandBegin) * inputWidth + w) * numRows;
+                        for (int32_t i = iBegin; i < iEnd; i++) {
+                            for (int32_t j = jBegin; j < jEnd; j++) {
+                                const Acc* tapColumns = pixelColumns + i * filterWidth + j;
+                                Acc* out = accumulator.data() +
+                                           ((hOutputOrigin + i) * outputWidth + wOutputOrigin + j) *
+                                                   numChannels;
+                                for (uint32_t c = 0; c < numChannels; c++) {
+                                    out[c] += tapColumns[c * numTaps];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            T_Input* output = outputData + b * outputPlaneSize * outputDepth + channelBegin;
+            for (uint32_t i = 0; i < outputPlaneSize; i++) {
+                for (uint32_t c = 0; c < numChannels; c++) {
+                    output[i * outputDepth + c] =
+                            finish(channelBegin + c, accumulator[i * numChannels + c]);
+                }
+            }
+        }
+    });
+    return true;
+}
 
 bool transposeConvNhwc(const float* inputData, const Shape& inputShape, const float* filterData,
                        const Shape& filterShape, const float* biasData, const Shape& biasShape,
                        const TransposeConv2dParam& param, float* outputData,
-                       const Shape& outputShape) {
+                       const Shape& outputShape, ThreadPool* threadPool) {
     NNTRACE_TRANS("transposeConvFloat32");
-    ANDROID_NN_TRANSPOSE_CONV_PARAMETERS
+    float outputActivationMin = 0.0f, outputActivationMax = 0.0f;
+    CalculateActivationRangeFloat(param.activation, &outputActivationMin, &outputActivationMax);
+    const uint32_t inputDepth = getSizeOfDimension(inputShape, 3);
+
+    using RowMajorMatrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    NNTRACE_COMP_SWITCH("transposeConvGemm");
+    return transposeConvGemm<float, float, float>(
+            inputData, inputShape, filterData, filterShape, param, outputData, outputShape,
+            threadPool,
+            [inputDepth](const float* input, uint32_t numPixels, const float* filterRows,
+                         uint32_t numRows, float* columns) {
+                Eigen::Map<const RowMajorMatrix> inputMatrix(input, numPixels, inputDepth);
+                Eigen::Map<const RowMajorMatrix> filterMatrix(filterRows, numRows, inputDepth);
+                Eigen::Map<RowMajorMatrix> columnsMatrix(columns, numPixels, numRows);
+                columnsMatrix.noalias() = inputMatrix * filterMatrix.transpose();
+            },
+            [&](uint32_t channel, float value) {
+                return std::max(std::min(value + biasData[channel], outputActivationMax),
+                                outputActivationMin);
+            });
+}
 
+bool transposeConvNhwc(const _Float16* inputData, const Shape& inputShape,
+                       const _Float16* filterData, const Shape& filterShape,
+                       const _Float16* biasData, const Shape& biasShape,
+                       const TransposeConv2dParam& param, _Float16* outputData,
+                       const Shape& outputShape, ThreadPool* threadPool) {
+    NNTRACE_TRANS("transposeConvFloat16");
     float outputActivationMin = 0.0f, outputActivationMax = 0.0f;
-    CalculateActivationRangeFloat(activation, &outputActivationMin, &outputActivationMax);
-
-    memset(outputData, 0, getNumberOfElements(outputShape) * sizeof(float));
-
-    const float* inputBase = inputData;
-    float* outputBase = outputData;
-    for (uint32_t b = 0; b < numBatches; b++) {
-        for (uint32_t h = 0; h < inputHeight; h++) {
-            for (uint32_t w = 0; w < inputWidth; w++) {
-                int32_t wOutputOrigin = static_cast<int32_t>(w) * strideWidth - paddingLeft;
-                int32_t hOutputOrigin = static_cast<int32_t>(h) * strideHeight - paddingTop;
-
-                const float* filterBase = filterData;
-                for (uint32_t k = 0; k < outputDepth; k++) {
-                    for (uint32_t i = 0; i < filterHeight; i++) {
-                        for (uint32_t j = 0; j < filterWidth; j++, filterBase += inputDepth) {
-                            int32_t hOutput = hOutputOrigin + static_cast<int32_t>(i);
-                            int32_t wOutput = wOutputOrigin + static_cast<int32_t>(j);
-                            if (hOutput >= 0 && hOutput < static_cast<int32_t>(outputHeight) &&
-                                wOutput >= 0 && wOutput < static_cast<int32_t>(outputWidth)) {
-                                for (uint32_t d = 0; d < inputDepth; d++) {
-                                    uint32_t outputIndex = hOutput * outputWidth * outputDepth +
-                                                           wOutput * outputDepth + k;
-                                    outputBase[outputIndex] += inputBase[d] * filterBase[d];
-                                }
-                            }
-                        }
+    CalculateActivationRangeFloat(param.activation, &outputActivationMin, &outputActivationMax);
+    const uint32_t inputDepth = getSizeOfDimension(inputShape, 3);
+
+    NNTRACE_COMP_SWITCH("transposeConvGemm");
+    return transposeConvGemm<_Float16, _Float16, float>(
+            inputData, inputShape, filterData, filterShape, param, outputData, outputShape,
+            threadPool,
+            [inputDepth](const _Float16* input, uint32_t numPixels, const _Float16* filterRows,
+                         uint32_t numRows, float* columns) {
+                for (uint32_t p = 0; p < numPixels; p++) {
+                    for (uint32_t r = 0; r < numRows; r++) {
+                        columns[p * numRows + r] = dotProductFloat16(
+                                input + p * inputDepth, filterRows + r * inputDepth, inputDepth);
                     }
                 }
+            },
+            [&](uint32_t channel, float value) {
+                return clampToFloat16(value + static_cast<float>(biasData[channel]),
+                                      outputActivationMin, outputActivationMax);
+            });
+}
 
-                inputBase += inputDepth;
+// Multiplies quantized input pixels by quantized filter rows, with the zero
+// points applied, for transposeConvGemm.
+template <typename T_Filter>
+void gemmQuant8(const uint8_t* input, uint32_t numPixels, int32_t inputOffset,
+                const T_Filter* filterRows, uint32_t numRows, int32_t filterOffset,
+                uint32_t depth, int32_t* columns) {
+    for (uint32_t p = 0; p < numPixels; p++) {
+        const uint8_t* pixel = input + p * depth;
+        for (uint32_t r = 0; r < numRows; r++) {
+            const T_Filter* filterRow = filterRows + r * depth;
+            int32_t sum = 0;
+            for (uint32_t d = 0; d < depth; d++) {
+                sum += (static_cast<int32_t>(pixel[d]) + inputOffset) *
+                       (static_cast<int32_t>(filterRow[d]) + filterOffset);
             }
+            columns[p * numRows + r] = sum;
         }
-        outputBase += outputHeight * outputWidth * outputDepth;
     }
-
-    const uint32_t outerSize = numBatches * outputHeight * outputWidth;
-    float* outPtr = outputData;
-    for (uint32_t i = 0; i < outerSize; i++) {
-        for (uint32_t d = 0; d < outputDepth; d++, outPtr++) {
-            *outPtr += biasData[d];
-            *outPtr = std::max(std::min(*outPtr, outputActivationMax), outputActivationMin);
-        }
-    }
-
-    return true;
 }
 
 bool transposeConvNhwc(const uint8_t* inputData, const Shape& inputShape, const uint8_t* filterData,
                        const Shape& filterShape, const int32_t* biasData, const Shape& biasShape,
                        const TransposeConv2dParam& param, uint8_t* outputData,
-                       const Shape& outputShape) {
+                       const Shape& outputShape, ThreadPool* threadPool) {
     NNTRACE_TRANS("transposeConvQuant8");
-    ANDROID_NN_TRANSPOSE_CONV_PARAMETERS
-
-    int32_t* tempBuffer = nullptr;
-    std::unique_ptr<int32_t[]> bufferGuard;
-    uint32_t tempBufferByteSize = getNumberOfElements(outputShape) * sizeof(int32_t);
-    if (tempBufferByteSize <= kStaticBufferSize) {
-        tempBuffer = reinterpret_cast<int32_t*>(static_scratch_buffer);
-    } else {
-        tempBuffer = new (std::nothrow) int32_t[tempBufferByteSize / sizeof(int32_t)];
-        if (tempBuffer == nullptr) {
-            LOG(ERROR) << "ConvTranspose size is too large, not enough memory";
-            return false;
-        }
-        bufferGuard.reset(tempBuffer);
-    }
-
+    const uint32_t inputDepth = getSizeOfDimension(inputShape, 3);
     int32_t inputOffset = -inputShape.offset;
     int32_t filterOffset = -filterShape.offset;
     int32_t outputOffset = outputShape.offset;
@@ -203,101 +280,40 @@ bool transposeConvNhwc(const uint8_t* inputData, const Shape& inputShape, const
     outputShift = -exponent;
 
     int32_t outputActivationMin = 0, outputActivationMax = 0;
-    CalculateActivationRangeUint8(activation, outputShape, &outputActivationMin,
+    CalculateActivationRangeUint8(param.activation, outputShape, &outputActivationMin,
                                   &outputActivationMax);
 
-    // Prevent concurrent executions that may access the scratch buffer
-    std::unique_lock<std::mutex> lock(executionMutex);
-    memset(tempBuffer, 0, tempBufferByteSize);
-
-    const uint8_t* inputPtr = inputData;
-    int32_t* outputBase = tempBuffer;
-    for (uint32_t b = 0; b < numBatches; b++) {
-        for (uint32_t h = 0; h < inputHeight; h++) {
-            for (uint32_t w = 0; w < inputWidth; w++) {
-                for (uint32_t d = 0; d < inputDepth; d++) {
-                    int32_t wOutputOrigin = static_cast<int32_t>(w) * strideWidth - paddingLeft;
-                    int32_t hOutputOrigin = static_cast<int32_t>(h) * strideHeight - paddingTop;
-
-                    for (uint32_t i = 0; i < filterHeight; i++) {
-                        for (uint32_t j = 0; j < filterWidth; j++) {
-                            for (uint32_t k = 0; k < outputDepth; k++) {
-                                int32_t hOutput = hOutputOrigin + static_cast<int32_t>(i);
-                                int32_t wOutput = wOutputOrigin + static_cast<int32_t>(j);
-                                if (hOutput >= 0 && hOutput < static_cast<int32_t>(outputHeight) &&
-                                    wOutput >= 0 && wOutput < static_cast<int32_t>(outputWidth)) {
-                                    uint32_t filterIndex =
-                                            k * filterHeight * filterWidth * inputDepth +
-                                            i * filterWidth * inputDepth + j * inputDepth + d;
-                                    uint32_t outputIndex = hOutput * outputWidth * outputDepth +
-                                                           wOutput * outputDepth + k;
-                                    outputBase[outputIndex] +=
-                                            (static_cast<int32_t>(*inputPtr) + inputOffset) *
-                                            (static_cast<int32_t>(filterData[filterIndex]) +
-                                             filterOffset);
-                                }
-                            }
-                        }
-                    }
-
-                    inputPtr++;
-                }
-            }
-        }
-        outputBase += outputHeight * outputWidth * outputDepth;
-    }
-
-    const uint32_t outerSize = numBatches * outputHeight * outputWidth;
-    int32_t* bufferPtr = tempBuffer;
-    uint8_t* outPtr = outputData;
-    for (uint32_t i = 0; i < outerSize; i++) {
-        for (uint32_t d = 0; d < outputDepth; d++, bufferPtr++, outPtr++) {
-            int32_t outVal = *bufferPtr + biasData[d];
-            outVal = tflite::MultiplyByQuantizedMultiplier(outVal, outputMultiplier, -outputShift);
-            outVal += outputOffset;
-            outVal = std::max(std::min(outVal, outputActivationMax), outputActivationMin);
-            *outPtr = static_cast<uint8_t>(outVal);
-        }
-    }
-
-    return true;
-}
-
-bool transposeConvNhwc(const _Float16* inputData, const Shape& inputShape,
-                       const _Float16* filterData, const Shape& filterShape,
-                       const _Float16* biasData, const Shape& biasShape,
-                       const TransposeConv2dParam& param, _Float16* outputData,
-                       const Shape& outputShape) {
-    NNTRACE_TRANS("transposeConvFloat16");
-    std::vector<float> inputData_float32(getNumberOfElements(inputShape));
-    std::vector<float> filterData_float32(getNumberOfElements(filterShape));
-    std::vector<float> biasData_float32(getNumberOfElements(biasShape));
-    std::vector<float> outputData_float32(getNumberOfElements(outputShape));
-
-    convertFloat16ToFloat32(inputData, &inputData_float32);
-    convertFloat16ToFloat32(filterData, &filterData_float32);
-    convertFloat16ToFloat32(biasData, &biasData_float32);
-
-    transposeConvNhwc(inputData_float32.data(), inputShape, filterData_float32.data(), filterShape,
-                      biasData_float32.data(), biasShape, param, outputData_float32.data(),
-                      outputShape);
-    convertFloat32ToFloat16(outputData_float32, outputData);
-
-    return true;
+    NNTRACE_COMP_SWITCH("transposeConvGemm");
+    return transposeConvGemm<uint8_t, uint8_t, int32_t>(
+            inputData, inputShape, filterData, filterShape, param, outputData, outputShape,
+            threadPool,
+            [&](const uint8_t* input, uint32_t numPixels, const uint8_t* filterRows,
+                uint32_t numRows, int32_t* columns) {
+                gemmQuant8(input, numPixels, inputOffset, filterRows, numRows, filterOffset,
+                           inputDepth, columns);
+            },
+            [&](uint32_t channel, int32_t value) {
+                int32_t outVal = value + biasData[channel];
+                outVal = tflite::MultiplyByQuantizedMultiplier(outVal, outputMultiplier,
+                                                               -outputShift);
+                outVal += outputOffset;
+                outVal = std::max(std::min(outVal, outputActivationMax), outputActivationMin);
+                return static_cast<uint8_t>(outVal);
+            });
 }
 
 template <typename T_Input, typename T_Filter, typename T_Bias>
 bool transposeConv(const T_Input* inputData, const Shape& inputShape, const T_Filter* filterData,
                    const Shape& filterShape, const T_Bias* biasData, const Shape& biasShape,
                    const TransposeConv2dParam& param, T_Input* outputData,
-                   const Shape& outputShape) {
+                   const Shape& outputShape, ThreadPool* threadPool) {
     InputWithLayout<T_Input> input(param.useNchw);
     OutputWithLayout<T_Input> output(param.useNchw);
     NN_RET_CHECK(input.initialize(inputData, inputShape));
     NN_RET_CHECK(output.initialize(outputData, outputShape));
     NN_RET_CHECK(transposeConvNhwc(input.getNhwcBuffer(), input.getNhwcShape(), filterData,
                                    filterShape, biasData, biasShape, param, output.getNhwcBuffer(),
-                                   output.getNhwcShape()));
+                                   output.getNhwcShape(), threadPool));
     NN_RET_CHECK(output.commit());
     return true;
 }
@@ -306,24 +322,11 @@ bool transposeConvQuant8PerChannelNhwc(const uint8_t* inputData, const Shape& in
                                        const int8_t* filterData, const Shape& filterShape,
                                        const float* filterScales, const int32_t* biasData,
                                        const Shape& biasShape, const TransposeConv2dParam& param,
-                                       uint8_t* outputData, const Shape& outputShape) {
+                                       uint8_t* outputData, const Shape& outputShape,
+                                       ThreadPool* threadPool) {
     NNTRACE_TRANS("transposeConvQuant8PerChannel");
-    ANDROID_NN_TRANSPOSE_CONV_PARAMETERS
-
-    int32_t* tempBuffer = nullptr;
-    std::unique_ptr<int32_t[]> bufferGuard;
-    uint32_t tempBufferByteSize = getNumberOfElements(outputShape) * sizeof(int32_t);
-    if (tempBufferByteSize <= kStaticBufferSize) {
-        tempBuffer = reinterpret_cast<int32_t*>(static_scratch_buffer);
-    } else {
-        tempBuffer = new (std::nothrow) int32_t[tempBufferByteSize / sizeof(int32_t)];
-        if (tempBuffer == nullptr) {
-            LOG(ERROR) << "ConvTranspose size is too large, not enough memory";
-            return false;
-        }
-        bufferGuard.reset(tempBuffer);
-    }
-
+    const uint32_t inputDepth = getSizeOfDimension(inputShape, 3);
+    const uint32_t outputDepth = getSizeOfDimension(outputShape, 3);
     int32_t inputOffset = -inputShape.offset;
     int32_t outputOffset = outputShape.offset;
 
@@ -344,84 +347,46 @@ bool transposeConvQuant8PerChannelNhwc(const uint8_t* inputData, const Shape& in
     }
 
     int32_t outputActivationMin = 0, outputActivationMax = 0;
-    CalculateActivationRangeUint8(activation, outputShape, &outputActivationMin,
+    CalculateActivationRangeUint8(param.activation, outputShape, &outputActivationMin,
                                   &outputActivationMax);
 
-    // Prevent concurrent executions that may access the scratch buffer
-    std::unique_lock<std::mutex> lock(executionMutex);
-    memset(tempBuffer, 0, tempBufferByteSize);
-
-    const uint8_t* inputPtr = inputData;
-    int32_t* outputBase = tempBuffer;
-    for (uint32_t b = 0; b < numBatches; b++) {
-        for (uint32_t h = 0; h < inputHeight; h++) {
-            for (uint32_t w = 0; w < inputWidth; w++) {
-                for (uint32_t d = 0; d < inputDepth; d++) {
-                    int32_t wOutputOrigin = static_cast<int32_t>(w) * strideWidth - paddingLeft;
-                    int32_t hOutputOrigin = static_cast<int32_t>(h) * strideHeight - paddingTop;
-
-                    for (uint32_t i = 0; i < filterHeight; i++) {
-                        for (uint32_t j = 0; j < filterWidth; j++) {
-                            for (uint32_t k = 0; k < outputDepth; k++) {
-                                int32_t hOutput = hOutputOrigin + static_cast<int32_t>(i);
-                                int32_t wOutput = wOutputOrigin + static_cast<int32_t>(j);
-                                if (hOutput >= 0 && hOutput < static_cast<int32_t>(outputHeight) &&
-                                    wOutput >= 0 && wOutput < static_cast<int32_t>(outputWidth)) {
-                                    uint32_t filterIndex =
-                                            k * filterHeight * filterWidth * inputDepth +
-                                            i * filterWidth * inputDepth + j * inputDepth + d;
-                                    uint32_t outputIndex = hOutput * outputWidth * outputDepth +
-                                                           wOutput * outputDepth + k;
-                                    outputBase[outputIndex] +=
-                                            (static_cast<int32_t>(*inputPtr) + inputOffset) *
-                                            static_cast<int32_t>(filterData[filterIndex]);
-                                }
-                            }
-                        }
-                    }
-
-                    inputPtr++;
-                }
-            }
-        }
-        outputBase += outputHeight * outputWidth * outputDepth;
-    }
-
-    const uint32_t outerSize = numBatches * outputHeight * outputWidth;
-    int32_t* bufferPtr = tempBuffer;
-    uint8_t* outPtr = outputData;
-    for (uint32_t i = 0; i < outerSize; i++) {
-        for (uint32_t d = 0; d < outputDepth; d++, bufferPtr++, outPtr++) {
-            int32_t outVal = *bufferPtr + biasData[d];
-            outVal = tflite::MultiplyByQuantizedMultiplier(outVal, outputMultiplier[d],
-                                                           -outputShift[d]);
-            outVal += outputOffset;
-            outVal = std::max(std::min(outVal, outputActivationMax), outputActivationMin);
-            *outPtr = static_cast<uint8_t>(outVal);
-        }
-    }
-
-    return true;
+    NNTRACE_COMP_SWITCH("transposeConvGemm");
+    return transposeConvGemm<uint8_t, int8_t, int32_t>(
+            inputData, inputShape, filterData, filterShape, param, outputData, outputShape,
+            threadPool,
+            [&](const uint8_t* input, uint32_t numPixels, const int8_t* filterRows,
+                uint32_t numRows, int32_t* columns) {
+                gemmQuant8(input, numPixels, inputOffset, filterRows, numRows, 0, inputDepth,
+                           columns);
+            },
+            [&](uint32_t channel, int32_t value) {
+                int32_t outVal = value + biasData[channel];
+                outVal = tflite::MultiplyByQuantizedMultiplier(outVal, outputMultiplier[channel],
+                                                               -outputShift[channel]);
+                outVal += outputOffset;
+                outVal = std::max(std::min(outVal, outputActivationMax), outputActivationMin);
+                return static_cast<uint8_t>(outVal);
+            });
 }
 
 bool transposeConvQuant8PerChannel(const uint8_t* inputData, const Shape& inputShape,
                                    const int8_t* filterData, const Shape& filterShape,
                                    const float* filterScales, const int32_t* biasData,
                                    const Shape& biasShape, const TransposeConv2dParam& param,
-                                   uint8_t* outputData, const Shape& outputShape) {
+                                   uint8_t* outputData, const Shape& outputShape,
+                                   ThreadPool* threadPool) {
     InputWithLayout<uint8_t> input(param.useNchw);
     OutputWithLayout<uint8_t> output(param.useNchw);
     NN_RET_CHECK(input.initialize(inputData, inputShape));
     NN_RET_CHECK(output.initialize(outputData, outputShape));
     NN_RET_CHECK(transposeConvQuant8PerChannelNhwc(
             input.getNhwcBuffer(), input.getNhwcShape(), filterData, filterShape, filterScales,
-            biasData, biasShape, param, output.getNhwcBuffer(), output.getNhwcShape()));
+            biasData, biasShape, param, output.getNhwcBuffer(), output.getNhwcShape(),
+            threadPool));
     NN_RET_CHECK(output.commit());
     return true;
 }
 
-#undef ANDROID_NN_TRANSPOSE_CONV_PARAMETERS
-
 }  // namespace
 
 bool validate(const IOperationValidationContext* context) {
@@ -532,7 +497,8 @@ bool execute(IOperationExecutionContext* context) {
                                  context->getInputBuffer<float>(kBiasTensor),
                                  context->getInputShape(kBiasTensor), param,
                                  context->getOutputBuffer<float>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getOutputShape(kOutputTensor),
+                                 context->getThreadPool());
         case OperandType::TENSOR_FLOAT16:
             return transposeConv(context->getInputBuffer<_Float16>(kInputTensor),
                                  context->getInputShape(kInputTensor),
@@ -541,7 +507,8 @@ bool execute(IOperationExecutionContext* context) {
                                  context->getInputBuffer<_Float16>(kBiasTensor),
                                  context->getInputShape(kBiasTensor), param,
                                  context->getOutputBuffer<_Float16>(kOutputTensor),
-                                 context->getOutputShape(kOutputTensor));
+                                 context->getOutputShape(kOutputTensor),
+                                 context->getThreadPool());
         case OperandType::TENSOR_QUANT8_ASYMM:
             if (context->getInputType(kFilterTensor) ==
                 OperandType::TENSOR_QUANT8_SYMM_PER_CHANNEL) {
@@ -554,7 +521,7 @@ bool execute(IOperationExecutionContext* context) {
                         context->getInputBuffer<int32_t>(kBiasTensor),
                         context->getInputShape(kBiasTensor), param,
                         context->getOutputBuffer<uint8_t>(kOutputTensor),
-                        context->getOutputShape(kOutputTensor));
+                        context->getOutputShape(kOutputTensor), context->getThreadPool());
             } else if (context->getInputType(kFilterTensor) == OperandType::TENSOR_QUANT8_ASYMM) {
                 return transposeConv(context->getInputBuffer<uint8_t>(kInputTensor),
                                      context->getInputShape(kInputTensor),
@@ -563,7 +530,8 @@ bool execute(IOperationExecutionContext* context) {
                                      context->getInputBuffer<int32_t>(kBiasTensor),
                                      context->getInputShape(kBiasTensor), param,
                                      context->getOutputBuffer<uint8_t>(kOutputTensor),
-                                     context->getOutputShape(kOutputTensor));
+                                     context->getOutputShape(kOutputTensor),
+                                     context->getThreadPool());
             } else {
                 NN_RET_CHECK_FAIL() << "Unsupported filter type for operation " << kOperationName;
             }
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "VectorMath.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace vector_math {
+namespace {
+
+// Every float32 bit pattern in steps of this is tested.
+constexpr uint32_t kFloat32Step = 4093;
+
+// Returns the error of a float32 result in units in the last place of the
+// reference, which is computed in double precision.
+double getUlpError(float result, double reference) {
+    if (std::isnan(reference)) {
+        return std::isnan(result) ? 0 : HUGE_VAL;
+    }
+    if (std::isinf(static_cast<float>(reference))) {
+        return result == static_cast<float>(reference) ? 0 : HUGE_VAL;
+    }
+    int exponent;
+    std::frexp(reference, &exponent);
+    // Subnormal results have the ulp of the smallest normal number.
+    const double ulp = std::ldexp(1.0, std::max(exponent - 24, -149));
+    return std::abs(result - reference) / ulp;
+}
+
+// Same as getUlpError for float16 results.
+double getUlpErrorFloat16(_Float16 result, double reference) {
+    if (std::isnan(reference)) {
+        return std::isnan(static_cast<float>(result)) ? 0 : HUGE_VAL;
+    }
+    if (std::isinf(static_cast<float>(static_cast<_Float16>(reference)))) {
+        return static_cast<float>(result) == static_cast<float>(static_cast<_Float16>(reference))
+                       ? 0
+                       : HUGE_VAL;
+    }
+    int exponent;
+    std::frexp(reference, &exponent);
+    const double ulp = std::ldexp(1.0, std::max(exponent - 11, -24));
+    return std::abs(static_cast<double>(result) - reference) / ulp;
+}
+
+template <typename Function, typename Reference>
+void testAccuracy(Function function, Reference reference, double maxUlpError,
+                  float maxArgument = HUGE_VALF) {
+    double maxError = 0;
+    float worstInput = 0;
+    for (uint64_t bits = 0; bits <= UINT32_MAX; bits += kFloat32Step) {
+        const float x = fromBits(static_cast<uint32_t>(bits));
+        if (std::abs(x) > maxArgument) {
+            continue;
+        }
+        const double error = getUlpError(function(x), reference(static_cast<double>(x)));
+        if (error > maxError) {
+            maxError = error;
+            worstInput = x;
+        }
+    }
+    EXPECT_LE(maxError, maxUlpError) << "at " << worstInput;
+
+    // Float16 results go through map, like in the operations.
+    std::vector<_Float16> input(1 << 16), output(1 << 16);
+    for (uint32_t bits = 0; bits < input.size(); ++bits) {
+        memcpy(&input[bits], &bits, sizeof(_Float16));
+    }
+    map(input.data(), output.data(), input.size(), function);
+    for (uint32_t i = 0; i < input.size(); ++i) {
+        const float x = static_cast<float>(input[i]);
+        EXPECT_LE(getUlpErrorFloat16(output[i], reference(static_cast<double>(x))), 1.0)
+                << "at " << x;
+    }
+}
+
+TEST(VectorMathTest, Exp) {
+    testAccuracy([](float x) { return exp(x); }, [](double x) { return std::exp(x); }, 1.1);
+}
+
+TEST(VectorMathTest, Log) {
+    testAccuracy([](float x) { return log(x); }, [](double x) { return std::log(x); }, 2.0);
+}
+
+TEST(VectorMathTest, Sin) {
+    testAccuracy([](float x) { return sin(x); }, [](double x) { return std::sin(x); }, 2.4,
+                 kSinMaxArgument);
+}
+
+TEST(VectorMathTest, SinLargeArguments) {
+    const std::vector<float> input = {1.f, 1e4f, -3e5f, 1e30f, HUGE_VALF, NAN};
+    std::vector<float> output(input.size());
+    mapSin(input.data(), output.data(), input.size());
+    for (uint32_t i = 0; i < input.size(); ++i) {
+        EXPECT_LE(getUlpError(output[i], std::sin(static_cast<double>(input[i]))), 1.0)
+                << "at " << input[i];
+    }
+}
+
+TEST(VectorMathTest, Tanh) {
+    testAccuracy([](float x) { return tanh(x); }, [](double x) { return std::tanh(x); }, 2.5);
+}
+
+TEST(VectorMathTest, Logistic) {
+    testAccuracy([](float x) { return logistic(x); },
+                 [](double x) { return 1 / (1 + std::exp(-x)); }, 2.5);
+}
+
+}  // namespace
+}  // namespace vector_math
+}  // namespace nn
+}  // namespace android
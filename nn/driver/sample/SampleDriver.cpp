@@ -46,6 +46,9 @@ auto microsecondsDuration(decltype(now()) end, decltype(now()) start) {
     return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 };
 
+// The number of threads serving HIDL calls.
+constexpr size_t kNumRpcThreads = 4;
+
 }  // namespace
 
 static const Timing kNoTiming = {.timeOnDevice = UINT64_MAX, .timeInDriver = UINT64_MAX};
@@ -197,7 +200,7 @@ Return<DeviceStatus> SampleDriver::getStatus() {
 }
 
 int SampleDriver::run() {
-    android::hardware::configureRpcThreadpool(4, true);
+    android::hardware::configureRpcThreadpool(kNumRpcThreads, true);
     if (registerAsService(mName) != android::OK) {
         LOG(ERROR) << "Could not register service";
         return 1;
@@ -207,8 +210,48 @@ int SampleDriver::run() {
     return 1;
 }
 
+void SampleDriver::initThreadPool() {
+    // The number of threads that an operation splits its computation across,
+    // and whether independent operations also run at the same time on those
+    // threads, can be overridden for debugging or benchmarking.  With a single
+    // thread, everything runs on the thread of the execution.
+    uint32_t numThreads = ThreadPool::getDefaultNumThreads();
+#ifdef NN_DEBUGGABLE
+    numThreads = getProp("debug.nn.sample.cpu-threads", numThreads);
+    mParallelOperations = getProp("debug.nn.sample.parallel-operations") != 0;
+#endif  // NN_DEBUGGABLE
+    if (numThreads > 1) {
+        VLOG(DRIVER) << mName << " runs operations on " << numThreads << " threads"
+                     << (mParallelOperations ? ", independent operations in parallel" : "");
+        mThreadPool = std::make_unique<ThreadPool>(numThreads);
+    }
+}
+
+std::unique_ptr<CpuExecutor> SampleExecutorPool::acquire() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mIdleExecutors.empty()) {
+        return std::make_unique<CpuExecutor>(mDriver->getOperationResolver());
+    }
+    std::unique_ptr<CpuExecutor> executor = std::move(mIdleExecutors.back());
+    mIdleExecutors.pop_back();
+    return executor;
+}
+
+void SampleExecutorPool::release(std::unique_ptr<CpuExecutor> executor) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mIdleExecutors.size() < kNumRpcThreads) {
+        mIdleExecutors.push_back(std::move(executor));
+    }
+}
+
 bool SamplePreparedModel::initialize() {
-    return setRunTimePoolInfosFromHidlMemories(&mPoolInfos, mModel.pools);
+    if (!setRunTimePoolInfosFromHidlMemories(&mPoolInfos, mModel.pools)) {
+        return false;
+    }
+    mCpuPreparedModel = CpuPreparedModel::create(
+            mModel, mPoolInfos, mDriver->getOperationResolver(), mDriver->getThreadPool(),
+            /*allowFusion=*/true, mDriver->getParallelOperations());
+    return true;
 }
 
 static Return<void> notify(const sp<V1_0::IExecutionCallback>& callback, const ErrorStatus& status,
@@ -225,8 +268,7 @@ static Return<void> notify(const sp<V1_2::IExecutionCallback>& callback, const E
 //                is supported in CpuExecutor.
 template <typename T_IExecutionCallback>
 void asyncExecute(const Request& request, MeasureTiming measure, time_point driverStart,
-                  const Model& model, const SampleDriver& driver,
-                  const std::vector<RunTimePoolInfo>& poolInfos,
+                  const CpuPreparedModel& preparedModel, SampleExecutorPool* executorPool,
                   const sp<T_IExecutionCallback>& callback) {
     NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_INPUTS_AND_OUTPUTS,
                  "SampleDriver::asyncExecute");
@@ -238,14 +280,15 @@ void asyncExecute(const Request& request, MeasureTiming measure, time_point driv
 
     NNTRACE_FULL_SWITCH(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_EXECUTION,
                         "SampleDriver::asyncExecute");
-    CpuExecutor executor = driver.getExecutor();
+    std::unique_ptr<CpuExecutor> executor = executorPool->acquire();
     time_point driverEnd, deviceStart, deviceEnd;
     if (measure == MeasureTiming::YES) deviceStart = now();
-    int n = executor.run(model, request, poolInfos, requestPoolInfos);
+    int n = executor->run(preparedModel, request, requestPoolInfos);
     if (measure == MeasureTiming::YES) deviceEnd = now();
     VLOG(DRIVER) << "executor.run returned " << n;
     ErrorStatus executionStatus = convertResultCodeToErrorStatus(n);
-    hidl_vec<OutputShape> outputShapes = executor.getOutputShapes();
+    hidl_vec<OutputShape> outputShapes = executor->getOutputShapes();
+    executorPool->release(std::move(executor));
     Return<void> returned;
     if (measure == MeasureTiming::YES && executionStatus == ErrorStatus::NONE) {
         driverEnd = now();
@@ -262,9 +305,9 @@ void asyncExecute(const Request& request, MeasureTiming measure, time_point driv
 }
 
 template <typename T_IExecutionCallback>
-Return<ErrorStatus> executeBase(const Request& request, MeasureTiming measure, const Model& model,
-                                const SampleDriver& driver,
-                                const std::vector<RunTimePoolInfo>& poolInfos,
+Return<ErrorStatus> executeBase(const Request& request, MeasureTiming measure,
+                                const CpuPreparedModel& preparedModel,
+                                SampleExecutorPool* executorPool,
                                 const sp<T_IExecutionCallback>& callback) {
     NNTRACE_FULL(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_EXECUTION, "SampleDriver::executeBase");
     VLOG(DRIVER) << "executeBase(" << SHOW_IF_DEBUG(toString(request)) << ")";
@@ -276,15 +319,15 @@ Return<ErrorStatus> executeBase(const Request& request, MeasureTiming measure, c
         LOG(ERROR) << "invalid callback passed to executeBase";
         return ErrorStatus::INVALID_ARGUMENT;
     }
-    if (!validateRequest(request, model)) {
+    if (!validateRequest(request, preparedModel.getModel())) {
         notify(callback, ErrorStatus::INVALID_ARGUMENT, {}, kNoTiming);
         return ErrorStatus::INVALID_ARGUMENT;
     }
 
     // This thread is intentionally detached because the sample driver service
     // is expected to live forever.
-    std::thread([&model, &driver, &poolInfos, request, measure, driverStart, callback] {
-        asyncExecute(request, measure, driverStart, model, driver, poolInfos, callback);
+    std::thread([&preparedModel, executorPool, request, measure, driverStart, callback] {
+        asyncExecute(request, measure, driverStart, preparedModel, executorPool, callback);
     })
             .detach();
 
@@ -293,12 +336,12 @@ Return<ErrorStatus> executeBase(const Request& request, MeasureTiming measure, c
 
 Return<ErrorStatus> SamplePreparedModel::execute(const Request& request,
                                                  const sp<V1_0::IExecutionCallback>& callback) {
-    return executeBase(request, MeasureTiming::NO, mModel, *mDriver, mPoolInfos, callback);
+    return executeBase(request, MeasureTiming::NO, *mCpuPreparedModel, &mExecutorPool, callback);
 }
 
 Return<ErrorStatus> SamplePreparedModel::execute_1_2(const Request& request, MeasureTiming measure,
                                                      const sp<V1_2::IExecutionCallback>& callback) {
-    return executeBase(request, measure, mModel, *mDriver, mPoolInfos, callback);
+    return executeBase(request, measure, *mCpuPreparedModel, &mExecutorPool, callback);
 }
 
 Return<void> SamplePreparedModel::executeSynchronously(const Request& request,
@@ -326,13 +369,14 @@ Return<void> SamplePreparedModel::executeSynchronously(const Request& request,
 
     NNTRACE_FULL_SWITCH(NNTRACE_LAYER_DRIVER, NNTRACE_PHASE_EXECUTION,
                         "SampleDriver::executeSynchronously");
-    CpuExecutor executor = mDriver->getExecutor();
+    std::unique_ptr<CpuExecutor> executor = mExecutorPool.acquire();
     if (measure == MeasureTiming::YES) deviceStart = now();
-    int n = executor.run(mModel, request, mPoolInfos, requestPoolInfos);
+    int n = executor->run(*mCpuPreparedModel, request, requestPoolInfos);
     if (measure == MeasureTiming::YES) deviceEnd = now();
     VLOG(DRIVER) << "executor.run returned " << n;
     ErrorStatus executionStatus = convertResultCodeToErrorStatus(n);
-    hidl_vec<OutputShape> outputShapes = executor.getOutputShapes();
+    hidl_vec<OutputShape> outputShapes = executor->getOutputShapes();
+    mExecutorPool.release(std::move(executor));
     if (measure == MeasureTiming::YES && executionStatus == ErrorStatus::NONE) {
         driverEnd = now();
         Timing timing = {.timeOnDevice = uint64_t(microsecondsDuration(deviceEnd, deviceStart)),
@@ -349,12 +393,13 @@ Return<void> SamplePreparedModel::executeSynchronously(const Request& request,
 // the mapping until either (1) the memory is freed in the runtime, or (2) the
 // burst object is destroyed. This allows for subsequent executions operating on
 // pools that have been used before to reuse the mapping instead of mapping and
-// unmapping the memory on each execution.
+// unmapping the memory on each execution.  The operations run as prepared by
+// the SamplePreparedModel, which the burst keeps alive.
 class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCache {
    public:
-    BurstExecutorWithCache(const Model& model, const SampleDriver* driver,
-                           const std::vector<RunTimePoolInfo>& poolInfos)
-        : mModel(model), mDriver(driver), mModelPoolInfos(poolInfos) {}
+    BurstExecutorWithCache(const sp<SamplePreparedModel>& preparedModel,
+                           const SampleDriver* driver)
+        : mPreparedModel(preparedModel), mExecutor(driver->getExecutor()) {}
 
     bool isCacheEntryPresent(int32_t slot) const override {
         const auto it = mMemoryCache.find(slot);
@@ -390,7 +435,7 @@ class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCa
         fullRequest.pools = std::move(pools);
 
         // validate request object against the model
-        if (!validateRequest(fullRequest, mModel)) {
+        if (!validateRequest(fullRequest, mPreparedModel->getModel())) {
             return {ErrorStatus::INVALID_ARGUMENT, {}, kNoTiming};
         }
 
@@ -401,13 +446,12 @@ class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCa
                        [this](int32_t slot) { return *mMemoryCache[slot]; });
 
         // execution
-        CpuExecutor executor = mDriver->getExecutor();
         if (measure == MeasureTiming::YES) deviceStart = now();
-        int n = executor.run(mModel, request, mModelPoolInfos, requestPoolInfos);
+        int n = mExecutor.run(mPreparedModel->getCpuPreparedModel(), request, requestPoolInfos);
         if (measure == MeasureTiming::YES) deviceEnd = now();
         VLOG(DRIVER) << "executor.run returned " << n;
         ErrorStatus executionStatus = convertResultCodeToErrorStatus(n);
-        hidl_vec<OutputShape> outputShapes = executor.getOutputShapes();
+        hidl_vec<OutputShape> outputShapes = mExecutor.getOutputShapes();
         if (measure == MeasureTiming::YES && executionStatus == ErrorStatus::NONE) {
             driverEnd = now();
             Timing timing = {
@@ -421,9 +465,10 @@ class BurstExecutorWithCache : public ExecutionBurstServer::IBurstExecutorWithCa
     }
 
    private:
-    const Model mModel;
-    const SampleDriver* const mDriver;
-    const std::vector<RunTimePoolInfo> mModelPoolInfos;
+    const sp<SamplePreparedModel> mPreparedModel;
+    // The burst server runs one execution at a time, so a single executor is
+    // reused for all of them.
+    CpuExecutor mExecutor;
     std::map<int32_t, std::optional<RunTimePoolInfo>> mMemoryCache;  // cached requestPoolInfos
 };
 
@@ -443,7 +488,7 @@ Return<void> SamplePreparedModel::configureExecutionBurst(
     // However, this alternative representation does not include a memory map
     // caching optimization, and adds overhead.
     const std::shared_ptr<BurstExecutorWithCache> executorWithCache =
-            std::make_shared<BurstExecutorWithCache>(mModel, mDriver, mPoolInfos);
+            std::make_shared<BurstExecutorWithCache>(this, mDriver);
     const sp<V1_2::IBurstContext> burst = ExecutionBurstServer::create(
             callback, requestChannel, resultChannel, executorWithCache);
 
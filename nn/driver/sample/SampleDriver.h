@@ -20,8 +20,13 @@
 #include "CpuExecutor.h"
 #include "HalInterfaces.h"
 #include "NeuralNetworks.h"
+#include "ThreadPool.h"
 
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace android {
 namespace nn {
@@ -41,6 +46,7 @@ class SampleDriver : public IDevice {
                  const IOperationResolver* operationResolver = BuiltinOperationResolver::get())
         : mName(name), mOperationResolver(operationResolver) {
         android::nn::initVLogMask();
+        initThreadPool();
     }
     ~SampleDriver() override {}
     Return<void> getCapabilities(getCapabilities_cb cb) override;
@@ -72,16 +78,47 @@ class SampleDriver : public IDevice {
     int run();
 
     CpuExecutor getExecutor() const { return CpuExecutor(mOperationResolver); }
+    const IOperationResolver* getOperationResolver() const { return mOperationResolver; }
+    // The pool running the operations of a model, or nullptr if they run on
+    // the thread of the execution only.
+    ThreadPool* getThreadPool() const { return mThreadPool.get(); }
+    // Whether independent operations run in parallel on the pool, rather than
+    // one after the other with each of them using the pool.  Off by default.
+    bool getParallelOperations() const { return mParallelOperations; }
 
    protected:
     std::string mName;
     const IOperationResolver* mOperationResolver;
+
+   private:
+    void initThreadPool();
+
+    std::unique_ptr<ThreadPool> mThreadPool;
+    bool mParallelOperations = false;
+};
+
+// The CpuExecutors used for the executions of a prepared model.  Executors
+// are reused from one execution to the next so that their memory is allocated
+// only once; executions that overlap get an executor each.  At most as many
+// idle executors as there are threads serving HIDL calls are kept; the others
+// are destroyed when released.
+class SampleExecutorPool {
+   public:
+    explicit SampleExecutorPool(const SampleDriver* driver) : mDriver(driver) {}
+
+    std::unique_ptr<CpuExecutor> acquire();
+    void release(std::unique_ptr<CpuExecutor> executor);
+
+   private:
+    const SampleDriver* const mDriver;
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<CpuExecutor>> mIdleExecutors;
 };
 
 class SamplePreparedModel : public IPreparedModel {
    public:
     SamplePreparedModel(const Model& model, const SampleDriver* driver)
-        : mModel(model), mDriver(driver) {}
+        : mModel(model), mDriver(driver), mExecutorPool(driver) {}
     ~SamplePreparedModel() override {}
     bool initialize();
     Return<ErrorStatus> execute(const Request& request,
@@ -96,10 +133,15 @@ class SamplePreparedModel : public IPreparedModel {
             const MQDescriptorSync<V1_2::FmqResultDatum>& resultChannel,
             configureExecutionBurst_cb cb) override;
 
+    const Model& getModel() const { return mModel; }
+    const CpuPreparedModel& getCpuPreparedModel() const { return *mCpuPreparedModel; }
+
    private:
     Model mModel;
     const SampleDriver* mDriver;
     std::vector<RunTimePoolInfo> mPoolInfos;
+    std::optional<CpuPreparedModel> mCpuPreparedModel;
+    SampleExecutorPool mExecutorPool;
 };
 
 }  // namespace sample_driver
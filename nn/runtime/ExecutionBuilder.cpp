@@ -693,7 +693,7 @@ bool StepExecutor::updateOutputShapes(const std::vector<OutputShape>& from,
 // Figures out how to place each of the input or outputs in a buffer. This just does the layout,
 // it does not copy data.  Aligns each input a bit.
 int StepExecutor::allocatePointerArgumentsToPool(std::vector<ModelArgumentInfo>* args,
-                                                 Memory* memory) {
+                                                 std::shared_ptr<Memory>* memory) {
     uint32_t nextPoolIndex = mMemories.size();
     int64_t total = 0;
     for (auto& info : *args) {
@@ -711,10 +711,14 @@ int StepExecutor::allocatePointerArgumentsToPool(std::vector<ModelArgumentInfo>*
                       "Size of all inputs or outputs exceeds 2^32.";
         return ANEURALNETWORKS_BAD_DATA;
     }
-    hidl_memory hidlMemory;
     if (total > 0) {
-        memory->create(total);  // TODO check error
-        mMemories.add(memory);
+        *memory = MemoryPool::get()->allocate(total);
+        if (*memory == nullptr) {
+            LOG(ERROR) << "StepExecutor::allocatePointerArgumentsToPool: failed to allocate "
+                       << total << " bytes";
+            return ANEURALNETWORKS_OUT_OF_MEMORY;
+        }
+        mMemories.add(memory->get());
     }
     return ANEURALNETWORKS_NO_ERROR;
 }
@@ -866,8 +870,8 @@ int StepExecutor::startComputeOnDevice(
     // We separate the input & output pools so that we reduce the copying done if we
     // do an eventual remoting (hidl_memory->update()).  We could also use it to set
     // protection on read only memory but that's not currently done.
-    Memory inputPointerArguments;
-    Memory outputPointerArguments;
+    std::shared_ptr<Memory> inputPointerArguments;
+    std::shared_ptr<Memory> outputPointerArguments;
 
     // Layout the input and output data
     int n = allocatePointerArgumentsToPool(&mInputs, &inputPointerArguments);
@@ -885,7 +889,7 @@ int StepExecutor::startComputeOnDevice(
         if (info.state == ModelArgumentInfo::POINTER) {
             DataLocation& loc = info.locationAndLength;
             uint8_t* data = nullptr;
-            int n = inputPointerArguments.getPointer(&data);
+            int n = inputPointerArguments->getPointer(&data);
             if (n != ANEURALNETWORKS_NO_ERROR) {
                 return n;
             }
@@ -1019,7 +1023,7 @@ int StepExecutor::startComputeOnDevice(
         if (info.state == ModelArgumentInfo::POINTER) {
             DataLocation& loc = info.locationAndLength;
             uint8_t* data = nullptr;
-            int n = outputPointerArguments.getPointer(&data);
+            int n = outputPointerArguments->getPointer(&data);
             if (n != ANEURALNETWORKS_NO_ERROR) {
                 return n;
             }
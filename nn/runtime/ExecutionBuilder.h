@@ -275,7 +275,10 @@ class StepExecutor {
     /// @}
 
    private:
-    int allocatePointerArgumentsToPool(std::vector<ModelArgumentInfo>* args, Memory* memory);
+    // Lays out the arguments specified by pointer in a Memory from the
+    // MemoryPool, which is left as nullptr if there are none.
+    int allocatePointerArgumentsToPool(std::vector<ModelArgumentInfo>* args,
+                                       std::shared_ptr<Memory>* memory);
     int startComputeOnDevice(sp<ExecutionCallback>* synchronizationCallback,
                              const std::shared_ptr<ExecutionBurstController>& burstController);
 
@@ -37,6 +37,7 @@
 #include <openssl/sha.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <algorithm>
 #include <functional>
 #include <map>
 #include <mutex>
@@ -604,10 +605,86 @@ int ExecutionPlan::CompoundBody::finish(const ModelBuilder* fromModel,
         return ANEURALNETWORKS_OP_FAILED;
     }
 
+    findMemoryLayoutOfTemporaries(fromModel);
     mSuccessfulFinish = true;
     return ANEURALNETWORKS_NO_ERROR;
 }
 
+void ExecutionPlan::CompoundBody::findMemoryLayoutOfTemporaries(const ModelBuilder* fromModel) {
+    struct Temporary {
+        uint32_t fromModelOperandIndex;
+        uint32_t size;
+        uint32_t definingStep;
+        uint32_t lastReadingStep;
+        uint32_t offset;
+    };
+    std::vector<Temporary> temporaries;
+    std::map<uint32_t, uint32_t> fromModelOperandIndexToTemporary;
+    for (uint32_t stepIndex = 0; stepIndex < mSteps.size(); stepIndex++) {
+        for (const auto& output : mSteps[stepIndex]->getTempsAsSubModelOutputs()) {
+            const uint32_t fromModelOperandIndex = output.first;
+            const Operand& fromModelOperand = fromModel->getOperand(fromModelOperandIndex);
+            const uint32_t size = TypeManager::get()->getSizeOfData(fromModelOperand);
+            fromModelOperandIndexToTemporary[fromModelOperandIndex] = temporaries.size();
+            temporaries.push_back({fromModelOperandIndex, size, stepIndex, stepIndex, 0});
+            mUnsharedSizeOfTemporaries += alignBytesNeeded(mUnsharedSizeOfTemporaries, size);
+            mUnsharedSizeOfTemporaries += size;
+        }
+    }
+    if (temporaries.empty()) {
+        return;
+    }
+    for (uint32_t stepIndex = 0; stepIndex < mSteps.size(); stepIndex++) {
+        for (const auto& input : mSteps[stepIndex]->getTempsAsSubModelInputs()) {
+            const auto it = fromModelOperandIndexToTemporary.find(input.first);
+            nnAssert(it != fromModelOperandIndexToTemporary.end());
+            Temporary& temporary = temporaries[it->second];
+            temporary.lastReadingStep = std::max(temporary.lastReadingStep, stepIndex);
+        }
+    }
+
+    // Place the largest temporaries first, each at the lowest offset where it
+    // does not overlap any placed temporary that is live at the same time.
+    std::vector<Temporary*> order;
+    for (Temporary& temporary : temporaries) {
+        order.push_back(&temporary);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Temporary* a, const Temporary* b) {
+        return a->size > b->size;
+    });
+    std::vector<const Temporary*> placed;
+    for (Temporary* temporary : order) {
+        std::vector<const Temporary*> conflicts;
+        for (const Temporary* other : placed) {
+            if (other->definingStep <= temporary->lastReadingStep &&
+                temporary->definingStep <= other->lastReadingStep) {
+                conflicts.push_back(other);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end(),
+                  [](const Temporary* a, const Temporary* b) { return a->offset < b->offset; });
+        uint32_t offset = 0;
+        for (const Temporary* other : conflicts) {
+            offset += alignBytesNeeded(offset, temporary->size);
+            if (offset + temporary->size <= other->offset) {
+                break;
+            }
+            offset = std::max(offset, other->offset + other->size);
+        }
+        offset += alignBytesNeeded(offset, temporary->size);
+        temporary->offset = offset;
+        mTotalSizeOfTemporaries = std::max(mTotalSizeOfTemporaries, offset + temporary->size);
+        placed.push_back(temporary);
+    }
+
+    auto subModelInputsAndOutputs = std::make_shared<Controller::SubModelInputsAndOutputsType>();
+    for (const Temporary& temporary : temporaries) {
+        subModelInputsAndOutputs->insert(
+                std::make_pair(temporary.fromModelOperandIndex, temporary.offset));
+    }
+    mSubModelInputsAndOutputs = std::move(subModelInputsAndOutputs);
+}
+
 int ExecutionPlan::SimpleBody::finish([[maybe_unused]] const ModelBuilder* fromModel,
                                       int32_t executionPreference) {
     nnAssert(mDevice != nullptr);
@@ -634,7 +711,8 @@ ExecutionPlan::Controller::Controller(
       mSubModelInputsAndOutputs(subModelInputsAndOutputs),
       mNextStepIndex(0) {
     if (totalSizeOfTemporaries) {
-        if (mTemporaries.create(totalSizeOfTemporaries) != ANEURALNETWORKS_NO_ERROR) {
+        mTemporaries = MemoryPool::get()->allocate(totalSizeOfTemporaries);
+        if (mTemporaries == nullptr) {
             LOG(ERROR) << "ExecutionPlan::Controller failed to allocate temporaries";
             mNextStepIndex = kBadStepIndex;
         }
@@ -682,45 +760,14 @@ std::shared_ptr<ExecutionPlan::Controller> ExecutionPlan::makeController(
         ExecutionBuilder* executionBuilder, const BurstBuilder* burstBuilder) const {
     nnAssert(isValid());
 
-    // Create the layout for a Memory object big enough for to hold
-    // every TEMPORARY in the original model that is live across
-    // partition boundaries.
-    //
-    // TODO: Rethink this approach for managing temporaries.  Some
-    // alternatives:
-    //
-    // 1) Adopt a memory layout scheme analogous to stack allocation,
-    // where objects of non-overlapping lifetime can occupy the same
-    // storage.  We would still have a single Memory object in this
-    // case.
-    //
-    // 2) Do something like what CpuExecutor does, and do allocations
-    // and deallocations on the fly (during execution) before first
-    // reference and after last reference, respectively.  This would
-    // mean having one Memory object per TEMPORARY; or, in a more
-    // complicated implementation, one Memory object per set of
-    // temporaries that have the same lifetime.  Note that the Android
-    // system limits the number of shared memory objects, which are
-    // what our Memory objects represent.
-    //
+    // The layout of the Memory object holding every TEMPORARY in the
+    // original model that is live across partition boundaries is computed
+    // once by CompoundBody::finish().
     uint32_t totalSizeOfTemporaries = 0;
-    std::shared_ptr<Controller::SubModelInputsAndOutputsType> subModelInputsAndOutputs;
+    std::shared_ptr<const Controller::SubModelInputsAndOutputsType> subModelInputsAndOutputs;
     if (mState == COMPOUND) {
-        const ModelBuilder* fromModel = executionBuilder->getModel();
-        for (const auto& step : compound()->mSteps) {
-            for (const auto& output: step->getTempsAsSubModelOutputs()) {
-                const uint32_t fromModelOperandIndex = output.first;
-                const Operand& fromModelOperand = fromModel->getOperand(fromModelOperandIndex);
-                if (subModelInputsAndOutputs == nullptr) {
-                    subModelInputsAndOutputs =
-                            std::make_shared<Controller::SubModelInputsAndOutputsType>();
-                }
-                const uint32_t size = TypeManager::get()->getSizeOfData(fromModelOperand);
-                totalSizeOfTemporaries += alignBytesNeeded(totalSizeOfTemporaries, size);
-                subModelInputsAndOutputs->insert(std::make_pair(fromModelOperandIndex, totalSizeOfTemporaries));
-                totalSizeOfTemporaries += size;
-            }
-        }
+        totalSizeOfTemporaries = compound()->mTotalSizeOfTemporaries;
+        subModelInputsAndOutputs = compound()->mSubModelInputsAndOutputs;
         if (VLOG_IS_ON(EXECUTION) && (subModelInputsAndOutputs != nullptr)) {
             for (const auto& io : *subModelInputsAndOutputs) {
                 VLOG(EXECUTION) << "temp: origOpndIdx = " << io.first
@@ -834,7 +881,7 @@ int ExecutionPlan::next(std::shared_ptr<Controller> controller,
                     controller->mSubModelInputsAndOutputs->at(fromModelOperandIndex);
                 int n = (*executor)->setOutputFromTemporaryMemory(
                     firstSubModelOutputIndex + idx,
-                    &controller->mTemporaries,
+                    controller->mTemporaries.get(),
                     offsetOfTemporary);
                 if (n != ANEURALNETWORKS_NO_ERROR) {
                     controller->mNextStepIndex = Controller::kBadStepIndex;
@@ -855,7 +902,7 @@ int ExecutionPlan::next(std::shared_ptr<Controller> controller,
                     controller->mSubModelInputsAndOutputs->at(fromModelOperandIndex);
                 int n = (*executor)->setInputFromTemporaryMemory(
                     firstSubModelInputIndex + idx,
-                    &controller->mTemporaries,
+                    controller->mTemporaries.get(),
                     offsetOfTemporary);
                 if (n != ANEURALNETWORKS_NO_ERROR) {
                     controller->mNextStepIndex = Controller::kBadStepIndex;
@@ -945,6 +992,14 @@ bool ExecutionPlan::forTest_hasSubModelOutputsOfUnknownSize() const {
     return mBody->hasSubModelOutputsOfUnknownSize();
 }
 
+uint32_t ExecutionPlan::forTest_compoundGetSizeOfTemporaries() const {
+    return compound()->mTotalSizeOfTemporaries;
+}
+
+uint32_t ExecutionPlan::forTest_compoundGetUnsharedSizeOfTemporaries() const {
+    return compound()->mUnsharedSizeOfTemporaries;
+}
+
 const uint8_t* ExecutionPlan::forTest_simpleGetCacheToken() const {
     CHECK(mState == SIMPLE)
             << "Calling forTest_simpleGetCacheToken from execution plan with a non-SIMPLE body";
@@ -959,6 +1014,8 @@ void ExecutionPlan::CompoundBody::dump() const {
     for (const auto& step : mSteps) {
         step->dump();
     }
+    VLOG(COMPILATION) << "Temporaries across partitions: " << mTotalSizeOfTemporaries
+                      << " bytes (" << mUnsharedSizeOfTemporaries << " bytes without sharing)";
 }
 
 int ModelBuilder::partitionTheWork(const std::vector<std::shared_ptr<Device>>& devices,
@@ -206,7 +206,7 @@ public:
         ExecutionBuilder* mExecutionBuilder;
         const BurstBuilder* mBurstBuilder;
         std::shared_ptr<const SubModelInputsAndOutputsType> mSubModelInputsAndOutputs;  // may be nullptr
-        Memory mTemporaries;
+        std::shared_ptr<Memory> mTemporaries;  // from the MemoryPool, may be nullptr
         size_t mNextStepIndex;
     };
 
@@ -259,6 +259,10 @@ public:
     std::shared_ptr<const Device> forTest_simpleGetDevice() const;
     const std::vector<std::shared_ptr<ExecutionStep>>& forTest_compoundGetSteps() const;
     bool forTest_hasSubModelOutputsOfUnknownSize() const;
+    // The size of the memory for temporaries across partitions, and what it
+    // would be if no two temporaries shared memory.
+    uint32_t forTest_compoundGetSizeOfTemporaries() const;
+    uint32_t forTest_compoundGetUnsharedSizeOfTemporaries() const;
     const uint8_t* forTest_simpleGetCacheToken() const;
 
    private:
@@ -307,8 +311,21 @@ public:
         std::unordered_map<uint32_t, uint32_t> mTemporaryToDefiningStep;
 
         bool mHasSubModelOutputOfUnknownSize = false;
+
+        // Layout of the Memory that each Controller allocates for the
+        // TEMPORARYs in the original model that are live across partition
+        // boundaries, computed by finish().  A temporary is live from the
+        // step defining it to the last step reading it; temporaries that
+        // are not live at the same time share storage.
+        std::shared_ptr<const Controller::SubModelInputsAndOutputsType>
+                mSubModelInputsAndOutputs;  // may be nullptr
+        uint32_t mTotalSizeOfTemporaries = 0;
+        // The size that the temporaries would take without sharing storage.
+        uint32_t mUnsharedSizeOfTemporaries = 0;
+
     private:
         void findTempsAsSubModelOutputs();
+        void findMemoryLayoutOfTemporaries(const ModelBuilder* fromModel);
     };
 
     enum { EMPTY, SIMPLE, COMPOUND } mState = EMPTY;
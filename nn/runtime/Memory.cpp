@@ -20,8 +20,12 @@
 
 #include "ExecutionBurstController.h"
 #include "HalInterfaces.h"
+#include "Tracing.h"
 #include "Utils.h"
 
+#include <limits>
+#include <vector>
+
 namespace android {
 namespace nn {
 
@@ -58,7 +62,10 @@ intptr_t Memory::getKey() const {
 
 void Memory::usedBy(const std::shared_ptr<ExecutionBurstController>& burst) const {
     std::lock_guard<std::mutex> guard(mMutex);
-    mUsedBy.emplace(burst.get(), burst);
+    // Replace rather than emplace: a burst created at the address of a
+    // destroyed one must not be shadowed by the expired entry, as recycled
+    // memory objects can outlive many bursts.
+    mUsedBy[burst.get()] = burst;
 }
 
 MemoryFd::~MemoryFd() {
@@ -138,6 +145,95 @@ int MemoryFd::getPointer(uint8_t** buffer) const {
     }
 }
 
+MemoryPool* MemoryPool::get() {
+    static MemoryPool pool;
+    return &pool;
+}
+
+static uint32_t getSizeClass(uint32_t size) {
+    uint32_t sizeClass = MemoryPool::kMinSize;
+    while (sizeClass < size) {
+        if (sizeClass > std::numeric_limits<uint32_t>::max() / 2) {
+            // Too large to round up; such regions are never cached anyway.
+            return size;
+        }
+        sizeClass *= 2;
+    }
+    return sizeClass;
+}
+
+std::shared_ptr<Memory> MemoryPool::allocate(uint32_t size) {
+    const uint32_t sizeClass = getSizeClass(size);
+    std::unique_ptr<Memory> memory;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        for (auto it = mCached.begin(); it != mCached.end(); ++it) {
+            if ((*it)->getHidlMemory().size() == sizeClass) {
+                memory = std::move(*it);
+                mCached.erase(it);
+                mCachedBytes -= sizeClass;
+                break;
+            }
+        }
+        if (memory != nullptr) {
+            mNumHits++;
+        } else {
+            mNumMisses++;
+        }
+        VLOG(EXECUTION) << "MemoryPool::allocate(" << size << "): "
+                        << (memory != nullptr ? "hit" : "miss") << " (" << mNumHits
+                        << " hits, " << mNumMisses << " misses)";
+    }
+    if (memory == nullptr) {
+        NNTRACE_RT(NNTRACE_PHASE_INPUTS_AND_OUTPUTS, "MemoryPool::allocate miss");
+        memory = std::make_unique<Memory>();
+        if (memory->create(sizeClass) != ANEURALNETWORKS_NO_ERROR) {
+            return nullptr;
+        }
+    }
+    return std::shared_ptr<Memory>(memory.release(), [this](Memory* m) { release(m); });
+}
+
+void MemoryPool::release(Memory* memory) {
+    std::unique_ptr<Memory> owned(memory);
+    const uint64_t size = owned->getHidlMemory().size();
+    if (size > kMaxCachedBytes) {
+        return;
+    }
+    // Destroy the evicted memory objects without holding the lock, as their
+    // destructors notify the bursts using them.
+    std::vector<std::unique_ptr<Memory>> evicted;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        mCached.push_front(std::move(owned));
+        mCachedBytes += size;
+        while (mCached.size() > kMaxCachedMemories || mCachedBytes > kMaxCachedBytes) {
+            mCachedBytes -= mCached.back()->getHidlMemory().size();
+            evicted.push_back(std::move(mCached.back()));
+            mCached.pop_back();
+        }
+    }
+}
+
+void MemoryPool::clear() {
+    std::list<std::unique_ptr<Memory>> cached;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        cached.swap(mCached);
+        mCachedBytes = 0;
+    }
+}
+
+uint64_t MemoryPool::getNumHits() const {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mNumHits;
+}
+
+uint64_t MemoryPool::getNumMisses() const {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mNumMisses;
+}
+
 uint32_t MemoryTracker::add(const Memory* memory) {
     VLOG(MODEL) << __func__ << "(" << SHOW_IF_DEBUG(memory) << ")";
     // See if we already have this memory. If so,
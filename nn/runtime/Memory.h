@@ -22,6 +22,8 @@
 
 #include <cutils/native_handle.h>
 #include <sys/mman.h>
+#include <list>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include "vndk/hardware_buffer.h"
@@ -169,6 +171,48 @@ class MemoryAHWB : public Memory {
     AHardwareBuffer_Desc mBufferDesc;
 };
 
+// A process-wide cache of the shared memory regions that the runtime creates
+// for the duration of one execution: the pools holding the inputs and outputs
+// specified by pointer, and the temporaries crossing partition boundaries.
+// Instead of creating and mapping a region on every execution, regions are
+// recycled once released.
+//
+// Sizes are rounded up to a power of two (a size class) of at least kMinSize
+// bytes, and a cached region is only handed out for its own size class.  At
+// most kMaxCachedMemories regions, totalling at most kMaxCachedBytes, are kept;
+// the least recently released ones are destroyed first.
+class MemoryPool {
+   public:
+    static constexpr uint32_t kMinSize = 4096;
+    static constexpr uint32_t kMaxCachedMemories = 16;
+    static constexpr uint64_t kMaxCachedBytes = 64 * 1024 * 1024;
+
+    static MemoryPool* get();
+
+    // Returns a Memory of at least size bytes, or nullptr if it cannot be
+    // created.  The Memory goes back to the pool once the last reference to
+    // it is dropped.  Its contents are unspecified.
+    std::shared_ptr<Memory> allocate(uint32_t size);
+
+    // Destroys all the cached regions.
+    void clear();
+
+    // The number of calls to allocate() served from the cache, and the number
+    // that created a new region.
+    uint64_t getNumHits() const;
+    uint64_t getNumMisses() const;
+
+   private:
+    void release(Memory* memory);
+
+    mutable std::mutex mMutex;
+    // Most recently released first.
+    std::list<std::unique_ptr<Memory>> mCached;
+    uint64_t mCachedBytes = 0;
+    uint64_t mNumHits = 0;
+    uint64_t mNumMisses = 0;
+};
+
 // A utility class to accumulate mulitple Memory objects and assign each
 // a distinct index number, starting with 0.
 //
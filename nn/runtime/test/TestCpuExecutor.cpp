@@ -0,0 +1,1543 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CpuExecutor.h"
+#include "NeuralNetworks.h"
+#include "ThreadPool.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace {
+
+Operand makeOperand(OperandLifeTime lifetime, std::vector<uint32_t> dimensions) {
+    return {
+            .type = OperandType::TENSOR_FLOAT32,
+            .dimensions = dimensions,
+            .numberOfConsumers = 0,
+            .scale = 0.0f,
+            .zeroPoint = 0,
+            .lifetime = lifetime,
+            .location = {.poolIndex = 0, .offset = 0, .length = 0},
+            .extraParams = Operand::ExtraParams(),
+    };
+}
+
+// Builds a chain of ABS operations: operand i is the input of operation i and
+// the output of operation i - 1.  Operand 0 is the model input and the last
+// operand is the model output.
+Model makeChainModel(const std::vector<std::vector<uint32_t>>& dimensions) {
+    Model model;
+    const uint32_t operandCount = dimensions.size();
+    model.operands.resize(operandCount);
+    model.operations.resize(operandCount - 1);
+    for (uint32_t i = 0; i < operandCount; i++) {
+        const OperandLifeTime lifetime =
+                i == 0 ? OperandLifeTime::MODEL_INPUT
+                       : (i == operandCount - 1 ? OperandLifeTime::MODEL_OUTPUT
+                                                : OperandLifeTime::TEMPORARY_VARIABLE);
+        model.operands[i] = makeOperand(lifetime, dimensions[i]);
+        model.operands[i].numberOfConsumers = i == operandCount - 1 ? 0 : 1;
+    }
+    for (uint32_t i = 0; i < operandCount - 1; i++) {
+        model.operations[i] = {.type = OperationType::ABS, .inputs = {i}, .outputs = {i + 1}};
+    }
+    model.inputIndexes = hidl_vec<uint32_t>{0};
+    model.outputIndexes = hidl_vec<uint32_t>{operandCount - 1};
+    return model;
+}
+
+// Builds two branches joined by an ADD:
+//   input -> ABS -> t1 -> ABS -> t3 --+
+//   input -> NEG -> t2 -> ABS -> t4 --+-> ADD -> output
+// The operations of the two branches are interleaved, so that the sequential
+// order lets t4 reuse the memory of t1.
+Model makeBranchesModel() {
+    Model model;
+    model.operands.resize(7);
+    model.operands[0] = makeOperand(OperandLifeTime::MODEL_INPUT, {4});
+    model.operands[0].numberOfConsumers = 2;
+    for (uint32_t i = 1; i <= 4; i++) {
+        model.operands[i] = makeOperand(OperandLifeTime::TEMPORARY_VARIABLE, {4});
+        model.operands[i].numberOfConsumers = 1;
+    }
+    model.operands[5] = makeOperand(OperandLifeTime::CONSTANT_COPY, {});
+    model.operands[5].type = OperandType::INT32;
+    model.operands[5].numberOfConsumers = 1;
+    model.operands[5].location = {.poolIndex = 0, .offset = 0, .length = sizeof(int32_t)};
+    model.operands[6] = makeOperand(OperandLifeTime::MODEL_OUTPUT, {4});
+    model.operations = hidl_vec<Operation>{
+            {.type = OperationType::ABS, .inputs = {0}, .outputs = {1}},
+            {.type = OperationType::NEG, .inputs = {0}, .outputs = {2}},
+            {.type = OperationType::ABS, .inputs = {1}, .outputs = {3}},
+            {.type = OperationType::ABS, .inputs = {2}, .outputs = {4}},
+            {.type = OperationType::ADD, .inputs = {3, 4, 5}, .outputs = {6}},
+    };
+    // ANEURALNETWORKS_FUSED_NONE
+    model.operandValues = std::vector<uint8_t>(sizeof(int32_t), 0);
+    model.inputIndexes = hidl_vec<uint32_t>{0};
+    model.outputIndexes = hidl_vec<uint32_t>{6};
+    return model;
+}
+
+// Builds input -> ABS -> t1 -> RESHAPE -> t2 -> ABS -> output, reshaping {4}
+// to {2, 2}.
+Model makeReshapeModel() {
+    Model model;
+    model.operands.resize(5);
+    model.operands[0] = makeOperand(OperandLifeTime::MODEL_INPUT, {4});
+    model.operands[0].numberOfConsumers = 1;
+    model.operands[1] = makeOperand(OperandLifeTime::TEMPORARY_VARIABLE, {4});
+    model.operands[1].numberOfConsumers = 1;
+    model.operands[2] = makeOperand(OperandLifeTime::CONSTANT_COPY, {2});
+    model.operands[2].type = OperandType::TENSOR_INT32;
+    model.operands[2].numberOfConsumers = 1;
+    model.operands[2].location = {.poolIndex = 0, .offset = 0, .length = 2 * sizeof(int32_t)};
+    model.operands[3] = makeOperand(OperandLifeTime::TEMPORARY_VARIABLE, {2, 2});
+    model.operands[3].numberOfConsumers = 1;
+    model.operands[4] = makeOperand(OperandLifeTime::MODEL_OUTPUT, {2, 2});
+    model.operations = hidl_vec<Operation>{
+            {.type = OperationType::ABS, .inputs = {0}, .outputs = {1}},
+            {.type = OperationType::RESHAPE, .inputs = {1, 2}, .outputs = {3}},
+            {.type = OperationType::ABS, .inputs = {3}, .outputs = {4}},
+    };
+    const int32_t shape[] = {2, 2};
+    model.operandValues.resize(sizeof(shape));
+    memcpy(model.operandValues.data(), shape, sizeof(shape));
+    model.inputIndexes = hidl_vec<uint32_t>{0};
+    model.outputIndexes = hidl_vec<uint32_t>{4};
+    return model;
+}
+
+// Builds a chain of ADD operations on single-element tensors, each adding the
+// model input to the output of the previous one.
+Model makeAddChainModel(uint32_t operationCount) {
+    Model model;
+    model.operands.resize(operationCount + 2);
+    model.operands[0] = makeOperand(OperandLifeTime::MODEL_INPUT, {1});
+    model.operands[0].numberOfConsumers = operationCount + 1;
+    model.operands[1] = makeOperand(OperandLifeTime::CONSTANT_COPY, {});
+    model.operands[1].type = OperandType::INT32;
+    model.operands[1].numberOfConsumers = operationCount;
+    model.operands[1].location = {.poolIndex = 0, .offset = 0, .length = sizeof(int32_t)};
+    model.operations.resize(operationCount);
+    for (uint32_t i = 0; i < operationCount; i++) {
+        const uint32_t input = i == 0 ? 0 : i + 1;
+        const uint32_t output = i + 2;
+        model.operands[output] = makeOperand(i == operationCount - 1
+                                                     ? OperandLifeTime::MODEL_OUTPUT
+                                                     : OperandLifeTime::TEMPORARY_VARIABLE,
+                                             {1});
+        model.operands[output].numberOfConsumers = i == operationCount - 1 ? 0 : 1;
+        model.operations[i] = {
+                .type = OperationType::ADD, .inputs = {input, 0, 1}, .outputs = {output}};
+    }
+    // ANEURALNETWORKS_FUSED_NONE
+    model.operandValues = std::vector<uint8_t>(sizeof(int32_t), 0);
+    model.inputIndexes = hidl_vec<uint32_t>{0};
+    model.outputIndexes = hidl_vec<uint32_t>{operationCount + 1};
+    return model;
+}
+
+// Builds numBranches chains of depth TANH operations on the model input, and
+// sums the ends of the chains with ADD operations into the model output.  All
+// the tensors have size elements.
+Model makeTanhBranchesModel(uint32_t numBranches, uint32_t depth, uint32_t size) {
+    std::vector<Operand> operands(2);
+    operands[0] = makeOperand(OperandLifeTime::MODEL_INPUT, {size});
+    operands[0].numberOfConsumers = numBranches;
+    operands[1] = makeOperand(OperandLifeTime::CONSTANT_COPY, {});
+    operands[1].type = OperandType::INT32;
+    operands[1].numberOfConsumers = numBranches - 1;
+    operands[1].location = {.poolIndex = 0, .offset = 0, .length = sizeof(int32_t)};
+    auto addTemporary = [&operands, size] {
+        operands.push_back(makeOperand(OperandLifeTime::TEMPORARY_VARIABLE, {size}));
+        operands.back().numberOfConsumers = 1;
+        return static_cast<uint32_t>(operands.size() - 1);
+    };
+    std::vector<Operation> operations;
+    std::vector<uint32_t> branchOutputs;
+    for (uint32_t branch = 0; branch < numBranches; branch++) {
+        uint32_t input = 0;
+        for (uint32_t i = 0; i < depth; i++) {
+            const uint32_t output = addTemporary();
+            operations.push_back(
+                    {.type = OperationType::TANH, .inputs = {input}, .outputs = {output}});
+            input = output;
+        }
+        branchOutputs.push_back(input);
+    }
+    uint32_t sum = branchOutputs[0];
+    for (uint32_t branch = 1; branch < numBranches; branch++) {
+        const uint32_t output = addTemporary();
+        operations.push_back({.type = OperationType::ADD,
+                              .inputs = {sum, branchOutputs[branch], 1},
+                              .outputs = {output}});
+        sum = output;
+    }
+    operands[sum].lifetime = OperandLifeTime::MODEL_OUTPUT;
+    operands[sum].numberOfConsumers = 0;
+
+    Model model;
+    model.operands = operands;
+    model.operations = operations;
+    // ANEURALNETWORKS_FUSED_NONE
+    model.operandValues = std::vector<uint8_t>(sizeof(int32_t), 0);
+    model.inputIndexes = hidl_vec<uint32_t>{0};
+    model.outputIndexes = hidl_vec<uint32_t>{sum};
+    return model;
+}
+
+// Builds input -> FULLY_CONNECTED -> t1, t1 + addend -> ADD -> t2, and
+// t2 -> RELU -> output, where input is {1, 4} and the other tensors are {1, 3}.
+Model makeResidualModel(OperandType type) {
+    const bool isQuant = type == OperandType::TENSOR_QUANT8_ASYMM;
+    auto makeTensor = [type, isQuant](OperandLifeTime lifetime, std::vector<uint32_t> dimensions,
+                                      float scale, int32_t zeroPoint) {
+        Operand operand = makeOperand(lifetime, dimensions);
+        operand.type = type;
+        operand.numberOfConsumers = 1;
+        if (isQuant) {
+            operand.scale = scale;
+            operand.zeroPoint = zeroPoint;
+        }
+        return operand;
+    };
+
+    Model model;
+    std::vector<uint8_t> values;
+    auto addValues = [&values](const void* data, uint32_t length) -> DataLocation {
+        const uint32_t offset = values.size();
+        values.resize(offset + length);
+        memcpy(values.data() + offset, data, length);
+        return {.poolIndex = 0, .offset = offset, .length = length};
+    };
+
+    model.operands.resize(8);
+    model.operands[0] = makeTensor(OperandLifeTime::MODEL_INPUT, {1, 4}, 0.5f, 127);
+    model.operands[1] = makeTensor(OperandLifeTime::CONSTANT_COPY, {3, 4}, 0.25f, 128);
+    model.operands[2] = makeTensor(OperandLifeTime::CONSTANT_COPY, {3}, 0.125f, 0);
+    if (isQuant) {
+        const uint8_t weights[] = {120, 130, 140, 150, 160, 110, 100, 90, 128, 129, 127, 200};
+        const int32_t bias[] = {-40, 12, 300};
+        model.operands[1].location = addValues(weights, sizeof(weights));
+        model.operands[2].type = OperandType::TENSOR_INT32;
+        model.operands[2].location = addValues(bias, sizeof(bias));
+    } else {
+        const float weights[] = {-1.0f, 0.5f, 2.0f, 0.25f, 1.5f, -0.75f,
+                                 0.0f,  1.0f, -2.0f, 3.0f, -0.5f, 0.125f};
+        const float bias[] = {-0.5f, 1.0f, 0.25f};
+        model.operands[1].location = addValues(weights, sizeof(weights));
+        model.operands[2].location = addValues(bias, sizeof(bias));
+    }
+    // The activation is shared by the FULLY_CONNECTED and the ADD.
+    const int32_t activation = ANEURALNETWORKS_FUSED_NONE;
+    model.operands[3] = makeOperand(OperandLifeTime::CONSTANT_COPY, {});
+    model.operands[3].type = OperandType::INT32;
+    model.operands[3].numberOfConsumers = 2;
+    model.operands[3].location = addValues(&activation, sizeof(activation));
+    model.operands[4] = makeTensor(OperandLifeTime::TEMPORARY_VARIABLE, {1, 3}, 1.0f, 128);
+    model.operands[5] = makeTensor(OperandLifeTime::MODEL_INPUT, {1, 3}, 0.5f, 120);
+    model.operands[6] = makeTensor(OperandLifeTime::TEMPORARY_VARIABLE, {1, 3}, 1.0f, 100);
+    model.operands[7] = makeTensor(OperandLifeTime::MODEL_OUTPUT, {1, 3}, 1.0f, 100);
+    model.operands[7].numberOfConsumers = 0;
+    model.operations = hidl_vec<Operation>{
+            {.type = OperationType::FULLY_CONNECTED, .inputs = {0, 1, 2, 3}, .outputs = {4}},
+            {.type = OperationType::ADD, .inputs = {4, 5, 3}, .outputs = {6}},
+            {.type = OperationType::RELU, .inputs = {6}, .outputs = {7}},
+    };
+    model.operandValues = values;
+    model.inputIndexes = hidl_vec<uint32_t>{0, 5};
+    model.outputIndexes = hidl_vec<uint32_t>{7};
+    return model;
+}
+
+// Builds input1, input2 -> operationType -> output, where operationType is
+// ADD, MUL, SUB or DIV with the fused activation.
+Model makeBinaryModel(OperationType operationType, OperandType type,
+                      const std::vector<uint32_t>& dimensions1,
+                      const std::vector<uint32_t>& dimensions2,
+                      const std::vector<uint32_t>& outputDimensions, int32_t activation) {
+    Model model;
+    model.operands.resize(4);
+    model.operands[0] = makeOperand(OperandLifeTime::MODEL_INPUT, dimensions1);
+    model.operands[1] = makeOperand(OperandLifeTime::MODEL_INPUT, dimensions2);
+    model.operands[2] = makeOperand(OperandLifeTime::CONSTANT_COPY, {});
+    model.operands[2].type = OperandType::INT32;
+    model.operands[2].location = {.poolIndex = 0, .offset = 0, .length = sizeof(int32_t)};
+    for (uint32_t i = 0; i < 3; i++) {
+        model.operands[i].numberOfConsumers = 1;
+    }
+    model.operands[0].type = type;
+    model.operands[1].type = type;
+    model.operands[3] = makeOperand(OperandLifeTime::MODEL_OUTPUT, outputDimensions);
+    model.operands[3].type = type;
+    model.operations = hidl_vec<Operation>{
+            {.type = operationType, .inputs = {0, 1, 2}, .outputs = {3}}};
+    model.operandValues.resize(sizeof(activation));
+    memcpy(model.operandValues.data(), &activation, sizeof(activation));
+    model.inputIndexes = hidl_vec<uint32_t>{0, 1};
+    model.outputIndexes = hidl_vec<uint32_t>{3};
+    return model;
+}
+
+uint32_t getElementCount(const std::vector<uint32_t>& dimensions) {
+    uint32_t count = 1;
+    for (uint32_t dimension : dimensions) {
+        count *= dimension;
+    }
+    return count;
+}
+
+// Builds input -> SOFTMAX or LOG_SOFTMAX -> output along the axis, with
+// beta 1.  Quant8 outputs have the scale 1 / 256 that SOFTMAX requires.
+Model makeSoftmaxModel(OperationType operationType, OperandType type,
+                       const std::vector<uint32_t>& dimensions, int32_t axis, float scale = 0.0f,
+                       int32_t zeroPoint = 0) {
+    Model model;
+    model.operands.resize(4);
+    model.operands[0] = makeOperand(OperandLifeTime::MODEL_INPUT, dimensions);
+    model.operands[0].type = type;
+    model.operands[0].numberOfConsumers = 1;
+    model.operands[0].scale = scale;
+    model.operands[0].zeroPoint = zeroPoint;
+    model.operands[1] = makeOperand(OperandLifeTime::CONSTANT_COPY, {});
+    model.operands[1].type = OperandType::FLOAT32;
+    model.operands[1].numberOfConsumers = 1;
+    model.operands[1].location = {.poolIndex = 0, .offset = 0, .length = sizeof(float)};
+    model.operands[2] = makeOperand(OperandLifeTime::CONSTANT_COPY, {});
+    model.operands[2].type = OperandType::INT32;
+    model.operands[2].numberOfConsumers = 1;
+    model.operands[2].location = {
+            .poolIndex = 0, .offset = sizeof(float), .length = sizeof(int32_t)};
+    model.operands[3] = makeOperand(OperandLifeTime::MODEL_OUTPUT, dimensions);
+    model.operands[3].type = type;
+    if (type == OperandType::TENSOR_QUANT8_ASYMM) {
+        model.operands[3].scale = 1.0f / 256;
+    }
+    model.operations = hidl_vec<Operation>{
+            {.type = operationType, .inputs = {0, 1, 2}, .outputs = {3}}};
+    const float beta = 1.0f;
+    model.operandValues.resize(sizeof(beta) + sizeof(axis));
+    memcpy(model.operandValues.data(), &beta, sizeof(beta));
+    memcpy(model.operandValues.data() + sizeof(beta), &axis, sizeof(axis));
+    model.inputIndexes = hidl_vec<uint32_t>{0};
+    model.outputIndexes = hidl_vec<uint32_t>{3};
+    return model;
+}
+
+// Computes softmax(input), or its logarithm if isLog is true, along the axis
+// in double precision.
+std::vector<double> computeSoftmaxReference(const std::vector<double>& input,
+                                            const std::vector<uint32_t>& dimensions,
+                                            int32_t axis, bool isLog) {
+    if (axis < 0) {
+        axis += dimensions.size();
+    }
+    uint32_t outerSize = 1, innerSize = 1;
+    for (int32_t i = 0; i < axis; i++) {
+        outerSize *= dimensions[i];
+    }
+    for (uint32_t i = axis + 1; i < dimensions.size(); i++) {
+        innerSize *= dimensions[i];
+    }
+    const uint32_t axisSize = dimensions[axis];
+    std::vector<double> output(input.size());
+    for (uint32_t outer = 0; outer < outerSize; outer++) {
+        for (uint32_t inner = 0; inner < innerSize; inner++) {
+            const uint32_t offset = outer * axisSize * innerSize + inner;
+            double maxValue = -HUGE_VAL;
+            for (uint32_t i = 0; i < axisSize; i++) {
+                maxValue = std::max(maxValue, input[offset + i * innerSize]);
+            }
+            double sum = 0;
+            for (uint32_t i = 0; i < axisSize; i++) {
+                sum += std::exp(input[offset + i * innerSize] - maxValue);
+            }
+            for (uint32_t i = 0; i < axisSize; i++) {
+                const double x = input[offset + i * innerSize] - maxValue;
+                output[offset + i * innerSize] = isLog ? x - std::log(sum) : std::exp(x) / sum;
+            }
+        }
+    }
+    return output;
+}
+
+// Returns an arbitrary value in [-8, 8] for the element index.
+float getSoftmaxInput(uint32_t index) {
+    return 8.0f * std::sin(index * 12.9898f);
+}
+
+// Builds a model of a single operation.  Its inputs are added in order, and
+// build() adds its output.
+class OperationModelBuilder {
+   public:
+    void addInput(OperandType type, const std::vector<uint32_t>& dimensions, float scale = 0.0f,
+                  int32_t zeroPoint = 0) {
+        mInputIndexes.push_back(
+                addOperand(OperandLifeTime::MODEL_INPUT, type, dimensions, scale, zeroPoint));
+    }
+
+    template <typename T>
+    void addConstant(OperandType type, const std::vector<uint32_t>& dimensions,
+                     const std::vector<T>& values, float scale = 0.0f, int32_t zeroPoint = 0) {
+        const uint32_t index =
+                addOperand(OperandLifeTime::CONSTANT_COPY, type, dimensions, scale, zeroPoint);
+        const uint32_t offset = mOperandValues.size();
+        const uint32_t length = values.size() * sizeof(T);
+        mOperandValues.resize(offset + length);
+        memcpy(mOperandValues.data() + offset, values.data(), length);
+        mOperands[index].location = {.poolIndex = 0, .offset = offset, .length = length};
+    }
+
+    void addInt32(int32_t value) {
+        addConstant(OperandType::INT32, {}, std::vector<int32_t>{value});
+    }
+
+    void addBool(bool value) {
+        addConstant(OperandType::BOOL, {}, std::vector<uint8_t>{value});
+    }
+
+    Model build(OperationType operationType, OperandType type,
+                const std::vector<uint32_t>& dimensions, float scale = 0.0f,
+                int32_t zeroPoint = 0) {
+        std::vector<uint32_t> inputs(mOperands.size());
+        std::iota(inputs.begin(), inputs.end(), 0);
+        const uint32_t output =
+                addOperand(OperandLifeTime::MODEL_OUTPUT, type, dimensions, scale, zeroPoint);
+        mOperands[output].numberOfConsumers = 0;
+        Model model;
+        model.operands = mOperands;
+        model.operations.resize(1);
+        model.operations[0].type = operationType;
+        model.operations[0].inputs = inputs;
+        model.operations[0].outputs = hidl_vec<uint32_t>{output};
+        model.operandValues = mOperandValues;
+        model.inputIndexes = mInputIndexes;
+        model.outputIndexes = hidl_vec<uint32_t>{output};
+        return model;
+    }
+
+   private:
+    uint32_t addOperand(OperandLifeTime lifetime, OperandType type,
+                        const std::vector<uint32_t>& dimensions, float scale, int32_t zeroPoint) {
+        Operand operand = makeOperand(lifetime, dimensions);
+        operand.type = type;
+        operand.scale = scale;
+        operand.zeroPoint = zeroPoint;
+        operand.numberOfConsumers = 1;
+        mOperands.push_back(operand);
+        return mOperands.size() - 1;
+    }
+
+    std::vector<Operand> mOperands;
+    std::vector<uint8_t> mOperandValues;
+    std::vector<uint32_t> mInputIndexes;
+};
+
+// Returns the bytes of count arbitrary elements of the type: values in [-1, 1]
+// for TENSOR_FLOAT32, and all the values in turn for TENSOR_QUANT8_ASYMM.
+std::vector<uint8_t> makeTestData(OperandType type, uint32_t count) {
+    if (type == OperandType::TENSOR_FLOAT32) {
+        std::vector<uint8_t> data(count * sizeof(float));
+        float* values = reinterpret_cast<float*>(data.data());
+        for (uint32_t i = 0; i < count; i++) {
+            values[i] = getSoftmaxInput(i) / 8.0f;
+        }
+        return data;
+    }
+    std::vector<uint8_t> data(count);
+    for (uint32_t i = 0; i < count; i++) {
+        data[i] = static_cast<uint8_t>(i * 37);
+    }
+    return data;
+}
+
+// Runs the prepared model on buffers holding the model inputs and output.
+int runPreparedModel(const CpuPreparedModel& preparedModel, const std::vector<void*>& buffers,
+                     const std::vector<uint32_t>& lengths) {
+    const uint32_t inputCount = preparedModel.getModel().inputIndexes.size();
+    std::vector<RequestArgument> inputs, outputs;
+    std::vector<RunTimePoolInfo> requestPoolInfos;
+    for (uint32_t i = 0; i < buffers.size(); i++) {
+        (i < inputCount ? inputs : outputs)
+                .push_back({.hasNoValue = false,
+                            .location = {.poolIndex = i, .offset = 0, .length = lengths[i]},
+                            .dimensions = {}});
+        requestPoolInfos.push_back(
+                RunTimePoolInfo::createFromExistingBuffer(reinterpret_cast<uint8_t*>(buffers[i])));
+    }
+    Request request;
+    request.inputs = inputs;
+    request.outputs = outputs;
+    CpuExecutor executor;
+    return executor.run(preparedModel, request, requestPoolInfos);
+}
+
+// Runs the prepared model numRuns times on the buffers, and returns the
+// average time of a run in nanoseconds.
+int64_t timePreparedModel(const CpuPreparedModel& preparedModel,
+                          const std::vector<void*>& buffers,
+                          const std::vector<uint32_t>& lengths, int numRuns) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < numRuns; run++) {
+        EXPECT_EQ(runPreparedModel(preparedModel, buffers, lengths), ANEURALNETWORKS_NO_ERROR);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / numRuns;
+}
+
+TEST(CpuMemoryPlanTest, ChainReusesMemory) {
+    // input -> t1 -> t2 -> t3 -> t4 -> output
+    const Model model = makeChainModel({{100}, {100}, {100}, {100}, {100}, {100}});
+    const CpuMemoryPlan plan = CpuMemoryPlan::create(model);
+
+    EXPECT_FALSE(plan.isPlanned(0));
+    EXPECT_FALSE(plan.isPlanned(5));
+    for (uint32_t i = 1; i <= 4; i++) {
+        ASSERT_TRUE(plan.isPlanned(i));
+        EXPECT_EQ(plan.getOffset(i) % CpuMemoryPlan::kAlignment, 0u);
+    }
+    // Consecutive temporaries are alive at the same time, but t1 and t3 are not.
+    EXPECT_NE(plan.getOffset(1), plan.getOffset(2));
+    EXPECT_NE(plan.getOffset(2), plan.getOffset(3));
+    EXPECT_EQ(plan.getPeakLiveSize(), 2 * 100 * sizeof(float));
+    EXPECT_LT(plan.getArenaSize(), 4 * 100 * sizeof(float));
+}
+
+TEST(CpuMemoryPlanTest, UnspecifiedDimensionsAreNotPlanned) {
+    const Model model = makeChainModel({{4, 4}, {4, 0}, {}, {4, 4}, {4, 4}});
+    const CpuMemoryPlan plan = CpuMemoryPlan::create(model);
+
+    EXPECT_FALSE(plan.isPlanned(1));
+    EXPECT_FALSE(plan.isPlanned(2));
+    EXPECT_TRUE(plan.isPlanned(3));
+    EXPECT_EQ(plan.getArenaSize(), 4 * 4 * sizeof(float));
+}
+
+TEST(CpuMemoryPlanTest, NoTemporaries) {
+    const Model model = makeChainModel({{4}, {4}});
+    const CpuMemoryPlan plan = CpuMemoryPlan::create(model);
+
+    EXPECT_FALSE(plan.isPlanned(0));
+    EXPECT_FALSE(plan.isPlanned(1));
+    EXPECT_EQ(plan.getArenaSize(), 0u);
+    EXPECT_EQ(plan.getPeakLiveSize(), 0u);
+}
+
+TEST(CpuMemoryPlanTest, ReshapeIsView) {
+    const Model model = makeReshapeModel();
+    const CpuMemoryPlan plan = CpuMemoryPlan::create(model);
+
+    ASSERT_TRUE(plan.isPlanned(1));
+    ASSERT_TRUE(plan.isPlanned(3));
+    EXPECT_EQ(plan.getOffset(1), plan.getOffset(3));
+    EXPECT_EQ(plan.getNumViews(), 1u);
+    EXPECT_EQ(plan.getArenaSize(), 4 * sizeof(float));
+}
+
+TEST(CpuMemoryPlanTest, ReshapeOfSharedInputIsNotView) {
+    Model model = makeReshapeModel();
+    // Another operation reading t1 after the RESHAPE.
+    model.operands[1].numberOfConsumers = 2;
+    model.operations[2].type = OperationType::ADD;
+    model.operations[2].inputs = hidl_vec<uint32_t>{3, 1};
+    const CpuMemoryPlan plan = CpuMemoryPlan::create(model);
+
+    ASSERT_TRUE(plan.isPlanned(1));
+    ASSERT_TRUE(plan.isPlanned(3));
+    EXPECT_NE(plan.getOffset(1), plan.getOffset(3));
+    EXPECT_EQ(plan.getNumViews(), 0u);
+}
+
+TEST(CpuMemoryPlanTest, TransposeOfUnitDimensionIsView) {
+    Model model = makeReshapeModel();
+    // {1, 4} -> {4, 1}, which keeps the data in place.
+    model.operands[0].dimensions = hidl_vec<uint32_t>{1, 4};
+    model.operands[1].dimensions = hidl_vec<uint32_t>{1, 4};
+    model.operands[3].dimensions = hidl_vec<uint32_t>{4, 1};
+    model.operands[4].dimensions = hidl_vec<uint32_t>{4, 1};
+    model.operations[1].type = OperationType::TRANSPOSE;
+    const int32_t perm[] = {1, 0};
+    memcpy(model.operandValues.data(), perm, sizeof(perm));
+    const CpuMemoryPlan plan = CpuMemoryPlan::create(model);
+
+    ASSERT_TRUE(plan.isPlanned(1));
+    ASSERT_TRUE(plan.isPlanned(3));
+    EXPECT_EQ(plan.getOffset(1), plan.getOffset(3));
+    EXPECT_EQ(plan.getNumViews(), 1u);
+}
+
+TEST(CpuMemoryPlanTest, TransposeOfMatrixIsNotView) {
+    Model model = makeReshapeModel();
+    model.operands[0].dimensions = hidl_vec<uint32_t>{2, 2};
+    model.operands[1].dimensions = hidl_vec<uint32_t>{2, 2};
+    model.operations[1].type = OperationType::TRANSPOSE;
+    const int32_t perm[] = {1, 0};
+    memcpy(model.operandValues.data(), perm, sizeof(perm));
+    const CpuMemoryPlan plan = CpuMemoryPlan::create(model);
+
+    ASSERT_TRUE(plan.isPlanned(1));
+    ASSERT_TRUE(plan.isPlanned(3));
+    EXPECT_NE(plan.getOffset(1), plan.getOffset(3));
+    EXPECT_EQ(plan.getNumViews(), 0u);
+}
+
+TEST(CpuOperationGraphTest, Branches) {
+    const Model model = makeBranchesModel();
+    const CpuOperationGraph graph = CpuOperationGraph::create(model);
+
+    ASSERT_EQ(graph.getNumOperations(), 5u);
+    EXPECT_EQ(graph.getNumPredecessors(0), 0u);
+    EXPECT_EQ(graph.getNumPredecessors(1), 0u);
+    EXPECT_EQ(graph.getNumPredecessors(2), 1u);
+    EXPECT_EQ(graph.getNumPredecessors(4), 2u);
+    EXPECT_EQ(graph.getSuccessors(0), std::vector<uint32_t>({2}));
+    EXPECT_TRUE(graph.happensBefore(0, 2));
+    EXPECT_TRUE(graph.happensBefore(1, 4));
+    EXPECT_FALSE(graph.happensBefore(0, 1));
+    EXPECT_FALSE(graph.happensBefore(2, 3));
+    EXPECT_FALSE(graph.happensBefore(2, 2));
+    EXPECT_FALSE(graph.happensBefore(4, 0));
+}
+
+TEST(CpuMemoryPlanTest, ParallelBranchesDoNotShareMemory) {
+    const Model model = makeBranchesModel();
+    const CpuMemoryPlan sequentialPlan = CpuMemoryPlan::create(model);
+    const CpuOperationGraph graph = CpuOperationGraph::create(model);
+    const CpuMemoryPlan parallelPlan = CpuMemoryPlan::create(model, &graph);
+
+    ASSERT_TRUE(parallelPlan.isPlanned(1));
+    ASSERT_TRUE(parallelPlan.isPlanned(4));
+    // The ABS writing t4 may run before the ABS reading t1.
+    EXPECT_NE(parallelPlan.getOffset(1), parallelPlan.getOffset(4));
+    EXPECT_GT(parallelPlan.getArenaSize(), sequentialPlan.getArenaSize());
+}
+
+TEST(CpuExecutorTest, ParallelMatchesSequential) {
+    const Model model = makeBranchesModel();
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    const CpuPreparedModel sequentialModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+    const CpuPreparedModel parallelModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get(),
+                                     &threadPool, /*allowFusion=*/true,
+                                     /*parallelOperations=*/true);
+    ASSERT_NE(parallelModel.getOperationGraph(), nullptr);
+    // Without parallelOperations, only the operations themselves use the pool.
+    EXPECT_EQ(CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get(),
+                                       &threadPool)
+                      .getOperationGraph(),
+              nullptr);
+
+    float input[4] = {-1.0f, 2.0f, -3.0f, 4.0f};
+    float sequentialOutput[4] = {};
+    float parallelOutput[4] = {};
+    Request request;
+    request.inputs = hidl_vec<RequestArgument>{
+            {.hasNoValue = false,
+             .location = {.poolIndex = 0, .offset = 0, .length = sizeof(input)},
+             .dimensions = {}}};
+    request.outputs = hidl_vec<RequestArgument>{
+            {.hasNoValue = false,
+             .location = {.poolIndex = 1, .offset = 0, .length = sizeof(input)},
+             .dimensions = {}}};
+
+    CpuExecutor sequentialExecutor;
+    ASSERT_EQ(sequentialExecutor.run(
+                      sequentialModel, request,
+                      {RunTimePoolInfo::createFromExistingBuffer(reinterpret_cast<uint8_t*>(input)),
+                       RunTimePoolInfo::createFromExistingBuffer(
+                               reinterpret_cast<uint8_t*>(sequentialOutput))}),
+              ANEURALNETWORKS_NO_ERROR);
+    CpuExecutor parallelExecutor;
+    for (int run = 0; run < 10; run++) {
+        ASSERT_EQ(parallelExecutor.run(parallelModel, request,
+                                       {RunTimePoolInfo::createFromExistingBuffer(
+                                                reinterpret_cast<uint8_t*>(input)),
+                                        RunTimePoolInfo::createFromExistingBuffer(
+                                                reinterpret_cast<uint8_t*>(parallelOutput))}),
+                  ANEURALNETWORKS_NO_ERROR);
+        for (int i = 0; i < 4; i++) {
+            EXPECT_EQ(parallelOutput[i], sequentialOutput[i]);
+            EXPECT_EQ(parallelOutput[i], 2.0f * std::abs(input[i]));
+        }
+    }
+}
+
+TEST(CpuExecutorTest, ReusePreparedModel) {
+    // input -> ABS -> t1 -> ABS -> t2 -> ABS -> output
+    const Model model = makeChainModel({{4}, {4}, {4}, {4}});
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel preparedModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+
+    float input[4] = {-1.0f, 2.0f, -3.0f, 4.0f};
+    float output[4] = {};
+    const std::vector<RunTimePoolInfo> requestPoolInfos = {
+            RunTimePoolInfo::createFromExistingBuffer(reinterpret_cast<uint8_t*>(input)),
+            RunTimePoolInfo::createFromExistingBuffer(reinterpret_cast<uint8_t*>(output)),
+    };
+    Request request;
+    request.inputs = hidl_vec<RequestArgument>{
+            {.hasNoValue = false,
+             .location = {.poolIndex = 0, .offset = 0, .length = sizeof(input)},
+             .dimensions = {}}};
+    request.outputs = hidl_vec<RequestArgument>{
+            {.hasNoValue = false,
+             .location = {.poolIndex = 1, .offset = 0, .length = sizeof(output)},
+             .dimensions = {}}};
+
+    CpuExecutor executor;
+    for (int run = 0; run < 3; run++) {
+        input[0] = -1.0f - run;
+        ASSERT_EQ(executor.run(preparedModel, request, requestPoolInfos),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(output[0], 1.0f + run);
+        EXPECT_EQ(output[1], 2.0f);
+        EXPECT_EQ(output[2], 3.0f);
+        EXPECT_EQ(output[3], 4.0f);
+        ASSERT_EQ(executor.getOutputShapes().size(), 1u);
+        EXPECT_TRUE(executor.getOutputShapes()[0].isSufficient);
+    }
+}
+
+TEST(CpuExecutorTest, SingleRunIsNotPlanned) {
+    const Model model = makeBranchesModel();
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel preparedModel = CpuPreparedModel::createForSingleRun(
+            model, modelPoolInfos, BuiltinOperationResolver::get());
+    EXPECT_EQ(preparedModel.getMemoryPlan().getArenaSize(), 0u);
+    EXPECT_FALSE(preparedModel.getMemoryPlan().isPlanned(1));
+    EXPECT_EQ(preparedModel.getOperationGraph(), nullptr);
+    EXPECT_EQ(&preparedModel.getModel(), &model);
+
+    float input[4] = {-1.0f, 2.0f, -3.0f, 4.0f};
+    float output[4] = {};
+    ASSERT_EQ(runPreparedModel(preparedModel, {input, output}, {sizeof(input), sizeof(output)}),
+              ANEURALNETWORKS_NO_ERROR);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(output[i], 2.0f * std::abs(input[i]));
+    }
+}
+
+TEST(CpuExecutorTest, ReusePreparedModelWithDynamicShapes) {
+    // input -> ABS -> t1 -> ABS -> output, with the length known at execution
+    // time only.
+    const Model model = makeChainModel({{0}, {0}, {0}});
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel preparedModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+
+    float input[4] = {-1.0f, 2.0f, -3.0f, 4.0f};
+    float output[4] = {};
+    const std::vector<RunTimePoolInfo> requestPoolInfos = {
+            RunTimePoolInfo::createFromExistingBuffer(reinterpret_cast<uint8_t*>(input)),
+            RunTimePoolInfo::createFromExistingBuffer(reinterpret_cast<uint8_t*>(output)),
+    };
+    CpuExecutor executor;
+    // The shapes that a run computes must not carry over to the next one.
+    for (uint32_t length : {4u, 2u, 3u}) {
+        Request request;
+        request.inputs = hidl_vec<RequestArgument>{
+                {.hasNoValue = false,
+                 .location = {.poolIndex = 0, .offset = 0, .length = length * sizeof(float)},
+                 .dimensions = {length}}};
+        request.outputs = hidl_vec<RequestArgument>{
+                {.hasNoValue = false,
+                 .location = {.poolIndex = 1, .offset = 0, .length = sizeof(output)},
+                 .dimensions = {}}};
+        ASSERT_EQ(executor.run(preparedModel, request, requestPoolInfos),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(executor.getOutputShapes().size(), 1u);
+        EXPECT_EQ(executor.getOutputShapes()[0].dimensions, std::vector<uint32_t>({length}));
+        for (uint32_t i = 0; i < length; i++) {
+            EXPECT_EQ(output[i], std::abs(input[i]));
+        }
+    }
+}
+
+TEST(CpuExecutorTest, ReshapeView) {
+    const Model model = makeReshapeModel();
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel preparedModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+    ASSERT_EQ(preparedModel.getMemoryPlan().getNumViews(), 1u);
+
+    float input[4] = {-1.0f, 2.0f, -3.0f, 4.0f};
+    float output[4] = {};
+    Request request;
+    request.inputs = hidl_vec<RequestArgument>{
+            {.hasNoValue = false,
+             .location = {.poolIndex = 0, .offset = 0, .length = sizeof(input)},
+             .dimensions = {}}};
+    request.outputs = hidl_vec<RequestArgument>{
+            {.hasNoValue = false,
+             .location = {.poolIndex = 1, .offset = 0, .length = sizeof(output)},
+             .dimensions = {}}};
+
+    CpuExecutor executor;
+    ASSERT_EQ(executor.run(preparedModel, request,
+                           {RunTimePoolInfo::createFromExistingBuffer(
+                                    reinterpret_cast<uint8_t*>(input)),
+                            RunTimePoolInfo::createFromExistingBuffer(
+                                    reinterpret_cast<uint8_t*>(output))}),
+              ANEURALNETWORKS_NO_ERROR);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(output[i], std::abs(input[i]));
+    }
+    ASSERT_EQ(executor.getOutputShapes().size(), 1u);
+    EXPECT_EQ(executor.getOutputShapes()[0].dimensions, std::vector<uint32_t>({2, 2}));
+}
+
+TEST(CpuExecutorTest, FusedUnaryChain) {
+    // input -> NEG -> t1 -> EXP -> t2 -> RELU6 -> output
+    Model model = makeChainModel({{8}, {8}, {8}, {8}});
+    model.operations[0].type = OperationType::NEG;
+    model.operations[1].type = OperationType::EXP;
+    model.operations[2].type = OperationType::RELU6;
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel fusedModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+    const CpuPreparedModel unfusedModel = CpuPreparedModel::create(
+            model, modelPoolInfos, BuiltinOperationResolver::get(), nullptr, false);
+    ASSERT_EQ(fusedModel.getModel().operations.size(), 1u);
+    ASSERT_EQ(unfusedModel.getModel().operations.size(), 3u);
+
+    float input[8] = {-3.0f, -1.5f, -0.25f, 0.0f, 0.1f, 1.0f, 2.5f, 100.0f};
+    float fusedOutput[8] = {};
+    float unfusedOutput[8] = {};
+    ASSERT_EQ(runPreparedModel(fusedModel, {input, fusedOutput}, {sizeof(input), sizeof(input)}),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(runPreparedModel(unfusedModel, {input, unfusedOutput},
+                               {sizeof(input), sizeof(input)}),
+              ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(memcmp(fusedOutput, unfusedOutput, sizeof(fusedOutput)), 0);
+    EXPECT_EQ(fusedOutput[0], 6.0f);
+}
+
+TEST(CpuExecutorTest, FusedUnaryChainDenseInputs) {
+    // Every multiple of 1/1024 in [-20, 20), and some arguments of SIN that
+    // are too large for the vectorized implementation.
+    constexpr uint32_t kSize = 40 * 1024;
+    std::vector<float> input(kSize);
+    for (uint32_t i = 0; i < kSize; i++) {
+        input[i] = -20.0f + i / 1024.0f;
+    }
+    for (uint32_t i = 0; i < kSize; i += 1000) {
+        input[i] *= 1e4f;
+    }
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    for (OperationType type :
+         {OperationType::ABS, OperationType::EXP, OperationType::LOG, OperationType::NEG,
+          OperationType::RSQRT, OperationType::SIN, OperationType::SQRT, OperationType::RELU,
+          OperationType::RELU1, OperationType::RELU6, OperationType::LOGISTIC,
+          OperationType::TANH}) {
+        SCOPED_TRACE(getOperationName(type));
+        // input -> NEG -> t1 -> type -> output
+        Model model = makeChainModel({{kSize}, {kSize}, {kSize}});
+        model.operations[0].type = OperationType::NEG;
+        model.operations[1].type = type;
+        const CpuPreparedModel fusedModel = CpuPreparedModel::create(
+                model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+        const CpuPreparedModel unfusedModel = CpuPreparedModel::create(
+                model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool, false);
+        ASSERT_EQ(fusedModel.getModel().operations.size(), 1u);
+
+        std::vector<float> fusedOutput(kSize), unfusedOutput(kSize);
+        const uint32_t length = kSize * sizeof(float);
+        ASSERT_EQ(runPreparedModel(fusedModel, {input.data(), fusedOutput.data()},
+                                   {length, length}),
+                  ANEURALNETWORKS_NO_ERROR);
+        ASSERT_EQ(runPreparedModel(unfusedModel, {input.data(), unfusedOutput.data()},
+                                   {length, length}),
+                  ANEURALNETWORKS_NO_ERROR);
+        EXPECT_EQ(memcmp(fusedOutput.data(), unfusedOutput.data(), length), 0);
+    }
+}
+
+TEST(CpuExecutorTest, FusedResidualAddFloat32) {
+    const Model model = makeResidualModel(OperandType::TENSOR_FLOAT32);
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel fusedModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+    const CpuPreparedModel unfusedModel = CpuPreparedModel::create(
+            model, modelPoolInfos, BuiltinOperationResolver::get(), nullptr, false);
+    ASSERT_EQ(fusedModel.getModel().operations.size(), 1u);
+
+    float input[4] = {1.0f, -2.0f, 0.5f, 3.0f};
+    float addend[3] = {0.5f, -10.0f, 1.0f};
+    float fusedOutput[3] = {};
+    float unfusedOutput[3] = {};
+    const std::vector<uint32_t> lengths = {sizeof(input), sizeof(addend), sizeof(fusedOutput)};
+    ASSERT_EQ(runPreparedModel(fusedModel, {input, addend, fusedOutput}, lengths),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(runPreparedModel(unfusedModel, {input, addend, unfusedOutput}, lengths),
+              ANEURALNETWORKS_NO_ERROR);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_FLOAT_EQ(fusedOutput[i], unfusedOutput[i]);
+    }
+    // RELU(-1 - 1 + 1 + 0.75 - 0.5 + 0.5)
+    EXPECT_EQ(fusedOutput[0], 0.0f);
+}
+
+TEST(CpuExecutorTest, FusedResidualAddQuant8IsExact) {
+    const Model model = makeResidualModel(OperandType::TENSOR_QUANT8_ASYMM);
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel fusedModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+    const CpuPreparedModel unfusedModel = CpuPreparedModel::create(
+            model, modelPoolInfos, BuiltinOperationResolver::get(), nullptr, false);
+    ASSERT_EQ(fusedModel.getModel().operations.size(), 1u);
+
+    uint8_t input[4] = {0, 100, 200, 255};
+    uint8_t addend[3] = {10, 120, 250};
+    uint8_t fusedOutput[3] = {};
+    uint8_t unfusedOutput[3] = {};
+    const std::vector<uint32_t> lengths = {sizeof(input), sizeof(addend), sizeof(fusedOutput)};
+    ASSERT_EQ(runPreparedModel(fusedModel, {input, addend, fusedOutput}, lengths),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(runPreparedModel(unfusedModel, {input, addend, unfusedOutput}, lengths),
+              ANEURALNETWORKS_NO_ERROR);
+    EXPECT_EQ(memcmp(fusedOutput, unfusedOutput, sizeof(fusedOutput)), 0);
+}
+
+TEST(CpuExecutorTest, SoftmaxFloat32MatchesReference) {
+    struct TestCase {
+        std::vector<uint32_t> dimensions;
+        int32_t axis;
+    };
+    const TestCase testCases[] = {
+            // The innermost axis.
+            {{3, 37}, -1},
+            // More than one tile of 256, the last one partial.
+            {{2, 3, 300}, 1},
+            // An axis size that is not a multiple of the block size of 8.
+            {{4, 13, 20}, 1},
+            // Attention scores [B, H, S, S], normalized over the queries.
+            {{2, 3, 37, 37}, -2},
+    };
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    for (OperationType operationType : {OperationType::SOFTMAX, OperationType::LOG_SOFTMAX}) {
+        for (const TestCase& testCase : testCases) {
+            SCOPED_TRACE(getOperationName(operationType) + " " +
+                         toString(testCase.dimensions) + " axis " +
+                         std::to_string(testCase.axis));
+            const Model model = makeSoftmaxModel(operationType, OperandType::TENSOR_FLOAT32,
+                                                 testCase.dimensions, testCase.axis);
+            const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+                    model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+            const uint32_t size = getElementCount(testCase.dimensions);
+            std::vector<float> input(size), output(size);
+            std::vector<double> referenceInput(size);
+            for (uint32_t i = 0; i < size; i++) {
+                input[i] = getSoftmaxInput(i);
+                referenceInput[i] = input[i];
+            }
+            const uint32_t length = size * sizeof(float);
+            ASSERT_EQ(runPreparedModel(preparedModel, {input.data(), output.data()},
+                                       {length, length}),
+                      ANEURALNETWORKS_NO_ERROR);
+            const bool isLog = operationType == OperationType::LOG_SOFTMAX;
+            const std::vector<double> reference = computeSoftmaxReference(
+                    referenceInput, testCase.dimensions, testCase.axis, isLog);
+            for (uint32_t i = 0; i < size; i++) {
+                ASSERT_NEAR(output[i], reference[i], 1e-5 * std::max(1.0, std::abs(reference[i])))
+                        << "at " << i;
+            }
+        }
+    }
+}
+
+TEST(CpuExecutorTest, SoftmaxQuant8MatchesReference) {
+    struct TestCase {
+        std::vector<uint32_t> dimensions;
+        int32_t axis;
+    };
+    const TestCase testCases[] = {
+            // The innermost axis, computed by TFLite.
+            {{3, 37}, -1},
+            // The table path: more than one tile, and an axis size that is not
+            // a multiple of 8.
+            {{2, 11, 300}, 1},
+            // Attention scores [B, H, S, S], normalized over the queries.
+            {{1, 2, 37, 37}, -2},
+    };
+    constexpr float kScale = 0.0625f;
+    constexpr int32_t kZeroPoint = 128;
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    for (const TestCase& testCase : testCases) {
+        SCOPED_TRACE(toString(testCase.dimensions) + " axis " + std::to_string(testCase.axis));
+        const Model model =
+                makeSoftmaxModel(OperationType::SOFTMAX, OperandType::TENSOR_QUANT8_ASYMM,
+                                 testCase.dimensions, testCase.axis, kScale, kZeroPoint);
+        const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+                model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+        const uint32_t size = getElementCount(testCase.dimensions);
+        std::vector<uint8_t> input(size), output(size);
+        std::vector<double> referenceInput(size);
+        for (uint32_t i = 0; i < size; i++) {
+            input[i] = static_cast<uint8_t>(
+                    std::min(kZeroPoint + getSoftmaxInput(i) / kScale, 255.0f));
+            referenceInput[i] = kScale * (input[i] - kZeroPoint);
+        }
+        ASSERT_EQ(runPreparedModel(preparedModel, {input.data(), output.data()}, {size, size}),
+                  ANEURALNETWORKS_NO_ERROR);
+        const std::vector<double> reference = computeSoftmaxReference(
+                referenceInput, testCase.dimensions, testCase.axis, /*isLog=*/false);
+        for (uint32_t i = 0; i < size; i++) {
+            const double expected = std::min(std::round(reference[i] * 256), 255.0);
+            ASSERT_NEAR(output[i], expected, 1.0) << "at " << i;
+        }
+    }
+}
+
+TEST(CpuExecutorTest, BinaryFloat16MatchesFloat32) {
+    struct TestCase {
+        std::vector<uint32_t> dimensions1;
+        std::vector<uint32_t> dimensions2;
+    };
+    // The output is {64, 129}, which is split across the threads.
+    const TestCase testCases[] = {
+            // The same shape.
+            {{64, 129}, {64, 129}},
+            // A scalar operand, on either side.
+            {{64, 129}, {1}},
+            {{1}, {64, 129}},
+            // A row broadcast along the first dimension.
+            {{64, 129}, {129}},
+            // A column broadcast along the second dimension.
+            {{64, 129}, {64, 1}},
+            {{64, 1}, {1, 129}},
+    };
+    const std::vector<uint32_t> outputDimensions = {64, 129};
+    const uint32_t outputSize = getElementCount(outputDimensions);
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    for (OperationType operationType : {OperationType::ADD, OperationType::MUL,
+                                        OperationType::SUB, OperationType::DIV}) {
+        for (int32_t activation :
+             {ANEURALNETWORKS_FUSED_NONE, ANEURALNETWORKS_FUSED_RELU,
+              ANEURALNETWORKS_FUSED_RELU1, ANEURALNETWORKS_FUSED_RELU6}) {
+            for (const TestCase& testCase : testCases) {
+                SCOPED_TRACE(getOperationName(operationType) + " activation " +
+                             std::to_string(activation) + " " +
+                             toString(testCase.dimensions1) + " " +
+                             toString(testCase.dimensions2));
+                const Model model =
+                        makeBinaryModel(operationType, OperandType::TENSOR_FLOAT16,
+                                        testCase.dimensions1, testCase.dimensions2,
+                                        outputDimensions, activation);
+                const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+                        model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+
+                // Multiples of 1/16 in [-3, 3), and nonzero divisors.
+                std::vector<_Float16> input1(getElementCount(testCase.dimensions1));
+                std::vector<_Float16> input2(getElementCount(testCase.dimensions2));
+                for (uint32_t i = 0; i < input1.size(); i++) {
+                    input1[i] = static_cast<_Float16>((i % 97 - 48.0f) / 16);
+                }
+                for (uint32_t i = 0; i < input2.size(); i++) {
+                    input2[i] = static_cast<_Float16>((i * 7 % 89 - 44.5f) / 16);
+                }
+                std::vector<_Float16> output(outputSize);
+                const std::vector<uint32_t> lengths = {
+                        static_cast<uint32_t>(input1.size() * sizeof(_Float16)),
+                        static_cast<uint32_t>(input2.size() * sizeof(_Float16)),
+                        static_cast<uint32_t>(output.size() * sizeof(_Float16))};
+                ASSERT_EQ(runPreparedModel(preparedModel,
+                                           {input1.data(), input2.data(), output.data()}, lengths),
+                          ANEURALNETWORKS_NO_ERROR);
+
+                // The result rounded from float32 to float16.
+                const uint32_t columns = outputDimensions[1];
+                auto getInput = [columns](const std::vector<_Float16>& input,
+                                          const std::vector<uint32_t>& dimensions,
+                                          uint32_t index) {
+                    const uint32_t row = dimensions.size() == 2 && dimensions[0] > 1
+                                                 ? index / columns
+                                                 : 0;
+                    const uint32_t column = dimensions.back() > 1 ? index % columns : 0;
+                    return static_cast<float>(input[row * dimensions.back() + column]);
+                };
+                for (uint32_t i = 0; i < outputSize; i++) {
+                    const float a = getInput(input1, testCase.dimensions1, i);
+                    const float b = getInput(input2, testCase.dimensions2, i);
+                    float expected = operationType == OperationType::ADD   ? a + b
+                                     : operationType == OperationType::MUL ? a * b
+                                     : operationType == OperationType::SUB ? a - b
+                                                                           : a / b;
+                    if (activation == ANEURALNETWORKS_FUSED_RELU) {
+                        expected = std::max(expected, 0.0f);
+                    } else if (activation == ANEURALNETWORKS_FUSED_RELU1) {
+                        expected = std::min(std::max(expected, -1.0f), 1.0f);
+                    } else if (activation == ANEURALNETWORKS_FUSED_RELU6) {
+                        expected = std::min(std::max(expected, 0.0f), 6.0f);
+                    }
+                    ASSERT_EQ(static_cast<float>(output[i]),
+                              static_cast<float>(static_cast<_Float16>(expected)))
+                            << "at " << i;
+                }
+            }
+        }
+    }
+}
+
+// Reports the time of a float16 residual connection, an ADD of two tensors of
+// the same shape, per element.
+TEST(CpuExecutorTest, ResidualAddFloat16) {
+    constexpr int kNumRuns = 20;
+    const std::vector<uint32_t> dimensions = {1, 56, 56, 256};
+    const uint32_t size = getElementCount(dimensions);
+    const Model model = makeBinaryModel(OperationType::ADD, OperandType::TENSOR_FLOAT16,
+                                        dimensions, dimensions, dimensions,
+                                        ANEURALNETWORKS_FUSED_NONE);
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+            model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+
+    std::vector<_Float16> input(size, static_cast<_Float16>(1.5f));
+    std::vector<_Float16> residual(size, static_cast<_Float16>(0.25f));
+    std::vector<_Float16> output(size);
+    const uint32_t length = size * sizeof(_Float16);
+    const auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < kNumRuns; run++) {
+        ASSERT_EQ(runPreparedModel(preparedModel, {input.data(), residual.data(), output.data()},
+                                   {length, length, length}),
+                  ANEURALNETWORKS_NO_ERROR);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(static_cast<float>(output[size - 1]), 1.75f);
+    const auto picoseconds =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() * 1000;
+    RecordProperty("picosecondsPerElement", static_cast<int>(picoseconds / (kNumRuns * size)));
+}
+
+// Reports the time of a float32 ADD on rank-4 tensors per output element, with
+// the second operand of the same shape or broadcast from a scalar, a row of
+// channels, or a column of pixels.
+TEST(CpuExecutorTest, BroadcastAdd) {
+    struct TestCase {
+        const char* name;
+        std::vector<uint32_t> dimensions2;
+    };
+    const TestCase testCases[] = {
+            {"SameShape", {1, 56, 56, 256}},
+            {"Scalar", {1}},
+            {"Row", {256}},
+            {"Column", {1, 56, 56, 1}},
+    };
+    constexpr int kNumRuns = 20;
+    const std::vector<uint32_t> dimensions = {1, 56, 56, 256};
+    const uint32_t size = getElementCount(dimensions);
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    for (const TestCase& testCase : testCases) {
+        SCOPED_TRACE(testCase.name);
+        const Model model = makeBinaryModel(OperationType::ADD, OperandType::TENSOR_FLOAT32,
+                                            dimensions, testCase.dimensions2, dimensions,
+                                            ANEURALNETWORKS_FUSED_NONE);
+        const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+                model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+
+        std::vector<uint8_t> input1 = makeTestData(OperandType::TENSOR_FLOAT32, size);
+        std::vector<uint8_t> input2 = makeTestData(OperandType::TENSOR_FLOAT32,
+                                                   getElementCount(testCase.dimensions2));
+        std::vector<uint8_t> output(size * sizeof(float));
+        const int64_t nanoseconds = timePreparedModel(
+                preparedModel, {input1.data(), input2.data(), output.data()},
+                {static_cast<uint32_t>(input1.size()), static_cast<uint32_t>(input2.size()),
+                 static_cast<uint32_t>(output.size())},
+                kNumRuns);
+        // The last element adds the last element of either operand.
+        const float* values1 = reinterpret_cast<const float*>(input1.data());
+        const float* values2 = reinterpret_cast<const float*>(input2.data());
+        EXPECT_EQ(reinterpret_cast<const float*>(output.data())[size - 1],
+                  values1[size - 1] + values2[getElementCount(testCase.dimensions2) - 1]);
+        RecordProperty(std::string(testCase.name) + "PicosecondsPerElement",
+                       static_cast<int>(nanoseconds * 1000 / size));
+    }
+}
+
+TEST(CpuExecutorTest, ScopedThreadScratchBuffer) {
+    uint8_t* ownBuffer = getThreadScratchBuffer();
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[kThreadScratchBufferSize]);
+    {
+        const ScopedThreadScratchBuffer scratchBuffer(buffer.get());
+        EXPECT_EQ(getThreadScratchBuffer(), buffer.get());
+        {
+            const ScopedThreadScratchBuffer noBuffer(nullptr);
+            EXPECT_EQ(getThreadScratchBuffer(), buffer.get());
+        }
+        EXPECT_EQ(getThreadScratchBuffer(), buffer.get());
+    }
+    EXPECT_EQ(getThreadScratchBuffer(), ownBuffer);
+}
+
+// Reports the time spent per operation on tiny tensors, where the cost of
+// dispatching the operations dominates.
+TEST(CpuExecutorTest, DispatchOverhead) {
+    constexpr uint32_t kNumOperations = 500;
+    constexpr int kNumRuns = 100;
+    const Model model = makeAddChainModel(kNumOperations);
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    const CpuPreparedModel preparedModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get());
+    for (uint32_t i = 0; i < kNumOperations; i++) {
+        const CpuPreparedModel::OperationStep& step = preparedModel.getOperationStep(i);
+        ASSERT_NE(step.registration, nullptr);
+        EXPECT_FALSE(step.checkZeroSizedInputs);
+        EXPECT_FALSE(step.freesInputs);
+    }
+
+    float input = 1.0f;
+    float output = 0.0f;
+    const auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < kNumRuns; run++) {
+        ASSERT_EQ(runPreparedModel(preparedModel, {&input, &output},
+                                   {sizeof(input), sizeof(output)}),
+                  ANEURALNETWORKS_NO_ERROR);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(output, kNumOperations + 1.0f);
+    const auto nanoseconds =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    RecordProperty("nanosecondsPerOperation",
+                   static_cast<int>(nanoseconds / (kNumRuns * kNumOperations)));
+}
+
+// Reports the speedup of running the branches of a model in parallel over
+// running its operations one after the other.  The operations are too small to
+// be split across threads themselves, so only the scheduler runs them in
+// parallel.
+TEST(CpuExecutorTest, ParallelOperationsSpeedup) {
+    constexpr uint32_t kNumBranches = 8;
+    constexpr uint32_t kDepth = 16;
+    constexpr uint32_t kSize = 4096;
+    constexpr int kNumRuns = 20;
+    const Model model = makeTanhBranchesModel(kNumBranches, kDepth, kSize);
+    const uint32_t operationCount = model.operations.size();
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    // Without fusion, each TANH is an operation of its own.
+    const CpuPreparedModel sequentialModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get(),
+                                     &threadPool, /*allowFusion=*/false);
+    const CpuPreparedModel parallelModel =
+            CpuPreparedModel::create(model, modelPoolInfos, BuiltinOperationResolver::get(),
+                                     &threadPool, /*allowFusion=*/false,
+                                     /*parallelOperations=*/true);
+    ASSERT_NE(parallelModel.getOperationGraph(), nullptr);
+
+    std::vector<float> input(kSize);
+    for (uint32_t i = 0; i < kSize; i++) {
+        input[i] = getSoftmaxInput(i);
+    }
+    const uint32_t length = kSize * sizeof(float);
+    auto timeRuns = [&input, length](const CpuPreparedModel& preparedModel,
+                                     std::vector<float>* output) {
+        output->resize(input.size());
+        const auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < kNumRuns; run++) {
+            EXPECT_EQ(runPreparedModel(preparedModel, {input.data(), output->data()},
+                                       {length, length}),
+                      ANEURALNETWORKS_NO_ERROR);
+        }
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                .count();
+    };
+    std::vector<float> sequentialOutput, parallelOutput;
+    const auto sequentialNanoseconds = timeRuns(sequentialModel, &sequentialOutput);
+    const auto parallelNanoseconds = timeRuns(parallelModel, &parallelOutput);
+    EXPECT_EQ(parallelOutput, sequentialOutput);
+    RecordProperty("sequentialNanosecondsPerOperation",
+                   static_cast<int>(sequentialNanoseconds / (kNumRuns * operationCount)));
+    RecordProperty("parallelNanosecondsPerOperation",
+                   static_cast<int>(parallelNanoseconds / (kNumRuns * operationCount)));
+    RecordProperty("speedupPercent", static_cast<int>(100 * sequentialNanoseconds /
+                                                      std::max<int64_t>(parallelNanoseconds, 1)));
+}
+
+// Reports the time of the grouped pointwise convolutions of a ShuffleNet unit
+// with 3 groups, which compress 240 channels to 60 and expand them back, per
+// multiply-accumulate.
+TEST(CpuExecutorTest, ShuffleNetGroupedConv) {
+    struct TestCase {
+        const char* name;
+        uint32_t inDepth;
+        uint32_t outDepth;
+    };
+    const TestCase testCases[] = {{"Compress", 240, 60}, {"Expand", 60, 240}};
+    constexpr uint32_t kNumGroups = 3;
+    constexpr uint32_t kSize = 28;
+    constexpr int kNumRuns = 20;
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    for (OperandType type : {OperandType::TENSOR_FLOAT32, OperandType::TENSOR_QUANT8_ASYMM}) {
+        const bool isQuant = type == OperandType::TENSOR_QUANT8_ASYMM;
+        for (const TestCase& testCase : testCases) {
+            const std::string name = (isQuant ? "quant8" : "float32") + std::string(testCase.name);
+            SCOPED_TRACE(name);
+            const uint32_t groupDepth = testCase.inDepth / kNumGroups;
+            const std::vector<uint32_t> inputDimensions = {1, kSize, kSize, testCase.inDepth};
+            const std::vector<uint32_t> outputDimensions = {1, kSize, kSize, testCase.outDepth};
+            const std::vector<uint8_t> filter =
+                    makeTestData(type, testCase.outDepth * groupDepth);
+            OperationModelBuilder builder;
+            builder.addInput(type, inputDimensions, isQuant ? 0.5f : 0.0f, isQuant ? 128 : 0);
+            builder.addConstant(type, {testCase.outDepth, 1, 1, groupDepth}, filter,
+                                isQuant ? 0.25f : 0.0f, isQuant ? 128 : 0);
+            if (isQuant) {
+                std::vector<int32_t> bias(testCase.outDepth);
+                std::iota(bias.begin(), bias.end(), -100);
+                builder.addConstant(OperandType::TENSOR_INT32, {testCase.outDepth}, bias,
+                                    0.5f * 0.25f);
+            } else {
+                builder.addConstant(type, {testCase.outDepth},
+                                    makeTestData(type, testCase.outDepth));
+            }
+            builder.addInt32(ANEURALNETWORKS_PADDING_VALID);
+            builder.addInt32(1);  // stride_width
+            builder.addInt32(1);  // stride_height
+            builder.addInt32(kNumGroups);
+            builder.addInt32(ANEURALNETWORKS_FUSED_RELU);
+            builder.addBool(false);  // NHWC
+            const Model model = builder.build(OperationType::GROUPED_CONV_2D, type,
+                                              outputDimensions, isQuant ? 1.0f : 0.0f,
+                                              isQuant ? 128 : 0);
+            const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+                    model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+
+            std::vector<uint8_t> input = makeTestData(type, getElementCount(inputDimensions));
+            std::vector<uint8_t> output(getElementCount(outputDimensions) *
+                                        (isQuant ? sizeof(uint8_t) : sizeof(float)));
+            const int64_t nanoseconds = timePreparedModel(
+                    preparedModel, {input.data(), output.data()},
+                    {static_cast<uint32_t>(input.size()), static_cast<uint32_t>(output.size())},
+                    kNumRuns);
+            if (!isQuant) {
+                // The first output channel of the first pixel sees the first group.
+                const float* inputValues = reinterpret_cast<const float*>(input.data());
+                const float* filterValues = reinterpret_cast<const float*>(filter.data());
+                float expected = getSoftmaxInput(0) / 8.0f;
+                for (uint32_t i = 0; i < groupDepth; i++) {
+                    expected += inputValues[i] * filterValues[i];
+                }
+                EXPECT_NEAR(reinterpret_cast<const float*>(output.data())[0],
+                            std::max(expected, 0.0f), 1e-4f);
+            }
+            const uint64_t numMacs =
+                    uint64_t(kSize) * kSize * testCase.outDepth * groupDepth;
+            RecordProperty(name + "PicosecondsPerMac",
+                           static_cast<int>(nanoseconds * 1000 / numMacs));
+        }
+    }
+}
+
+// Reports the time of TRANSPOSE_CONV_2D per multiply-accumulate, on the shapes
+// of the transpose_conv2d spec scaled up to the size of a decoder layer.
+TEST(CpuExecutorTest, TransposeConv2D) {
+    struct TestCase {
+        const char* name;
+        std::vector<uint32_t> inputDimensions;
+        std::vector<uint32_t> filterDimensions;
+        std::vector<uint32_t> outputDimensions;
+        int32_t padding;
+        int32_t stride;
+        // The padding on the top and the left that the padding scheme implies.
+        int32_t paddingBefore;
+    };
+    const TestCase testCases[] = {
+            // {1, 2, 2, 1} to {1, 5, 5, 2} with a stride of 2.
+            {"Stride2Valid", {1, 32, 32, 32}, {64, 3, 3, 32}, {1, 65, 65, 64},
+             ANEURALNETWORKS_PADDING_VALID, 2, 0},
+            // {1, 4, 4, 2} to {1, 4, 4, 1} with a stride of 1.
+            {"Stride1Same", {1, 64, 64, 32}, {32, 3, 3, 32}, {1, 64, 64, 32},
+             ANEURALNETWORKS_PADDING_SAME, 1, 1},
+    };
+    constexpr int kNumRuns = 10;
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    for (OperandType type : {OperandType::TENSOR_FLOAT32, OperandType::TENSOR_QUANT8_ASYMM}) {
+        const bool isQuant = type == OperandType::TENSOR_QUANT8_ASYMM;
+        for (const TestCase& testCase : testCases) {
+            const std::string name = (isQuant ? "quant8" : "float32") + std::string(testCase.name);
+            SCOPED_TRACE(name);
+            const uint32_t outDepth = testCase.filterDimensions[0];
+            const int32_t filterWidth = testCase.filterDimensions[2];
+            const uint32_t inDepth = testCase.filterDimensions[3];
+            const std::vector<uint8_t> filter =
+                    makeTestData(type, getElementCount(testCase.filterDimensions));
+            OperationModelBuilder builder;
+            builder.addInput(type, testCase.inputDimensions, isQuant ? 0.5f : 0.0f,
+                             isQuant ? 128 : 0);
+            builder.addConstant(type, testCase.filterDimensions, filter, isQuant ? 0.25f : 0.0f,
+                                isQuant ? 128 : 0);
+            if (isQuant) {
+                std::vector<int32_t> bias(outDepth);
+                std::iota(bias.begin(), bias.end(), -100);
+                builder.addConstant(OperandType::TENSOR_INT32, {outDepth}, bias, 0.5f * 0.25f);
+            } else {
+                builder.addConstant(type, {outDepth}, makeTestData(type, outDepth));
+            }
+            const std::vector<int32_t> outputShape(testCase.outputDimensions.begin(),
+                                                   testCase.outputDimensions.end());
+            builder.addConstant(OperandType::TENSOR_INT32, {4}, outputShape);
+            builder.addInt32(testCase.padding);
+            builder.addInt32(testCase.stride);  // stride_width
+            builder.addInt32(testCase.stride);  // stride_height
+            builder.addInt32(ANEURALNETWORKS_FUSED_NONE);
+            builder.addBool(false);  // NHWC
+            const Model model = builder.build(OperationType::TRANSPOSE_CONV_2D, type,
+                                              testCase.outputDimensions, isQuant ? 8.0f : 0.0f,
+                                              isQuant ? 128 : 0);
+            const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+                    model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+
+            std::vector<uint8_t> input =
+                    makeTestData(type, getElementCount(testCase.inputDimensions));
+            std::vector<uint8_t> output(getElementCount(testCase.outputDimensions) *
+                                        (isQuant ? sizeof(uint8_t) : sizeof(float)));
+            const int64_t nanoseconds = timePreparedModel(
+                    preparedModel, {input.data(), output.data()},
+                    {static_cast<uint32_t>(input.size()), static_cast<uint32_t>(output.size())},
+                    kNumRuns);
+            if (!isQuant) {
+                // The first output channel of the first pixel gathers the taps
+                // that the filter places there from each input pixel.
+                const float* inputValues = reinterpret_cast<const float*>(input.data());
+                const float* filterValues = reinterpret_cast<const float*>(filter.data());
+                const int32_t inHeight = testCase.inputDimensions[1];
+                const int32_t inWidth = testCase.inputDimensions[2];
+                float expected = getSoftmaxInput(0) / 8.0f;
+                for (int32_t inY = 0; inY < inHeight; inY++) {
+                    for (int32_t inX = 0; inX < inWidth; inX++) {
+                        // The filters are square.
+                        const int32_t filterY = testCase.paddingBefore - testCase.stride * inY;
+                        const int32_t filterX = testCase.paddingBefore - testCase.stride * inX;
+                        if (filterY < 0 || filterY >= filterWidth || filterX < 0 ||
+                            filterX >= filterWidth) {
+                            continue;
+                        }
+                        const float* inputPixel = inputValues + (inY * inWidth + inX) * inDepth;
+                        const float* filterTap =
+                                filterValues + (filterY * filterWidth + filterX) * inDepth;
+                        for (uint32_t c = 0; c < inDepth; c++) {
+                            expected += inputPixel[c] * filterTap[c];
+                        }
+                    }
+                }
+                EXPECT_NEAR(reinterpret_cast<const float*>(output.data())[0], expected, 1e-4f);
+            }
+            const uint64_t numMacs = uint64_t(getElementCount(testCase.inputDimensions)) *
+                                     filterWidth * filterWidth * outDepth;
+            RecordProperty(name + "PicosecondsPerMac",
+                           static_cast<int>(nanoseconds * 1000 / numMacs));
+        }
+    }
+}
+
+// Reports the time of the reductions per input element, on the global average
+// pool at the end of MobileNet and on reductions over axis 1, whose inner
+// dimension stays contiguous.
+TEST(CpuExecutorTest, Reduce) {
+    struct TestCase {
+        const char* name;
+        OperationType operationType;
+        std::vector<uint32_t> inputDimensions;
+        std::vector<int32_t> axes;
+        std::vector<uint32_t> outputDimensions;
+    };
+    const TestCase testCases[] = {
+            {"MeanGlobalAveragePool", OperationType::MEAN, {1, 7, 7, 1024}, {1, 2},
+             {1, 1, 1, 1024}},
+            {"MeanAxis1", OperationType::MEAN, {8, 512, 256}, {1}, {8, 1, 256}},
+            {"SumAxis1", OperationType::REDUCE_SUM, {8, 512, 256}, {1}, {8, 1, 256}},
+            {"MaxAxis1", OperationType::REDUCE_MAX, {8, 512, 256}, {1}, {8, 1, 256}},
+    };
+    constexpr int kNumRuns = 20;
+    const std::vector<RunTimePoolInfo> modelPoolInfos;
+    ThreadPool threadPool(4);
+    const OperandType type = OperandType::TENSOR_FLOAT32;
+    for (const TestCase& testCase : testCases) {
+        SCOPED_TRACE(testCase.name);
+        OperationModelBuilder builder;
+        builder.addInput(type, testCase.inputDimensions);
+        builder.addConstant(OperandType::TENSOR_INT32,
+                            {static_cast<uint32_t>(testCase.axes.size())}, testCase.axes);
+        // MEAN takes keep_dims as an INT32, the other reductions as a BOOL.
+        if (testCase.operationType == OperationType::MEAN) {
+            builder.addInt32(1);
+        } else {
+            builder.addBool(true);
+        }
+        const Model model =
+                builder.build(testCase.operationType, type, testCase.outputDimensions);
+        const CpuPreparedModel preparedModel = CpuPreparedModel::create(
+                model, modelPoolInfos, BuiltinOperationResolver::get(), &threadPool);
+
+        const uint32_t numElements = getElementCount(testCase.inputDimensions);
+        std::vector<uint8_t> input = makeTestData(type, numElements);
+        std::vector<uint8_t> output(getElementCount(testCase.outputDimensions) * sizeof(float));
+        const int64_t nanoseconds = timePreparedModel(
+                preparedModel, {input.data(), output.data()},
+                {static_cast<uint32_t>(input.size()), static_cast<uint32_t>(output.size())},
+                kNumRuns);
+
+        // The first output element reduces the first element of every inner
+        // row, which are the reduced size apart.
+        const float* inputValues = reinterpret_cast<const float*>(input.data());
+        const uint32_t innerSize = testCase.inputDimensions.back();
+        const uint32_t numReduced = numElements / getElementCount(testCase.outputDimensions);
+        float expected = testCase.operationType == OperationType::REDUCE_MAX
+                                 ? std::numeric_limits<float>::lowest()
+                                 : 0.0f;
+        for (uint32_t i = 0; i < numReduced; i++) {
+            const float value = inputValues[i * innerSize];
+            if (testCase.operationType == OperationType::REDUCE_MAX) {
+                expected = std::max(expected, value);
+            } else {
+                expected += value;
+            }
+        }
+        if (testCase.operationType == OperationType::MEAN) {
+            expected /= numReduced;
+        }
+        EXPECT_NEAR(reinterpret_cast<const float*>(output.data())[0], expected, 1e-3f);
+        RecordProperty(std::string(testCase.name) + "PicosecondsPerElement",
+                       static_cast<int>(nanoseconds * 1000 / numElements));
+    }
+}
+
+}  // namespace
+}  // namespace nn
+}  // namespace android
@@ -66,11 +66,14 @@ private:
 
 void MemoryLeakTest::SetUp() {
     mIsCpuOnly = android::nn::DeviceManager::get()->getUseCpuOnly();
+    // Regions cached by the MemoryPool are not leaks.
+    android::nn::MemoryPool::get()->clear();
     mStartingMapCount = GetAshmemMappingsCount();
 }
 
 void MemoryLeakTest::TearDown() {
     android::nn::DeviceManager::get()->setUseCpuOnly(mIsCpuOnly);
+    android::nn::MemoryPool::get()->clear();
     const size_t endingMapCount = GetAshmemMappingsCount();
     ASSERT_EQ(mStartingMapCount, endingMapCount);
 }
@@ -225,6 +228,35 @@ TEST_F(MemoryLeakTest, Instantiate) {
     close(fd);
 }
 
+TEST_F(MemoryLeakTest, MemoryPool) {
+    using android::nn::MemoryPool;
+    MemoryPool* pool = MemoryPool::get();
+    const uint64_t hits = pool->getNumHits();
+    const uint64_t misses = pool->getNumMisses();
+
+    std::shared_ptr<android::nn::Memory> memory = pool->allocate(100);
+    ASSERT_NE(memory, nullptr);
+    EXPECT_GE(memory->getHidlMemory().size(), 100u);
+    EXPECT_EQ(pool->getNumMisses(), misses + 1);
+    const intptr_t key = memory->getKey();
+    memory.reset();
+
+    // A released region is handed out again for a size of the same class.
+    memory = pool->allocate(200);
+    ASSERT_NE(memory, nullptr);
+    EXPECT_EQ(memory->getKey(), key);
+    EXPECT_EQ(pool->getNumHits(), hits + 1);
+
+    // But not for a larger size class.
+    std::shared_ptr<android::nn::Memory> larger =
+            pool->allocate(MemoryPool::kMinSize + 1);
+    ASSERT_NE(larger, nullptr);
+    EXPECT_GT(larger->getHidlMemory().size(), MemoryPool::kMinSize);
+    EXPECT_EQ(pool->getNumMisses(), misses + 2);
+
+    // The fixture checks that the cached regions are unmapped by clear().
+}
+
 #ifndef NNTEST_ONLY_PUBLIC_API
 // Regression test for http://b/73663843, conv_2d trying to allocate too much memory.
 TEST_F(MemoryLeakTest, convTooLarge) {
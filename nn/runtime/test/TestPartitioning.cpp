@@ -1260,6 +1260,36 @@ TEST_F(PartitioningTest, SimpleModel) {
     }
 }
 
+TEST_F(PartitioningTest, TemporariesShareMemory) {
+    // A chain of four operations alternating between two devices, so that
+    // each operation is a step of its own: opnd2 lives from step 0 to step 1,
+    // opnd4 from step 1 to step 2, and opnd6 from step 2 to step 3.
+    PartitioningModel model;
+    uint32_t opnd0 = model.addFloatOperand();
+    uint32_t opnd1 = model.addFloatOperand();
+    uint32_t opnd2 = model.addOperation2To1V1_0(0, opnd0, opnd1);
+    uint32_t opnd3 = model.addFloatOperand();
+    uint32_t opnd4 = model.addOperation2To1V1_0(1, opnd2, opnd3);
+    uint32_t opnd5 = model.addFloatOperand();
+    uint32_t opnd6 = model.addOperation2To1V1_0(0, opnd4, opnd5);
+    uint32_t opnd7 = model.addFloatOperand();
+    uint32_t opnd8 = model.addOperation2To1V1_0(1, opnd6, opnd7);
+    model.identifyInputsAndOutputs({opnd0, opnd1, opnd3, opnd5, opnd7}, {opnd8});
+    model.finish();
+    ASSERT_TRUE(model.isValid());
+
+    const auto devices = makeDevices({{"0", 0.9, 1 << 0}, {"1", 0.5, 1 << 1}});
+    ExecutionPlan plan;
+    ASSERT_EQ(model.partitionTheWork(devices, ExecutePreference::PREFER_LOW_POWER, &plan),
+              ANEURALNETWORKS_NO_ERROR);
+    ASSERT_EQ(plan.forTest_getKind(), ExecutionPlan::Kind::COMPOUND);
+    ASSERT_EQ(plan.forTest_compoundGetSteps().size(), size_t(4));
+
+    // opnd2 and opnd6 are never alive at the same time, and share memory.
+    EXPECT_EQ(plan.forTest_compoundGetUnsharedSizeOfTemporaries(), 3 * sizeof(float));
+    EXPECT_EQ(plan.forTest_compoundGetSizeOfTemporaries(), 2 * sizeof(float));
+}
+
 TEST_F(PartitioningTest, SliceModel) {
     PartitioningModel model;
     uint32_t opnd0 = model.addFloatOperand();
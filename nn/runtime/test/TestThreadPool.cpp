@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ThreadPool.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace nn {
+namespace {
+
+TEST(ThreadPoolTest, DefaultNumThreads) {
+    EXPECT_GE(ThreadPool::getDefaultNumThreads(), 1u);
+}
+
+TEST(ThreadPoolTest, TaskGroupRunsAllTasks) {
+    ThreadPool threadPool(4);
+    std::atomic<uint32_t> count(0);
+    {
+        TaskGroup taskGroup(&threadPool);
+        for (int i = 0; i < 100; i++) {
+            taskGroup.schedule([&taskGroup, &count] {
+                // Tasks may schedule more tasks to their group.
+                taskGroup.schedule([&count] { count++; });
+                count++;
+            });
+        }
+        taskGroup.wait();
+        EXPECT_EQ(count, 200u);
+    }
+}
+
+TEST(ThreadPoolTest, TaskGroupWaitRunsOnlyItsOwnTasks) {
+    ThreadPool threadPool(1);
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> otherTaskRan(false);
+    TaskGroup otherGroup(&threadPool);
+    // Keeps the only worker busy until released.
+    otherGroup.schedule([&started, released] {
+        started.set_value();
+        released.wait();
+    });
+    started.get_future().wait();
+    otherGroup.schedule([&otherTaskRan] { otherTaskRan = true; });
+
+    std::thread::id taskThread;
+    TaskGroup taskGroup(&threadPool);
+    taskGroup.schedule([&taskThread] { taskThread = std::this_thread::get_id(); });
+    taskGroup.wait();
+    EXPECT_EQ(taskThread, std::this_thread::get_id());
+    EXPECT_FALSE(otherTaskRan);
+
+    release.set_value();
+    otherGroup.wait();
+    EXPECT_TRUE(otherTaskRan);
+}
+
+TEST(ThreadPoolTest, ParallelForCoversRangeOnce) {
+    ThreadPool threadPool(4);
+    for (uint32_t size : {0u, 1u, 3u, 4u, 17u, 1000u}) {
+        for (uint32_t minChunkSize : {1u, 5u, 2000u}) {
+            std::vector<std::atomic<uint32_t>> visits(size);
+            parallelFor(&threadPool, 10, 10 + size, minChunkSize,
+                        [&visits](uint32_t begin, uint32_t end) {
+                            ASSERT_LT(begin, end);
+                            for (uint32_t i = begin; i < end; i++) {
+                                visits[i - 10]++;
+                            }
+                        });
+            for (uint32_t i = 0; i < size; i++) {
+                EXPECT_EQ(visits[i], 1u) << "size " << size << ", index " << i;
+            }
+        }
+    }
+}
+
+TEST(ThreadPoolTest, ParallelForChunkSize) {
+    ThreadPool threadPool(4);
+    std::atomic<uint32_t> numChunks(0);
+    parallelFor(&threadPool, 0, 10, 4, [&numChunks](uint32_t begin, uint32_t end) {
+        EXPECT_GE(end - begin, 4u);
+        numChunks++;
+    });
+    EXPECT_EQ(numChunks, 2u);
+}
+
+TEST(ThreadPoolTest, ParallelForWithoutPool) {
+    uint32_t numCalls = 0;
+    parallelFor(nullptr, 3, 50, 1, [&numCalls](uint32_t begin, uint32_t end) {
+        EXPECT_EQ(begin, 3u);
+        EXPECT_EQ(end, 50u);
+        numCalls++;
+    });
+    EXPECT_EQ(numCalls, 1u);
+}
+
+TEST(ThreadPoolTest, NestedParallelFor) {
+    // Nested loops must not deadlock even when every worker is busy with an
+    // outer chunk.
+    ThreadPool threadPool(2);
+    std::vector<std::atomic<uint32_t>> visits(64 * 64);
+    parallelFor(&threadPool, 0, 64, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            parallelFor(&threadPool, 0, 64, 1, [&visits, i](uint32_t begin, uint32_t end) {
+                for (uint32_t j = begin; j < end; j++) {
+                    visits[i * 64 + j]++;
+                }
+            });
+        }
+    });
+    for (const auto& count : visits) {
+        EXPECT_EQ(count, 1u);
+    }
+}
+
+}  // namespace
+}  // namespace nn
+}  // namespace android
@@ -18,6 +18,10 @@
 
 //#include <android-base/logging.h>
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 using namespace android::nn::test_wrapper;
 
@@ -218,4 +222,165 @@ TEST_F(TrivialTest, BroadcastMulTwo) {
     ASSERT_EQ(CompareMatrices(expected2c, actual), 0);
 }
 
+// A stack of 3x3 convolutions, alternating CONV_2D and GROUPED_CONV_2D with
+// two groups, for testing concurrent executions.  In quant8, every layer runs
+// a gemmlowp GEMM.  The weights are referenced by the model, so they must
+// outlive it.
+class ConvStackModel {
+   public:
+    static constexpr uint32_t kSize = 32;
+    static constexpr uint32_t kDepth = 8;
+    static constexpr uint32_t kNumLayers = 4;
+    static constexpr uint32_t kNumGroups = 2;
+    static constexpr uint32_t kNumElements = kSize * kSize * kDepth;
+
+    explicit ConvStackModel(Type tensorType) {
+        const bool quant8 = tensorType == Type::TENSOR_QUANT8_ASYMM;
+        OperandType imageType(tensorType, {1, kSize, kSize, kDepth}, quant8 ? 0.5f : 0.0f,
+                              quant8 ? 128 : 0);
+        OperandType filterType(tensorType, {kDepth, 3, 3, kDepth}, quant8 ? 0.01f : 0.0f,
+                               quant8 ? 128 : 0);
+        OperandType groupedFilterType(tensorType, {kDepth, 3, 3, kDepth / kNumGroups},
+                                      quant8 ? 0.01f : 0.0f, quant8 ? 128 : 0);
+        OperandType biasType(quant8 ? Type::TENSOR_INT32 : Type::TENSOR_FLOAT32, {kDepth},
+                             quant8 ? 0.005f : 0.0f);
+        OperandType scalarType(Type::INT32, {});
+        OperandType boolType(Type::BOOL, {});
+
+        const uint32_t filterSize = kDepth * 3 * 3 * kDepth;
+        for (uint32_t i = 0; i < filterSize; i++) {
+            mFloatFilter.push_back(static_cast<float>(i % 7) / 7.0f - 0.4f);
+            mQuant8Filter.push_back(static_cast<uint8_t>(100 + i % 57));
+        }
+        mFloatBias.assign(kDepth, 0.5f);
+        mInt32Bias.assign(kDepth, 100);
+        const int32_t padding = ANEURALNETWORKS_PADDING_SAME;
+        const int32_t stride = 1;
+        const int32_t activation = ANEURALNETWORKS_FUSED_RELU;
+        const int32_t numGroups = kNumGroups;
+        const bool useNchw = false;
+
+        auto filter = mModel.addOperand(&filterType);
+        auto groupedFilter = mModel.addOperand(&groupedFilterType);
+        auto bias = mModel.addOperand(&biasType);
+        auto paddingScalar = mModel.addOperand(&scalarType);
+        auto strideScalar = mModel.addOperand(&scalarType);
+        auto activationScalar = mModel.addOperand(&scalarType);
+        auto numGroupsScalar = mModel.addOperand(&scalarType);
+        auto layoutScalar = mModel.addOperand(&boolType);
+        // The grouped filter is the first half of the regular one.
+        const uint32_t groupedFilterSize = filterSize / kNumGroups;
+        if (quant8) {
+            mModel.setOperandValue(filter, mQuant8Filter.data(), filterSize);
+            mModel.setOperandValue(groupedFilter, mQuant8Filter.data(), groupedFilterSize);
+            mModel.setOperandValue(bias, mInt32Bias.data(), kDepth * sizeof(int32_t));
+        } else {
+            mModel.setOperandValue(filter, mFloatFilter.data(), filterSize * sizeof(float));
+            mModel.setOperandValue(groupedFilter, mFloatFilter.data(),
+                                   groupedFilterSize * sizeof(float));
+            mModel.setOperandValue(bias, mFloatBias.data(), kDepth * sizeof(float));
+        }
+        mModel.setOperandValue(paddingScalar, &padding, sizeof(padding));
+        mModel.setOperandValue(strideScalar, &stride, sizeof(stride));
+        mModel.setOperandValue(activationScalar, &activation, sizeof(activation));
+        mModel.setOperandValue(numGroupsScalar, &numGroups, sizeof(numGroups));
+        mModel.setOperandValue(layoutScalar, &useNchw, sizeof(useNchw));
+
+        auto input = mModel.addOperand(&imageType);
+        auto layerInput = input;
+        for (uint32_t i = 0; i < kNumLayers; i++) {
+            auto layerOutput = mModel.addOperand(&imageType);
+            if (i % 2 == 0) {
+                mModel.addOperation(ANEURALNETWORKS_CONV_2D,
+                                    {layerInput, filter, bias, paddingScalar, strideScalar,
+                                     strideScalar, activationScalar},
+                                    {layerOutput});
+            } else {
+                mModel.addOperation(ANEURALNETWORKS_GROUPED_CONV_2D,
+                                    {layerInput, groupedFilter, bias, paddingScalar, strideScalar,
+                                     strideScalar, numGroupsScalar, activationScalar,
+                                     layoutScalar},
+                                    {layerOutput});
+            }
+            layerInput = layerOutput;
+        }
+        mModel.identifyInputsAndOutputs({input}, {layerInput});
+        mModel.finish();
+    }
+
+    const Model* get() const { return &mModel; }
+
+   private:
+    Model mModel;
+    std::vector<float> mFloatFilter;
+    std::vector<float> mFloatBias;
+    std::vector<uint8_t> mQuant8Filter;
+    std::vector<int32_t> mInt32Bias;
+};
+
+// Runs executions of the model from several threads at once, checking that
+// they all compute the same results as a lone execution, and records the
+// throughput.
+template <typename T>
+void RunConcurrentExecutions(Type tensorType) {
+    constexpr uint32_t kNumThreads = 4;
+    constexpr uint32_t kExecutionsPerThread = 8;
+
+    ConvStackModel model(tensorType);
+    ASSERT_TRUE(model.get()->isValid());
+    Compilation compilation(model.get());
+    ASSERT_EQ(compilation.finish(), Result::NO_ERROR);
+
+    std::vector<T> input(ConvStackModel::kNumElements);
+    for (uint32_t i = 0; i < input.size(); i++) {
+        input[i] = static_cast<T>(i % 251);
+    }
+    auto compute = [&compilation, &input](std::vector<T>* output) {
+        output->assign(ConvStackModel::kNumElements, 0);
+        Execution execution(&compilation);
+        if (execution.setInput(0, input.data(), input.size() * sizeof(T)) != Result::NO_ERROR ||
+            execution.setOutput(0, output->data(), output->size() * sizeof(T)) !=
+                    Result::NO_ERROR) {
+            return Result::BAD_DATA;
+        }
+        return execution.compute();
+    };
+    std::vector<T> expected;
+    ASSERT_EQ(compute(&expected), Result::NO_ERROR);
+
+    std::atomic<uint32_t> numMismatches(0);
+    std::atomic<uint32_t> numFailures(0);
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < kNumThreads; i++) {
+        threads.emplace_back([&] {
+            std::vector<T> actual;
+            for (uint32_t j = 0; j < kExecutionsPerThread; j++) {
+                if (compute(&actual) != Result::NO_ERROR) {
+                    numFailures++;
+                } else if (actual != expected) {
+                    numMismatches++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(numFailures, 0u);
+    EXPECT_EQ(numMismatches, 0u);
+    ::testing::Test::RecordProperty(
+            "executionsPerSecond",
+            static_cast<int>(kNumThreads * kExecutionsPerThread / elapsed.count()));
+}
+
+TEST_F(TrivialTest, ConcurrentConvFloat32) {
+    RunConcurrentExecutions<float>(Type::TENSOR_FLOAT32);
+}
+
+TEST_F(TrivialTest, ConcurrentConvQuant8) {
+    RunConcurrentExecutions<uint8_t>(Type::TENSOR_QUANT8_ASYMM);
+}
+
 }  // end namespace